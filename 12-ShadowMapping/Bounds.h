@@ -0,0 +1,103 @@
+#pragma once
+
+//glm
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+//STL
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+//uwb-vk
+#include "Vertex.h"
+
+/** @brief An axis aligned bounding box, stored as a center and half extents
+*/
+struct AABB
+{
+	glm::vec3 center = glm::vec3(0.0f);		///< Center of the box
+	glm::vec3 extents = glm::vec3(0.0f);	///< Half the size of the box along each axis
+};
+
+/** @brief A bounding sphere
+*/
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);		///< Center of the sphere
+	float radius = 0.0f;					///< Radius of the sphere
+};
+
+/** @brief The bounding volumes of a mesh or object
+
+	Both volumes share the same center, so a single center can be used
+	when testing against the box and the sphere at the same time
+*/
+struct Bounds
+{
+	AABB box;				///< Axis aligned bounding box
+	BoundingSphere sphere;	///< Bounding sphere
+
+	/** @brief Compute the bounds of a set of vertices
+		@param vertices The vertices to enclose
+	*/
+	static Bounds fromVertices(const std::vector<Vertex>& vertices)
+	{
+		Bounds bounds;
+		if (vertices.empty())
+			return bounds;
+
+		glm::vec3 minPos(std::numeric_limits<float>::max());
+		glm::vec3 maxPos(-std::numeric_limits<float>::max());
+		for (const auto& vertex : vertices) {
+			minPos = glm::min(minPos, glm::vec3(vertex.pos));
+			maxPos = glm::max(maxPos, glm::vec3(vertex.pos));
+		}
+
+		bounds.box.center = (minPos + maxPos) * 0.5f;
+		bounds.box.extents = (maxPos - minPos) * 0.5f;
+
+		//the sphere is centered on the box, but only as big as the furthest vertex
+		float maxDistance2 = 0.0f;
+		for (const auto& vertex : vertices) {
+			glm::vec3 offset = glm::vec3(vertex.pos) - bounds.box.center;
+			maxDistance2 = std::max(maxDistance2, glm::dot(offset, offset));
+		}
+
+		bounds.sphere.center = bounds.box.center;
+		bounds.sphere.radius = glm::sqrt(maxDistance2);
+
+		return bounds;
+	}
+
+	/** @brief Get the bounds after they have been transformed by a model matrix
+
+		The box is re-fit around the transformed box (Arvo's method), and the
+		sphere radius is scaled by the largest axis scale of the matrix.
+
+		@param model The model matrix to transform by
+	*/
+	Bounds transformed(const glm::mat4& model) const
+	{
+		Bounds result;
+
+		glm::vec3 center = glm::vec3(model * glm::vec4(box.center, 1.0f));
+
+		glm::mat3 absRotScale = glm::mat3(model);
+		for (int col = 0; col < 3; col++)
+			absRotScale[col] = glm::abs(absRotScale[col]);
+
+		result.box.center = center;
+		result.box.extents = absRotScale * box.extents;
+
+		float maxScale = std::max(glm::length(glm::vec3(model[0])),
+							std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		result.sphere.center = center;
+		result.sphere.radius = sphere.radius * maxScale;
+
+		return result;
+	}
+};
@@ -10,7 +10,7 @@ void CommandPool::initialize()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = mContext->selectedIndices.graphicsFamily;
-	poolInfo.flags = 0; // Optional
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;	//command buffers are re-recorded each frame
 
 	if (vkCreateCommandPool(mContext->device, &poolInfo, nullptr, &mCommandPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create command pool!");
@@ -0,0 +1,94 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <cmath>
+
+DescriptorAllocator::DescriptorAllocator(std::shared_ptr<VulkanContext> context, const std::vector<DescriptorPoolRatio>& ratios, uint32_t setsPerPool) :
+	mContext(context),
+	mRatios(ratios),
+	mNextPoolSets(setsPerPool)
+{}
+
+void DescriptorAllocator::cleanup()
+{
+	reset();
+	for (VkDescriptorPool pool : mFreePools) {
+		vkDestroyDescriptorPool(mContext->device, pool, nullptr);
+	}
+	mFreePools.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout setLayout)
+{
+	if (mCurrentPool == VK_NULL_HANDLE) {
+		mCurrentPool = acquirePool();
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mCurrentPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &setLayout;
+
+	VkDescriptorSet descriptorSet;
+	VkResult result = vkAllocateDescriptorSets(mContext->device, &allocInfo, &descriptorSet);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+		//the pool is full, continue in a fresh one
+		mUsedPools.push_back(mCurrentPool);
+		mCurrentPool = acquirePool();
+
+		allocInfo.descriptorPool = mCurrentPool;
+		result = vkAllocateDescriptorSets(mContext->device, &allocInfo, &descriptorSet);
+	}
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate descriptor set!");
+	}
+	return descriptorSet;
+}
+
+void DescriptorAllocator::reset()
+{
+	if (mCurrentPool != VK_NULL_HANDLE) {
+		mUsedPools.push_back(mCurrentPool);
+		mCurrentPool = VK_NULL_HANDLE;
+	}
+
+	for (VkDescriptorPool pool : mUsedPools) {
+		vkResetDescriptorPool(mContext->device, pool, 0);
+		mFreePools.push_back(pool);
+	}
+	mUsedPools.clear();
+}
+
+VkDescriptorPool DescriptorAllocator::acquirePool()
+{
+	if (!mFreePools.empty()) {
+		VkDescriptorPool pool = mFreePools.back();
+		mFreePools.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& ratio : mRatios) {
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = ratio.type;
+		poolSize.descriptorCount = std::max(1u, static_cast<uint32_t>(std::ceil(ratio.descriptorsPerSet * mNextPoolSets)));
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = mNextPoolSets;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(mContext->device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor pool!");
+	}
+
+	std::cout << "Created a descriptor pool for " << mNextPoolSets << " sets" << std::endl;
+	mNextPoolSets = std::min(mNextPoolSets * 2, MAX_DESCRIPTOR_POOL_SETS);
+	return pool;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+//vulkan
+#include <vulkan/vulkan.h>
+
+//STL
+#include <vector>
+#include <memory>
+
+//uwb-vk
+#include "VulkanContext.h"
+
+const uint32_t MAX_DESCRIPTOR_POOL_SETS = 4096;	///< Descriptor pools stop growing at this many sets
+
+/** @brief How many descriptors of a type a pool holds, per set it has room for */
+struct DescriptorPoolRatio
+{
+	VkDescriptorType type;			///< The descriptor type
+	float descriptorsPerSet;		///< Descriptors of the type per set (fractions are fine, most sets don't use every type)
+};
+
+/** @class DescriptorAllocator
+
+	@brief Allocates descriptor sets from a chain of pools that grows as they fill up
+
+	When the current pool is out of sets or descriptors (reported through
+	VK_KHR_maintenance1's VK_ERROR_OUT_OF_POOL_MEMORY), a new pool is chained
+	on, each twice the size of the last up to a limit. Sets are never freed one
+	by one: reset() returns every set at once, recycling the pools for the next
+	round of allocations. That suits two lifetimes:
+	- static sets, allocated once and kept until the allocator is cleaned up
+	- transient sets, valid for one frame, with one allocator per frame in flight
+	  that is reset once the frame's fence has been waited on
+*/
+class DescriptorAllocator
+{
+public:
+	/** @brief Constructor
+		@param context		The RenderSystem's Vulkan Context
+		@param ratios		The descriptors of each type a pool holds per set
+		@param setsPerPool	The sets the first pool has room for
+	*/
+	DescriptorAllocator(std::shared_ptr<VulkanContext> context, const std::vector<DescriptorPoolRatio>& ratios, uint32_t setsPerPool);
+
+	/** @brief Destroy every pool, freeing every set allocated from them */
+	void cleanup();
+
+	/** @brief Allocate a descriptor set, chaining a new pool if the current one is full
+		@param setLayout The layout of the set
+		@return The set, valid until reset() or cleanup()
+	*/
+	VkDescriptorSet allocate(VkDescriptorSetLayout setLayout);
+
+	/** @brief Free every set allocated so far, keeping the pools for reuse
+
+		Nothing may use the sets anymore (i.e. the frame they were recorded in has finished).
+	*/
+	void reset();
+
+private:
+	std::shared_ptr<VulkanContext> mContext;		///< The RenderSystem's Vulkan Context
+	std::vector<DescriptorPoolRatio> mRatios;		///< Descriptors of each type per set
+	uint32_t mNextPoolSets;							///< The sets the next new pool will have room for
+
+	VkDescriptorPool mCurrentPool = VK_NULL_HANDLE;	///< The pool sets are allocated from
+	std::vector<VkDescriptorPool> mUsedPools;		///< Full pools, recycled by reset()
+	std::vector<VkDescriptorPool> mFreePools;		///< Pools that were reset, used before creating new ones
+
+	/** @brief Get an empty pool, recycled or newly created
+		@return The pool
+	*/
+	VkDescriptorPool acquirePool();
+};
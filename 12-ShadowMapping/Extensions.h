@@ -10,5 +10,14 @@ const std::vector<const char*> instanceExtensions = {
 
 /// Device Extensions
 const std::vector<const char*> deviceExtensions = {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+	VK_KHR_MAINTENANCE1_EXTENSION_NAME,			//full descriptor pools report VK_ERROR_OUT_OF_POOL_MEMORY (see DescriptorAllocator)
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME,			//required by descriptor indexing
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,	//bindless material textures (see MaterialLibrary)
+	VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME	//renderable sets are written with update templates
+};
+
+/// Device Extensions enabled when the device supports them
+const std::vector<const char*> optionalDeviceExtensions = {
+	VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME		//dynamic renderables push their bindings instead of allocating sets
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "FrustumCulling.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define UWB_CULL_AVX
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+	#include <xmmintrin.h>
+	#define UWB_CULL_SSE
+#endif
+
+//widest SIMD width supported, the SoA arrays are padded to a multiple of this
+const uint32_t CULL_BATCH_ALIGNMENT = 8;
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProj)
+{
+	//glm is column major, so rows have to be gathered from each column
+	glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+	glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+	glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+	glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;	//left
+	frustum.planes[1] = row3 - row0;	//right
+	frustum.planes[2] = row3 + row1;	//bottom
+	frustum.planes[3] = row3 - row1;	//top
+	frustum.planes[4] = row2;			//near (vulkan clip space z starts at 0)
+	frustum.planes[5] = row3 - row2;	//far
+
+	//normalize so the plane distances are in world units
+	for (auto& plane : frustum.planes) {
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f)
+			plane /= length;
+	}
+
+	return frustum;
+}
+
+void CullingBatch::clear()
+{
+	mCount = 0;
+}
+
+uint32_t CullingBatch::add(const Bounds& bounds)
+{
+	if (mCount == mCenterX.size()) {
+		size_t paddedSize = mCenterX.size() + CULL_BATCH_ALIGNMENT;
+		mCenterX.resize(paddedSize, 0.0f);
+		mCenterY.resize(paddedSize, 0.0f);
+		mCenterZ.resize(paddedSize, 0.0f);
+		mRadius.resize(paddedSize, 0.0f);
+		mExtentX.resize(paddedSize, 0.0f);
+		mExtentY.resize(paddedSize, 0.0f);
+		mExtentZ.resize(paddedSize, 0.0f);
+	}
+
+	mCenterX[mCount] = bounds.sphere.center.x;
+	mCenterY[mCount] = bounds.sphere.center.y;
+	mCenterZ[mCount] = bounds.sphere.center.z;
+	mRadius[mCount] = bounds.sphere.radius;
+	mExtentX[mCount] = bounds.box.extents.x;
+	mExtentY[mCount] = bounds.box.extents.y;
+	mExtentZ[mCount] = bounds.box.extents.z;
+
+	return mCount++;
+}
+
+void CullingBatch::cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const
+{
+	visibleIndices.clear();
+
+#if defined(UWB_CULL_AVX)
+	for (uint32_t base = 0; base < mCount; base += 8) {
+		__m256 cx = _mm256_loadu_ps(&mCenterX[base]);
+		__m256 cy = _mm256_loadu_ps(&mCenterY[base]);
+		__m256 cz = _mm256_loadu_ps(&mCenterZ[base]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&mRadius[base]));
+		__m256 ex = _mm256_loadu_ps(&mExtentX[base]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[base]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[base]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const auto& plane : frustum.planes) {
+			//signed distance from the center to the plane
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+
+			//the box's extent projected onto the plane normal
+			__m256 projExtent = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::fabs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::fabs(plane.y)))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(std::fabs(plane.z))));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negRadius, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, projExtent), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 8 && base + lane < mCount; lane++) {
+			if (mask & (1 << lane))
+				visibleIndices.push_back(base + lane);
+		}
+	}
+#elif defined(UWB_CULL_SSE)
+	for (uint32_t base = 0; base < mCount; base += 4) {
+		__m128 cx = _mm_loadu_ps(&mCenterX[base]);
+		__m128 cy = _mm_loadu_ps(&mCenterY[base]);
+		__m128 cz = _mm_loadu_ps(&mCenterZ[base]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&mRadius[base]));
+		__m128 ex = _mm_loadu_ps(&mExtentX[base]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[base]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[base]);
+
+		__m128 inside = _mm_cmpeq_ps(cx, cx);	//all ones (centers are never NaN)
+		for (const auto& plane : frustum.planes) {
+			//signed distance from the center to the plane
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+
+			//the box's extent projected onto the plane normal
+			__m128 projExtent = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negRadius));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, projExtent), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4 && base + lane < mCount; lane++) {
+			if (mask & (1 << lane))
+				visibleIndices.push_back(base + lane);
+		}
+	}
+#else
+	for (uint32_t i = 0; i < mCount; i++) {
+		bool inside = true;
+		for (const auto& plane : frustum.planes) {
+			float dist = mCenterX[i] * plane.x + mCenterY[i] * plane.y + mCenterZ[i] * plane.z + plane.w;
+			float projExtent = mExtentX[i] * std::fabs(plane.x) + mExtentY[i] * std::fabs(plane.y) + mExtentZ[i] * std::fabs(plane.z);
+			if (dist < -mRadius[i] || dist + projExtent < 0.0f) {
+				inside = false;
+				break;
+			}
+		}
+		if (inside)
+			visibleIndices.push_back(i);
+	}
+#endif
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+//glm
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <array>
+#include <vector>
+
+//uwb-vk
+#include "Bounds.h"
+
+/** @brief The six planes of a view frustum
+
+	Planes are stored as (normal, distance), with normals pointing into
+	the frustum. A point p is inside a plane when dot(normal, p) + distance >= 0.
+*/
+struct Frustum
+{
+	std::array<glm::vec4, 6> planes;	///< Left, right, bottom, top, near and far planes
+
+	/** @brief Extract the frustum planes from a combined view-projection matrix
+
+		Expects Vulkan clip space conventions (0 <= z <= w), which is
+		what Camera::projMat produces.
+
+		@param viewProj The projection matrix multiplied by the view matrix
+	*/
+	static Frustum fromMatrix(const glm::mat4& viewProj);
+};
+
+/** @class CullingBatch
+
+	@brief A batch of world-space bounds laid out for SIMD frustum culling
+
+	Bounds are stored structure-of-arrays so that the culling kernel can
+	test 4 (SSE) or 8 (AVX) objects against a plane with a handful of instructions.
+	Each object is tested against both its bounding sphere and its bounding box,
+	and is only rejected if one of the two is entirely outside a plane.
+*/
+class CullingBatch
+{
+public:
+	/** @brief Remove all bounds from the batch, keeping the allocated memory */
+	void clear();
+
+	/** @brief Add world space bounds to the end of the batch
+		@param bounds The world space bounds of the object
+		@return The index of the object within the batch
+	*/
+	uint32_t add(const Bounds& bounds);
+
+	/** @brief Get the number of objects in the batch */
+	uint32_t size() const { return mCount; }
+
+	/** @brief Test every object in the batch against a frustum
+
+		@param frustum			The frustum to test against
+		@param visibleIndices	Filled with the batch indices of every object that
+								is at least partially inside the frustum
+	*/
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const;
+private:
+	uint32_t mCount = 0;				///< Number of objects in the batch
+
+	//SoA bounds, padded to a multiple of the SIMD width
+	std::vector<float> mCenterX;		///< X coordinates of the bounds centers
+	std::vector<float> mCenterY;		///< Y coordinates of the bounds centers
+	std::vector<float> mCenterZ;		///< Z coordinates of the bounds centers
+	std::vector<float> mRadius;			///< Bounding sphere radii
+	std::vector<float> mExtentX;		///< Box half extents along x
+	std::vector<float> mExtentY;		///< Box half extents along y
+	std::vector<float> mExtentZ;		///< Box half extents along z
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+//Vulkan
+#include <vulkan/vulkan.h>
+
+//glm
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <array>
+
+const uint32_t GBUFFER_ATTACHMENT_COUNT = 3;	///< Color attachments written by the geometry subpass
+
+/** @brief The formats of the G-buffer attachments, in attachment order
+
+	Kept compact so the G-buffer can stay in tile memory on tiled GPUs:
+	- albedo (rgb), and whether the surface receives shadows (a)
+	- the normal mapped and surface normals, each octahedral encoded into two channels
+	- specular color (rgb), and the material's shininess (a), so the single lighting
+	  shader still shades every material with its own specular exponent
+*/
+const std::array<VkFormat, GBUFFER_ATTACHMENT_COUNT> GBUFFER_FORMATS = {
+	VK_FORMAT_R8G8B8A8_UNORM,
+	VK_FORMAT_R16G16B16A16_SFLOAT,
+	VK_FORMAT_R8G8B8A8_UNORM
+};
+
+/** @brief One G-buffer attachment */
+struct GBufferAttachment
+{
+	VkImage image = VK_NULL_HANDLE;				///< The attachment's image
+	VkDeviceMemory memory = VK_NULL_HANDLE;		///< The memory the image is allocated from
+	VkImageView view = VK_NULL_HANDLE;			///< Used both as a color attachment and an input attachment
+	VkFormat format = VK_FORMAT_UNDEFINED;		///< One of GBUFFER_FORMATS
+};
+
+/** @brief The attachments the geometry subpass writes and the lighting subpass reads */
+struct GBuffer
+{
+	std::array<GBufferAttachment, GBUFFER_ATTACHMENT_COUNT> attachments;	///< Albedo, normals and specular
+};
+
+/** @brief Per frame data of the deferred lighting pass
+
+	Matches the DeferredLightingUBO block in deferredLighting.frag (std140)
+*/
+struct DeferredLightingUBO
+{
+	glm::mat4 inverseViewProj = glm::mat4(1.0f);	///< Takes a pixel's NDC position and depth back to world space
+	glm::mat4 view = glm::mat4(1.0f);				///< The camera's view matrix, to find the view depth for cascades and clusters
+	glm::vec4 viewPos = glm::vec4(0.0f);			///< The camera's world position (xyz)
+	glm::vec4 screenSize = glm::vec4(1.0f);			///< The framebuffer's width and height in pixels (xy)
+};
@@ -11,7 +11,7 @@ ImageManager::~ImageManager()
 {
 }
 
-void ImageManager::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory)
+void ImageManager::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory, uint32_t mipLevels, uint32_t arrayLayers, VkImageCreateFlags flags)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -19,14 +19,15 @@ void ImageManager::createImage(uint32_t width, uint32_t height, VkFormat format,
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = arrayLayers;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usage;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.flags = flags;
 
 	if (vkCreateImage(mContext->device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create image!");
@@ -47,24 +48,25 @@ void ImageManager::createImage(uint32_t width, uint32_t height, VkFormat format,
 	vkBindImageMemory(mContext->device, image, imageMemory, 0);
 }
 
-VkImageView ImageManager::createImageView(VkImage image, VkFormat imageFormat, VkImageAspectFlags aspectFlags)
+VkImageView ImageManager::createImageView(VkImage image, VkFormat imageFormat, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t levelCount,
+										VkImageViewType viewType, uint32_t baseArrayLayer, uint32_t layerCount)
 {
 	VkImageView imageView;
 
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = image;
-	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.viewType = viewType;
 	viewInfo.format = imageFormat;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 	viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
 	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
-	viewInfo.subresourceRange.baseArrayLayer = 0;
-	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	viewInfo.subresourceRange.levelCount = levelCount;
+	viewInfo.subresourceRange.baseArrayLayer = baseArrayLayer;
+	viewInfo.subresourceRange.layerCount = layerCount;
 
 	if (vkCreateImageView(mContext->device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create image view!");
@@ -73,7 +75,7 @@ VkImageView ImageManager::createImageView(VkImage image, VkFormat imageFormat, V
 	return imageView;
 }
 
-void ImageManager::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+void ImageManager::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layerCount)
 {
 	VkCommandBuffer commandBuffer = mCommandPool->beginSingleCmdBuffer();
 
@@ -85,7 +87,7 @@ void ImageManager::transitionImageLayout(VkImage image, VkFormat format, VkImage
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;									//the image to transition
 
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)	//we're dealing with a depth/stencil image
+	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL || hasDepthComponent(format))	//we're dealing with a depth/stencil image
 	{
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 
@@ -102,7 +104,7 @@ void ImageManager::transitionImageLayout(VkImage image, VkFormat format, VkImage
 	barrier.subresourceRange.baseMipLevel = 0;
 	barrier.subresourceRange.levelCount = 1;
 	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.layerCount = layerCount;
 
 	barrier.srcAccessMask = 0;	//todo
 	barrier.dstAccessMask = 0;  //todo
@@ -140,6 +142,15 @@ void ImageManager::transitionImageLayout(VkImage image, VkFormat format, VkImage
 								VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;	//reading and writing
 		dstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;					//reading during early tests, writing during late fragment tests
 	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		//nothing written yet, the image just has to be in a valid layout for sampling
+		barrier.srcAccessMask = 0;
+		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
 	else
 	{
 		throw std::invalid_argument("Layout transition not supported!");
@@ -181,4 +192,10 @@ VkFormat ImageManager::findSupportedFormat(const std::vector<VkFormat>& candidat
 bool ImageManager::hasStencilComponent(VkFormat format)
 {
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-}
\ No newline at end of file
+}
+
+bool ImageManager::hasDepthComponent(VkFormat format)
+{
+	return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT ||
+		format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
@@ -35,23 +35,33 @@ public:
 		@param properties Required properties of the created image
 		@param image The VkImage object to be created
 		@param imageMemory The memory associated with the created VkImage
+		@param mipLevels The number of mip levels in the image
+		@param arrayLayers The number of array layers in the image
+		@param flags Image creation flags (i.e. VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT for cube views)
 	*/
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory);
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory, uint32_t mipLevels = 1, uint32_t arrayLayers = 1, VkImageCreateFlags flags = 0);
 	
 	/** @brief Create a new VkImageView object
 		@param image A handle to the associated VkImage
 		@param imageFormat The texel format of the image
 		@param aspectFlags indicating which aspect of the image you want to view (i.e. color or depth)
+		@param baseMipLevel The first mip level visible through the view
+		@param levelCount The number of mip levels visible through the view
+		@param viewType The type of view (i.e. 2D or 2D array)
+		@param baseArrayLayer The first array layer visible through the view
+		@param layerCount The number of array layers visible through the view
 	*/
-	VkImageView createImageView(VkImage image, VkFormat imageFormat, VkImageAspectFlags aspectFlags);
+	VkImageView createImageView(VkImage image, VkFormat imageFormat, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel = 0, uint32_t levelCount = 1,
+								VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t baseArrayLayer = 0, uint32_t layerCount = 1);
 	
 	/** @brief Transition an image from one layout to another
 		@param image A handle to the associated VkImage
 		@param format The texel format of the image
 		@param oldLayout The old Layout of the image
 		@param newLayout The target layout
+		@param layerCount The number of array layers to transition (starting at layer 0)
 	*/
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layerCount = 1);
 
 
 	/** @brief From a list of candidates, pick the best image format supported by the device
@@ -65,6 +75,11 @@ public:
 		@param format The format being evaluated
 	*/
 	bool hasStencilComponent(VkFormat format);
+
+	/** @brief Determine if a particular image format has a depth component
+		@param format The format being evaluated
+	*/
+	bool hasDepthComponent(VkFormat format);
 private:
 	std::shared_ptr<VulkanContext> mContext;		///< A reference to the Vulkan Context
 	std::shared_ptr<CommandPool> mCommandPool;		///< The Command Pool
@@ -0,0 +1,219 @@
+#include "LightClustering.h"
+
+#include <cmath>
+#include <algorithm>
+#include <future>
+
+LightClusterGrid::LightClusterGrid() :
+	mClusterBounds(CLUSTER_COUNT),
+	mSliceCandidates(CLUSTER_GRID_Z),
+	mClusterLists(CLUSTER_COUNT)
+{
+	mClusterLights.reserve(CLUSTER_LIGHT_LIST_SIZE);
+}
+
+void LightClusterGrid::build(const Camera& camera, uint32_t width, uint32_t height, const std::vector<Light>& lights, ThreadPool* threadPool)
+{
+	updateClusterBounds(camera);
+
+	//slice = log(depth / near) / log(far / near) * slices, split into a scale and bias on log(depth)
+	float nearPlane = camera.nearPlane;
+	float farPlane = camera.farPlane;
+	float logRatio = std::log(farPlane / nearPlane);
+	float sliceScale = CLUSTER_GRID_Z / logRatio;
+	float sliceBias = CLUSTER_GRID_Z * std::log(nearPlane) / logRatio;
+	mClusterInfo.depthSlicing = glm::vec4(nearPlane, farPlane, sliceScale, sliceBias);
+	mClusterInfo.tileSize = glm::vec4(width / (float)CLUSTER_GRID_X, height / (float)CLUSTER_GRID_Y, 0.0f, 0.0f);
+
+	auto depthToSlice = [=](float depth) {
+		float slice = std::log(depth) * sliceScale - sliceBias;
+		return static_cast<uint32_t>(std::min(std::max(slice, 0.0f), CLUSTER_GRID_Z - 1.0f));
+	};
+
+	//find which slices each light's depth range covers
+	for (auto& candidates : mSliceCandidates) {
+		candidates.clear();
+	}
+
+	uint32_t lightCount = static_cast<uint32_t>(lights.size());
+	mViewSpaceLights.resize(lightCount);
+	std::vector<uint32_t> globalLights;
+	for (uint32_t lightIndex = 0; lightIndex < lightCount; lightIndex++) {
+		const Light& light = lights[lightIndex];
+		if (!light.isEnabled || light.lightType == LightType::None)
+			continue;
+
+		float range = computeLightRange(light);
+		if (range < 0.0f) {
+			globalLights.push_back(lightIndex);
+			continue;
+		}
+
+		BoundingSphere& sphere = mViewSpaceLights[lightIndex];
+		sphere.center = glm::vec3(camera.viewMat * glm::vec4(glm::vec3(light.position), 1.0f));
+		sphere.radius = range;
+
+		//the camera looks down -z
+		float minDepth = -sphere.center.z - range;
+		float maxDepth = -sphere.center.z + range;
+		if (maxDepth < nearPlane || minDepth > farPlane)
+			continue;
+
+		uint32_t firstSlice = depthToSlice(std::max(minDepth, nearPlane));
+		uint32_t lastSlice = depthToSlice(std::min(maxDepth, farPlane));
+		for (uint32_t slice = firstSlice; slice <= lastSlice; slice++) {
+			mSliceCandidates[slice].push_back(lightIndex);
+		}
+	}
+
+	//slices only write to their own clusters, so they can be binned in parallel
+	if (threadPool) {
+		std::vector<std::future<void>> tasks;
+		tasks.reserve(CLUSTER_GRID_Z);
+		for (uint32_t slice = 0; slice < CLUSTER_GRID_Z; slice++) {
+			tasks.push_back(threadPool->submit([this, slice]() { binSlice(slice); }));
+		}
+		for (auto& task : tasks) {
+			task.get();
+		}
+	}
+	else {
+		for (uint32_t slice = 0; slice < CLUSTER_GRID_Z; slice++) {
+			binSlice(slice);
+		}
+	}
+
+	writeClusterLights(globalLights);
+}
+
+void LightClusterGrid::buildUnclustered(const std::vector<Light>& lights)
+{
+	//every lookup lands in cluster 0, which is empty
+	mClusterInfo.depthSlicing = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	mClusterInfo.tileSize = glm::vec4(std::numeric_limits<float>::max());
+
+	std::vector<uint32_t> globalLights;
+	uint32_t lightCount = static_cast<uint32_t>(lights.size());
+	for (uint32_t lightIndex = 0; lightIndex < lightCount; lightIndex++) {
+		if (lights[lightIndex].isEnabled && lights[lightIndex].lightType != LightType::None)
+			globalLights.push_back(lightIndex);
+	}
+
+	for (auto& list : mClusterLists) {
+		list.clear();
+	}
+	writeClusterLights(globalLights);
+}
+
+float LightClusterGrid::computeLightRange(const Light& light)
+{
+	if (light.lightType == LightType::Directional)
+		return -1.0f;
+
+	//the shaders don't attenuate a spot light's ambient term, so it reaches everything
+	glm::vec3 ambient(light.ambient);
+	if (light.lightType == LightType::Spot && glm::max(ambient.r, glm::max(ambient.g, ambient.b)) > 0.0f)
+		return -1.0f;
+
+	glm::vec3 brightest = glm::max(glm::max(glm::vec3(light.diffuse), glm::vec3(light.specular)), ambient);
+	float intensity = glm::max(brightest.r, glm::max(brightest.g, brightest.b));
+
+	//solve constant + linear * d + quadratic * d^2 = intensity / cutoff for d
+	float threshold = intensity / CLUSTER_LIGHT_CUTOFF;
+	if (light.constant >= threshold)
+		return 0.0f;
+
+	if (light.quadratic > 0.0f) {
+		float discriminant = light.linear * light.linear - 4.0f * light.quadratic * (light.constant - threshold);
+		return (-light.linear + std::sqrt(discriminant)) / (2.0f * light.quadratic);
+	}
+	if (light.linear > 0.0f)
+		return (threshold - light.constant) / light.linear;
+
+	return -1.0f;
+}
+
+void LightClusterGrid::updateClusterBounds(const Camera& camera)
+{
+	if (camera.projMat == mProjection)
+		return;
+	mProjection = camera.projMat;
+
+	//rays through the tile corners, scaled to a view space depth of 1
+	glm::mat4 inverseProjection = glm::inverse(camera.projMat);
+	std::vector<glm::vec3> cornerRays((CLUSTER_GRID_X + 1) * (CLUSTER_GRID_Y + 1));
+	for (uint32_t y = 0; y <= CLUSTER_GRID_Y; y++) {
+		for (uint32_t x = 0; x <= CLUSTER_GRID_X; x++) {
+			glm::vec2 ndc = glm::vec2(x / (float)CLUSTER_GRID_X, y / (float)CLUSTER_GRID_Y) * 2.0f - 1.0f;
+			glm::vec4 farPoint = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+			glm::vec3 point = glm::vec3(farPoint) / farPoint.w;
+			cornerRays[y * (CLUSTER_GRID_X + 1) + x] = point / -point.z;
+		}
+	}
+
+	float depthRatio = camera.farPlane / camera.nearPlane;
+	for (uint32_t z = 0; z < CLUSTER_GRID_Z; z++) {
+		float sliceNear = camera.nearPlane * std::pow(depthRatio, z / (float)CLUSTER_GRID_Z);
+		float sliceFar = camera.nearPlane * std::pow(depthRatio, (z + 1) / (float)CLUSTER_GRID_Z);
+
+		for (uint32_t y = 0; y < CLUSTER_GRID_Y; y++) {
+			for (uint32_t x = 0; x < CLUSTER_GRID_X; x++) {
+				glm::vec3 minPos(std::numeric_limits<float>::max());
+				glm::vec3 maxPos(-std::numeric_limits<float>::max());
+				for (uint32_t corner = 0; corner < 4; corner++) {
+					const glm::vec3& ray = cornerRays[(y + corner / 2) * (CLUSTER_GRID_X + 1) + x + corner % 2];
+					minPos = glm::min(minPos, glm::min(ray * sliceNear, ray * sliceFar));
+					maxPos = glm::max(maxPos, glm::max(ray * sliceNear, ray * sliceFar));
+				}
+
+				AABB& box = mClusterBounds[clusterIndex(x, y, z)];
+				box.center = (minPos + maxPos) * 0.5f;
+				box.extents = (maxPos - minPos) * 0.5f;
+			}
+		}
+	}
+}
+
+void LightClusterGrid::binSlice(uint32_t slice)
+{
+	uint32_t firstCluster = clusterIndex(0, 0, slice);
+	uint32_t endCluster = firstCluster + CLUSTER_GRID_X * CLUSTER_GRID_Y;
+	for (uint32_t cluster = firstCluster; cluster < endCluster; cluster++) {
+		mClusterLists[cluster].clear();
+	}
+
+	for (uint32_t lightIndex : mSliceCandidates[slice]) {
+		const BoundingSphere& sphere = mViewSpaceLights[lightIndex];
+		float radiusSquared = sphere.radius * sphere.radius;
+
+		for (uint32_t cluster = firstCluster; cluster < endCluster; cluster++) {
+			//distance from the sphere's center to the closest point of the box
+			const AABB& box = mClusterBounds[cluster];
+			glm::vec3 offset = glm::max(glm::abs(sphere.center - box.center) - box.extents, glm::vec3(0.0f));
+			if (glm::dot(offset, offset) <= radiusSquared)
+				mClusterLists[cluster].push_back(lightIndex);
+		}
+	}
+}
+
+void LightClusterGrid::writeClusterLights(const std::vector<uint32_t>& globalLights)
+{
+	//lists that don't fit are cut short, rather than overflowing the storage buffer
+	uint32_t globalCount = std::min(static_cast<uint32_t>(globalLights.size()), MAX_CLUSTER_LIGHT_INDICES);
+	mDroppedIndices = static_cast<uint32_t>(globalLights.size()) - globalCount;
+
+	mClusterLights.assign(CLUSTER_COUNT * 2, 0);
+	mClusterLights.insert(mClusterLights.end(), globalLights.begin(), globalLights.begin() + globalCount);
+	mClusterInfo.globalLights = glm::uvec4(CLUSTER_COUNT * 2, globalCount, 0, 0);
+
+	for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+		const auto& list = mClusterLists[cluster];
+		uint32_t space = CLUSTER_LIGHT_LIST_SIZE - static_cast<uint32_t>(mClusterLights.size());
+		uint32_t count = std::min(static_cast<uint32_t>(list.size()), space);
+		mDroppedIndices += static_cast<uint32_t>(list.size()) - count;
+
+		mClusterLights[cluster * 2] = static_cast<uint32_t>(mClusterLights.size());
+		mClusterLights[cluster * 2 + 1] = count;
+		mClusterLights.insert(mClusterLights.end(), list.begin(), list.begin() + count);
+	}
+}
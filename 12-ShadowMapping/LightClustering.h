@@ -0,0 +1,125 @@
+#pragma once
+
+//glm
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <vector>
+#include <limits>
+
+//uwb-vk
+#include "Lighting.h"
+#include "Camera.h"
+#include "Bounds.h"
+#include "ThreadPool.h"
+
+const uint32_t CLUSTER_GRID_X = 16;											///< Cluster columns across the screen
+const uint32_t CLUSTER_GRID_Y = 9;											///< Cluster rows down the screen
+const uint32_t CLUSTER_GRID_Z = 24;											///< Depth slices between the camera's near and far plane
+const uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;	///< Total number of clusters
+const uint32_t MAX_CLUSTER_LIGHT_INDICES = CLUSTER_COUNT * 32;				///< Capacity of the light index lists (an average of 32 lights per cluster)
+const uint32_t CLUSTER_LIGHT_LIST_SIZE = CLUSTER_COUNT * 2 + MAX_CLUSTER_LIGHT_INDICES;	///< Most uints written to the cluster light list (the ranges, then the indices)
+const float CLUSTER_LIGHT_CUTOFF = 1.0f / 256.0f;							///< Brightness below which a light is treated as out of range
+
+/** @brief Describes the cluster grid to the shaders
+
+	Matches the ClusterUBO block in the lit fragment shaders (std140)
+*/
+struct ClusterUBO
+{
+	glm::uvec4 gridSize = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 0);	///< Cluster counts along x, y and z
+	glm::vec4 depthSlicing = glm::vec4(0.0f);		///< Camera near (x) and far (y) plane, slice scale (z) and bias (w): slice = log(depth) * z - w
+	glm::vec4 tileSize = glm::vec4(1.0f);			///< Size of a cluster on screen in pixels (xy)
+	glm::uvec4 globalLights = glm::uvec4(0);		///< Lights that reach every cluster: offset (x) and count (y) in the index list
+};
+
+/** @class LightClusterGrid
+
+	@brief Bins lights into a 3D grid of clusters (froxels) covering the camera's view frustum
+
+	The screen is split into CLUSTER_GRID_X by CLUSTER_GRID_Y tiles, and the depth range
+	into CLUSTER_GRID_Z slices spaced exponentially, so clusters stay roughly cube shaped.
+	Each light is tested against the clusters its range overlaps, and fragments only
+	shade the lights listed for their own cluster.
+
+	The output is a single list of uints:
+	- CLUSTER_COUNT pairs of (offset, count), one per cluster, x fastest then y then z
+	- the lights that reach every cluster (directional lights, or lights that never fade out)
+	- the light indices of every cluster, at the offsets given by the pairs
+
+	The slices are binned on the thread pool, each into its own clusters.
+*/
+class LightClusterGrid
+{
+public:
+	/** @brief Constructor */
+	LightClusterGrid();
+
+	/** @brief Bin lights into clusters for a frame
+
+		@param camera		The camera the scene is viewed from
+		@param width		Width of the framebuffer in pixels
+		@param height		Height of the framebuffer in pixels
+		@param lights		The lights, in the order their indices are written
+		@param threadPool	Pool to bin the slices on. If null, everything is binned on the calling thread
+	*/
+	void build(const Camera& camera, uint32_t width, uint32_t height, const std::vector<Light>& lights, ThreadPool* threadPool);
+
+	/** @brief Put every enabled light in the global list (used when there is no camera to build clusters from)
+		@param lights The lights, in the order their indices are written
+	*/
+	void buildUnclustered(const std::vector<Light>& lights);
+
+	/** @brief Get the grid description for the shaders */
+	const ClusterUBO& getClusterInfo() const { return mClusterInfo; }
+
+	/** @brief Get the cluster ranges and light index lists */
+	const std::vector<uint32_t>& getClusterLights() const { return mClusterLights; }
+
+	/** @brief Get how many light indices didn't fit in MAX_CLUSTER_LIGHT_INDICES during the last build */
+	uint32_t getDroppedIndices() const { return mDroppedIndices; }
+
+	/** @brief Compute the distance at which a light's brightness falls below CLUSTER_LIGHT_CUTOFF
+		@param light The light
+		@return The range, or a negative value if the light never fades out (directional, or no attenuation)
+	*/
+	static float computeLightRange(const Light& light);
+
+private:
+	ClusterUBO mClusterInfo;								///< The grid description of the last build
+	std::vector<uint32_t> mClusterLights;					///< Output: ranges, then the global lights, then the per cluster lists
+	uint32_t mDroppedIndices = 0;							///< Indices that didn't fit in the last build
+
+	glm::mat4 mProjection = glm::mat4(0.0f);				///< The projection the cluster bounds were built for
+	std::vector<AABB> mClusterBounds;						///< View space bounds of every cluster
+	std::vector<BoundingSphere> mViewSpaceLights;			///< View space sphere of every clustered light this frame
+	std::vector<std::vector<uint32_t>> mSliceCandidates;	///< Per slice: the lights whose depth range overlaps it
+	std::vector<std::vector<uint32_t>> mClusterLists;		///< Per cluster: the lights found to touch it
+
+	/** @brief Rebuild the view space bounds of the clusters, when the projection changes
+		@param camera The camera, whose projection and planes are used
+	*/
+	void updateClusterBounds(const Camera& camera);
+
+	/** @brief Test the candidate lights of one slice against its clusters
+		@param slice The depth slice
+	*/
+	void binSlice(uint32_t slice);
+
+	/** @brief Compact the per cluster lists into mClusterLights
+		@param globalLights The lights that go in every cluster
+	*/
+	void writeClusterLights(const std::vector<uint32_t>& globalLights);
+
+	/** @brief Get the index of a cluster
+		@param x Column
+		@param y Row
+		@param z Slice
+	*/
+	static uint32_t clusterIndex(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);
+	}
+};
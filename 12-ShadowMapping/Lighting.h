@@ -1,6 +1,12 @@
 #pragma once
 
-const int MAX_LIGHTS = 8;			///< The maximum number of lights available
+//STL
+#include <cstring>
+
+//uwb-vk
+#include "Shader.h"
+
+const int MAX_LIGHTS = 8;			///< The maximum number of shadow casting lights (the first lights of the light buffer)
 
 /** @brief The type of light being used
 */
@@ -12,6 +18,61 @@ enum class LightType : uint32_t
 	Spot
 };
 
+/** @brief Get the bit of a light type in LightingVariant::lightTypeMask */
+inline uint32_t lightTypeBit(LightType lightType)
+{
+	return 1u << static_cast<uint32_t>(lightType);
+}
+
+/** @brief The constant_ids of the lighting shaders' specialization constants (see lighting.glsl and shadowSampling.glsl) */
+enum class LightingConstant : uint32_t
+{
+	DirectionalPCFTaps = 0,
+	SpotPCFTaps,
+	PointPCFTaps,
+	LightTypeMask,
+	ShadowedLightCount,
+	MaxFragmentLights,
+	Shininess,
+	NormalMapping
+};
+
+/** @brief What a material is lit by, compiled into its lighting shaders as specialization constants
+
+	Light types left out of the mask, and shadows past shadowedLightCount, are
+	constant folded out of the fragment shader instead of branched over per light.
+	Shaders that don't declare a constant ignore it.
+*/
+struct LightingVariant
+{
+	uint32_t lightTypeMask = lightTypeBit(LightType::Directional) | lightTypeBit(LightType::Point) | lightTypeBit(LightType::Spot);	///< The light types that are shaded
+	uint32_t shadowedLightCount = MAX_LIGHTS;			///< The first lights whose shadows are sampled (0 for none)
+	uint32_t maxFragmentLights = 65535;					///< Most lights shaded per fragment
+	float shininess = 16.0f;							///< Specular exponent
+	bool normalMapping = true;							///< Sample the normal map, rather than use the surface normal
+	uint32_t directionalPCFTaps = 16;					///< Poisson taps for cascaded shadows (0 for a single hardware compare)
+	uint32_t spotPCFTaps = 8;							///< Poisson taps for atlas shadows
+	uint32_t pointPCFTaps = 8;							///< Poisson taps for cube shadows
+
+	/** @brief Get the specialization constants to create the variant's shaders with */
+	SpecializationConstants getSpecializationConstants() const
+	{
+		uint32_t shininessBits;
+		std::memcpy(&shininessBits, &shininess, sizeof(float));
+
+		return {
+			{ static_cast<uint32_t>(LightingConstant::DirectionalPCFTaps), directionalPCFTaps },
+			{ static_cast<uint32_t>(LightingConstant::SpotPCFTaps), spotPCFTaps },
+			{ static_cast<uint32_t>(LightingConstant::PointPCFTaps), pointPCFTaps },
+			{ static_cast<uint32_t>(LightingConstant::LightTypeMask), lightTypeMask },
+			{ static_cast<uint32_t>(LightingConstant::ShadowedLightCount), shadowedLightCount },
+			{ static_cast<uint32_t>(LightingConstant::MaxFragmentLights), maxFragmentLights },
+			{ static_cast<uint32_t>(LightingConstant::Shininess), shininessBits },
+			{ static_cast<uint32_t>(LightingConstant::NormalMapping), normalMapping ? VK_TRUE : VK_FALSE }
+		};
+	}
+};
+
 
 /** @brief A Light Source
 
@@ -42,7 +103,7 @@ struct Light
 	float outerCutOff = 0.0f;									///< Outer Dot product cutoff value for spotlights
 	LightType lightType = LightType::None;						///< The light type (dirctional, point, or spot)
 	
-	char padding[4];											///< Padding values to fix alignment issues passing to the shader
+	char padding[4] = {};										///< Padding values to fix alignment issues passing to the shader
 };
 
 
@@ -56,5 +117,15 @@ struct Light
 struct LightUBO
 {
 	glm::vec4 viewPos;			///< The position we are viewing from (in world space)
-	Light lights[MAX_LIGHTS];	///< The array of lights we are using
+};
+
+/** @brief The start of the light storage buffer
+
+	Followed by lightCount tightly packed Light structs. Padded so the
+	lights start 16 byte aligned, as the LightBuffer block expects (std430)
+*/
+struct LightBufferHeader
+{
+	uint32_t lightCount = 0;	///< The number of lights following the header
+	uint32_t padding[3] = {};	///< Aligns the first light
 };
\ No newline at end of file
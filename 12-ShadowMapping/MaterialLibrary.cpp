@@ -0,0 +1,223 @@
+#include "MaterialLibrary.h"
+
+#include <array>
+#include <string>
+
+MaterialLibrary::MaterialLibrary(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<VulkanObjectCache> objectCache) :
+	mContext(context),
+	mBufferManager(bufferManager),
+	mObjectCache(objectCache)
+{}
+
+void MaterialLibrary::initialize()
+{
+	std::vector<VkDescriptorSetLayoutBinding> bindings = getLayoutBindings();
+
+	//the buffer is written once, only the texture array changes while the set is in use
+	std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {};
+	bindingFlags[0] = 0;
+	bindingFlags[1] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	flagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout setLayout;
+	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create material descriptor set layout!");
+	}
+
+	//the binding flags can't be described to the cache, but the renderable pipeline layouts are made with it
+	mDescriptorSetLayout = mObjectCache->adoptDescriptorSetLayout(setLayout);
+
+	VkPushConstantRange pushRange = getPushConstantRange();
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = mDescriptorSetLayout.get();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+
+	if (vkCreatePipelineLayout(mContext->device, &pipelineLayoutInfo, nullptr, &mPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create material pipeline layout!");
+	}
+
+	createDescriptorSet();
+	createMaterialBuffer();
+}
+
+void MaterialLibrary::cleanup()
+{
+	vkUnmapMemory(mContext->device, mMaterialBufferMemory);
+	vkDestroyBuffer(mContext->device, mMaterialBuffer, nullptr);
+	vkFreeMemory(mContext->device, mMaterialBufferMemory, nullptr);
+	mMaterials = nullptr;
+
+	vkDestroyDescriptorPool(mContext->device, mDescriptorPool, nullptr);
+	vkDestroyPipelineLayout(mContext->device, mPipelineLayout, nullptr);
+	mDescriptorSetLayout.reset();
+
+	mMaterialCount = 0;
+	mTextureIndices.clear();
+}
+
+uint32_t MaterialLibrary::addMaterial(const Material& material)
+{
+	if (!material.diffuseMap || !material.normalMap || !material.specularMap) {
+		throw std::runtime_error("Materials need a diffuse, normal and specular map!");
+	}
+	if (mMaterialCount >= MAX_MATERIALS) {
+		throw std::runtime_error("Material library is full (" + std::to_string(MAX_MATERIALS) + " materials)!");
+	}
+
+	MaterialData data = {};
+	data.diffuseMap = addTexture(material.diffuseMap);
+	data.normalMap = addTexture(material.normalMap);
+	data.specularMap = addTexture(material.specularMap);
+
+	//no frame in flight reads past the materials that existed when it was recorded
+	mMaterials[mMaterialCount] = data;
+	return mMaterialCount++;
+}
+
+void MaterialLibrary::bind(VkCommandBuffer commandBuffer) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, MATERIAL_DESCRIPTOR_SET, 1, &mDescriptorSet, 0, nullptr);
+}
+
+void MaterialLibrary::pushMaterial(VkCommandBuffer commandBuffer, uint32_t materialIndex) const
+{
+	MaterialPushConstants constants = {};
+	constants.materialIndex = materialIndex;
+
+	VkPushConstantRange pushRange = getPushConstantRange();
+	vkCmdPushConstants(commandBuffer, mPipelineLayout, pushRange.stageFlags, pushRange.offset, pushRange.size, &constants);
+}
+
+std::vector<VkDescriptorSetLayoutBinding> MaterialLibrary::getLayoutBindings()
+{
+	std::vector<VkDescriptorSetLayoutBinding> bindings(2);
+	bindings[0].binding = 0;									//materials
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[0].pImmutableSamplers = nullptr;
+
+	bindings[1].binding = 1;									//textures
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorCount = MAX_MATERIAL_TEXTURES;
+	bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].pImmutableSamplers = nullptr;
+	return bindings;
+}
+
+VkPushConstantRange MaterialLibrary::getPushConstantRange()
+{
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushRange.offset = 0;
+	pushRange.size = sizeof(MaterialPushConstants);
+	return pushRange;
+}
+
+uint32_t MaterialLibrary::addTexture(const std::shared_ptr<Texture>& texture)
+{
+	auto existing = mTextureIndices.find(texture.get());
+	if (existing != mTextureIndices.end())
+		return existing->second;
+
+	uint32_t index = static_cast<uint32_t>(mTextureIndices.size());
+	if (index >= MAX_MATERIAL_TEXTURES) {
+		throw std::runtime_error("Material texture array is full (" + std::to_string(MAX_MATERIAL_TEXTURES) + " textures)!");
+	}
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = texture->getImageView();
+	imageInfo.sampler = texture->getSampler();
+
+	VkWriteDescriptorSet textureWrite = {};
+	textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	textureWrite.dstSet = mDescriptorSet;
+	textureWrite.dstBinding = 1;
+	textureWrite.dstArrayElement = index;
+	textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	textureWrite.descriptorCount = 1;
+	textureWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(mContext->device, 1, &textureWrite, 0, nullptr);
+
+	std::cout << "Added texture " << index << " to the material library" << std::endl;
+	mTextureIndices[texture.get()] = index;
+	return index;
+}
+
+void MaterialLibrary::createDescriptorSet()
+{
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = MAX_MATERIAL_TEXTURES;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(mContext->device, &poolInfo, nullptr, &mDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create material descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = mDescriptorSetLayout.get();
+
+	if (vkAllocateDescriptorSets(mContext->device, &allocInfo, &mDescriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate material descriptor set!");
+	}
+}
+
+void MaterialLibrary::createMaterialBuffer()
+{
+	VkDeviceSize bufferSize = sizeof(MaterialData) * MAX_MATERIALS;
+	mBufferManager->createBuffer(bufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		mMaterialBuffer,
+		mMaterialBufferMemory);
+
+	void* mappedData;
+	if (vkMapMemory(mContext->device, mMaterialBufferMemory, 0, VK_WHOLE_SIZE, 0, &mappedData) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to map material buffer memory!");
+	}
+	mMaterials = static_cast<MaterialData*>(mappedData);
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = mMaterialBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = bufferSize;
+
+	VkWriteDescriptorSet bufferWrite = {};
+	bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	bufferWrite.dstSet = mDescriptorSet;
+	bufferWrite.dstBinding = 0;
+	bufferWrite.dstArrayElement = 0;
+	bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bufferWrite.descriptorCount = 1;
+	bufferWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(mContext->device, 1, &bufferWrite, 0, nullptr);
+}
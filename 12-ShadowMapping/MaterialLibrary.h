@@ -0,0 +1,138 @@
+#pragma once
+
+//vulkan
+#include <vulkan/vulkan.h>
+
+//STL
+#include <vector>
+#include <memory>
+#include <map>
+
+//uwb-vk
+#include "VulkanContext.h"
+#include "BufferManager.h"
+#include "Texture.h"
+#include "VulkanObjectCache.h"
+
+const uint32_t MATERIAL_DESCRIPTOR_SET = 0;		///< The set every renderable pipeline reads the material library from (see materials.glsl)
+const uint32_t RENDERABLE_DESCRIPTOR_SET = 1;	///< The set holding a Renderable's own bindings
+const uint32_t MAX_MATERIALS = 1024;			///< The most materials the material buffer holds
+const uint32_t MAX_MATERIAL_TEXTURES = 4096;	///< The size of the bindless texture array
+
+/** @brief The textures a surface is shaded with */
+struct Material
+{
+	std::shared_ptr<Texture> diffuseMap;		///< Base color
+	std::shared_ptr<Texture> normalMap;			///< Tangent space normals
+	std::shared_ptr<Texture> specularMap;		///< Specular color
+};
+
+/** @brief A material as the shaders see it, its textures replaced by their index in the texture array
+
+	Matches the Material struct in materials.glsl (std430)
+*/
+struct MaterialData
+{
+	uint32_t diffuseMap;						///< Index of the diffuse map
+	uint32_t normalMap;							///< Index of the normal map
+	uint32_t specularMap;						///< Index of the specular map
+	uint32_t padding;							///< Padding to a 16 byte multiple
+};
+
+/** @brief Pushed before each draw, picks the Renderable's material
+
+	Matches the DrawConstants block in materials.glsl
+*/
+struct MaterialPushConstants
+{
+	uint32_t materialIndex;						///< Index into the material buffer
+};
+
+/** @class MaterialLibrary
+
+	@brief Every material in the scene, in one descriptor set bound once per pass
+
+	Textures are written into one large array the first time a material uses them,
+	and materials are stored in a storage buffer that refers to them by index. A
+	Renderable only pushes its material's index, so Renderables with different
+	textures no longer need their own image descriptors.
+
+	The texture array is update-after-bind and partially bound: materials can be
+	added while frames using the set are in flight, and the unused part of the
+	array never has to be written.
+*/
+class MaterialLibrary
+{
+public:
+	/** @brief Constructor
+		@param context			The RenderSystem's Vulkan Context
+		@param bufferManager	The RenderSystem's Buffer Manager
+		@param objectCache		The RenderSystem's Object Cache
+	*/
+	MaterialLibrary(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<VulkanObjectCache> objectCache);
+
+	/** @brief Create the descriptor set, its layout and the material buffer */
+	void initialize();
+
+	/** @brief Free all Vulkan resources */
+	void cleanup();
+
+	/** @brief Add a material, adding its textures to the texture array if no other material uses them yet
+		@param material The material, all of its textures must be set
+		@return The material's index, for Renderable::setMaterial()
+	*/
+	uint32_t addMaterial(const Material& material);
+
+	/** @brief Bind the material set at MATERIAL_DESCRIPTOR_SET
+
+		Renderable pipelines share the set's layout and push constant range,
+		so it stays bound while they are switched.
+
+		@param commandBuffer The command buffer being recorded
+	*/
+	void bind(VkCommandBuffer commandBuffer) const;
+
+	/** @brief Push the index of the material the next draws use
+		@param commandBuffer	The command buffer being recorded
+		@param materialIndex	The material's index
+	*/
+	void pushMaterial(VkCommandBuffer commandBuffer, uint32_t materialIndex) const;
+
+	/** @brief Get the layout of the material set, set MATERIAL_DESCRIPTOR_SET of every renderable pipeline */
+	SharedDescriptorSetLayout getDescriptorSetLayout() const { return mDescriptorSetLayout; }
+
+	/** @brief Get the bindings of the material set (as declared in materials.glsl) */
+	static std::vector<VkDescriptorSetLayoutBinding> getLayoutBindings();
+
+	/** @brief Get the push constant range of every renderable pipeline */
+	static VkPushConstantRange getPushConstantRange();
+
+private:
+	std::shared_ptr<VulkanContext> mContext;			///< The RenderSystem's Vulkan Context
+	std::shared_ptr<BufferManager> mBufferManager;		///< The RenderSystem's Buffer Manager
+
+	std::shared_ptr<VulkanObjectCache> mObjectCache;	///< The RenderSystem's Object Cache, which the set layout is handed to
+
+	SharedDescriptorSetLayout mDescriptorSetLayout;					///< Layout of the material set (kept alive by the pipeline layouts made with it)
+	VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;				///< Layout with just the material set, compatible with every renderable pipeline for binding it
+	VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;				///< Update-after-bind pool the material set is allocated from
+	VkDescriptorSet mDescriptorSet = VK_NULL_HANDLE;				///< The material set, shared by every frame
+
+	VkBuffer mMaterialBuffer = VK_NULL_HANDLE;						///< Storage buffer holding MAX_MATERIALS MaterialData
+	VkDeviceMemory mMaterialBufferMemory = VK_NULL_HANDLE;			///< Memory of mMaterialBuffer (host visible and coherent)
+	MaterialData* mMaterials = nullptr;								///< mMaterialBuffer, persistently mapped
+
+	uint32_t mMaterialCount = 0;									///< Number of materials written to mMaterialBuffer
+	std::map<const Texture*, uint32_t> mTextureIndices;				///< Index of each texture already in the texture array
+
+	/** @brief Get a texture's index in the texture array, writing it into the array if it isn't there yet
+		@param texture The texture
+	*/
+	uint32_t addTexture(const std::shared_ptr<Texture>& texture);
+
+	/** @brief Create the update-after-bind descriptor pool and allocate the material set */
+	void createDescriptorSet();
+
+	/** @brief Create the material buffer and point the material set at it */
+	void createMaterialBuffer();
+};
@@ -13,6 +13,7 @@ void Mesh::load(std::vector<Vertex>& vertices, std::vector<uint32_t> &indices)
 	//do we really need to keep a copy around?
 	mVertices = vertices;
 	mIndices = indices;
+	mBounds = Bounds::fromVertices(mVertices);
 
 	mBufferManager->createVertexBuffer(mVertices, mVertexBuffer, mVertexBufferMemory);
 	mBufferManager->createIndexBuffer(mIndices, mIndexBuffer, mIndexBufferMemory);
@@ -43,3 +44,18 @@ VkBuffer Mesh::getIndexBuffer()
 {
 	return mIndexBuffer;
 }
+
+const Bounds& Mesh::getBounds() const
+{
+	return mBounds;
+}
+
+const std::vector<Vertex>& Mesh::getVertices() const
+{
+	return mVertices;
+}
+
+const std::vector<uint32_t>& Mesh::getIndices() const
+{
+	return mIndices;
+}
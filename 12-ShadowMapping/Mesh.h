@@ -11,6 +11,7 @@
 #include "VulkanContext.h"
 #include "BufferManager.h"
 #include "Vertex.h"
+#include "Bounds.h"
 
 /** @class Mesh
 	
@@ -52,6 +53,20 @@ public:
 		@return The index buffer
 	*/
 	VkBuffer getIndexBuffer();
+	/** @brief Get the object space bounds of the mesh (computed in load())
+		@return The bounding box and sphere of the mesh
+	*/
+	const Bounds& getBounds() const;
+
+	/** @brief Get the CPU side copy of the vertices
+		@return The vertices passed to load()
+	*/
+	const std::vector<Vertex>& getVertices() const;
+
+	/** @brief Get the CPU side copy of the indices
+		@return The indices passed to load()
+	*/
+	const std::vector<uint32_t>& getIndices() const;
 protected:
 	std::shared_ptr<VulkanContext> mContext;			///< The RenderSystem's VulkanContext
 	std::shared_ptr<BufferManager> mBufferManager;		///< The RenderSystem's BufferManager
@@ -65,4 +80,6 @@ protected:
 	std::vector<uint32_t> mIndices;						///< The indices in the mesh
 	VkBuffer mIndexBuffer;								///< The VkBuffer object for the indices
 	VkDeviceMemory mIndexBufferMemory;					///< The device memory for the indices
+
+	Bounds mBounds;										///< Object space bounds of the vertices
 };
\ No newline at end of file
@@ -0,0 +1,491 @@
+#include "OcclusionCulling.h"
+#include "FileIO.h"
+
+#include <glm/vec2.hpp>
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+/** @brief Push constants for depthPyramid.comp */
+struct PyramidParams
+{
+	glm::ivec2 srcSize;		///< Size of the level being read
+	glm::ivec2 dstSize;		///< Size of the level being written
+};
+
+/** @brief Push constants for occlusionCull.comp */
+struct CullParams
+{
+	glm::mat4 viewProj;		///< Camera projection * view
+	uint32_t objectCount;	///< Number of objects to test
+	uint32_t latePass;		///< 0 for the early phase, 1 for the late phase
+	uint32_t drawOffset;	///< Index of the first draw command written by this phase
+	uint32_t pyramidLevels;	///< Number of mip levels in the depth pyramid
+};
+
+const uint32_t PYRAMID_GROUP_SIZE = 8;		///< local_size_x/y of depthPyramid.comp
+const uint32_t CULL_GROUP_SIZE = 64;		///< local_size_x of occlusionCull.comp
+
+OcclusionCuller::OcclusionCuller(std::shared_ptr<VulkanContext> context,
+								std::shared_ptr<CommandPool> commandPool,
+								std::shared_ptr<BufferManager> bufferManager,
+								std::shared_ptr<ImageManager> imageManager) :
+	mContext(context),
+	mCommandPool(commandPool),
+	mBufferManager(bufferManager),
+	mImageManager(imageManager)
+{ }
+
+void OcclusionCuller::initialize(uint32_t framesInFlight)
+{
+	std::cout << "Creating occlusion culler" << std::endl;
+	mFramesInFlight = framesInFlight;
+
+	//shaders & pipelines
+	mPyramidShader = std::make_shared<Shader>(Shader(mContext));
+	mPyramidShader->load(readShaderFile(DEPTH_PYRAMID_SHADER_COMP), VK_SHADER_STAGE_COMPUTE_BIT);
+	mCullShader = std::make_shared<Shader>(Shader(mContext));
+	mCullShader->load(readShaderFile(OCCLUSION_CULL_SHADER_COMP), VK_SHADER_STAGE_COMPUTE_BIT);
+
+	createDescriptorSetLayouts();
+	createComputePipeline(*mPyramidShader, mPyramidSetLayout, sizeof(PyramidParams), mPyramidPipelineLayout, mPyramidPipeline);
+	createComputePipeline(*mCullShader, mCullSetLayout, sizeof(CullParams), mCullPipelineLayout, mCullPipeline);
+
+	//object data is rewritten by the CPU every frame, so keep one mapped buffer per frame in flight
+	VkDeviceSize objectBufferSize = sizeof(OcclusionObject) * MAX_OCCLUSION_OBJECTS;
+	mObjectBuffers.resize(mFramesInFlight);
+	mObjectBuffersMemory.resize(mFramesInFlight);
+	mObjectBuffersMapped.resize(mFramesInFlight);
+	for (uint32_t i = 0; i < mFramesInFlight; i++) {
+		mBufferManager->createBuffer(objectBufferSize,
+									VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+									VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+									mObjectBuffers[i], mObjectBuffersMemory[i]);
+		vkMapMemory(mContext->device, mObjectBuffersMemory[i], 0, objectBufferSize, 0, &mObjectBuffersMapped[i]);
+	}
+
+	//early phase commands, then late phase commands
+	mBufferManager->createBuffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_OCCLUSION_OBJECTS * 2,
+								VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+								mDrawBuffer, mDrawBufferMemory);
+
+	VkDeviceSize visibilitySize = sizeof(uint32_t) * MAX_OCCLUSION_OBJECTS;
+	mBufferManager->createBuffer(visibilitySize,
+								VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+								mVisibilityBuffer, mVisibilityBufferMemory);
+
+	//nothing has been seen yet, so the first frame draws everything in the late phase
+	VkCommandBuffer commandBuffer = mCommandPool->beginSingleCmdBuffer();
+	vkCmdFillBuffer(commandBuffer, mVisibilityBuffer, 0, visibilitySize, 0);
+	mCommandPool->endSingleCmdBuffer(commandBuffer);
+
+	//sampler for reading the depth buffer and the pyramid with texelFetch
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+	if (vkCreateSampler(mContext->device, &samplerInfo, nullptr, &mPyramidSampler) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+	}
+}
+
+void OcclusionCuller::cleanup()
+{
+	cleanupDepthPyramid();
+
+	vkDestroySampler(mContext->device, mPyramidSampler, nullptr);
+
+	for (uint32_t i = 0; i < mFramesInFlight; i++) {
+		vkUnmapMemory(mContext->device, mObjectBuffersMemory[i]);
+		vkDestroyBuffer(mContext->device, mObjectBuffers[i], nullptr);
+		vkFreeMemory(mContext->device, mObjectBuffersMemory[i], nullptr);
+	}
+	vkDestroyBuffer(mContext->device, mDrawBuffer, nullptr);
+	vkFreeMemory(mContext->device, mDrawBufferMemory, nullptr);
+	vkDestroyBuffer(mContext->device, mVisibilityBuffer, nullptr);
+	vkFreeMemory(mContext->device, mVisibilityBufferMemory, nullptr);
+
+	vkDestroyPipeline(mContext->device, mPyramidPipeline, nullptr);
+	vkDestroyPipelineLayout(mContext->device, mPyramidPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mContext->device, mPyramidSetLayout, nullptr);
+
+	vkDestroyPipeline(mContext->device, mCullPipeline, nullptr);
+	vkDestroyPipelineLayout(mContext->device, mCullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mContext->device, mCullSetLayout, nullptr);
+
+	mPyramidShader->free();
+	mCullShader->free();
+}
+
+void OcclusionCuller::createDepthPyramid(VkImageView depthImageView, VkExtent2D depthExtent)
+{
+	mDepthExtent = depthExtent;
+
+	//round down to a power of two, so every level is exactly half the size of the one before
+	mPyramidExtent = { 1, 1 };
+	while (mPyramidExtent.width * 2 <= depthExtent.width) mPyramidExtent.width *= 2;
+	while (mPyramidExtent.height * 2 <= depthExtent.height) mPyramidExtent.height *= 2;
+
+	mPyramidLevels = 1;
+	while ((std::max(mPyramidExtent.width, mPyramidExtent.height) >> mPyramidLevels) > 0) mPyramidLevels++;
+
+	mImageManager->createImage(mPyramidExtent.width, mPyramidExtent.height,
+								VK_FORMAT_R32_SFLOAT,
+								VK_IMAGE_TILING_OPTIMAL,
+								VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+								mPyramidImage, mPyramidImageMemory,
+								mPyramidLevels);
+
+	mPyramidView = mImageManager->createImageView(mPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, mPyramidLevels);
+	mPyramidLevelViews.resize(mPyramidLevels);
+	for (uint32_t level = 0; level < mPyramidLevels; level++) {
+		mPyramidLevelViews[level] = mImageManager->createImageView(mPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+	}
+
+	//the pyramid is both written and read by compute shaders, so it lives in the general layout
+	VkCommandBuffer commandBuffer = mCommandPool->beginSingleCmdBuffer();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = mPyramidImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mPyramidLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	mCommandPool->endSingleCmdBuffer(commandBuffer);
+
+	createDescriptorSets(depthImageView);
+}
+
+void OcclusionCuller::cleanupDepthPyramid()
+{
+	if (!hasDepthPyramid())
+		return;
+
+	//destroying the pool frees every set allocated from it
+	vkDestroyDescriptorPool(mContext->device, mDescriptorPool, nullptr);
+	mDescriptorPool = VK_NULL_HANDLE;
+	mPyramidSets.clear();
+	mCullSets.clear();
+
+	for (auto view : mPyramidLevelViews) {
+		vkDestroyImageView(mContext->device, view, nullptr);
+	}
+	mPyramidLevelViews.clear();
+	vkDestroyImageView(mContext->device, mPyramidView, nullptr);
+	vkDestroyImage(mContext->device, mPyramidImage, nullptr);
+	vkFreeMemory(mContext->device, mPyramidImageMemory, nullptr);
+
+	mPyramidView = VK_NULL_HANDLE;
+	mPyramidImage = VK_NULL_HANDLE;
+	mPyramidImageMemory = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::updateObjects(uint32_t frameIndex, const std::vector<OcclusionObject>& objects)
+{
+	if (objects.size() > MAX_OCCLUSION_OBJECTS) {
+		throw std::runtime_error("Too many objects for occlusion culling!");
+	}
+
+	mObjectCount = static_cast<uint32_t>(objects.size());
+	memcpy(mObjectBuffersMapped[frameIndex], objects.data(), sizeof(OcclusionObject) * objects.size());
+}
+
+void OcclusionCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj, bool latePass)
+{
+	//the last frame's indirect draws and visibility writes must be done before they are overwritten
+	VkMemoryBarrier beforeCull = {};
+	beforeCull.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	beforeCull.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	beforeCull.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &beforeCull,
+		0, nullptr,
+		0, nullptr);
+
+	CullParams params = {};
+	params.viewProj = viewProj;
+	params.objectCount = mObjectCount;
+	params.latePass = latePass ? 1 : 0;
+	params.drawOffset = latePass ? MAX_OCCLUSION_OBJECTS : 0;
+	params.pyramidLevels = mPyramidLevels;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipelineLayout, 0, 1, &mCullSets[frameIndex], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, mCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &params);
+
+	if (mObjectCount > 0) {
+		vkCmdDispatch(commandBuffer, (mObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	}
+
+	//make the draw commands available to the indirect draws
+	VkMemoryBarrier afterCull = {};
+	afterCull.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	afterCull.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	afterCull.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0,
+		1, &afterCull,
+		0, nullptr,
+		0, nullptr);
+}
+
+void OcclusionCuller::recordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPyramidPipeline);
+
+	VkMemoryBarrier levelBarrier = {};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	//the previous frame's late cull may still be reading the pyramid
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &levelBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	glm::ivec2 srcSize(mDepthExtent.width, mDepthExtent.height);
+	for (uint32_t level = 0; level < mPyramidLevels; level++) {
+		glm::ivec2 dstSize(std::max(mPyramidExtent.width >> level, 1u), std::max(mPyramidExtent.height >> level, 1u));
+
+		PyramidParams params = { srcSize, dstSize };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPyramidPipelineLayout, 0, 1, &mPyramidSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, mPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidParams), &params);
+		vkCmdDispatch(commandBuffer,
+			(dstSize.x + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+			(dstSize.y + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+			1);
+
+		//the next level reads this one
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &levelBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		srcSize = dstSize;
+	}
+}
+
+VkDeviceSize OcclusionCuller::getDrawOffset(uint32_t objectIndex, bool latePass) const
+{
+	uint32_t commandIndex = (latePass ? MAX_OCCLUSION_OBJECTS : 0) + objectIndex;
+	return sizeof(VkDrawIndexedIndirectCommand) * commandIndex;
+}
+
+void OcclusionCuller::createComputePipeline(const Shader& shader, VkDescriptorSetLayout setLayout, uint32_t pushSize,
+											VkPipelineLayout& layout, VkPipeline& pipeline)
+{
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushRange.offset = 0;
+	pushRange.size = pushSize;
+
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &setLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+
+	if (vkCreatePipelineLayout(mContext->device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = shader.getShaderStageInfo();
+	pipelineInfo.layout = layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(mContext->device, mContext->pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline!");
+	}
+}
+
+void OcclusionCuller::createDescriptorSetLayouts()
+{
+	//depth pyramid: 0 = source level, 1 = destination level
+	std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings = {};
+	pyramidBindings[0].binding = 0;
+	pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidBindings[0].descriptorCount = 1;
+	pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pyramidBindings[1].binding = 1;
+	pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pyramidBindings[1].descriptorCount = 1;
+	pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+	layoutInfo.pBindings = pyramidBindings.data();
+
+	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &mPyramidSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+	}
+
+	//culling: 0 = objects, 1 = draw commands, 2 = visibility, 3 = depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 4> cullBindings = {};
+	for (uint32_t i = 0; i < 3; i++) {
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	cullBindings[3].binding = 3;
+	cullBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	cullBindings[3].descriptorCount = 1;
+	cullBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	layoutInfo.pBindings = cullBindings.data();
+
+	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &mCullSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create occlusion cull descriptor set layout!");
+	}
+}
+
+void OcclusionCuller::createDescriptorSets(VkImageView depthImageView)
+{
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = mPyramidLevels + mFramesInFlight;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = mPyramidLevels;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 3 * mFramesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = mPyramidLevels + mFramesInFlight;
+
+	if (vkCreateDescriptorPool(mContext->device, &poolInfo, nullptr, &mDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create occlusion culling descriptor pool!");
+	}
+
+	//one set per pyramid level
+	std::vector<VkDescriptorSetLayout> pyramidLayouts(mPyramidLevels, mPyramidSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mDescriptorPool;
+	allocInfo.descriptorSetCount = mPyramidLevels;
+	allocInfo.pSetLayouts = pyramidLayouts.data();
+
+	mPyramidSets.resize(mPyramidLevels);
+	if (vkAllocateDescriptorSets(mContext->device, &allocInfo, mPyramidSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+	}
+
+	for (uint32_t level = 0; level < mPyramidLevels; level++) {
+		//level 0 reads the depth buffer, every other level reads the one above it
+		VkDescriptorImageInfo srcInfo = {};
+		srcInfo.sampler = mPyramidSampler;
+		srcInfo.imageView = (level == 0) ? depthImageView : mPyramidLevelViews[level - 1];
+		srcInfo.imageLayout = (level == 0) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo dstInfo = {};
+		dstInfo.imageView = mPyramidLevelViews[level];
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes = {};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = mPyramidSets[level];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &srcInfo;
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = mPyramidSets[level];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &dstInfo;
+
+		vkUpdateDescriptorSets(mContext->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	//one cull set per frame in flight
+	std::vector<VkDescriptorSetLayout> cullLayouts(mFramesInFlight, mCullSetLayout);
+	allocInfo.descriptorSetCount = mFramesInFlight;
+	allocInfo.pSetLayouts = cullLayouts.data();
+
+	mCullSets.resize(mFramesInFlight);
+	if (vkAllocateDescriptorSets(mContext->device, &allocInfo, mCullSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate occlusion cull descriptor sets!");
+	}
+
+	for (uint32_t i = 0; i < mFramesInFlight; i++) {
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+		bufferInfos[0] = { mObjectBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[1] = { mDrawBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { mVisibilityBuffer, 0, VK_WHOLE_SIZE };
+
+		VkDescriptorImageInfo pyramidInfo = {};
+		pyramidInfo.sampler = mPyramidSampler;
+		pyramidInfo.imageView = mPyramidView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 4> writes = {};
+		for (uint32_t binding = 0; binding < 3; binding++) {
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = mCullSets[i];
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].descriptorCount = 1;
+			writes[binding].pBufferInfo = &bufferInfos[binding];
+		}
+		writes[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[3].dstSet = mCullSets[i];
+		writes[3].dstBinding = 3;
+		writes[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[3].descriptorCount = 1;
+		writes[3].pImageInfo = &pyramidInfo;
+
+		vkUpdateDescriptorSets(mContext->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+//vulkan
+#include <vulkan/vulkan.h>
+
+//glm
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <vector>
+#include <memory>
+
+//uwb-vk
+#include "VulkanContext.h"
+#include "CommandPool.h"
+#include "BufferManager.h"
+#include "ImageManager.h"
+#include "Shader.h"
+
+const uint32_t MAX_OCCLUSION_OBJECTS = 1024;	///< The most renderables the occlusion culler can test in one frame
+
+const std::string DEPTH_PYRAMID_SHADER_COMP = "Resources/Shaders/depthPyramid_comp.spv";		///< Compute shader that reduces one level of the depth pyramid
+const std::string OCCLUSION_CULL_SHADER_COMP = "Resources/Shaders/occlusionCull_comp.spv";		///< Compute shader that tests bounds against the depth pyramid
+
+/** @brief How (and whether) renderables hidden behind other geometry are culled */
+enum class OcclusionCullingMode
+{
+	None,		///< Only frustum culling is performed
+	HiZ,		///< Bounds are tested against a hierarchical depth pyramid on the GPU
+	Software	///< Bounds are tested against occluders rasterized on the CPU
+};
+
+/** @brief Per-object data read by the occlusion culling shader
+
+	Matches the ObjectData struct in occlusionCull.comp (std430)
+*/
+struct OcclusionObject
+{
+	glm::vec4 sphere;				///< World space bounds center (xyz) and bounding sphere radius (w)
+	glm::vec4 extents;				///< World space bounding box half extents (xyz)
+	uint32_t indexCount;			///< Index count of the object's mesh
+	uint32_t frustumVisible;		///< 1 if the object passed frustum culling this frame
+	uint32_t padding[2];			///< Padding to a 16 byte multiple
+};
+
+/** @class OcclusionCuller
+
+	@brief GPU occlusion culling against a hierarchical depth pyramid (Hi-Z)
+
+	Culling happens in two phases to avoid objects popping in when they become visible:
+	- Early: every object that was visible last frame is drawn
+	- The depth buffer produced by the early draws is reduced into a depth pyramid,
+	  where each texel holds the farthest depth of the texels it covers
+	- Late: every object is tested against the pyramid, objects that are visible now
+	  but were not drawn in the early phase are drawn, and the results are kept for the next frame
+
+	Each phase writes one VkDrawIndexedIndirectCommand per object into a
+	shared buffer, with an instance count of 0 for objects that are culled.
+*/
+class OcclusionCuller
+{
+public:
+	/** @brief Constructor
+		@param context			The RenderSystem's Vulkan Context
+		@param commandPool		The RenderSystem's Command Pool
+		@param bufferManager	The RenderSystem's Buffer Manager
+		@param imageManager		The RenderSystem's Image Manager
+	*/
+	OcclusionCuller(std::shared_ptr<VulkanContext> context,
+					std::shared_ptr<CommandPool> commandPool,
+					std::shared_ptr<BufferManager> bufferManager,
+					std::shared_ptr<ImageManager> imageManager);
+
+	/** @brief Create the compute pipelines and the buffers that don't depend on the swapchain
+		@param framesInFlight The number of frames that can be recorded before one is finished
+	*/
+	void initialize(uint32_t framesInFlight);
+
+	/** @brief Free all Vulkan resources (including the depth pyramid) */
+	void cleanup();
+
+	/** @brief Create the depth pyramid for a depth buffer
+
+		Must be called again whenever the depth buffer is recreated.
+
+		@param depthImageView	A view of the depth aspect of the depth buffer
+		@param depthExtent		The size of the depth buffer
+	*/
+	void createDepthPyramid(VkImageView depthImageView, VkExtent2D depthExtent);
+
+	/** @brief Free the depth pyramid and the descriptor sets referencing it */
+	void cleanupDepthPyramid();
+
+	/** @brief Upload this frame's object data
+		@param frameIndex	The index of the frame in flight
+		@param objects		One entry per object, in draw command order
+	*/
+	void updateObjects(uint32_t frameIndex, const std::vector<OcclusionObject>& objects);
+
+	/** @brief Record the culling dispatch for one of the two phases
+
+		The draw commands written are ready for vkCmdDrawIndexedIndirect once this returns.
+
+		@param commandBuffer	The command buffer to record into
+		@param frameIndex		The index of the frame in flight (selects the object data)
+		@param viewProj			The camera's projection * view matrix
+		@param latePass			False for the early phase, true for the late phase
+	*/
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj, bool latePass);
+
+	/** @brief Record the reduction of the depth buffer into the depth pyramid
+
+		The depth buffer must be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+		with its writes made visible to the compute stage.
+
+		@param commandBuffer	The command buffer to record into
+	*/
+	void recordDepthPyramid(VkCommandBuffer commandBuffer);
+
+	//--------------
+	// Accessors
+	//--------------
+
+	/** @brief Get the buffer holding the indirect draw commands */
+	VkBuffer getDrawBuffer() const { return mDrawBuffer; }
+
+	/** @brief Get the offset of an object's draw command within the draw buffer
+		@param objectIndex	The index of the object
+		@param latePass		Whether to get the late phase command instead of the early phase one
+	*/
+	VkDeviceSize getDrawOffset(uint32_t objectIndex, bool latePass) const;
+
+	/** @brief Check if the depth pyramid has been created */
+	bool hasDepthPyramid() const { return mPyramidImage != VK_NULL_HANDLE; }
+
+private:
+	std::shared_ptr<VulkanContext> mContext;				///< The Vulkan Context
+	std::shared_ptr<CommandPool> mCommandPool;				///< Command pool for one-off setup commands
+	std::shared_ptr<BufferManager> mBufferManager;			///< Used to create the storage buffers
+	std::shared_ptr<ImageManager> mImageManager;			///< Used to create the depth pyramid
+
+	uint32_t mFramesInFlight = 0;							///< The number of frames in flight (one object buffer and cull set each)
+	uint32_t mObjectCount = 0;								///< The number of objects uploaded by updateObjects()
+
+#pragma region Buffers
+	std::vector<VkBuffer> mObjectBuffers;					///< Object data, one host visible buffer per frame in flight
+	std::vector<VkDeviceMemory> mObjectBuffersMemory;		///< Memory backing mObjectBuffers
+	std::vector<void*> mObjectBuffersMapped;				///< Persistently mapped pointers into mObjectBuffersMemory
+
+	VkBuffer mDrawBuffer = VK_NULL_HANDLE;					///< Indirect draw commands, early phase followed by late phase
+	VkDeviceMemory mDrawBufferMemory = VK_NULL_HANDLE;		///< Memory backing mDrawBuffer
+
+	VkBuffer mVisibilityBuffer = VK_NULL_HANDLE;			///< One uint per object, 1 if it was visible when last tested
+	VkDeviceMemory mVisibilityBufferMemory = VK_NULL_HANDLE;///< Memory backing mVisibilityBuffer
+#pragma endregion
+
+#pragma region Depth Pyramid
+	VkImage mPyramidImage = VK_NULL_HANDLE;					///< R32 image with a full mip chain
+	VkDeviceMemory mPyramidImageMemory = VK_NULL_HANDLE;	///< Memory backing mPyramidImage
+	VkImageView mPyramidView = VK_NULL_HANDLE;				///< View of every mip level, read by the cull shader
+	std::vector<VkImageView> mPyramidLevelViews;			///< One view per mip level, written by the reduction shader
+	VkExtent2D mPyramidExtent = {};							///< Size of the first pyramid level
+	uint32_t mPyramidLevels = 0;							///< Number of mip levels in the pyramid
+	VkExtent2D mDepthExtent = {};							///< Size of the depth buffer the pyramid is built from
+	VkSampler mPyramidSampler = VK_NULL_HANDLE;				///< Nearest, clamped sampler used for texelFetch
+#pragma endregion
+
+#pragma region Pipelines
+	std::shared_ptr<Shader> mPyramidShader;					///< depthPyramid.comp
+	std::shared_ptr<Shader> mCullShader;					///< occlusionCull.comp
+
+	VkDescriptorSetLayout mPyramidSetLayout = VK_NULL_HANDLE;	///< Source depth + destination level
+	VkPipelineLayout mPyramidPipelineLayout = VK_NULL_HANDLE;	///< Layout of the reduction pipeline
+	VkPipeline mPyramidPipeline = VK_NULL_HANDLE;				///< Reduction pipeline
+
+	VkDescriptorSetLayout mCullSetLayout = VK_NULL_HANDLE;		///< Objects, draws, visibility and the pyramid
+	VkPipelineLayout mCullPipelineLayout = VK_NULL_HANDLE;		///< Layout of the cull pipeline
+	VkPipeline mCullPipeline = VK_NULL_HANDLE;					///< Cull pipeline
+
+	VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;			///< Pool for all sets below, recreated with the pyramid
+	std::vector<VkDescriptorSet> mPyramidSets;					///< One set per pyramid level
+	std::vector<VkDescriptorSet> mCullSets;						///< One set per frame in flight
+#pragma endregion
+
+	/** @brief Create a compute pipeline
+		@param shader		The compute shader
+		@param setLayout	The pipeline's only descriptor set layout
+		@param pushSize		The size of the push constant block
+		@param layout		The pipeline layout to be created
+		@param pipeline		The pipeline to be created
+	*/
+	void createComputePipeline(const Shader& shader, VkDescriptorSetLayout setLayout, uint32_t pushSize,
+								VkPipelineLayout& layout, VkPipeline& pipeline);
+
+	/** @brief Create the pyramid and cull descriptor set layouts */
+	void createDescriptorSetLayouts();
+
+	/** @brief Allocate and write the descriptor sets for the current pyramid
+		@param depthImageView A view of the depth buffer
+	*/
+	void createDescriptorSets(VkImageView depthImageView);
+};
@@ -0,0 +1,123 @@
+#include "PipelineRegistry.h"
+
+GraphicsPipeline::GraphicsPipeline(std::shared_ptr<VulkanContext> context, VkPipeline pipeline, SharedPipelineLayout layout) :
+	pipeline(pipeline),
+	layout(*layout),
+	mContext(context),
+	mLayout(layout)
+{}
+
+GraphicsPipeline::~GraphicsPipeline()
+{
+	vkDestroyPipeline(mContext->device, pipeline, nullptr);
+}
+
+std::string PipelineRegistry::makeKey(const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+									  const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings,
+									  VkDescriptorSetLayoutCreateFlags layoutFlags,
+									  const std::vector<VkPushConstantRange>& pushConstantRanges,
+									  const std::vector<VkDynamicState>& dynamicStates,
+									  const PipelineOutputState& outputState,
+									  VkRenderPass renderPass)
+{
+	//every field is written out one by one, so struct padding never ends up in the key
+	std::string key;
+
+	appendBytes(key, shaderStages.size());
+	for (const auto& stage : shaderStages) {
+		appendBytes(key, stage.stage);
+		appendBytes(key, stage.module);
+		key.append(stage.pName);
+		key.push_back('\0');
+
+		const VkSpecializationInfo* specialization = stage.pSpecializationInfo;
+		uint32_t entryCount = specialization ? specialization->mapEntryCount : 0;
+		appendBytes(key, entryCount);
+		for (uint32_t entry = 0; entry < entryCount; entry++) {
+			appendBytes(key, specialization->pMapEntries[entry].constantID);
+			appendBytes(key, specialization->pMapEntries[entry].offset);
+			appendBytes(key, specialization->pMapEntries[entry].size);
+		}
+		if (specialization) {
+			appendBytes(key, specialization->dataSize);
+			key.append(static_cast<const char*>(specialization->pData), specialization->dataSize);
+		}
+	}
+
+	key.append(makeLayoutKey(layoutBindings, layoutFlags));
+
+	appendBytes(key, pushConstantRanges.size());
+	for (const auto& range : pushConstantRanges) {
+		appendBytes(key, range.stageFlags);
+		appendBytes(key, range.offset);
+		appendBytes(key, range.size);
+	}
+
+	appendBytes(key, dynamicStates.size());
+	for (VkDynamicState state : dynamicStates) {
+		appendBytes(key, state);
+	}
+
+	appendBytes(key, outputState.subpass);
+	appendBytes(key, outputState.colorAttachmentCount);
+	appendBytes(key, outputState.depthTest);
+	appendBytes(key, outputState.depthWrite);
+	appendBytes(key, outputState.depthCompareOp);
+	appendBytes(key, outputState.vertexInput);
+
+	appendBytes(key, renderPass);
+
+	return key;
+}
+
+std::string PipelineRegistry::makeLayoutKey(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags)
+{
+	std::string key;
+
+	appendBytes(key, layoutFlags);
+	appendBytes(key, layoutBindings.size());
+	for (const auto& binding : layoutBindings) {
+		appendBytes(key, binding.binding);
+		appendBytes(key, binding.descriptorType);
+		appendBytes(key, binding.descriptorCount);
+		appendBytes(key, binding.stageFlags);
+		appendBytes(key, binding.pImmutableSamplers);
+	}
+
+	return key;
+}
+
+std::shared_ptr<GraphicsPipeline> PipelineRegistry::find(const std::string& key)
+{
+	auto entry = mPipelines.find(key);
+	if (entry == mPipelines.end())
+		return nullptr;
+
+	std::shared_ptr<GraphicsPipeline> pipeline = entry->second.lock();
+	if (pipeline) {
+		mReuseCount++;
+	}
+	return pipeline;
+}
+
+void PipelineRegistry::add(const std::string& key, const std::shared_ptr<GraphicsPipeline>& pipeline)
+{
+	removeExpired();
+	mPipelines[key] = pipeline;
+}
+
+size_t PipelineRegistry::getLiveCount()
+{
+	removeExpired();
+	return mPipelines.size();
+}
+
+void PipelineRegistry::removeExpired()
+{
+	for (auto entry = mPipelines.begin(); entry != mPipelines.end();) {
+		if (entry->second.expired())
+			entry = mPipelines.erase(entry);
+		else
+			++entry;
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+//uwb-vk
+#include "VulkanContext.h"
+#include "VulkanObjectCache.h"
+
+/** @brief Fixed function state for pipelines that differ from the default color pass setup */
+struct PipelineOutputState
+{
+	uint32_t subpass = 0;								///< The subpass of the render pass the pipeline is used in
+	uint32_t colorAttachmentCount = 1;					///< Color attachments of the subpass (0 for depth only pipelines, GBUFFER_ATTACHMENT_COUNT for the G-buffer)
+	bool depthTest = true;								///< False in subpasses without a depth attachment
+	bool depthWrite = true;								///< Should the depth of passing fragments be written
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;	///< How new fragments are compared against the depth buffer
+	bool vertexInput = true;							///< False for pipelines that make their vertices in the vertex shader (no vertex buffer)
+};
+
+/** @class GraphicsPipeline
+
+	@brief A pipeline and its layout, shared by every Renderable created with the same description
+
+	Destroys the pipeline when the last user lets go of it, so it can't be copied.
+	The layout comes from the VulkanObjectCache and may be shared with other pipelines.
+*/
+class GraphicsPipeline
+{
+public:
+	/** @brief Constructor, taking ownership of the pipeline
+		@param context	The RenderSystem's VulkanContext object
+		@param pipeline	The pipeline
+		@param layout	The pipeline's layout, kept alive as long as the pipeline
+	*/
+	GraphicsPipeline(std::shared_ptr<VulkanContext> context, VkPipeline pipeline, SharedPipelineLayout layout);
+	~GraphicsPipeline();
+
+	GraphicsPipeline(const GraphicsPipeline&) = delete;
+	GraphicsPipeline& operator=(const GraphicsPipeline&) = delete;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;				///< The pipeline
+	VkPipelineLayout layout = VK_NULL_HANDLE;			///< The layout descriptor sets are bound with
+private:
+	std::shared_ptr<VulkanContext> mContext;			///< The Vulkan Context Object
+	SharedPipelineLayout mLayout;						///< Keeps the layout alive
+};
+
+/** @class PipelineRegistry
+
+	@brief Deduplicates graphics pipelines by their full description
+
+	A pipeline is described by its shader stages (modules and specialization
+	constants), the descriptor set layout's bindings, push constant ranges, dynamic
+	state, output state and render pass. These are flattened into a key, and
+	a pipeline already created with the same key is handed out again instead of
+	compiling a new one. Set layouts are compared by their bindings rather than their
+	handle, as identically defined layouts are compatible.
+
+	The registry only holds weak references, so a pipeline is destroyed once the
+	last Renderable using it releases it.
+*/
+class PipelineRegistry
+{
+public:
+	/** @brief Build the key describing a pipeline
+		@param shaderStages			The shaders that the pipeline will use
+		@param layoutBindings		The bindings of the descriptor set layout
+		@param layoutFlags			The creation flags of the descriptor set layout (i.e. push descriptors)
+		@param pushConstantRanges	The push constants the shaders read
+		@param dynamicStates		State set while recording instead of baked into the pipeline
+		@param outputState			Subpass, depth and color output state
+		@param renderPass			The renderPass the pipeline will use
+	*/
+	static std::string makeKey(const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+							   const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings,
+							   VkDescriptorSetLayoutCreateFlags layoutFlags,
+							   const std::vector<VkPushConstantRange>& pushConstantRanges,
+							   const std::vector<VkDynamicState>& dynamicStates,
+							   const PipelineOutputState& outputState,
+							   VkRenderPass renderPass);
+
+	/** @brief Build the key describing a descriptor set layout (part of a pipeline's key)
+		@param layoutBindings	The bindings of the descriptor set layout, in binding order
+		@param layoutFlags		The creation flags of the descriptor set layout
+	*/
+	static std::string makeLayoutKey(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags = 0);
+
+	/** @brief Find a live pipeline created with a key
+		@param key The pipeline's key (see makeKey())
+		@return The pipeline, or null if there is none
+	*/
+	std::shared_ptr<GraphicsPipeline> find(const std::string& key);
+
+	/** @brief Register a newly created pipeline, so later requests with the same key reuse it
+		@param key			The pipeline's key (see makeKey())
+		@param pipeline		The pipeline
+	*/
+	void add(const std::string& key, const std::shared_ptr<GraphicsPipeline>& pipeline);
+
+	/** @brief Get the number of pipelines that are still in use */
+	size_t getLiveCount();
+
+	/** @brief Get how many requests were answered with an existing pipeline */
+	uint32_t getReuseCount() const { return mReuseCount; }
+
+private:
+	std::unordered_map<std::string, std::weak_ptr<GraphicsPipeline>> mPipelines;	///< Every registered pipeline by key
+	uint32_t mReuseCount = 0;														///< Requests answered by find()
+
+	/** @brief Drop the entries of pipelines that were destroyed */
+	void removeExpired();
+
+	/** @brief Append the bytes of a value to a key
+		@param key		The key being built
+		@param value	The value to append
+	*/
+	template<typename T>
+	static void appendBytes(std::string& key, const T& value)
+	{
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+};
@@ -10,6 +10,8 @@
 
 void RenderSystem::initialize(GLFWwindow * window, const std::string& appName)
 {
+	mInitializeTime = std::chrono::steady_clock::now();
+
 	mContext = std::make_shared<VulkanContext>(VulkanContext());
 	mContext->initialize(window, appName);
 
@@ -20,19 +22,50 @@ void RenderSystem::initialize(GLFWwindow * window, const std::string& appName)
 
 	mImageManager = std::make_shared<ImageManager>(ImageManager(mContext, mCommandPool));
 
+	mObjectCache = std::make_shared<VulkanObjectCache>(mContext);
+
+	mMaterialLibrary = std::make_unique<MaterialLibrary>(mContext, mBufferManager, mObjectCache);
+	mMaterialLibrary->initialize();
+
 	createSwapchain();
-	createDescriptorPool(MAX_DESCRIPTOR_SETS, MAX_UNIFORM_BUFFERS, MAX_IMAGE_SAMPLERS);
+	createDescriptorAllocators();
+
+	mThreadPool = std::make_unique<ThreadPool>();
+
+	mOcclusionCuller = std::make_unique<OcclusionCuller>(mContext, mCommandPool, mBufferManager, mImageManager);
+	mOcclusionCuller->initialize(MAX_CONCURRENT_FRAMES);
 	
-	createShadowMap();
-	createShadowRenderPass(mShadowMap);
-	createShadowFramebuffers(mShadowRenderPass, mShadowMap.imageView);
-	createShadowMapPipeline();
+	//shadow pass creation. The shader, descriptors and UBO outlive the rest of the
+	//shadow resources, which are recreated when the shadow settings change
+	mShadowMapShaderSet.vertShader = std::make_shared<Shader>(Shader(mContext));
+	createShader(mShadowMapShaderSet.vertShader, SHADOW_MAP_SHADER_VERT, VK_SHADER_STAGE_VERTEX_BIT);
+	createShader(mPointShadowShaderSet.vertShader, POINT_SHADOW_SHADER_VERT, VK_SHADER_STAGE_VERTEX_BIT);
+	createShader(mPointShadowShaderSet.geometryShader, POINT_SHADOW_SHADER_GEOM, VK_SHADER_STAGE_GEOMETRY_BIT);
+	createShadowMapDescriptorSetLayout();	//just one light for now
+	createUniformBuffer<ShadowUBO>(mShadowUBO, 1);
+	createShadowMapDescriptorSets();
+	mShadowViewCache.resize(MAX_LIGHTS * MAX_SHADOW_CASCADES);
+	createShadowResources();
 	createShadowCommandBuffers();
+
+	//clustered lighting buffers, filled every frame by updateLightClusters()
+	createUniformBuffer<ClusterUBO>(mClusterUBO, 1);
+	createStorageBuffer(mLightBuffer, sizeof(LightBufferHeader) + sizeof(Light) * INITIAL_LIGHT_CAPACITY);
+	mUploadedLights.resize(mLightBuffer->buffers.size());
+	createStorageBuffer(mClusterLightBuffer, sizeof(uint32_t) * CLUSTER_LIGHT_LIST_SIZE);
+
+	//deferred lighting pass, its descriptor sets are written once the G-buffer exists
+	createShader(mDeferredLightingShaderSet.vertShader, DEFERRED_LIGHTING_SHADER_VERT, VK_SHADER_STAGE_VERTEX_BIT);
+	createShader(mDeferredLightingShaderSet.fragShader, DEFERRED_LIGHTING_SHADER_FRAG, VK_SHADER_STAGE_FRAGMENT_BIT);
+	createUniformBuffer<DeferredLightingUBO>(mDeferredUBO, 1);
+	createDeferredDescriptorSetLayout();
+	createDeferredDescriptorSets();
 	
 	//color pass creation
 	createDepthBuffer();
 	createColorRenderPass();					//assumes swapchain & attachments?
 	createFramebuffers(mColorPass);				//needs swapchain, attachments
+	createStatisticsQueryPool();
 	createCommandBuffers();						//create a basic set of command buffers (doesn't render anything at this point)
 
 	createSyncObjects();
@@ -42,12 +75,26 @@ void RenderSystem::cleanup()
 {
 	std::cout << "Shutting down render system" << std::endl;
 	vkQueueWaitIdle(mContext->presentQueue);
+	mSoftwareOcclusion.wait();
 	
 	cleanupSwapchain();
+	cleanupColorPass();
+	cleanupShadowResources();
+	mShadowMapDescriptorSetLayout.reset();
+	mDeferredDescriptorSetLayout.reset();
 
 	for (auto& model : mRenderables) {
 		model->cleanup();
 	}
+	//the layouts are destroyed along with the last reference
+	for (auto& setLayout : mDescriptorSetLayouts) {
+		if (setLayout.second.updateTemplate != VK_NULL_HANDLE) {
+			mContext->destroyDescriptorUpdateTemplate(mContext->device, setLayout.second.updateTemplate, nullptr);
+		}
+	}
+	mDescriptorSetLayouts.clear();
+	mMaterialLibrary->cleanup();
+	std::cout << "Object cache handed out existing samplers and layouts " << mObjectCache->getReuseCount() << " times" << std::endl;
 
 	while (!mMeshes.empty()) {
 		auto& mesh = mMeshes.back();
@@ -75,10 +122,14 @@ void RenderSystem::cleanup()
 		shader->free();
 		mShaders.pop_back();
 	}
+	mShaderVariants.clear();
 
 
-	//cleanup descriptorpool
-	vkDestroyDescriptorPool(mContext->device, mDescriptorPool, nullptr);
+	//cleanup descriptor pools
+	mDescriptorAllocator->cleanup();
+	for (auto& frameAllocator : mFrameDescriptorAllocators) {
+		frameAllocator.cleanup();
+	}
 	
 	//clean up synchronization constructs
 	for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
@@ -88,21 +139,69 @@ void RenderSystem::cleanup()
 		vkDestroyFence(mContext->device, mFrameFences[i], nullptr);
 	}
 
+	mOcclusionCuller->cleanup();
+
 	mCommandPool->cleanup();
 	mContext->cleanup();
 }
 
 void RenderSystem::drawFrame()
 {
+	//start rasterizing occluders on the worker threads while this thread waits on the GPU
+	if (mOcclusionCullingMode == OcclusionCullingMode::Software && mCamera) {
+		rasterizeOccluders();
+	}
+
 	vkWaitForFences(mContext->device, 1, &mFrameFences[mCurrentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	vkResetFences(mContext->device, 1, &mFrameFences[mCurrentFrame]);
+
+	//the sets this frame slot used last time around are done with
+	mFrameDescriptorAllocators[mCurrentFrame].reset();
+
+	//renderables start being drawn once their pipelines finish compiling
+	releaseRetiredPipelines(false);
+	collectRenderablePipelines(false);
 
 	//Get the next available image
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(mContext->device, mSwapchain->getVkSwapchain(), std::numeric_limits<uint64_t>::max(), mImageAvailableSemaphores[mCurrentFrame], VK_NULL_HANDLE, &imageIndex);
 
+	//the command buffer for this image may still be in use by an earlier frame
+	if (mImagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		vkWaitForFences(mContext->device, 1, &mImagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	mImagesInFlight[imageIndex] = mFrameFences[mCurrentFrame];
+
+	//only record the renderables that can be seen this frame (by the camera or, for shadows, the light)
+	cullRenderables();
+	if (mOcclusionCullingMode == OcclusionCullingMode::HiZ) {
+		mOcclusionCuller->updateObjects(static_cast<uint32_t>(mCurrentFrame), mOcclusionObjects);
+	}
+	updateLightClusters(imageIndex);
+	if (mDeferredShading) {
+		updateDeferredLightingUBO(imageIndex);
+	}
+	updateShadowCache();
+
+	//the receivers read the copy of this swapchain image, which has to hold the matrices the cached views were rendered with
+	void* shadowData;
+	vkMapMemory(mContext->device, mShadowUBO->buffersMemory[imageIndex], 0, sizeof(ShadowUBO), 0, &shadowData);
+	memcpy(shadowData, &mShadowData, sizeof(ShadowUBO));
+	vkUnmapMemory(mContext->device, mShadowUBO->buffersMemory[imageIndex]);
+	bool shadowPass = !mRefreshedShadowViews.empty() || mRefreshPointShadows;
+	if (shadowPass) {
+		recordShadowCommandBuffer(imageIndex);
+	}
+
+	//the last frame that used this image is done, so its query has a result
+	readPipelineStatistics(imageIndex);
+	recordCommandBuffer(imageIndex);
+	mStatisticsPending[imageIndex] = true;
+
+	vkResetFences(mContext->device, 1, &mFrameFences[mCurrentFrame]);
+
 	/*
 	Pass 1: Shadows
+	Skipped when every shadow view is still valid, the color pass then waits on the image directly
 	*/
 
 	VkSubmitInfo shadowSubmitInfo = {};
@@ -125,7 +224,7 @@ void RenderSystem::drawFrame()
 	shadowSubmitInfo.signalSemaphoreCount = 1;
 	shadowSubmitInfo.pSignalSemaphores = shadowSignalSemaphores;
 
-	if (vkQueueSubmit(mContext->graphicsQueue, 1, &shadowSubmitInfo, mFrameFences[mCurrentFrame]) != VK_SUCCESS) {
+	if (shadowPass && vkQueueSubmit(mContext->graphicsQueue, 1, &shadowSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
 
@@ -140,7 +239,7 @@ void RenderSystem::drawFrame()
 	//Semaphores for waiting to submit
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = shadowSignalSemaphores;
+	submitInfo.pWaitSemaphores = shadowPass ? shadowSignalSemaphores : shadowWaitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	//Draw Command Buffer
@@ -152,7 +251,8 @@ void RenderSystem::drawFrame()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(mContext->graphicsQueue, 1, &submitInfo, /*mFrameFences[mCurrentFrame]*/ NULL) != VK_SUCCESS) {
+	//the frame fence goes on the last submission, since that is when the command buffers are free to re-record
+	if (vkQueueSubmit(mContext->graphicsQueue, 1, &submitInfo, mFrameFences[mCurrentFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
 
@@ -179,7 +279,15 @@ void RenderSystem::drawFrame()
 		throw std::runtime_error("Failed to acquire swapchain image!");
 	}
 
+	//pipeline compilation dominates startup, so this shows what the pipeline cache saves
+	if (!mFirstFramePresented) {
+		std::chrono::duration<float, std::milli> startupTime = std::chrono::steady_clock::now() - mInitializeTime;
+		std::cout << "First frame presented " << startupTime.count() << " ms after initialization" << std::endl;
+		mFirstFramePresented = true;
+	}
+
 	mCurrentFrame = (mCurrentFrame + 1) % MAX_CONCURRENT_FRAMES;
+	mFrameNumber++;
 }
 
 void RenderSystem::createSwapchain()
@@ -188,28 +296,41 @@ void RenderSystem::createSwapchain()
 	mSwapchain->initialize(mContext->surface, MAX_CONCURRENT_FRAMES);
 }
 
-void RenderSystem::recreateSwapchain()
+void RenderSystem::recreateSwapchain(bool rebuildColorPass)
 {
+	auto startTime = std::chrono::steady_clock::now();
 	vkDeviceWaitIdle(mContext->device);
 
+	VkFormat previousFormat = mSwapchain->getImageFormat();
 	cleanupSwapchain();
 	createSwapchain();
 
-	//Set up the shadowMap renderpass
-	createShadowMap();
-	createShadowRenderPass(mShadowMap);
-	createShadowFramebuffers(mShadowRenderPass, mShadowMap.imageView);
-	createShadowMapPipeline();
+	//viewport and scissor are dynamic, so a resize alone keeps the render passes and pipelines
+	rebuildColorPass = rebuildColorPass || mSwapchain->getImageFormat() != previousFormat;
+	if (rebuildColorPass) {
+		cleanupColorPass();
+		createColorPass();
+	}
+
+	//the shadow map doesn't depend on the window size, only its command buffers are per swapchain image
 	createShadowCommandBuffers();
 
-	createColorRenderPass();
-	for (auto& model : mRenderables) {
-		createPipeline(model->mPipeline, model->mPipelineLayout, model->mDescriptorSetLayout, model->mShaderSet.createShaderInfoSet(), mColorPass);
-	}
 	createDepthBuffer();
+	if (mDeferredShading) {
+		createGBuffer();
+		writeDeferredDescriptorSets();
+	}
 
 	createFramebuffers(mColorPass);
+	createStatisticsQueryPool();
 	createCommandBuffers();
+
+	//the device is idle, so no image is in use by a frame anymore
+	mImagesInFlight.assign(mSwapchain->size(), VK_NULL_HANDLE);
+
+	std::chrono::duration<float, std::milli> stallTime = std::chrono::steady_clock::now() - startTime;
+	std::cout << "Swapchain recreated in " << stallTime.count() << " ms"
+			  << (rebuildColorPass ? " (pipelines rebuilt)" : "") << std::endl;
 }
 
 void RenderSystem::cleanupSwapchain()
@@ -217,6 +338,7 @@ void RenderSystem::cleanupSwapchain()
 	vkDestroyImageView(mContext->device, mDepthImageView, nullptr);
 	vkDestroyImage(mContext->device, mDepthImage, nullptr);
 	vkFreeMemory(mContext->device, mDepthImageMemory, nullptr);
+	cleanupGBuffer();
 
 	for (auto framebuffer : mSwapchainFramebuffers) {
 		vkDestroyFramebuffer(mContext->device, framebuffer, nullptr);
@@ -224,38 +346,107 @@ void RenderSystem::cleanupSwapchain()
 
 	mCommandPool->freeCommandBuffers(mCommandBuffers);
 
+	vkDestroyQueryPool(mContext->device, mStatisticsQueryPool, nullptr);
+	mStatisticsQueryPool = VK_NULL_HANDLE;
+	mOcclusionCuller->cleanupDepthPyramid();
+
+
+	mCommandPool->freeCommandBuffers(mShadowCommandBuffers);
+
+	mSwapchain->cleanup();
+}
+
+void RenderSystem::createColorPass()
+{
+	createColorRenderPass();
+	for (auto& model : mRenderables) {
+		createRenderablePipelines(model, false);
+	}
+	if (mDeferredShading) {
+		createDeferredLightingPipeline();
+	}
+
+	//the compiles still run side by side, but nothing pops in after a rebuild
+	collectRenderablePipelines(true);
+}
+
+void RenderSystem::cleanupColorPass()
+{
+	//compiles still running were made against this render pass
+	collectRenderablePipelines(true);
+	releaseRetiredPipelines(true);
+
+	//shared pipelines are destroyed along with the last reference
 	for (auto renderable : mRenderables) {
-		vkDestroyPipeline(mContext->device, renderable->mPipeline, nullptr);
-		vkDestroyPipelineLayout(mContext->device, renderable->mPipelineLayout, nullptr);
+		renderable->mPipeline.reset();
+		renderable->mDepthPipeline.reset();
+	}
+	if (mDeferredLightingPipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(mContext->device, mDeferredLightingPipeline, nullptr);
+		mDeferredLightingPipeline = VK_NULL_HANDLE;
+		mDeferredLightingPipelineLayout.reset();
 	}
 	vkDestroyRenderPass(mContext->device, mColorPass, nullptr);
+	mColorPass = VK_NULL_HANDLE;
+	if (mColorLatePass != VK_NULL_HANDLE) {
+		vkDestroyRenderPass(mContext->device, mColorLatePass, nullptr);
+		mColorLatePass = VK_NULL_HANDLE;
+	}
+}
+
+void RenderSystem::createShadowResources()
+{
+	createShadowMap();
+	createShadowRenderPass(mShadowMap.imageFormat, VK_ATTACHMENT_LOAD_OP_LOAD, mShadowRenderPass);
+	createShadowFramebuffers(mShadowRenderPass, mShadowMap);
+	createShadowMapPipeline();
 
+	//the cubes are always re-rendered together, so they start from a clear
+	createShadowRenderPass(mShadowMap.imageFormat, VK_ATTACHMENT_LOAD_OP_CLEAR, mPointShadowRenderPass);
+	createPointShadowFramebuffer();
+	createPointShadowPipeline();
+}
 
-	//cleanup the ShadowMap resources
+void RenderSystem::cleanupShadowResources()
+{
 	vkDestroySampler(mContext->device, mShadowMap.imageSampler, nullptr);
 	vkDestroyImageView(mContext->device, mShadowMap.imageView, nullptr);
+	for (auto layerView : mShadowMap.layerViews) {
+		vkDestroyImageView(mContext->device, layerView, nullptr);
+	}
 	vkDestroyImage(mContext->device, mShadowMap.image, nullptr);
 	vkFreeMemory(mContext->device, mShadowMap.imageMemory, nullptr);
 
+	vkDestroyImageView(mContext->device, mShadowMap.pointImageView, nullptr);
+	vkDestroyImageView(mContext->device, mShadowMap.pointLayersView, nullptr);
+	vkDestroyImage(mContext->device, mShadowMap.pointImage, nullptr);
+	vkFreeMemory(mContext->device, mShadowMap.pointImageMemory, nullptr);
+	mShadowMap = ShadowMap();
+
 	for (auto framebuffer : mShadowFramebuffers) {
 		vkDestroyFramebuffer(mContext->device, framebuffer, nullptr);
 	}
-
-	mCommandPool->freeCommandBuffers(mShadowCommandBuffers);
+	mShadowFramebuffers.clear();
 
 	vkDestroyPipeline(mContext->device, mShadowMapPipeline, nullptr);
-	vkDestroyPipelineLayout(mContext->device, mShadowMapPipelineLayout, nullptr);
-	vkDestroyDescriptorSetLayout(mContext->device, mShadowMapDescriptorSetLayout, nullptr);
+	mShadowMapPipelineLayout.reset();
 
 	vkDestroyRenderPass(mContext->device, mShadowRenderPass, nullptr);
 
-	mSwapchain->cleanup();
+	vkDestroyFramebuffer(mContext->device, mPointShadowFramebuffer, nullptr);
+	vkDestroyPipeline(mContext->device, mPointShadowPipeline, nullptr);
+	mPointShadowPipelineLayout.reset();
+	vkDestroyRenderPass(mContext->device, mPointShadowRenderPass, nullptr);
 }
 
-void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout, 
-									VkDescriptorSetLayout& descriptorSetLayout, 
+void RenderSystem::createPipeline(VkPipeline& pipeline, SharedPipelineLayout& pipelineLayout, 
+									const std::vector<SharedDescriptorSetLayout>& setLayouts, 
 									const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages, 
-									VkRenderPass& renderPass)
+									VkRenderPass& renderPass,
+									const std::vector<VkPushConstantRange>& pushConstantRanges,
+									const std::vector<VkDynamicState>& dynamicStates,
+									const PipelineOutputState& outputState,
+									VkPipelineCreateFlags flags)
 {
 	std::cout << "Creating Graphics pipeline" << std::endl;
 
@@ -267,10 +458,12 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+	if (outputState.vertexInput) {
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+	}
 
 	//What kind of geometry primitives will be drawn from the vertices
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -279,26 +472,14 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
 	//ViewportState
-	//Where on the surface this pipeline will render to
-
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)mSwapchain->getExtent().width;
-	viewport.height = (float)mSwapchain->getExtent().height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = mSwapchain->getExtent();
-
+	//Where on the surface this pipeline will render to, set while recording (see setViewport())
+	//so the pipeline doesn't depend on the size of its target
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 
 
@@ -333,9 +514,9 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 	//not using for now, so just pass in nullptr
 	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;					//should the depth of new fragments be compared
-	depthStencil.depthWriteEnable = VK_TRUE;				//should the depth be written?	FALSE for transparent objects?
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;		//lower depth = closer convention
+	depthStencil.depthTestEnable = outputState.depthTest ? VK_TRUE : VK_FALSE;	//should the depth of new fragments be compared
+	depthStencil.depthWriteEnable = outputState.depthWrite ? VK_TRUE : VK_FALSE;	//should the depth be written?	FALSE for transparent objects?
+	depthStencil.depthCompareOp = outputState.depthCompareOp;						//LESS: lower depth = closer convention
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f;
 	depthStencil.maxDepthBounds = 1.0f;
@@ -359,8 +540,10 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlending.logicOpEnable = VK_FALSE;
 	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
+	//every attachment of the subpass (i.e. each G-buffer target) is written the same way
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(outputState.colorAttachmentCount, colorBlendAttachment);
+	colorBlending.attachmentCount = outputState.colorAttachmentCount;
+	colorBlending.pAttachments = colorBlendAttachments.empty() ? nullptr : colorBlendAttachments.data();
 	colorBlending.blendConstants[0] = 0.0f;
 	colorBlending.blendConstants[1] = 0.0f;
 	colorBlending.blendConstants[2] = 0.0f;
@@ -374,34 +557,28 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 
 
 	//Dynamic State
-	VkDynamicState dynamicStates[] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
-	};
+	//viewport and scissor are always dynamic, anything else is up to the caller
+	std::vector<VkDynamicState> pipelineDynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	for (VkDynamicState state : dynamicStates) {
+		if (std::find(pipelineDynamicStates.begin(), pipelineDynamicStates.end(), state) == pipelineDynamicStates.end())
+			pipelineDynamicStates.push_back(state);
+	}
 
 	VkPipelineDynamicStateCreateInfo dynamicState = {};
 	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = 2;
-	dynamicState.pDynamicStates = dynamicStates;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(pipelineDynamicStates.size());
+	dynamicState.pDynamicStates = pipelineDynamicStates.data();
 
 	//Pipeline Layout
-	//This is where you pass in uniform values
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1; 
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-	if (vkCreatePipelineLayout(mContext->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+	//This is where you pass in uniform values. Pipelines with the same set layouts and push constants share one
+	pipelineLayout = mObjectCache->getPipelineLayout(setLayouts, pushConstantRanges);
 
 
 	//Finally create the pipeline
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
 	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineCreateInfo.pNext = nullptr;
+	pipelineCreateInfo.flags = flags;
 	pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
 	pipelineCreateInfo.pStages = shaderStages.data();
 	pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
@@ -411,39 +588,48 @@ void RenderSystem::createPipeline(VkPipeline& pipeline, VkPipelineLayout& pipeli
 	pipelineCreateInfo.pMultisampleState = &multisampling;
 	pipelineCreateInfo.pDepthStencilState = &depthStencil;
 	pipelineCreateInfo.pColorBlendState = &colorBlending;
-	pipelineCreateInfo.pDynamicState = nullptr;
+	pipelineCreateInfo.pDynamicState = &dynamicState;
 	pipelineCreateInfo.pTessellationState = &tesselationState;
 
-	pipelineCreateInfo.layout = pipelineLayout;
+	pipelineCreateInfo.layout = *pipelineLayout;
 	pipelineCreateInfo.renderPass = renderPass;
-	pipelineCreateInfo.subpass = 0;
+	pipelineCreateInfo.subpass = outputState.subpass;
 
 	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineCreateInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(mContext->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS) {
+	if (vkCreateGraphicsPipelines(mContext->device, mContext->pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create a graphics pipeline!");
 	}
 }
 
 void RenderSystem::createShadowMapPipeline()
 {
-	mShadowMapShaderSet.vertShader = std::make_shared<Shader>(Shader(mContext));
-	createShader(mShadowMapShaderSet.vertShader, SHADOW_MAP_SHADER_VERT, VK_SHADER_STAGE_VERTEX_BIT);
-
-	createShadowMapDescriptorSetLayout();	//just one light for now
-	
+	//each caster's model matrix is pushed per draw, followed by the shadow view being rendered
+	std::vector<VkPushConstantRange> pushRanges = mShadowMapShaderSet.getInterface().pushConstantRanges;
 
-	//create the UBOs for shadow mapping
-	createUniformBuffer<glm::mat4>(mShadowCasterUBO, 1);
-
-	createShadowMapDescriptorSets();
-	
+	//atlas tiles are rendered by moving the viewport within a single render pass
 	createPipeline(mShadowMapPipeline, 
 					mShadowMapPipelineLayout, 
-					mShadowMapDescriptorSetLayout, 
+					{ mShadowMapDescriptorSetLayout }, 
 					mShadowMapShaderSet.createShaderInfoSet(), 
-					mShadowRenderPass);
+					mShadowRenderPass,
+					pushRanges);
+}
+
+void RenderSystem::createPointShadowPipeline()
+{
+	//the model matrix is read by the vertex shader, the cube and its face mask by the geometry shader
+	std::vector<VkPushConstantRange> pushRanges = mPointShadowShaderSet.getInterface().pushConstantRanges;
+
+	//the faces are rendered without the y flip (cube maps are addressed like OpenGL), which also
+	//reverses the winding, so back faces are what gets drawn. That keeps acne off lit surfaces
+	createPipeline(mPointShadowPipeline,
+					mPointShadowPipelineLayout,
+					{ mShadowMapDescriptorSetLayout },
+					mPointShadowShaderSet.createShaderInfoSet(),
+					mPointShadowRenderPass,
+					pushRanges);
 }
 
 void RenderSystem::createColorRenderPass()
@@ -458,6 +644,12 @@ void RenderSystem::createColorRenderPass()
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	//with occlusion culling, a second (late) pass continues drawing into the same attachments,
+	//and the depth buffer is read by compute in between
+	bool occlusionCulling = (mOcclusionCullingMode == OcclusionCullingMode::HiZ);
+	if (occlusionCulling)
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -475,53 +667,267 @@ void RenderSystem::createColorRenderPass()
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	if (occlusionCulling) {
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;							//reduced into the depth pyramid
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	}
+
 	VkAttachmentReference depthAttachmentRef = {};
 	depthAttachmentRef.attachment = 1;
 	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	//G-buffer, written by the geometry subpass and read back by the lighting subpass.
+	//Without HiZ it never leaves the render pass, so it is neither loaded nor stored
+	std::vector<VkAttachmentDescription> gBufferAttachments;
+	std::vector<VkAttachmentReference> gBufferOutputRefs;
+	std::vector<VkAttachmentReference> lightingInputRefs;
+	if (mDeferredShading) {
+		for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++) {
+			VkAttachmentDescription gBufferAttachment = {};
+			gBufferAttachment.format = GBUFFER_FORMATS[i];
+			gBufferAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			gBufferAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;		//pixels the geometry subpass misses are skipped by the lighting subpass
+			gBufferAttachment.storeOp = occlusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;	//the late pass adds to it
+			gBufferAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			gBufferAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			gBufferAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			gBufferAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			gBufferAttachments.push_back(gBufferAttachment);
+
+			VkAttachmentReference gBufferRef = {};
+			gBufferRef.attachment = 2 + i;
+			gBufferRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			gBufferOutputRefs.push_back(gBufferRef);
+
+			gBufferRef.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			lightingInputRefs.push_back(gBufferRef);
+		}
+
+		//positions are reconstructed from depth, so it is read as the last input attachment
+		VkAttachmentReference depthInputRef = {};
+		depthInputRef.attachment = 1;
+		depthInputRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		lightingInputRefs.push_back(depthInputRef);
+	}
+
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+	//with the depth pre-pass, a depth only subpass comes first and the shading subpass tests against it
+	VkSubpassDescription depthSubpass = {};
+	depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	depthSubpass.colorAttachmentCount = 0;
+	depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	//with deferred shading, the G-buffer is filled and lit before the shading subpass, which
+	//then only draws the renderables that are shaded forward (on top of the lit pixels)
+	VkSubpassDescription gBufferSubpass = {};
+	gBufferSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	gBufferSubpass.colorAttachmentCount = static_cast<uint32_t>(gBufferOutputRefs.size());
+	gBufferSubpass.pColorAttachments = gBufferOutputRefs.data();
+	gBufferSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	VkSubpassDescription lightingSubpass = {};
+	lightingSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	lightingSubpass.inputAttachmentCount = static_cast<uint32_t>(lightingInputRefs.size());
+	lightingSubpass.pInputAttachments = lightingInputRefs.data();
+	lightingSubpass.colorAttachmentCount = 1;
+	lightingSubpass.pColorAttachments = &colorAttachmentRef;
+
+	std::vector<VkSubpassDescription> subpasses;
+	if (mDeferredShading) {
+		subpasses.push_back(gBufferSubpass);
+		subpasses.push_back(lightingSubpass);
+	}
+	else if (usesDepthPrePass()) {
+		subpasses.push_back(depthSubpass);
+	}
+	subpasses.push_back(subpass);
+	uint32_t shadeSubpass = static_cast<uint32_t>(subpasses.size()) - 1;
+	uint32_t firstColorSubpass = mDeferredShading ? 1 : shadeSubpass;	//the first subpass to write the swapchain image
+
+	//the pre-pass depth has to be written before the shading subpass tests against it
+	VkSubpassDependency prePassDependency = {};
+	prePassDependency.srcSubpass = 0;
+	prePassDependency.dstSubpass = 1;
+	prePassDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prePassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	prePassDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prePassDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	prePassDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	//the lighting subpass only reads the G-buffer and depth at the pixel it shades
+	VkSubpassDependency geometryDependency = {};
+	geometryDependency.srcSubpass = 0;
+	geometryDependency.dstSubpass = 1;
+	geometryDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	geometryDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	geometryDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	geometryDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	geometryDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	//forward renderables test against the depth the lighting subpass read, and draw over the lit pixels
+	VkSubpassDependency forwardDependency = {};
+	forwardDependency.srcSubpass = 1;
+	forwardDependency.dstSubpass = 2;
+	forwardDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	forwardDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	forwardDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	forwardDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+										VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	forwardDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
 	//not necessary right now, but will come into play w/ multipass rendering
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	std::vector<VkSubpassDependency> dependencies;
+	VkSubpassDependency colorDependency = {};
+	colorDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	colorDependency.dstSubpass = firstColorSubpass;
+	colorDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	colorDependency.srcAccessMask = 0;
+	colorDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	colorDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies.push_back(colorDependency);
+
+	//the G-buffer and depth are overwritten while the last frame's lighting subpass may still read them
+	if (mDeferredShading) {
+		VkSubpassDependency gBufferDependency = {};
+		gBufferDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		gBufferDependency.dstSubpass = 0;
+		gBufferDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		gBufferDependency.srcAccessMask = 0;
+		gBufferDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		gBufferDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies.push_back(gBufferDependency);
+	}
+
+	//the depth buffer is cleared while the last frame's depth pyramid may still be reading it.
+	//The clear happens in the first subpass, which is the pre-pass if there is one
+	if (occlusionCulling) {
+		VkSubpassDependency depthDependency = {};
+		depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		depthDependency.dstSubpass = 0;
+		depthDependency.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		depthDependency.srcAccessMask = 0;
+		depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies.push_back(depthDependency);
+	}
+
+	if (usesDepthPrePass())
+		dependencies.push_back(prePassDependency);
+	if (mDeferredShading) {
+		dependencies.push_back(geometryDependency);
+		dependencies.push_back(forwardDependency);
+	}
+
+	//depth writes must be finished before the depth pyramid is built from them
+	//(in deferred mode, depth is written by the geometry and forward subpasses)
+	if (occlusionCulling) {
+		VkSubpassDependency pyramidDependency = {};
+		pyramidDependency.srcSubpass = shadeSubpass;
+		pyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		pyramidDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		pyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		pyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		pyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies.push_back(pyramidDependency);
+		if (mDeferredShading) {
+			pyramidDependency.srcSubpass = 0;
+			dependencies.push_back(pyramidDependency);
+		}
+	}
 
-	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+	std::vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment };
+	attachments.insert(attachments.end(), gBufferAttachments.begin(), gBufferAttachments.end());
 
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 	renderPassInfo.pAttachments = attachments.data();
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassInfo.pSubpasses = subpasses.data();
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 
 	if (vkCreateRenderPass(mContext->device, &renderPassInfo, nullptr, &mColorPass) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create render pass!");
 	}
+
+	if (!occlusionCulling)
+		return;
+
+	/*
+		Late pass: draws the objects the late occlusion test found, on top of the early pass.
+		Compatible with mColorPass, so the same framebuffers and pipelines are used.
+	*/
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	//the early pass' G-buffer is added to, then lit
+	for (auto& gBufferAttachment : gBufferAttachments) {
+		gBufferAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		gBufferAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		gBufferAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	attachments = { colorAttachment, depthAttachment };
+	attachments.insert(attachments.end(), gBufferAttachments.begin(), gBufferAttachments.end());
+
+	//wait for the early pass and for compute to finish reading the depth buffer
+	VkSubpassDependency lateDependency = {};
+	lateDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	lateDependency.dstSubpass = 0;
+	lateDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	lateDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	lateDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	lateDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+									VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	//the color attachment is first used by the shading (or lighting) subpass
+	dependencies = { lateDependency };
+	if (usesDepthPrePass() || mDeferredShading) {
+		lateDependency.dstSubpass = firstColorSubpass;
+		dependencies.push_back(lateDependency);
+	}
+	if (usesDepthPrePass())
+		dependencies.push_back(prePassDependency);
+	if (mDeferredShading) {
+		dependencies.push_back(geometryDependency);
+		dependencies.push_back(forwardDependency);
+	}
+
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(mContext->device, &renderPassInfo, nullptr, &mColorLatePass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create late render pass!");
+	}
 }
 
-void RenderSystem::createShadowRenderPass(const ShadowMap& shadowMap)
+void RenderSystem::createShadowRenderPass(VkFormat format, VkAttachmentLoadOp loadOp, VkRenderPass& renderPass)
 {
+	//with LOAD, views that didn't change are kept and refreshed views clear their own region
+	bool load = (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+
 	VkAttachmentDescription shadowAttachment = {};
-	shadowAttachment.format = shadowMap.imageFormat;
+	shadowAttachment.format = format;
 	shadowAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	shadowAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;					//clear to constant at start
+	shadowAttachment.loadOp = loadOp;
 	shadowAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;				//store for use in the next pass
 	shadowAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	shadowAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	shadowAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	shadowAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	shadowAttachment.initialLayout = load ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;	//every layer is put in the read only layout when the image is created
+	shadowAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;		//the layout receivers sample it in
 	shadowAttachment.flags = 0;
 
 	VkAttachmentReference shadowAttachmentRef = {};
@@ -545,80 +951,84 @@ void RenderSystem::createShadowRenderPass(const ShadowMap& shadowMap)
 	renderPassInfo.pNext = nullptr;
 	renderPassInfo.attachmentCount = 1;
 	renderPassInfo.pAttachments = &shadowAttachment;
+	//don't overwrite the map while the last frame's color pass may still sample it,
+	//and finish writing before this frame's color pass samples it
+	std::array<VkSubpassDependency, 2> dependencies = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 0;
-	renderPassInfo.pDependencies = nullptr;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 	renderPassInfo.flags = 0;
 
-	if (vkCreateRenderPass(mContext->device, &renderPassInfo, nullptr, &mShadowRenderPass) != VK_SUCCESS) {
+	if (vkCreateRenderPass(mContext->device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create shadow render pass!");
 	}
 }
 
-void RenderSystem::createDescriptorPool(uint32_t maxSets, uint32_t maxUniformBuffers, uint32_t maxImageSamplers)
+void RenderSystem::createDescriptorAllocators()
 {
-	assert(mSwapchain != nullptr);
-
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;			//#1: MVP matrices
-	poolSizes[0].descriptorCount = maxUniformBuffers;
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;	//#2: image + sampler
-	poolSizes[1].descriptorCount = maxImageSamplers;
-
-	VkDescriptorPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = mSwapchain->size() * maxSets;
+	std::vector<DescriptorPoolRatio> poolRatios = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4.0f },			//MVP matrices, lights, shadow views, cluster grid
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },			//light lists
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },	//shadow maps (material textures are in the MaterialLibrary)
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f }			//G-buffer reads, only in the lighting pass' sets
+	};
 
-	if (vkCreateDescriptorPool(mContext->device, &poolInfo, nullptr, &mDescriptorPool) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create descriptor pool!");
+	mDescriptorAllocator = std::make_unique<DescriptorAllocator>(mContext, poolRatios, DESCRIPTOR_POOL_SETS);
+	for (int frame = 0; frame < MAX_CONCURRENT_FRAMES; frame++) {
+		mFrameDescriptorAllocators.emplace_back(mContext, poolRatios, DESCRIPTOR_POOL_SETS);
 	}
 }
 
+VkDescriptorSet RenderSystem::allocateFrameDescriptorSet(VkDescriptorSetLayout setLayout)
+{
+	return mFrameDescriptorAllocators[mCurrentFrame].allocate(setLayout);
+}
+
 void RenderSystem::createShadowMapDescriptorSetLayout()
 {
 	//Set up a descriptorsetlayout/descriptorset for the shadowMap
 	VkDescriptorSetLayoutBinding layoutBinding = {};
-	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		//we're taking in a UBO w/ a MVP matrix
-	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		//we're taking in a UBO w/ the light's view-projection matrices
+	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;	//the point shadow geometry shader reads the cube faces
 	layoutBinding.binding = 0;
 	layoutBinding.descriptorCount = 1;
 	layoutBinding.pImmutableSamplers = nullptr;
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 1;
-	layoutInfo.pBindings = &layoutBinding;
-
-	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &mShadowMapDescriptorSetLayout) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create descriptor set layout!");
-	}
+	mShadowMapDescriptorSetLayout = mObjectCache->getDescriptorSetLayout({ layoutBinding });
 }
 
 void RenderSystem::createShadowMapDescriptorSets()
 {
-	std::vector<VkDescriptorSetLayout> layouts(mSwapchain->size(), mShadowMapDescriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = mDescriptorPool;
-	allocInfo.descriptorSetCount = mSwapchain->size();
-	allocInfo.pSetLayouts = layouts.data();
-
+	//one per swapchain image, like the shadow UBO's buffers
 	mShadowMapDescriptorSets.resize(mSwapchain->size());
-	VkResult result = vkAllocateDescriptorSets(mContext->device, &allocInfo, &mShadowMapDescriptorSets[0]);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate shadow map descriptor set!");
+	for (auto& descriptorSet : mShadowMapDescriptorSets) {
+		descriptorSet = mDescriptorAllocator->allocate(*mShadowMapDescriptorSetLayout);
 	}
 
 
 	//assign a UBO to this descriptor (just one for now)
 	for (size_t i = 0; i < mSwapchain->size(); i++) {
 		VkDescriptorBufferInfo bufferInfo;
-		bufferInfo.buffer = mShadowCasterUBO->buffers[i];
+		bufferInfo.buffer = mShadowUBO->buffers[i];
 		bufferInfo.offset = 0;
-		bufferInfo.range = mShadowCasterUBO->bufferSize;
+		bufferInfo.range = mShadowUBO->bufferSize;
 
 		VkWriteDescriptorSet bufferDescriptorWrite = {};
 		bufferDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -641,11 +1051,18 @@ void RenderSystem::createFramebuffers(VkRenderPass renderPass)
 
 	mSwapchainFramebuffers.resize(swapchainImageViews.size());
 	for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-		std::array<VkImageView, 2> attachments = {
+		std::vector<VkImageView> attachments = {
 			swapchainImageViews[i],
 			mDepthImageView
 		};
 
+		//every swapchain image shares the G-buffer, like the depth buffer
+		if (mDeferredShading) {
+			for (const auto& gBufferAttachment : mGBuffer.attachments) {
+				attachments.push_back(gBufferAttachment.view);
+			}
+		}
+
 		VkFramebufferCreateInfo framebufferInfo = {};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.pNext = nullptr;
@@ -663,11 +1080,11 @@ void RenderSystem::createFramebuffers(VkRenderPass renderPass)
 	}
 }
 
-void RenderSystem::createShadowFramebuffers(VkRenderPass shadowRenderPass, VkImageView shadowImageView)
+void RenderSystem::createShadowFramebuffers(VkRenderPass shadowRenderPass, const ShadowMap& shadowMap)
 {
 	std::cout << "Creating Shadow Framebuffer" << std::endl;
 
-	mShadowFramebuffers.resize(mSwapchain->size());
+	mShadowFramebuffers.resize(shadowMap.layerCount);
 	for (size_t i = 0; i < mShadowFramebuffers.size(); i++)
 	{
 		VkFramebufferCreateInfo framebufferInfo = {};
@@ -675,9 +1092,9 @@ void RenderSystem::createShadowFramebuffers(VkRenderPass shadowRenderPass, VkIma
 		framebufferInfo.pNext = nullptr;
 		framebufferInfo.renderPass = shadowRenderPass;
 		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = &shadowImageView;
-		framebufferInfo.width = mSwapchain->getExtent().width;
-		framebufferInfo.height = mSwapchain->getExtent().height;
+		framebufferInfo.pAttachments = &shadowMap.layerViews[i];
+		framebufferInfo.width = shadowMap.extent.width;
+		framebufferInfo.height = shadowMap.extent.height;
 		framebufferInfo.layers = 1;
 		framebufferInfo.flags = 0;
 
@@ -687,9 +1104,63 @@ void RenderSystem::createShadowFramebuffers(VkRenderPass shadowRenderPass, VkIma
 	}
 }
 
-void RenderSystem::setLightMVPBuffer(const glm::mat4 & mvp)
+void RenderSystem::createPointShadowFramebuffer()
+{
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = mPointShadowRenderPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &mShadowMap.pointLayersView;
+	framebufferInfo.width = mShadowMap.pointExtent.width;
+	framebufferInfo.height = mShadowMap.pointExtent.height;
+	framebufferInfo.layers = mShadowMap.pointLayerCount;		//gl_Layer picks the face
+
+	if (vkCreateFramebuffer(mContext->device, &framebufferInfo, nullptr, &mPointShadowFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create point shadow framebuffer!");
+	}
+}
+
+void RenderSystem::setShadowLights(const std::vector<ShadowLight>& lights)
+{
+	//the views follow the camera, so they are laid out in cullShadowCasters() every frame
+	mShadowLights = lights;
+}
+
+void RenderSystem::setShadowSettings(const ShadowSettings& settings)
 {
-	updateUniformBuffer<glm::mat4>(*mShadowCasterUBO, mvp, 0);
+	if (settings.cascadeCount < 1 || settings.cascadeCount > MAX_SHADOW_CASCADES)
+		throw std::runtime_error("Shadow cascade count must be between 1 and MAX_SHADOW_CASCADES!");
+	if (settings.minAtlasTileSize == 0 || settings.minAtlasTileSize > settings.resolution)
+		throw std::runtime_error("Shadow atlas tiles must be between 1 texel and the shadow map resolution!");
+	if (settings.depthFormat != VK_FORMAT_D16_UNORM && settings.depthFormat != VK_FORMAT_D32_SFLOAT)
+		throw std::runtime_error("Shadow depth format must be VK_FORMAT_D16_UNORM or VK_FORMAT_D32_SFLOAT!");
+
+	//caching and refresh rates don't change the shadow map itself
+	bool recreate = settings.resolution != mShadowSettings.resolution ||
+					settings.depthFormat != mShadowSettings.depthFormat ||
+					settings.cascadeCount != mShadowSettings.cascadeCount ||
+					settings.minAtlasTileSize != mShadowSettings.minAtlasTileSize ||
+					settings.pointResolution != mShadowSettings.pointResolution;
+	mShadowSettings = settings;
+	mShadowViewCache.assign(mShadowViewCache.size(), ShadowViewCache());
+	mPointShadowsValid = false;
+	if (!recreate)
+		return;
+
+	vkDeviceWaitIdle(mContext->device);
+	cleanupShadowResources();
+	createShadowResources();
+
+	//receivers still point at the old image
+	for (auto& renderable : mRenderables) {
+		renderable->updateShadowMap(mShadowMap);
+	}
+	mCommandPool->freeCommandBuffers(mShadowCommandBuffers);
+	createShadowCommandBuffers();
+
+	if (mDeferredShading) {
+		writeDeferredDescriptorSets();
+	}
 }
 
 void RenderSystem::createCommandBuffers()
@@ -699,220 +1170,1528 @@ void RenderSystem::createCommandBuffers()
 	mCommandBuffers.resize(mSwapchainFramebuffers.size());
 	mCommandPool->allocateCommandBuffers(mCommandBuffers, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
-	//record into the command buffers
-	for (size_t i = 0; i < mCommandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	//record into the command buffers, they are re-recorded every frame in drawFrame()
+	cullRenderables();
+	for (uint32_t i = 0; i < mCommandBuffers.size(); i++) {
+		recordCommandBuffer(i);
+	}
+}
 
-		if (vkBeginCommandBuffer(mCommandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("failed to begin recording command buffer!");
-		}
+void RenderSystem::recordCommandBuffer(uint32_t imageIndex)
+{
+	VkCommandBuffer commandBuffer = mCommandBuffers[imageIndex];
 
-		VkRenderPassBeginInfo colorPassInfo = {};
-		colorPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		colorPassInfo.pNext = nullptr;
-		colorPassInfo.renderPass = mColorPass;
-		colorPassInfo.framebuffer = mSwapchainFramebuffers[i];
-		colorPassInfo.renderArea.offset = { 0, 0 };
-		colorPassInfo.renderArea.extent = mSwapchain->getExtent();
-		
-		//set up clear values as part of renderPassInfo
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = mClearColor.color;
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		colorPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		colorPassInfo.pClearValues = clearValues.data();
-
-		//begin the render pass
-		vkCmdBeginRenderPass(mCommandBuffers[i], &colorPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		for (auto& renderable : mRenderables) {
-			vkCmdBindPipeline(mCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderable->mPipeline);
-			drawRenderable(mCommandBuffers[i], renderable, renderable->mDescriptorSets[i]);
-		}
+	//occlusion culling needs a camera to project bounds with
+	bool hiZ = (mOcclusionCullingMode == OcclusionCullingMode::HiZ);
+	bool occlusionCulling = hiZ && mCamera;
+	glm::mat4 viewProj = mCamera ? mCamera->projMat * mCamera->viewMat : glm::mat4(1.0f);
+	uint32_t frameIndex = static_cast<uint32_t>(mCurrentFrame);
 
-		vkCmdEndRenderPass(mCommandBuffers[i]);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0;
 
-		if (vkEndCommandBuffer(mCommandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
-		}
+	//beginning implicitly resets the buffer (the pool is created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT)
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
 	}
-}
-
-void RenderSystem::createShadowCommandBuffers()
-{
-	mShadowCommandBuffers.resize(mShadowFramebuffers.size());
-	mCommandPool->allocateCommandBuffers(mShadowCommandBuffers, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
-	//record into the command buffers
-	for (size_t i = 0; i < mShadowCommandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	//early phase: everything that was visible last frame
+	if (occlusionCulling) {
+		mOcclusionCuller->recordCull(commandBuffer, frameIndex, viewProj, false);
+	}
 
-		if (vkBeginCommandBuffer(mShadowCommandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("failed to begin recording shadow command buffer!");
+	VkRenderPassBeginInfo colorPassInfo = {};
+	colorPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	colorPassInfo.pNext = nullptr;
+	colorPassInfo.renderPass = mColorPass;
+	colorPassInfo.framebuffer = mSwapchainFramebuffers[imageIndex];
+	colorPassInfo.renderArea.offset = { 0, 0 };
+	colorPassInfo.renderArea.extent = mSwapchain->getExtent();
+
+	//set up clear values as part of renderPassInfo
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = mClearColor.color;
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	colorPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	colorPassInfo.pClearValues = clearValues.data();
+
+	//counts every draw of the color pass, both phases included
+	vkCmdResetQueryPool(commandBuffer, mStatisticsQueryPool, imageIndex, 1);
+	vkCmdBeginQuery(commandBuffer, mStatisticsQueryPool, imageIndex, 0);
+
+	//begin the render pass
+	vkCmdBeginRenderPass(commandBuffer, &colorPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	setViewport(commandBuffer, colorPassInfo.renderArea);	//still set for the late pass, nothing in between binds graphics state
+	drawColorPhase(commandBuffer, imageIndex, occlusionCulling, false);
+	vkCmdEndRenderPass(commandBuffer);
+
+	//late phase: build the pyramid from the early depth, then draw whatever the early phase missed.
+	//The late pass always runs in HiZ mode since it transitions the image for presentation
+	if (hiZ) {
+		if (occlusionCulling) {
+			mOcclusionCuller->recordDepthPyramid(commandBuffer);
+			mOcclusionCuller->recordCull(commandBuffer, frameIndex, viewProj, true);
 		}
 
-		/*
-		Shadow Pass
-		*/
-		VkClearValue shadowClearValues[1];
-		shadowClearValues[0].depthStencil.depth = 1.0f;
-		shadowClearValues[0].depthStencil.stencil = 0;
-
-		VkRenderPassBeginInfo shadowPassInfo = {};
-		shadowPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		shadowPassInfo.pNext = nullptr;
-		shadowPassInfo.renderPass = mShadowRenderPass;
-		shadowPassInfo.framebuffer = mShadowFramebuffers[i];
-		shadowPassInfo.renderArea.offset = { 0, 0 };
-		shadowPassInfo.renderArea.extent = mSwapchain->getExtent();		//may be too big
-		shadowPassInfo.clearValueCount = 1;
-		shadowPassInfo.pClearValues = shadowClearValues;
-
-		vkCmdBeginRenderPass(mShadowCommandBuffers[i], &shadowPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		/*
-		VkViewport viewport;
-		viewport.height = SHADOW_MAP_HEIGHT;
-		viewport.width = SHADOW_MAP_WIDTH;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		viewport.x = 0;
-		viewport.y = 0;
-		vkCmdSetViewport(shadow_map_cmd_buf, 0, 1, &viewport);
-
-		VkRect2D scissor;
-		scissor.extent.width = SHADOW_MAP_WIDTH;
-		scissor.extent.height = SHADOW_MAP_HEIGHT;
-		scissor.offset.x = 0;
-		scissor.offset.y = 0;
-		vkCmdSetScissor(shadow_map_cmd_buf, 0, 1, &scissor);
-		*/
-
-		vkCmdBindPipeline(mShadowCommandBuffers[i],
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			mShadowMapPipeline);
+		colorPassInfo.renderPass = mColorLatePass;
+		colorPassInfo.clearValueCount = 0;
+		colorPassInfo.pClearValues = nullptr;
 
-		for (auto& renderable : mRenderables) {
-			VkBuffer vertexBuffers[1] = { renderable->mMesh->getVertexBuffer() };
-			VkDeviceSize offsets[] = { 0 };
+		//deferred shading always lights the pixels here, whether or not there is late geometry
+		vkCmdBeginRenderPass(commandBuffer, &colorPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (occlusionCulling || mDeferredShading) {
+			drawColorPhase(commandBuffer, imageIndex, occlusionCulling, true);
+		}
+		else if (usesDepthPrePass()) {
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-			vkCmdBindVertexBuffers(mShadowCommandBuffers[i], 0, 1, vertexBuffers, offsets);
+	vkCmdEndQuery(commandBuffer, mStatisticsQueryPool, imageIndex);
 
-			vkCmdBindIndexBuffer(mShadowCommandBuffers[i],
-				renderable->mMesh->getIndexBuffer(),
-				0, VK_INDEX_TYPE_UINT32);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
 
-			vkCmdBindDescriptorSets(mShadowCommandBuffers[i],
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				mShadowMapPipelineLayout,
-				0, 1,
-				&mShadowMapDescriptorSets[i],
-				0, nullptr);
+void RenderSystem::drawColorPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool indirect, bool latePass)
+{
+	if (mDeferredShading) {
+		//a late pass without occlusion culling has no geometry of its own
+		if (!latePass || indirect) {
+			drawVisibleRenderables(commandBuffer, imageIndex, indirect, latePass, RenderablePass::GBuffer);
+		}
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+		//with HiZ, lighting waits for the late pass so every pixel is lit once
+		bool finalPhase = latePass || mOcclusionCullingMode != OcclusionCullingMode::HiZ;
+		if (finalPhase) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mDeferredLightingPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *mDeferredLightingPipelineLayout, 0, 1, &mDeferredDescriptorSets[imageIndex], 0, nullptr);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		}
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
-			//Draw our model
-			vkCmdDrawIndexed(mShadowCommandBuffers[i], renderable->mMesh->getIndexCount(), 1, 0, 0, 0);
+		if (finalPhase) {
+			drawVisibleRenderables(commandBuffer, imageIndex, indirect, false, RenderablePass::Forward);
+			if (indirect) {
+				drawVisibleRenderables(commandBuffer, imageIndex, indirect, true, RenderablePass::Forward);
+			}
 		}
+		return;
+	}
 
-		vkCmdEndRenderPass(mShadowCommandBuffers[i]);
+	if (usesDepthPrePass()) {
+		drawVisibleRenderables(commandBuffer, imageIndex, indirect, latePass, RenderablePass::DepthOnly);
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	}
+	drawVisibleRenderables(commandBuffer, imageIndex, indirect, latePass);
+}
 
-		if (vkEndCommandBuffer(mShadowCommandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record shadow command buffer!");
+void RenderSystem::drawVisibleRenderables(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool indirect, bool latePass, RenderablePass pass)
+{
+	//every renderable pipeline has the material set's layout at set 0, so it stays bound for the whole subpass
+	//(the deferred lighting pipeline's set 0 replaces it, hence binding it again for each call)
+	mMaterialLibrary->bind(commandBuffer);
+
+	for (uint32_t index : mVisibleRenderables) {
+		auto& renderable = mRenderables[index];
+		if (!isDrawable(renderable))
+			continue;
+
+		//in deferred mode, each renderable is drawn in either the geometry or the forward subpass
+		bool gBuffer = (renderable->mGBufferShader != nullptr);
+		if ((pass == RenderablePass::GBuffer && !gBuffer) || (pass == RenderablePass::Forward && gBuffer))
+			continue;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass == RenderablePass::DepthOnly ? renderable->mDepthPipeline->pipeline : renderable->mPipeline->pipeline);
+
+		if (indirect) {
+			bindRenderable(commandBuffer, renderable, imageIndex);
+			vkCmdDrawIndexedIndirect(commandBuffer,
+				mOcclusionCuller->getDrawBuffer(),
+				mOcclusionCuller->getDrawOffset(index, latePass),
+				1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else {
+			drawRenderable(commandBuffer, renderable, imageIndex);
 		}
 	}
 }
 
-void RenderSystem::drawRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, VkDescriptorSet& descriptorSet)
+void RenderSystem::createStatisticsQueryPool()
 {
-	//Set up draw info
-	VkBuffer vertexBuffers[1] = { model->mMesh->getVertexBuffer()};
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, model->mMesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, model->mPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolInfo.queryCount = static_cast<uint32_t>(mSwapchain->size());
+	queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+										VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	if (vkCreateQueryPool(mContext->device, &queryPoolInfo, nullptr, &mStatisticsQueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline statistics query pool!");
+	}
 
-	//Draw our model
-	vkCmdDrawIndexed(commandBuffer, model->mMesh->getIndexCount(), 1, 0, 0, 0);
+	mStatisticsPending.assign(mSwapchain->size(), false);
 }
 
-void RenderSystem::createSyncObjects()
+void RenderSystem::readPipelineStatistics(uint32_t imageIndex)
 {
-	std::cout << "Creating semaphores" << std::endl;
-	mImageAvailableSemaphores.resize(MAX_CONCURRENT_FRAMES);
-	mShadowMapAvailableSemaphores.resize(MAX_CONCURRENT_FRAMES);
-	mRenderFinishedSemaphores.resize(MAX_CONCURRENT_FRAMES);
-	mFrameFences.resize(MAX_CONCURRENT_FRAMES);
-	
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (!mStatisticsPending[imageIndex])
+		return;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	//results come back in the order of the statistic bits
+	std::array<uint64_t, 2> results = {};
+	VkResult result = vkGetQueryPoolResults(mContext->device, mStatisticsQueryPool, imageIndex, 1,
+		sizeof(results), results.data(), sizeof(results), VK_QUERY_RESULT_64_BIT);
 
-	for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
-	{
-		if(vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
-		   vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mShadowMapAvailableSemaphores[i]) != VK_SUCCESS ||
-		   vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(mContext->device, &fenceInfo, nullptr, &mFrameFences[i]) != VK_SUCCESS) 
-		{
-			throw std::runtime_error("Failed to create frame sync objects!");
-		}
+	if (result == VK_SUCCESS) {
+		mPipelineStatistics.valid = true;
+		mPipelineStatistics.vertexShaderInvocations = results[0];
+		mPipelineStatistics.fragmentShaderInvocations = results[1];
 	}
+	mStatisticsPending[imageIndex] = false;
 }
 
-
-
-void RenderSystem::createRenderable(std::shared_ptr<Renderable>& renderable)
+void RenderSystem::createShadowCommandBuffers()
 {
-	renderable = std::make_shared<Renderable>(Renderable(mContext));
+	mShadowCommandBuffers.resize(mSwapchain->size());
+	mCommandPool->allocateCommandBuffers(mShadowCommandBuffers, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+	//record into the command buffers, they are re-recorded every frame in drawFrame()
+	cullRenderables();
+	for (uint32_t i = 0; i < mShadowCommandBuffers.size(); i++) {
+		recordShadowCommandBuffer(i);
+	}
 }
 
-void RenderSystem::instantiateRenderable(std::shared_ptr<Renderable>& renderable)
+void RenderSystem::recordShadowCommandBuffer(uint32_t imageIndex)
 {
-	renderable->createDescriptorSetLayout();
-	renderable->createDescriptorSets(mDescriptorPool, mSwapchain->size());
+	VkCommandBuffer commandBuffer = mShadowCommandBuffers[imageIndex];
 
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0;
 
-	createPipeline(renderable->mPipeline, renderable->mPipelineLayout,
-		renderable->mDescriptorSetLayout,
-		renderable->mShaderSet.createShaderInfoSet(),
-		mColorPass);
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording shadow command buffer!");
+	}
 
-	mRenderables.push_back(renderable);
+	/*
+	Shadow Pass
+	*/
+	VkRenderPassBeginInfo shadowPassInfo = {};
+	shadowPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	shadowPassInfo.pNext = nullptr;
+	shadowPassInfo.renderPass = mShadowRenderPass;
+	shadowPassInfo.renderArea.offset = { 0, 0 };
+	shadowPassInfo.renderArea.extent = mShadowMap.extent;
+	shadowPassInfo.clearValueCount = 0;
+	shadowPassInfo.pClearValues = nullptr;
+
+	//one pass per cascade, each rendering into its own layer. Unused layers are left
+	//alone, they were put in a sampleable layout when the shadow map was created
+	bool atlasRefreshed = false;
+	VkRect2D layerRegion = { { 0, 0 }, mShadowMap.extent };
+	for (uint32_t view : mRefreshedShadowViews) {
+		if (view >= mCascadeViewCount) {
+			atlasRefreshed = true;
+			continue;
+		}
 
-	//recreate the command buffers to include the new model
-	createShadowCommandBuffers();
-	createCommandBuffers();
-}
+		shadowPassInfo.framebuffer = mShadowFramebuffers[view];
+		vkCmdBeginRenderPass(commandBuffer, &shadowPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		bindShadowPipeline(commandBuffer, imageIndex);
+		drawShadowCasters(commandBuffer, view, layerRegion);
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-void RenderSystem::createTexture(std::shared_ptr<Texture>& texture, const std::string &filename)
-{
-	std::cout << "Creating texture \"" << filename << "\"" << std::endl;
-	int width, height, channels;
-	stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	//every refreshed spot light shares one pass over the atlas layer
+	if (atlasRefreshed) {
+		shadowPassInfo.framebuffer = mShadowFramebuffers[mShadowMap.atlasLayer];
+		vkCmdBeginRenderPass(commandBuffer, &shadowPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		bindShadowPipeline(commandBuffer, imageIndex);
 
-	if (!pixels) {
-		throw std::runtime_error("Failed to load texture image");
+		for (uint32_t view : mRefreshedShadowViews) {
+			if (view < mCascadeViewCount)
+				continue;
+
+			const ShadowAtlasTile& tile = mAtlasTiles[view - mCascadeViewCount];
+			VkRect2D tileRegion = { { (int32_t)tile.x, (int32_t)tile.y }, { tile.size, tile.size } };
+			drawShadowCasters(commandBuffer, view, tileRegion);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
 	}
 
-	texture = std::make_shared<Texture>(Texture(mContext, mBufferManager, mImageManager));
-	texture->load(pixels, width, height, channels);
-	stbi_image_free(pixels);
+	//every cube face is drawn in one pass, the geometry shader sends each triangle to the faces it touches
+	if (mRefreshPointShadows) {
+		VkClearValue clearValue = {};
+		clearValue.depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo pointPassInfo = {};
+		pointPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		pointPassInfo.renderPass = mPointShadowRenderPass;
+		pointPassInfo.framebuffer = mPointShadowFramebuffer;
+		pointPassInfo.renderArea.offset = { 0, 0 };
+		pointPassInfo.renderArea.extent = mShadowMap.pointExtent;
+		pointPassInfo.clearValueCount = 1;
+		pointPassInfo.pClearValues = &clearValue;
+
+		vkCmdBeginRenderPass(commandBuffer, &pointPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		setViewport(commandBuffer, pointPassInfo.renderArea);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPointShadowPipeline);
+		vkCmdBindDescriptorSets(commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			*mPointShadowPipelineLayout,
+			0, 1,
+			&mShadowMapDescriptorSets[imageIndex],
+			0, nullptr);
+
+		for (uint32_t cube = 0; cube < mPointShadowCount; cube++) {
+			for (const auto& caster : mPointShadowCasters[cube]) {
+				auto& renderable = mRenderables[caster.renderable];
+				VkBuffer vertexBuffers[1] = { renderable->mMesh->getVertexBuffer() };
+				VkDeviceSize offsets[] = { 0 };
+
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+				vkCmdBindIndexBuffer(commandBuffer,
+					renderable->mMesh->getIndexBuffer(),
+					0, VK_INDEX_TYPE_UINT32);
+
+				struct {
+					glm::mat4 model;
+					uint32_t cube;
+					uint32_t faceMask;
+				} pushData = { renderable->mModelMatrix, cube, caster.faceMask };
+
+				vkCmdPushConstants(commandBuffer,
+					*mPointShadowPipelineLayout,
+					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT,
+					0, sizeof(pushData),
+					&pushData);
+
+				vkCmdDrawIndexed(commandBuffer, renderable->mMesh->getIndexCount(), 1, 0, 0, 0);
+			}
+		}
 
-	mTextures.push_back(texture);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record shadow command buffer!");
+	}
 }
 
-void RenderSystem::createMesh(std::shared_ptr<Mesh>& mesh, const std::string & filename, bool calculateTangents)
+void RenderSystem::bindShadowPipeline(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
-	std::cout << "creating mesh \"" << filename << "\"" << std::endl;
+	vkCmdBindPipeline(commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		mShadowMapPipeline);
+
+	//set 0 only holds the shadow views, so it is bound once for every caster
+	vkCmdBindDescriptorSets(commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		*mShadowMapPipelineLayout,
+		0, 1,
+		&mShadowMapDescriptorSets[imageIndex],
+		0, nullptr);
+}
 
-	std::vector<Vertex> vertices;
+void RenderSystem::setViewport(VkCommandBuffer commandBuffer, const VkRect2D& region)
+{
+	VkViewport viewport = { (float)region.offset.x, (float)region.offset.y,
+							(float)region.extent.width, (float)region.extent.height, 0.0f, 1.0f };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &region);
+}
+
+void RenderSystem::drawShadowCasters(VkCommandBuffer commandBuffer, uint32_t view, const VkRect2D& region)
+{
+	setViewport(commandBuffer, region);
+
+	//the render pass loads the old contents, so only this view's region is reset
+	VkClearAttachment clearAttachment = {};
+	clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	clearAttachment.colorAttachment = 0;
+	clearAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+	VkClearRect clearRect = {};
+	clearRect.rect = region;
+	clearRect.baseArrayLayer = 0;
+	clearRect.layerCount = 1;
+	vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+
+	vkCmdPushConstants(commandBuffer,
+		*mShadowMapPipelineLayout,
+		VK_SHADER_STAGE_VERTEX_BIT,
+		sizeof(glm::mat4), sizeof(uint32_t),
+		&view);
+
+	for (uint32_t index : mShadowCasters[view]) {
+		auto& renderable = mRenderables[index];
+		VkBuffer vertexBuffers[1] = { renderable->mMesh->getVertexBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer,
+			renderable->mMesh->getIndexBuffer(),
+			0, VK_INDEX_TYPE_UINT32);
+
+		//the light's view-projection is shared, only the model matrix changes per caster
+		vkCmdPushConstants(commandBuffer,
+			*mShadowMapPipelineLayout,
+			VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(glm::mat4),
+			&renderable->mModelMatrix);
+
+		//Draw our model
+		vkCmdDrawIndexed(commandBuffer, renderable->mMesh->getIndexCount(), 1, 0, 0, 0);
+	}
+}
+
+void RenderSystem::bindRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, uint32_t imageIndex)
+{
+	//Set up draw info
+	VkBuffer vertexBuffers[1] = { model->mMesh->getVertexBuffer()};
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, model->mMesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	switch (model->mDescriptorMode)
+	{
+	case DescriptorMode::Pushed:
+		mContext->cmdPushDescriptorSetWithTemplate(commandBuffer, model->mUpdateTemplate, model->mPipeline->layout, RENDERABLE_DESCRIPTOR_SET, model->getDescriptorData(imageIndex));
+		break;
+	case DescriptorMode::Transient:
+	{
+		VkDescriptorSet descriptorSet = allocateFrameDescriptorSet(*model->mDescriptorSetLayout);
+		mContext->updateDescriptorSetWithTemplate(mContext->device, descriptorSet, model->mUpdateTemplate, model->getDescriptorData(imageIndex));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, model->mPipeline->layout, RENDERABLE_DESCRIPTOR_SET, 1, &descriptorSet, 0, nullptr);
+		break;
+	}
+	default:
+	{
+		VkDescriptorSet descriptorSet = model->getDescriptorSet(imageIndex);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, model->mPipeline->layout, RENDERABLE_DESCRIPTOR_SET, 1, &descriptorSet, 0, nullptr);
+		break;
+	}
+	}
+	mMaterialLibrary->pushMaterial(commandBuffer, model->mMaterialIndex);
+}
+
+void RenderSystem::drawRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, uint32_t imageIndex)
+{
+	bindRenderable(commandBuffer, model, imageIndex);
+
+	//Draw our model
+	vkCmdDrawIndexed(commandBuffer, model->mMesh->getIndexCount(), 1, 0, 0, 0);
+}
+
+void RenderSystem::cullRenderables()
+{
+	mVisibleRenderables.clear();
+
+	//batch indices match mRenderables indices since every renderable is added in order.
+	//The bounds are gathered even without a camera, since shadow casters are culled with them
+	mWorldBounds.resize(mRenderables.size());
+	mCullingBatch.clear();
+	for (uint32_t i = 0; i < mRenderables.size(); i++) {
+		mWorldBounds[i] = mRenderables[i]->getWorldBounds();
+		mCullingBatch.add(mWorldBounds[i]);
+	}
+
+	if (!mCamera) {
+		for (uint32_t i = 0; i < mRenderables.size(); i++) {
+			mVisibleRenderables.push_back(i);
+		}
+		cullShadowCasters();
+		return;
+	}
+
+	Frustum frustum = Frustum::fromMatrix(mCamera->projMat * mCamera->viewMat);
+	mCullingBatch.cull(frustum, mVisibleRenderables);
+
+	//drop whatever is hidden behind the occluders rasterized at the start of the frame
+	if (mSoftwareOcclusion.wait()) {
+		auto hidden = [this](uint32_t index) { return !mSoftwareOcclusion.isVisible(mWorldBounds[index]); };
+		mVisibleRenderables.erase(std::remove_if(mVisibleRenderables.begin(), mVisibleRenderables.end(), hidden),
+									mVisibleRenderables.end());
+	}
+
+	if (mOcclusionCullingMode == OcclusionCullingMode::HiZ) {
+		//every renderable gets an entry, so objects leaving the frustum are marked as not visible
+		mOcclusionObjects.resize(mRenderables.size());
+		for (uint32_t i = 0; i < mRenderables.size(); i++) {
+			const Bounds& bounds = mWorldBounds[i];
+
+			OcclusionObject& object = mOcclusionObjects[i];
+			object.sphere = glm::vec4(bounds.sphere.center, bounds.sphere.radius);
+			object.extents = glm::vec4(bounds.box.extents, 0.0f);
+			object.indexCount = mRenderables[i]->mMesh->getIndexCount();
+			object.frustumVisible = 0;
+		}
+		for (uint32_t index : mVisibleRenderables) {
+			mOcclusionObjects[index].frustumVisible = 1;
+		}
+	}
+
+	cullShadowCasters();
+}
+
+void RenderSystem::cullShadowCasters()
+{
+	mShadowCasters.clear();
+	mPointShadowCasters.clear();
+	mRefreshedShadowViews.clear();
+	mRefreshPointShadows = false;
+	updateShadowViews();
+
+	//nothing on screen samples the shadow map, so there is no point filling it
+	mShadowReceiverVisible = std::any_of(mVisibleRenderables.begin(), mVisibleRenderables.end(),
+		[this](uint32_t index) { return mRenderables[index]->mReceivesShadow; });
+	if (!mShadowReceiverVisible)
+		return;
+
+	cullPointShadowCasters();
+
+	mShadowCasters.resize(mShadowViewCount);
+	for (uint32_t view = 0; view < mShadowViewCount; view++) {
+		mLightVisibleRenderables.clear();
+		mCullingBatch.cull(mLightFrustums[view], mLightVisibleRenderables);
+		for (uint32_t index : mLightVisibleRenderables) {
+			if (mRenderables[index]->mCastsShadow)
+				mShadowCasters[view].push_back(index);
+		}
+	}
+}
+
+void RenderSystem::updateShadowViews()
+{
+	mShadowData = ShadowUBO();
+	mShadowViewCount = 0;
+	mCascadeViewCount = 0;
+	mLightFrustums.clear();
+	mAtlasTiles.clear();
+	mShadowViewKeys.clear();
+	mShadowViewIntervals.clear();
+	mPointShadowCount = 0;
+
+	//cascades depend on the camera, and only one light gets them
+	std::vector<const ShadowLight*> spotLights;
+	std::vector<uint32_t> tileSizes;
+	for (const auto& light : mShadowLights) {
+		if (light.lightIndex >= MAX_LIGHTS)
+			continue;
+
+		mShadowData.lightFilters[light.lightIndex].x = light.filterRadius;
+
+		if (light.lightType == LightType::Directional) {
+			if (mCamera && mCascadeViewCount == 0) {
+				updateShadowCascades(light);
+				mCascadeViewCount = mShadowViewCount;
+			}
+		}
+		else if (light.lightType == LightType::Spot) {
+			uint32_t tileSize = computeAtlasTileSize(light);
+			if (tileSize > 0) {
+				spotLights.push_back(&light);
+				tileSizes.push_back(tileSize);
+			}
+		}
+		else if (light.lightType == LightType::Point) {
+			if (mPointShadowCount < MAX_POINT_SHADOWS && isLightOnScreen(light)) {
+				updatePointShadowCube(light, mPointShadowCount);
+				mPointShadowCount++;
+			}
+		}
+	}
+
+	std::vector<ShadowAtlasTile> tiles = mShadowAtlas.allocate(tileSizes);
+	float atlasResolution = static_cast<float>(mShadowAtlas.getResolution());
+	for (size_t i = 0; i < spotLights.size(); i++) {
+		if (tiles[i].size == 0 || mShadowViewCount >= MAX_SHADOW_VIEWS)
+			continue;
+
+		const ShadowLight& light = *spotLights[i];
+		ShadowView& view = mShadowData.views[mShadowViewCount];
+		view.viewProj = light.viewProj;
+		view.atlasRect = glm::vec4(tiles[i].x / atlasResolution,
+									tiles[i].y / atlasResolution,
+									tiles[i].size / atlasResolution,
+									static_cast<float>(mShadowMap.atlasLayer));
+
+		mShadowData.lightViews[light.lightIndex] = glm::uvec4(mShadowViewCount, 1, 0, 0);
+		mLightFrustums.push_back(Frustum::fromMatrix(light.viewProj));
+		mAtlasTiles.push_back(tiles[i]);
+
+		//less important lights can go a few frames without catching up
+		uint32_t interval = (light.importance > 0.0f) ? static_cast<uint32_t>(1.0f / light.importance) : mShadowSettings.maxRefreshInterval;
+		mShadowViewKeys.push_back(light.lightIndex * MAX_SHADOW_CASCADES);
+		mShadowViewIntervals.push_back(std::max(std::min(interval, mShadowSettings.maxRefreshInterval), 1u));
+		mShadowViewCount++;
+	}
+}
+
+void RenderSystem::updateShadowCache()
+{
+	mShadowFrame++;
+	mRefreshedShadowViews.clear();
+
+	//views that aren't in use this frame may have their region handed to another light
+	std::vector<bool> used(mShadowViewCache.size(), false);
+	for (uint32_t view = 0; view < mShadowViewCount; view++) {
+		used[mShadowViewKeys[view]] = true;
+	}
+	for (size_t key = 0; key < mShadowViewCache.size(); key++) {
+		if (!used[key])
+			mShadowViewCache[key].valid = false;
+	}
+
+	//no receivers on screen, so the views are left as they are until they are sampled again
+	if (!mShadowReceiverVisible)
+		return;
+
+	//the cubes are cheap to cull per face but share one pass, so they are refreshed together
+	mRefreshPointShadows = false;
+	if (mPointShadowCount > 0) {
+		uint64_t signature = computePointShadowSignature();
+		if (!mPointShadowsValid || !mShadowSettings.cacheShadows || signature != mPointShadowSignature) {
+			mPointShadowsValid = true;
+			mPointShadowSignature = signature;
+			mRefreshPointShadows = true;
+		}
+	}
+
+	float minTurnCos = std::cos(glm::radians(mShadowSettings.maxCascadeTurn));
+	for (uint32_t view = 0; view < mShadowViewCount; view++) {
+		ShadowViewCache& cache = mShadowViewCache[mShadowViewKeys[view]];
+		ShadowView& current = mShadowData.views[view];
+		uint64_t signature = computeShadowSignature(view);
+
+		//a cascade only covers the slice it was fit to, which swings away with the camera as it turns,
+		//so a waiting cascade can't stay behind once the camera has turned too far
+		bool turned = view < mCascadeViewCount && glm::dot(cache.cameraForward, mCamera->forward) < minTurnCos;
+
+		//a view that moved to a new region has nothing to fall back on
+		bool moved = !cache.valid || cache.view.atlasRect != current.atlasRect;
+		bool changed = moved || !mShadowSettings.cacheShadows || signature != cache.signature;
+		bool due = moved || turned || !mShadowSettings.cacheShadows || (mShadowFrame - cache.lastRefresh >= mShadowViewIntervals[view]);
+
+		if (changed && due) {
+			cache.valid = true;
+			cache.view = current;
+			cache.signature = signature;
+			cache.lastRefresh = mShadowFrame;
+			if (view < mCascadeViewCount) {
+				cache.cameraForward = mCamera->forward;
+			}
+			mRefreshedShadowViews.push_back(view);
+		}
+		else {
+			//receivers have to use the matrix the map was rendered with
+			current = cache.view;
+		}
+	}
+}
+
+uint64_t RenderSystem::computeShadowSignature(uint32_t view) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, &mShadowData.views[view].viewProj, sizeof(glm::mat4));
+
+	//the caster list changes when a caster enters or leaves the view, or stops casting
+	for (uint32_t index : mShadowCasters[view]) {
+		const auto& renderable = mRenderables[index];
+		const Mesh* mesh = renderable->mMesh.get();
+		hash = hashBytes(hash, &index, sizeof(index));
+		hash = hashBytes(hash, &mesh, sizeof(mesh));
+		hash = hashBytes(hash, &renderable->mModelMatrix, sizeof(glm::mat4));
+	}
+	return hash;
+}
+
+uint64_t RenderSystem::hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void RenderSystem::updatePointShadowCube(const ShadowLight& light, uint32_t cube)
+{
+	//face order and up vectors follow the cube map layer order (+X, -X, +Y, -Y, +Z, -Z)
+	static const glm::vec3 faceDirections[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	static const glm::vec3 faceUps[6] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	//only the depth range is corrected (1/2 z), cube faces keep OpenGL's y direction
+	const glm::mat4 depthFix(1.0f, 0.0f, 0.0f, 0.0f,
+							0.0f, 1.0f, 0.0f, 0.0f,
+							0.0f, 0.0f, 0.5f, 0.0f,
+							0.0f, 0.0f, 0.5f, 1.0f);
+	glm::mat4 projection = depthFix * glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, light.range);
+
+	for (uint32_t face = 0; face < 6; face++) {
+		glm::mat4 view = glm::lookAt(light.position, light.position + faceDirections[face], faceUps[face]);
+		mShadowData.pointFaceViewProj[cube * 6 + face] = projection * view;
+	}
+	mShadowData.pointShadows[cube] = glm::vec4(light.position, light.range);
+	mShadowData.lightViews[light.lightIndex].z = cube + 1;
+}
+
+void RenderSystem::cullPointShadowCasters()
+{
+	std::vector<uint32_t> faceMasks(mRenderables.size());
+	mPointShadowCasters.resize(mPointShadowCount);
+	for (uint32_t cube = 0; cube < mPointShadowCount; cube++) {
+		std::fill(faceMasks.begin(), faceMasks.end(), 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			mLightVisibleRenderables.clear();
+			mCullingBatch.cull(Frustum::fromMatrix(mShadowData.pointFaceViewProj[cube * 6 + face]), mLightVisibleRenderables);
+			for (uint32_t index : mLightVisibleRenderables) {
+				faceMasks[index] |= 1u << face;
+			}
+		}
+
+		mPointShadowCasters[cube].clear();
+		for (uint32_t index = 0; index < mRenderables.size(); index++) {
+			if (faceMasks[index] != 0 && mRenderables[index]->mCastsShadow)
+				mPointShadowCasters[cube].push_back({ index, faceMasks[index] });
+		}
+	}
+}
+
+uint64_t RenderSystem::computePointShadowSignature() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, mShadowData.pointShadows, sizeof(glm::vec4) * mPointShadowCount);
+	for (const auto& casters : mPointShadowCasters) {
+		for (const auto& caster : casters) {
+			const auto& renderable = mRenderables[caster.renderable];
+			const Mesh* mesh = renderable->mMesh.get();
+			hash = hashBytes(hash, &caster, sizeof(caster));
+			hash = hashBytes(hash, &mesh, sizeof(mesh));
+			hash = hashBytes(hash, &renderable->mModelMatrix, sizeof(glm::mat4));
+		}
+	}
+	return hash;
+}
+
+bool RenderSystem::isLightOnScreen(const ShadowLight& light) const
+{
+	if (!mCamera)
+		return true;
+
+	Frustum frustum = Frustum::fromMatrix(mCamera->projMat * mCamera->viewMat);
+	for (const auto& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), light.position) + plane.w < -light.range)
+			return false;
+	}
+	return true;
+}
+
+uint32_t RenderSystem::computeAtlasTileSize(const ShadowLight& light) const
+{
+	//the largest tile leaves room for three more at full size
+	float maxTileSize = mShadowAtlas.getResolution() * 0.5f;
+	if (!mCamera)
+		return static_cast<uint32_t>(maxTileSize * std::min(light.importance, 1.0f));
+
+	//lights that can't reach anything on screen don't need a shadow map
+	if (!isLightOnScreen(light))
+		return 0;
+
+	//fraction of the screen height covered by the light's reach (1 when the camera is inside it)
+	float distance = glm::length(light.position - mCamera->position);
+	float coverage = 1.0f;
+	if (distance > light.range)
+		coverage = std::min(light.range * std::abs(mCamera->projMat[1][1]) / distance, 1.0f);
+
+	//texel density follows the covered screen length, not area
+	float size = maxTileSize * std::min(coverage * light.importance, 1.0f);
+	return static_cast<uint32_t>(size);
+}
+
+void RenderSystem::updateShadowCascades(const ShadowLight& light)
+{
+	uint32_t cascadeCount = std::min(mShadowSettings.cascadeCount, MAX_SHADOW_CASCADES);
+	float nearPlane = mCamera->nearPlane;
+	float farPlane = std::min(mCamera->farPlane, mShadowSettings.maxDistance);
+	float range = farPlane - nearPlane;
+
+	//corners of the camera frustum at the near and far planes, in world space
+	glm::mat4 invViewProj = glm::inverse(mCamera->projMat * mCamera->viewMat);
+	std::array<glm::vec3, 4> nearCorners;
+	std::array<glm::vec3, 4> farCorners;
+	for (uint32_t i = 0; i < 4; i++) {
+		glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+		glm::vec4 nearCorner = invViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+		glm::vec4 farCorner = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+		farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+	}
+
+	glm::vec3 lightDir = glm::normalize(light.direction);
+
+	//To correct clip space (vulkan has inverted y, 1/2 z)
+	const glm::mat4 clipFix(1.0f, 0.0f, 0.0f, 0.0f,
+							0.0f, -1.0f, 0.0f, 0.0f,
+							0.0f, 0.0f, 0.5f, 0.0f,
+							0.0f, 0.0f, 0.5f, 1.0f);
+	glm::vec3 up = (std::abs(lightDir.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	float resolution = static_cast<float>(mShadowMap.extent.width);
+
+	uint32_t firstView = mShadowViewCount;
+	float splitNear = nearPlane;
+	for (uint32_t cascade = 0; cascade < cascadeCount; cascade++) {
+		//practical split scheme: blend the logarithmic and uniform split distances
+		float p = static_cast<float>(cascade + 1) / cascadeCount;
+		float logSplit = nearPlane * std::pow(farPlane / nearPlane, p);
+		float uniformSplit = nearPlane + range * p;
+		float splitFar = mShadowSettings.splitLambda * logSplit + (1.0f - mShadowSettings.splitLambda) * uniformSplit;
+
+		//corners of this slice, interpolated along the frustum edges (view depth is linear along them)
+		std::array<glm::vec3, 8> corners;
+		glm::vec3 center(0.0f);
+		for (uint32_t i = 0; i < 4; i++) {
+			glm::vec3 edge = farCorners[i] - nearCorners[i];
+			float edgeRange = mCamera->farPlane - mCamera->nearPlane;
+			corners[i] = nearCorners[i] + edge * ((splitNear - mCamera->nearPlane) / edgeRange);
+			corners[i + 4] = nearCorners[i] + edge * ((splitFar - mCamera->nearPlane) / edgeRange);
+			center += corners[i] + corners[i + 4];
+		}
+		center /= 8.0f;
+
+		//a bounding sphere keeps the projection's size constant as the camera turns
+		float radius = 0.0f;
+		for (const auto& corner : corners) {
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		//casters outside of the slice can still shadow it, so the depth range
+		//is stretched back towards the light to cover every caster
+		float backDistance = radius;
+		for (uint32_t i = 0; i < mRenderables.size(); i++) {
+			if (mRenderables[i]->mCastsShadow) {
+				const BoundingSphere& sphere = mWorldBounds[i].sphere;
+				backDistance = std::max(backDistance, glm::dot(center - sphere.center, lightDir) + sphere.radius);
+			}
+		}
+		glm::mat4 view = glm::lookAt(center - lightDir * backDistance, center, up);
+		glm::mat4 projection = clipFix * glm::ortho(-radius, radius, -radius, radius, 0.0f, backDistance + radius);
+
+		//snap the projection to whole texels, so the shadow edges don't shimmer as the camera moves
+		glm::vec4 origin = projection * view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		origin *= resolution * 0.5f;
+		glm::vec4 offset = (glm::round(origin) - origin) * (2.0f / resolution);
+		projection[3][0] += offset.x;
+		projection[3][1] += offset.y;
+
+		//cascades fill their whole layer
+		ShadowView& shadowView = mShadowData.views[firstView + cascade];
+		shadowView.viewProj = projection * view;
+		shadowView.atlasRect = glm::vec4(0.0f, 0.0f, 1.0f, static_cast<float>(cascade));
+		mShadowData.splitDepths[cascade] = splitFar;
+		mLightFrustums.push_back(Frustum::fromMatrix(shadowView.viewProj));
+
+		//far cascades cover more of the world per texel, so small changes are less visible there
+		mShadowViewKeys.push_back(light.lightIndex * MAX_SHADOW_CASCADES + cascade);
+		mShadowViewIntervals.push_back(std::max(std::min(1u << cascade, mShadowSettings.maxRefreshInterval), 1u));
+
+		splitNear = splitFar;
+	}
+	mShadowData.lightViews[light.lightIndex] = glm::uvec4(firstView, cascadeCount, 0, 0);
+	mShadowViewCount += cascadeCount;
+}
+
+void RenderSystem::rasterizeOccluders()
+{
+	mOccluders.clear();
+	for (auto& renderable : mRenderables) {
+		if (renderable->mOccluder) {
+			mOccluders.push_back({ renderable->mOccluder, renderable->mModelMatrix });
+		}
+	}
+
+	mSoftwareOcclusion.rasterize(mCamera->projMat * mCamera->viewMat, mOccluders, mThreadPool.get());
+}
+
+void RenderSystem::createSyncObjects()
+{
+	std::cout << "Creating semaphores" << std::endl;
+	mImageAvailableSemaphores.resize(MAX_CONCURRENT_FRAMES);
+	mShadowMapAvailableSemaphores.resize(MAX_CONCURRENT_FRAMES);
+	mRenderFinishedSemaphores.resize(MAX_CONCURRENT_FRAMES);
+	mFrameFences.resize(MAX_CONCURRENT_FRAMES);
+	mImagesInFlight.assign(mSwapchain->size(), VK_NULL_HANDLE);
+	
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+	{
+		if(vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
+		   vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mShadowMapAvailableSemaphores[i]) != VK_SUCCESS ||
+		   vkCreateSemaphore(mContext->device, &semaphoreInfo, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS ||
+			vkCreateFence(mContext->device, &fenceInfo, nullptr, &mFrameFences[i]) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to create frame sync objects!");
+		}
+	}
+}
+
+
+
+void RenderSystem::createRenderable(std::shared_ptr<Renderable>& renderable)
+{
+	renderable = std::make_shared<Renderable>(Renderable(mContext));
+}
+
+void RenderSystem::instantiateRenderable(std::shared_ptr<Renderable>& renderable)
+{
+	//dynamic bindings are pushed with each draw, or written to a set from the frame's pool where they can't be
+	if (!renderable->mDynamicBindings || renderable->mLayoutBindings.empty()) {
+		renderable->mDescriptorMode = DescriptorMode::Persistent;
+	}
+	else if (mContext->pushDescriptorsSupported && renderable->getDescriptorCount() <= mContext->maxPushDescriptors) {
+		renderable->mDescriptorMode = DescriptorMode::Pushed;
+	}
+	else {
+		renderable->mDescriptorMode = DescriptorMode::Transient;
+	}
+
+	const RenderableSetLayout& setLayout = getDescriptorSetLayout(renderable->mLayoutBindings, getLayoutFlags(*renderable));
+	renderable->mDescriptorSetLayout = setLayout.setLayout;
+	renderable->mUpdateTemplate = setLayout.updateTemplate;
+	renderable->createDescriptorSets(*mDescriptorAllocator, mSwapchain->size());
+
+
+	//once the scene is up, a quick compile gets a new renderable on screen while the optimized one is made
+	createRenderablePipelines(renderable, mFirstFramePresented);
+
+	//the command buffers are re-recorded every frame in drawFrame(), which picks it up from here
+	mRenderables.push_back(renderable);
+}
+
+const RenderableSetLayout& RenderSystem::getDescriptorSetLayout(const std::map<uint32_t, VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags)
+{
+	//map is most convenient for adding & removing, but vkCreateDescriptorSetLayout
+	//wants a strict array
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	bindings.reserve(layoutBindings.size());
+	for (const auto& binding : layoutBindings) {
+		bindings.push_back(binding.second);
+	}
+
+	std::string key = PipelineRegistry::makeLayoutKey(bindings, layoutFlags);
+	auto existing = mDescriptorSetLayouts.find(key);
+	if (existing != mDescriptorSetLayouts.end()) {
+		std::cout << "Reusing descriptor set layout" << std::endl;
+		return existing->second;
+	}
+
+	RenderableSetLayout setLayout;
+	setLayout.setLayout = mObjectCache->getDescriptorSetLayout(bindings, layoutFlags);
+
+	//a template can't be empty, sets without bindings are never written
+	if (bindings.empty()) {
+		return mDescriptorSetLayouts[key] = setLayout;
+	}
+
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries = Renderable::getUpdateTemplateEntries(bindings);
+
+	VkDescriptorUpdateTemplateCreateInfoKHR templateInfo = {};
+	templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+	templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+	templateInfo.pDescriptorUpdateEntries = entries.data();
+	templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+	templateInfo.descriptorSetLayout = *setLayout.setLayout;
+
+	//push templates are made for a pipeline layout, the same one the renderable pipelines with this set layout get
+	if (layoutFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR) {
+		setLayout.pipelineLayout = mObjectCache->getPipelineLayout({ mMaterialLibrary->getDescriptorSetLayout(), setLayout.setLayout },
+			{ MaterialLibrary::getPushConstantRange() });
+
+		templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+		templateInfo.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		templateInfo.pipelineLayout = *setLayout.pipelineLayout;
+		templateInfo.set = RENDERABLE_DESCRIPTOR_SET;
+	}
+
+	if (mContext->createDescriptorUpdateTemplate(mContext->device, &templateInfo, nullptr, &setLayout.updateTemplate) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor update template!");
+	}
+
+	return mDescriptorSetLayouts[key] = setLayout;
+}
+
+VkDescriptorSetLayoutCreateFlags RenderSystem::getLayoutFlags(const Renderable& renderable)
+{
+	return renderable.mDescriptorMode == DescriptorMode::Pushed ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+}
+
+void RenderSystem::createRenderablePipelines(std::shared_ptr<Renderable>& renderable, bool quickStart)
+{
+	if (mDeferredShading) {
+		std::vector<VkPipelineShaderStageCreateInfo> stages = renderable->mShaderSet.createShaderInfoSet();
+		PipelineOutputState outputState;
+		outputState.subpass = 2;
+
+		//G-buffer renderables keep their vertex stages, only the fragment shader changes
+		if (renderable->mGBufferShader) {
+			for (auto& stage : stages) {
+				if (stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT)
+					stage = renderable->mGBufferShader->getShaderStageInfo();
+			}
+			outputState.subpass = 0;
+			outputState.colorAttachmentCount = GBUFFER_ATTACHMENT_COUNT;
+		}
+
+		requestRenderablePipeline(renderable, stages, outputState, false, quickStart);
+		return;
+	}
+
+	if (!mDepthPrePass) {
+		requestRenderablePipeline(renderable, renderable->mShaderSet.createShaderInfoSet(), PipelineOutputState(), false, quickStart);
+		return;
+	}
+
+	//the pre-pass runs the renderable's own vertex stages, so both subpasses produce the exact same depths
+	std::vector<VkPipelineShaderStageCreateInfo> depthStages = renderable->mShaderSet.createShaderInfoSet();
+	depthStages.erase(std::remove_if(depthStages.begin(), depthStages.end(),
+		[](const VkPipelineShaderStageCreateInfo& stage) { return stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT; }),
+		depthStages.end());
+
+	PipelineOutputState depthState;
+	depthState.subpass = 0;
+	depthState.colorAttachmentCount = 0;
+	requestRenderablePipeline(renderable, depthStages, depthState, true, quickStart);
+
+	//only the front most surface is left to pass the depth test
+	PipelineOutputState shadeState;
+	shadeState.subpass = 1;
+	shadeState.depthWrite = false;
+	shadeState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	requestRenderablePipeline(renderable, renderable->mShaderSet.createShaderInfoSet(), shadeState, false, quickStart);
+}
+
+void RenderSystem::requestRenderablePipeline(std::shared_ptr<Renderable>& renderable,
+											 const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+											 const PipelineOutputState& outputState,
+											 bool depthOnly,
+											 bool quickStart)
+{
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+	layoutBindings.reserve(renderable->mLayoutBindings.size());
+	for (const auto& binding : renderable->mLayoutBindings) {
+		layoutBindings.push_back(binding.second);
+	}
+
+	std::string key = PipelineRegistry::makeKey(shaderStages, layoutBindings, getLayoutFlags(*renderable), { MaterialLibrary::getPushConstantRange() }, {}, outputState, mColorPass);
+
+	//another renderable with the same description is already waiting on this compile (checked before the registry,
+	//so renderables sharing a quick pipeline are all handed the optimized one)
+	auto job = mPipelineJobs.find(key);
+	if (job != mPipelineJobs.end()) {
+		job->second.requests.push_back({ renderable, depthOnly });
+		if (job->second.quickPipeline) {
+			(depthOnly ? renderable->mDepthPipeline : renderable->mPipeline) = job->second.quickPipeline;
+		}
+		return;
+	}
+
+	std::shared_ptr<GraphicsPipeline> pipeline = mPipelineRegistry.find(key);
+	if (pipeline) {
+		std::cout << "Reusing graphics pipeline" << std::endl;
+		(depthOnly ? renderable->mDepthPipeline : renderable->mPipeline) = pipeline;
+		return;
+	}
+
+	//the layout is made from this renderable's set layout, which is compatible with every other renderable's identically defined one.
+	//Everything the workers read is copied, including the specialization data the Shaders keep rewriting (the modules outlive the compile)
+	std::shared_ptr<const ShaderStageCopy> stages = std::make_shared<const ShaderStageCopy>(shaderStages);
+	SharedDescriptorSetLayout setLayout = renderable->mDescriptorSetLayout;
+	VkRenderPass renderPass = mColorPass;
+	PipelineJob& newJob = mPipelineJobs[key];
+	newJob.requests.push_back({ renderable, depthOnly });
+	newJob.queueTime = std::chrono::steady_clock::now();
+
+	//stands in for VK_EXT_graphics_pipeline_library, which the bundled headers don't have. With more than
+	//one worker both compiles run side by side and either may finish first, so collectRenderablePipelines()
+	//only publishes the optimized pipeline once the quick one has been collected
+	if (quickStart) {
+		newJob.pipeline = mThreadPool->submit([this, setLayout, renderPass, stages, outputState]() {
+			return compileRenderablePipeline(setLayout, renderPass, stages->getStages(), outputState, VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT);
+		});
+		newJob.optimizedPipeline = mThreadPool->submit([this, setLayout, renderPass, stages, outputState]() {
+			return compileRenderablePipeline(setLayout, renderPass, stages->getStages(), outputState, 0);
+		});
+	}
+	else {
+		newJob.pipeline = mThreadPool->submit([this, setLayout, renderPass, stages, outputState]() {
+			return compileRenderablePipeline(setLayout, renderPass, stages->getStages(), outputState, 0);
+		});
+	}
+}
+
+std::shared_ptr<GraphicsPipeline> RenderSystem::compileRenderablePipeline(SharedDescriptorSetLayout setLayout,
+																		  VkRenderPass renderPass,
+																		  const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+																		  PipelineOutputState outputState,
+																		  VkPipelineCreateFlags flags)
+{
+	VkPipeline handle;
+	SharedPipelineLayout layout;
+	createPipeline(handle, layout, { mMaterialLibrary->getDescriptorSetLayout(), setLayout }, shaderStages, renderPass,
+		{ MaterialLibrary::getPushConstantRange() }, {}, outputState, flags);
+	return std::make_shared<GraphicsPipeline>(mContext, handle, layout);
+}
+
+void RenderSystem::collectRenderablePipelines(bool wait)
+{
+	auto isReady = [wait](std::future<std::shared_ptr<GraphicsPipeline>>& result) {
+		return wait || result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+
+	for (auto job = mPipelineJobs.begin(); job != mPipelineJobs.end();) {
+		PipelineJob& pending = job->second;
+		std::chrono::duration<float, std::milli> readyTime = std::chrono::steady_clock::now() - pending.queueTime;
+
+		//first (or only) compile: the renderables can be drawn from now on. get() rethrows anything the compile threw
+		if (pending.pipeline.valid() && isReady(pending.pipeline)) {
+			std::shared_ptr<GraphicsPipeline> pipeline = pending.pipeline.get();
+			bool quick = pending.optimizedPipeline.valid();
+			if (quick) {
+				pending.quickPipeline = pipeline;
+			}
+
+			mPipelineRegistry.add(job->first, pipeline);
+			for (auto& request : pending.requests) {
+				(request.depthOnly ? request.renderable->mDepthPipeline : request.renderable->mPipeline) = pipeline;
+			}
+			std::cout << (quick ? "Unoptimized graphics" : "Graphics") << " pipeline ready " << readyTime.count() << " ms after it was queued ("
+				<< mPipelineRegistry.getLiveCount() << " live, " << mPipelineRegistry.getReuseCount() << " reused, "
+				<< mPipelineJobs.size() - 1 << " other compiles pending)" << std::endl;
+		}
+
+		//the optimized pipeline takes over from the quick one, which the frames in flight may still use.
+		//it waits for the quick pipeline to be collected, so it is never replaced by the slower-to-finish quick one
+		if (!pending.pipeline.valid() && pending.optimizedPipeline.valid() && isReady(pending.optimizedPipeline)) {
+			std::shared_ptr<GraphicsPipeline> pipeline = pending.optimizedPipeline.get();
+
+			mPipelineRegistry.add(job->first, pipeline);
+			for (auto& request : pending.requests) {
+				(request.depthOnly ? request.renderable->mDepthPipeline : request.renderable->mPipeline) = pipeline;
+			}
+			mRetiredPipelines.push_back({ pending.quickPipeline, mFrameNumber });
+			pending.quickPipeline.reset();
+			std::cout << "Optimized graphics pipeline swapped in " << readyTime.count() << " ms after it was queued" << std::endl;
+		}
+
+		if (pending.pipeline.valid() || pending.optimizedPipeline.valid())
+			++job;
+		else
+			job = mPipelineJobs.erase(job);
+	}
+}
+
+void RenderSystem::releaseRetiredPipelines(bool deviceIdle)
+{
+	//every frame recorded before the pipeline was retired has finished once its fence was waited on
+	mRetiredPipelines.erase(std::remove_if(mRetiredPipelines.begin(), mRetiredPipelines.end(),
+		[this, deviceIdle](const std::pair<std::shared_ptr<GraphicsPipeline>, uint64_t>& retired) {
+			return deviceIdle || mFrameNumber >= retired.second + MAX_CONCURRENT_FRAMES;
+		}),
+		mRetiredPipelines.end());
+}
+
+bool RenderSystem::isDrawable(const std::shared_ptr<Renderable>& renderable) const
+{
+	//both pipelines are needed with the pre-pass, or its depths would hide the surface they belong to
+	return renderable->mPipeline && (!usesDepthPrePass() || renderable->mDepthPipeline);
+}
+
+void RenderSystem::setDepthPrePass(bool enabled)
+{
+	if (enabled == mDepthPrePass)
+		return;
+
+	//the color passes gain (or lose) a subpass, which every renderable's pipeline is tied to
+	mDepthPrePass = enabled;
+	recreateSwapchain(true);
+}
+
+void RenderSystem::setDeferredShading(bool enabled)
+{
+	if (enabled == mDeferredShading)
+		return;
+
+	//the color passes' subpasses and attachments change, along with every renderable's pipeline
+	mDeferredShading = enabled;
+	recreateSwapchain(true);
+}
+
+void RenderSystem::createGBuffer()
+{
+	std::cout << "Creating G-buffer" << std::endl;
+
+	//the late HiZ pass loads what the early pass wrote, otherwise the contents never leave the render pass
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	if (mOcclusionCullingMode != OcclusionCullingMode::HiZ)
+		usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+	VkExtent2D extent = mSwapchain->getExtent();
+	for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++) {
+		GBufferAttachment& attachment = mGBuffer.attachments[i];
+		attachment.format = GBUFFER_FORMATS[i];
+		mImageManager->createImage(extent.width,
+			extent.height,
+			attachment.format,
+			VK_IMAGE_TILING_OPTIMAL,
+			usage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			attachment.image,
+			attachment.memory);
+		attachment.view = mImageManager->createImageView(attachment.image, attachment.format, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+}
+
+void RenderSystem::cleanupGBuffer()
+{
+	for (auto& attachment : mGBuffer.attachments) {
+		if (attachment.image == VK_NULL_HANDLE)
+			continue;
+		vkDestroyImageView(mContext->device, attachment.view, nullptr);
+		vkDestroyImage(mContext->device, attachment.image, nullptr);
+		vkFreeMemory(mContext->device, attachment.memory, nullptr);
+		attachment = GBufferAttachment();
+	}
+}
+
+void RenderSystem::createDeferredDescriptorSetLayout()
+{
+	//the G-buffer and depth, then the same lighting resources the forward shadow receivers bind
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	auto addBinding = [&bindings](VkDescriptorType type) {
+		VkDescriptorSetLayoutBinding layoutBinding = {};
+		layoutBinding.descriptorType = type;
+		layoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layoutBinding.binding = static_cast<uint32_t>(bindings.size());
+		layoutBinding.descriptorCount = 1;
+		layoutBinding.pImmutableSamplers = nullptr;
+		bindings.push_back(layoutBinding);
+	};
+
+	for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT + 1; i++) {
+		addBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);		//0-3: albedo, normals, specular, depth
+	}
+	addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);				//4: camera (DeferredLightingUBO)
+	addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);				//5: shadow views
+	addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);		//6: shadow map
+	addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);		//7: point shadow cubes
+	addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);				//8: cluster grid
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);				//9: every light
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);				//10: cluster light lists
+
+	mDeferredDescriptorSetLayout = mObjectCache->getDescriptorSetLayout(bindings);
+}
+
+void RenderSystem::createDeferredDescriptorSets()
+{
+	mDeferredDescriptorSets.resize(mSwapchain->size());
+	for (auto& descriptorSet : mDeferredDescriptorSets) {
+		descriptorSet = mDescriptorAllocator->allocate(*mDeferredDescriptorSetLayout);
+	}
+}
+
+void RenderSystem::writeDeferredDescriptorSets()
+{
+	std::array<VkDescriptorImageInfo, GBUFFER_ATTACHMENT_COUNT + 1> inputInfos = {};
+	for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++) {
+		inputInfos[i].imageView = mGBuffer.attachments[i].view;
+		inputInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	inputInfos[GBUFFER_ATTACHMENT_COUNT].imageView = mDepthImageView;
+	inputInfos[GBUFFER_ATTACHMENT_COUNT].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	std::array<VkDescriptorImageInfo, 2> shadowInfos = {};
+	shadowInfos[0].imageView = mShadowMap.getImageView(ShadowMapView::Layers);
+	shadowInfos[1].imageView = mShadowMap.getImageView(ShadowMapView::PointCubes);
+	for (auto& shadowInfo : shadowInfos) {
+		shadowInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		shadowInfo.sampler = mShadowMap.imageSampler;
+	}
+
+	for (size_t i = 0; i < mDeferredDescriptorSets.size(); i++) {
+		//binding 4 onwards, in the order of the layout
+		std::array<std::shared_ptr<UBO>, 5> buffers = { mDeferredUBO, mShadowUBO, mClusterUBO, mLightBuffer, mClusterLightBuffer };
+		std::array<uint32_t, 5> bufferBindings = { 4, 5, 8, 9, 10 };
+		std::array<VkDescriptorType, 5> bufferTypes = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+														VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+		for (size_t b = 0; b < buffers.size(); b++) {
+			bufferInfos[b].buffer = buffers[b]->buffers[i];
+			bufferInfos[b].offset = 0;
+			bufferInfos[b].range = buffers[b]->bufferSize;
+		}
+
+		std::vector<VkWriteDescriptorSet> descriptorWrites;
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = mDeferredDescriptorSets[i];
+		write.dstArrayElement = 0;
+		write.descriptorCount = 1;
+
+		write.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		for (uint32_t input = 0; input < inputInfos.size(); input++) {
+			write.dstBinding = input;
+			write.pImageInfo = &inputInfos[input];
+			descriptorWrites.push_back(write);
+		}
+
+		write.pImageInfo = nullptr;
+		for (size_t b = 0; b < buffers.size(); b++) {
+			write.dstBinding = bufferBindings[b];
+			write.descriptorType = bufferTypes[b];
+			write.pBufferInfo = &bufferInfos[b];
+			descriptorWrites.push_back(write);
+		}
+
+		write.pBufferInfo = nullptr;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		for (uint32_t shadow = 0; shadow < shadowInfos.size(); shadow++) {
+			write.dstBinding = 6 + shadow;
+			write.pImageInfo = &shadowInfos[shadow];
+			descriptorWrites.push_back(write);
+		}
+
+		vkUpdateDescriptorSets(mContext->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void RenderSystem::createDeferredLightingPipeline()
+{
+	//one fullscreen triangle made in the vertex shader, shading pixels the depth buffer says were drawn
+	PipelineOutputState lightingState;
+	lightingState.subpass = 1;
+	lightingState.depthTest = false;
+	lightingState.depthWrite = false;
+	lightingState.vertexInput = false;
+
+	createPipeline(mDeferredLightingPipeline,
+					mDeferredLightingPipelineLayout,
+					{ mDeferredDescriptorSetLayout },
+					mDeferredLightingShaderSet.createShaderInfoSet(),
+					mColorPass,
+					{}, {}, lightingState);
+}
+
+void RenderSystem::updateDeferredLightingUBO(uint32_t imageIndex)
+{
+	DeferredLightingUBO lightingData;
+	if (mCamera) {
+		lightingData.inverseViewProj = glm::inverse(mCamera->projMat * mCamera->viewMat);
+		lightingData.view = mCamera->viewMat;
+		lightingData.viewPos = glm::vec4(mCamera->position, 1.0f);
+	}
+	VkExtent2D extent = mSwapchain->getExtent();
+	lightingData.screenSize = glm::vec4(extent.width, extent.height, 0.0f, 0.0f);
+
+	void* data;
+	vkMapMemory(mContext->device, mDeferredUBO->buffersMemory[imageIndex], 0, sizeof(DeferredLightingUBO), 0, &data);
+	memcpy(data, &lightingData, sizeof(DeferredLightingUBO));
+	vkUnmapMemory(mContext->device, mDeferredUBO->buffersMemory[imageIndex]);
+}
+
+void RenderSystem::setCamera(const Camera& camera)
+{
+	mCamera = std::make_unique<Camera>(camera);
+}
+
+void RenderSystem::setLights(const std::vector<Light>& lights)
+{
+	mLights = lights;
+	if (sizeof(LightBufferHeader) + sizeof(Light) * mLights.size() > mLightBuffer->bufferSize) {
+		growLightBuffer(mLights.size());
+	}
+}
+
+void RenderSystem::createStorageBuffer(std::shared_ptr<UBO>& buffer, VkDeviceSize size)
+{
+	buffer = std::make_shared<UBO>();
+	allocateStorageBuffer(*buffer, size);
+
+	mUniformBuffers.push_back(buffer);
+}
+
+void RenderSystem::allocateStorageBuffer(UBO& buffer, VkDeviceSize size)
+{
+	buffer.bufferSize = size;
+
+	size_t swapchainSize = mSwapchain->size();
+	buffer.buffers.resize(swapchainSize);
+	buffer.buffersMemory.resize(swapchainSize);
+	buffer.mappedData.resize(swapchainSize);
+	for (size_t i = 0; i < swapchainSize; i++) {
+		mBufferManager->createBuffer(buffer.bufferSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			buffer.buffers[i],
+			buffer.buffersMemory[i]);
+
+		if (vkMapMemory(mContext->device, buffer.buffersMemory[i], 0, VK_WHOLE_SIZE, 0, &buffer.mappedData[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to map storage buffer memory!");
+		}
+	}
+}
+
+void RenderSystem::growLightBuffer(size_t lightCount)
+{
+	VkDeviceSize capacity = (mLightBuffer->bufferSize - sizeof(LightBufferHeader)) / sizeof(Light);
+	while (capacity < lightCount) {
+		capacity *= 2;
+	}
+	std::cout << "Growing the light buffer to " << capacity << " lights" << std::endl;
+
+	vkDeviceWaitIdle(mContext->device);
+	for (size_t i = 0; i < mLightBuffer->buffers.size(); i++) {
+		vkDestroyBuffer(mContext->device, mLightBuffer->buffers[i], nullptr);
+		vkFreeMemory(mContext->device, mLightBuffer->buffersMemory[i], nullptr);
+	}
+	allocateStorageBuffer(*mLightBuffer, sizeof(LightBufferHeader) + sizeof(Light) * capacity);
+
+	//the new buffers start out empty
+	for (auto& uploaded : mUploadedLights) {
+		uploaded.clear();
+	}
+
+	for (auto& renderable : mRenderables) {
+		renderable->updateBufferBinding(mLightBuffer);
+	}
+	if (mDeferredShading) {
+		writeDeferredDescriptorSets();
+	}
+}
+
+void RenderSystem::updateLightClusters(uint32_t imageIndex)
+{
+	if (mCamera) {
+		VkExtent2D extent = mSwapchain->getExtent();
+		mLightClusters.build(*mCamera, extent.width, extent.height, mLights, mThreadPool.get());
+	}
+	else {
+		mLightClusters.buildUnclustered(mLights);
+	}
+
+	const ClusterUBO& clusterInfo = mLightClusters.getClusterInfo();
+	const std::vector<uint32_t>& clusterLights = mLightClusters.getClusterLights();
+
+	void* data;
+	vkMapMemory(mContext->device, mClusterUBO->buffersMemory[imageIndex], 0, sizeof(ClusterUBO), 0, &data);
+	memcpy(data, &clusterInfo, sizeof(ClusterUBO));
+	vkUnmapMemory(mContext->device, mClusterUBO->buffersMemory[imageIndex]);
+
+	uploadLights(imageIndex);
+
+	//the cluster lists are rebuilt every frame, so they are always written whole
+	memcpy(mClusterLightBuffer->mappedData[imageIndex], clusterLights.data(), sizeof(uint32_t) * clusterLights.size());
+}
+
+void RenderSystem::uploadLights(uint32_t imageIndex)
+{
+	char* mapped = static_cast<char*>(mLightBuffer->mappedData[imageIndex]);
+	std::vector<Light>& uploaded = mUploadedLights[imageIndex];
+
+	LightBufferHeader header;
+	header.lightCount = static_cast<uint32_t>(mLights.size());
+	memcpy(mapped, &header, sizeof(LightBufferHeader));
+	mapped += sizeof(LightBufferHeader);
+
+	//the memory is host coherent, so writing the changed runs is all the upload there is
+	size_t previousCount = uploaded.size();
+	uploaded.resize(mLights.size());
+	auto isUploaded = [&](size_t lightIndex) {
+		return lightIndex < previousCount && memcmp(&uploaded[lightIndex], &mLights[lightIndex], sizeof(Light)) == 0;
+	};
+
+	size_t first = 0;
+	while (first < mLights.size()) {
+		if (isUploaded(first)) {
+			first++;
+			continue;
+		}
+
+		size_t end = first + 1;
+		while (end < mLights.size() && !isUploaded(end)) {
+			end++;
+		}
+
+		memcpy(mapped + sizeof(Light) * first, &mLights[first], sizeof(Light) * (end - first));
+		std::copy(mLights.begin() + first, mLights.begin() + end, uploaded.begin() + first);
+		first = end;
+	}
+}
+
+void RenderSystem::setOcclusionCullingMode(OcclusionCullingMode mode)
+{
+	if (mode == mOcclusionCullingMode)
+		return;
+
+	//the render passes and depth buffer depend on whether HiZ is used, so rebuild everything tied to the swapchain
+	bool rebuild = (mode == OcclusionCullingMode::HiZ) || (mOcclusionCullingMode == OcclusionCullingMode::HiZ);
+	mOcclusionCullingMode = mode;
+	if (rebuild) {
+		recreateSwapchain(true);
+	}
+}
+
+void RenderSystem::createTexture(std::shared_ptr<Texture>& texture, const std::string &filename)
+{
+	std::cout << "Creating texture \"" << filename << "\"" << std::endl;
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		throw std::runtime_error("Failed to load texture image");
+	}
+
+	texture = std::make_shared<Texture>(Texture(mContext, mBufferManager, mImageManager, mObjectCache));
+	texture->load(pixels, width, height, channels);
+	stbi_image_free(pixels);
+
+	mTextures.push_back(texture);
+}
+
+uint32_t RenderSystem::createMaterial(const Material& material)
+{
+	return mMaterialLibrary->addMaterial(material);
+}
+
+void RenderSystem::createMesh(std::shared_ptr<Mesh>& mesh, const std::string & filename, bool calculateTangents)
+{
+	std::cout << "creating mesh \"" << filename << "\"" << std::endl;
+
+	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 	readObjFile(filename, vertices, indices, VK_FRONT_FACE_CLOCKWISE);
 
@@ -965,21 +2744,49 @@ void RenderSystem::createShader(std::shared_ptr<Shader>& shader, const std::stri
 	mShaders.push_back(shader);
 }
 
+void RenderSystem::createShaderVariant(std::shared_ptr<Shader>& shader, const std::string& filename, VkShaderStageFlagBits stage, const SpecializationConstants& constants)
+{
+	auto key = std::make_tuple(filename, stage, constants);
+	auto variant = mShaderVariants.find(key);
+	if (variant != mShaderVariants.end()) {
+		shader = variant->second;
+		return;
+	}
+
+	createShader(shader, filename, stage);
+	shader->setSpecializationConstants(constants);
+	mShaderVariants[key] = shader;
+}
+
 void RenderSystem::createDepthBuffer()
 {
 	std::cout << "Creating depth buffer" << std::endl;
 
+	//the depth pyramid is built by sampling the depth buffer
+	bool occlusionCulling = (mOcclusionCullingMode == OcclusionCullingMode::HiZ);
+	VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (occlusionCulling) {
+		depthFeatures |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	//the deferred lighting pass reconstructs positions from depth
+	if (mDeferredShading) {
+		depthUsage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	}
+
 	mDepthImageFormat = mImageManager->findSupportedFormat(
 						{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 						VK_IMAGE_TILING_OPTIMAL,
-						VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+						depthFeatures);
 	
 	//create the depth image
 	mImageManager->createImage(mSwapchain->getExtent().width,
 						mSwapchain->getExtent().height,
 						mDepthImageFormat,
 						VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+						depthUsage,
 						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 						mDepthImage,
 						mDepthImageMemory);
@@ -992,32 +2799,80 @@ void RenderSystem::createDepthBuffer()
 									mDepthImageFormat,
 									VK_IMAGE_LAYOUT_UNDEFINED,
 									VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+	if (occlusionCulling) {
+		mOcclusionCuller->createDepthPyramid(mDepthImageView, mSwapchain->getExtent());
+	}
 }
 
 void RenderSystem::createShadowMap()
 {
 	std::cout << "Creating Shadow Map resources" << std::endl;
-	mShadowMap.imageFormat = VK_FORMAT_D32_SFLOAT;
+	mShadowMap.imageFormat = mShadowSettings.depthFormat;
+	mShadowMap.extent = { mShadowSettings.resolution, mShadowSettings.resolution };
+	mShadowMap.layerCount = mShadowSettings.cascadeCount + 1;
+	mShadowMap.atlasLayer = mShadowSettings.cascadeCount;
+	mShadowAtlas.setResolution(mShadowSettings.resolution, mShadowSettings.minAtlasTileSize);
 
 	std::cout << "Creating shadow image" << std::endl;
-	mImageManager->createImage(mSwapchain->getExtent().width,
-		mSwapchain->getExtent().height,
+	mImageManager->createImage(mShadowMap.extent.width,
+		mShadowMap.extent.height,
 		mShadowMap.imageFormat,
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
 		VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		mShadowMap.image,
-		mShadowMap.imageMemory);
+		mShadowMap.imageMemory,
+		1, mShadowMap.layerCount);
 
+	//layers without casters are never rendered to, so start every layer in the layout receivers sample it in
+	mImageManager->transitionImageLayout(mShadowMap.image, mShadowMap.imageFormat,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mShadowMap.layerCount);
 
 	std::cout << "Creatring shadow imageview" << std::endl;
-	mShadowMap.imageView = mImageManager->createImageView(mShadowMap.image, mShadowMap.imageFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	mShadowMap.imageView = mImageManager->createImageView(mShadowMap.image, mShadowMap.imageFormat, VK_IMAGE_ASPECT_DEPTH_BIT,
+		0, 1, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, mShadowMap.layerCount);
+
+	mShadowMap.layerViews.resize(mShadowMap.layerCount);
+	for (uint32_t layer = 0; layer < mShadowMap.layerCount; layer++) {
+		mShadowMap.layerViews[layer] = mImageManager->createImageView(mShadowMap.image, mShadowMap.imageFormat, VK_IMAGE_ASPECT_DEPTH_BIT,
+			0, 1, VK_IMAGE_VIEW_TYPE_2D, layer, 1);
+	}
+
+	//point lights: a cube array, rendered through a 2D array view of every face
+	mShadowMap.pointExtent = { mShadowSettings.pointResolution, mShadowSettings.pointResolution };
+	mShadowMap.pointLayerCount = MAX_POINT_SHADOWS * 6;
+	mImageManager->createImage(mShadowMap.pointExtent.width,
+		mShadowMap.pointExtent.height,
+		mShadowMap.imageFormat,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		mShadowMap.pointImage,
+		mShadowMap.pointImageMemory,
+		1, mShadowMap.pointLayerCount,
+		VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+
+	mImageManager->transitionImageLayout(mShadowMap.pointImage, mShadowMap.imageFormat,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mShadowMap.pointLayerCount);
+
+	mShadowMap.pointImageView = mImageManager->createImageView(mShadowMap.pointImage, mShadowMap.imageFormat, VK_IMAGE_ASPECT_DEPTH_BIT,
+		0, 1, VK_IMAGE_VIEW_TYPE_CUBE_ARRAY, 0, mShadowMap.pointLayerCount);
+	mShadowMap.pointLayersView = mImageManager->createImageView(mShadowMap.pointImage, mShadowMap.imageFormat, VK_IMAGE_ASPECT_DEPTH_BIT,
+		0, 1, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, mShadowMap.pointLayerCount);
+
+	//bilinear depth compares need linear filtering, which is only guaranteed for D16
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(mContext->physicalDevice, mShadowMap.imageFormat, &formatProperties);
+	bool linearCompare = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
 
 	//create a sampler so we can access it in other shaders
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.magFilter = linearCompare ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	samplerInfo.minFilter = samplerInfo.magFilter;
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
@@ -1032,8 +2887,9 @@ void RenderSystem::createShadowMap()
 	//use texel values from [0, 1)
 	samplerInfo.unnormalizedCoordinates = VK_FALSE;
 
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	//texture() returns the fraction of the 2x2 footprint that passes (is lit), instead of the stored depth
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
 	samplerInfo.mipLodBias = 0.0f;
@@ -1047,9 +2903,6 @@ void RenderSystem::createShadowMap()
 
 void RenderSystem::setClearColor(VkClearValue clearColor)
 {
-	//wait for the device to be idle, then recreate the command buffers with the new clear color
-	vkDeviceWaitIdle(mContext->device);
+	//the color pass is re-recorded every frame, so the next frame clears with it
 	mClearColor = clearColor;
-	createShadowCommandBuffers();
-	createCommandBuffers();
 }
\ No newline at end of file
@@ -15,6 +15,8 @@
 #include <fstream>
 #include <vector>
 #include <array>
+#include <map>
+#include <tuple>
 #include <chrono>
 
 //ubm-vk
@@ -30,15 +32,71 @@
 #include "Vertex.h"
 #include "Renderable.h"
 #include "Shader.h"
+#include "PipelineRegistry.h"
+#include "DescriptorAllocator.h"
+#include "VulkanObjectCache.h"
 #include "Mesh.h"
 #include "ShadowMap.h"
+#include "ShadowAtlas.h"
+#include "Camera.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "SoftwareOcclusion.h"
+#include "ThreadPool.h"
+#include "LightClustering.h"
+#include "GBuffer.h"
 
 
 const int MAX_CONCURRENT_FRAMES = 2;	///< The number of frames in flight (2 = double buffering, etc.)
-const int MAX_DESCRIPTOR_SETS = 40;		///< Maximum number of descriptor sets
-const int MAX_UNIFORM_BUFFERS = 40;		///< Maximum number of UBOS
-const int MAX_IMAGE_SAMPLERS = 40;		///< Maximum number of Image Samplers
+const uint32_t DESCRIPTOR_POOL_SETS = 64;	///< Sets the first descriptor pool has room for, pools chained on after it grow
+const uint32_t INITIAL_LIGHT_CAPACITY = 1024;	///< Lights the light buffer has room for before it first grows
 const std::string SHADOW_MAP_SHADER_VERT = "Resources/Shaders/shadowPass_vert.spv";	///< Vertex Shader for the ShadowMap
+const std::string POINT_SHADOW_SHADER_VERT = "Resources/Shaders/pointShadowPass_vert.spv";	///< Vertex Shader for the point light cube shadows
+const std::string POINT_SHADOW_SHADER_GEOM = "Resources/Shaders/pointShadowPass_geom.spv";	///< Geometry Shader routing triangles to cube faces
+const std::string DEFERRED_LIGHTING_SHADER_VERT = "Resources/Shaders/fullscreen_vert.spv";		///< Vertex Shader covering the screen for the deferred lighting pass
+const std::string DEFERRED_LIGHTING_SHADER_FRAG = "Resources/Shaders/deferredLighting_frag.spv";	///< Fragment Shader lighting every pixel from the G-buffer
+
+/** @brief Which pipelines and renderables drawVisibleRenderables() draws with */
+enum class RenderablePass
+{
+	Color,			///< Every renderable, with its color pipeline
+	DepthOnly,		///< Every renderable, with its depth pre-pass pipeline
+	GBuffer,		///< Deferred shading: the renderables that write the G-buffer
+	Forward			///< Deferred shading: the renderables shaded on top of the lit G-buffer
+};
+
+/** @brief Counters gathered over the color pass of a frame, through a pipeline statistics query */
+struct PipelineStatistics
+{
+	bool valid = false;							///< False until a frame with the query has completed
+	uint64_t vertexShaderInvocations = 0;		///< Vertex shader invocations (including the depth pre-pass)
+	uint64_t fragmentShaderInvocations = 0;		///< Fragment shader invocations, i.e. fragments that were shaded
+};
+
+/** @brief A renderable pipeline compiling on a worker thread, and the renderables waiting for it */
+struct PipelineJob
+{
+	/** @brief A renderable waiting for the pipeline */
+	struct Request
+	{
+		std::shared_ptr<Renderable> renderable;		///< The renderable
+		bool depthOnly;								///< Whether it becomes the depth pre-pass pipeline instead of the color pipeline
+	};
+
+	std::future<std::shared_ptr<GraphicsPipeline>> pipeline;			///< The first pipeline compiled (unoptimized when an optimized one follows)
+	std::future<std::shared_ptr<GraphicsPipeline>> optimizedPipeline;	///< The optimized pipeline replacing the quick one once that was collected (not valid if the first compile is optimized)
+	std::shared_ptr<GraphicsPipeline> quickPipeline;					///< The unoptimized pipeline in use until the optimized one is ready
+	std::vector<Request> requests;										///< The renderables waiting for it
+	std::chrono::steady_clock::time_point queueTime;					///< When the compile was queued
+};
+
+/** @brief A renderable set layout and the update template made for it */
+struct RenderableSetLayout
+{
+	SharedDescriptorSetLayout setLayout;							///< The set layout
+	VkDescriptorUpdateTemplateKHR updateTemplate = VK_NULL_HANDLE;	///< Writes or pushes a whole set from a Renderable's descriptor data (null without bindings)
+	SharedPipelineLayout pipelineLayout;							///< The pipeline layout a push template is made for (push descriptor layouts only)
+};
 
 /** @class RenderSystem
 
@@ -85,6 +143,16 @@ public:
 	*/
 	void createTexture(std::shared_ptr<Texture>& texture, const std::string &filename);
 
+	/** @brief Add a material to the material library
+
+		Its textures are added to the bindless texture array, so Renderables using
+		the material don't bind them (see Renderable::setMaterial())
+		
+		@param material			The material's textures
+		@return The index of the material
+	*/
+	uint32_t createMaterial(const Material& material);
+
 	/** @brief Create a Mesh object
 
 		Creates a Mesh object with std::make_shared and keeps a copy
@@ -107,6 +175,19 @@ public:
 	*/
 	void createShader(std::shared_ptr<Shader>& shader, const std::string& filename, VkShaderStageFlagBits stage);
 
+	/** @brief Get a Shader specialized with a set of constants, creating it on first use
+
+		Variants are cached by file, stage and constants, so every renderable
+		asking for the same variant shares one Shader (and one shader module).
+		The returned Shader is shared, so its constants must not be changed.
+
+		@param shader			The shader object to set
+		@param filename			The shader file to load (must a *.spv file)
+		@param stage			The shader stage the shader will run in
+		@param constants		The specialization constants of the variant
+	*/
+	void createShaderVariant(std::shared_ptr<Shader>& shader, const std::string& filename, VkShaderStageFlagBits stage, const SpecializationConstants& constants);
+
 	/** @brief Create a Renderable object
 
 		Very simple - Just creates a renderable shared_ptr, passing the
@@ -122,6 +203,13 @@ public:
 		DescriptorSets, and Pipelines. Also keeps a copy of the renderable
 		for cleanup, and recreates the command buffers.
 
+		The pipelines are compiled on worker threads, so renderables instantiated
+		together compile side by side. The renderable is drawn from the first frame
+		after its pipelines are ready. After the first frame, an unoptimized pipeline
+		is compiled alongside the optimized one so it appears sooner, and replaced
+		once the optimized one is ready. This is a substitute for
+		VK_EXT_graphics_pipeline_library, which the Vulkan headers used here predate.
+
 		@param renderable The Renderable to instantiate
 	*/
 	void instantiateRenderable(std::shared_ptr<Renderable>& renderable);
@@ -156,6 +244,17 @@ public:
 		mUniformBuffers.push_back(ubo);
 	}
 
+	/** @brief Create a host visible Storage Buffer, one per swapchain image
+
+		Storage buffers share the UBO struct (and its cleanup), but are sized at
+		runtime rather than from a type, and bound with Renderable::bindStorageBuffer().
+		They stay mapped for their whole lifetime (see UBO::mappedData).
+
+		@param buffer	The buffer to create
+		@param size		The size of each buffer in bytes
+	*/
+	void createStorageBuffer(std::shared_ptr<UBO>& buffer, VkDeviceSize size);
+
 	/** @brief Update the info inside a UBO
 
 		@param ubo			The UBO to update
@@ -176,21 +275,63 @@ public:
 		vkUnmapMemory(mContext->device, ubo.buffersMemory[actualIndex]);
 	}
 	
+	/** @brief Write the same data to every swapchain image's copy of a UBO, for data that doesn't change
+
+		@param ubo			The UBO to fill
+		@param uboData		The data to fill the UBO with
+	*/
+	template<typename T>
+	void fillUniformBuffer(const UBO& ubo, const T& uboData)
+	{
+		for (size_t i = 0; i < ubo.buffersMemory.size(); i++) {
+			void* data;
+			vkMapMemory(mContext->device, ubo.buffersMemory[i], 0, sizeof(T), 0, &data);
+			memcpy(data, &uboData, sizeof(T));
+			vkUnmapMemory(mContext->device, ubo.buffersMemory[i]);
+		}
+	}
+
 	/** @brief Set the background clear color to a given value
 
 		@param clearColor	The Color to set the background color as
 	*/
 	void setClearColor(VkClearValue clearColor);
 	
-	/** @brief Set the MVP buffer for a shadow-casting light source
+	/** @brief Set the lights that cast shadows
+
+		The first directional light gets cascaded shadow maps: the camera's view frustum
+		(up to ShadowSettings::maxDistance) is split into ShadowSettings::cascadeCount
+		slices, each with its own orthographic shadow map layer.
+
+		Spot lights are packed into a single atlas layer and rendered in one pass,
+		switching the viewport per tile. Tiles are resized every frame from the light's
+		screen coverage and importance. Lights off screen are not given a tile.
+
+		Until this is called, nothing casts shadows.
+
+		@param lights	The shadow-casting lights, at most one per LightUBO light
+	*/
+	void setShadowLights(const std::vector<ShadowLight>& lights);
+
+	/** @brief Change the shadow map's resolution, format, cascade count or caching
+
+		Changes to the shadow map's layout recreate it and its pipeline (not the
+		swapchain) and update every Renderable that samples it. Either way, every
+		shadow view is re-rendered on the next frame.
+
+		@param settings The new shadow settings
+	*/
+	void setShadowSettings(const ShadowSettings& settings);
+
+	/** @brief Get the current shadow settings */
+	const ShadowSettings& getShadowSettings() const { return mShadowSettings; }
 
-		Set the MVP buffer for a shadow-casting light source. Currently
-		This only supports a single light source, but could be modified to support
-		several
+	/** @brief Get the UBO holding the shadow matrices (a ShadowUBO)
 
-		@param mvp		The mvp matrix to set.
+		Shadow receivers bind this alongside the ShadowMap to find where
+		they are in the shadow map.
 	*/
-	void setLightMVPBuffer(const glm::mat4& mvp);
+	std::shared_ptr<UBO> getShadowUBO() const { return mShadowUBO; }
 
 	/** @brief Get the ShadowMap
 
@@ -198,27 +339,158 @@ public:
 	*/
 	ShadowMap getShadowMap() const { return mShadowMap; };
 
+	/** @brief Set the lights shaded by the clustered lighting
+
+		Every frame, the lights are binned into a grid of clusters over the camera's
+		view frustum, so each fragment only loops over the lights that can reach it.
+		Point and spot light ranges come from their attenuation (see
+		LightClusterGrid::computeLightRange()), directional lights reach every cluster.
+
+		The first MAX_LIGHTS lights are the shadow casting ones, the ones ShadowLight::lightIndex
+		refers to. There is no limit on the count: the light buffer doubles in size whenever
+		the lights outgrow it, which waits for the device to go idle.
+
+		@param lights The lights in the scene
+	*/
+	void setLights(const std::vector<Light>& lights);
+
+	/** @brief Get the UBO describing the cluster grid (a ClusterUBO) */
+	std::shared_ptr<UBO> getClusterUBO() const { return mClusterUBO; }
+
+	/** @brief Get the storage buffer holding every light (a LightBufferHeader, then an array of Light) */
+	std::shared_ptr<UBO> getLightBuffer() const { return mLightBuffer; }
+
+	/** @brief Get the storage buffer holding each cluster's light indices (see LightClusterGrid) */
+	std::shared_ptr<UBO> getClusterLightBuffer() const { return mClusterLightBuffer; }
+
+	/** @brief Get the light clusters built for the last frame */
+	const LightClusterGrid& getLightClusters() const { return mLightClusters; }
+
+	/** @brief Set the camera the scene is viewed from
+
+		The camera's matrices are used to cull Renderables outside of the
+		view frustum before recording the color pass. Should be called once per
+		frame, after the camera has been updated.
+
+		@param camera	The camera viewing the scene
+	*/
+	void setCamera(const Camera& camera);
+
+	/** @brief Choose how renderables hidden behind other geometry are culled
+
+		Switching to or from HiZ rebuilds the swapchain resources, since HiZ culling
+		splits the color pass in two and samples the depth buffer. Software culling
+		only uses Renderables that have been given an occluder with Renderable::setOccluder().
+
+		@param mode The occlusion culling mode to use
+	*/
+	void setOcclusionCullingMode(OcclusionCullingMode mode);
+
+	/** @brief Get the occlusion culling mode in use */
+	OcclusionCullingMode getOcclusionCullingMode() const { return mOcclusionCullingMode; }
+
+	/** @brief Lay down the depth of every visible renderable before shading it
+
+		The color pass becomes two subpasses: the first draws each renderable with
+		only its vertex stages, the second shades with an EQUAL depth test and depth
+		writes off, so every pixel runs the fragment shader at most once. Worth it for
+		scenes with expensive fragment shaders and a lot of overlap. Rebuilds the
+		swapchain resources (the render passes and every Renderable's pipelines).
+
+		@param enabled Use the depth pre-pass
+	*/
+	void setDepthPrePass(bool enabled);
+
+	/** @brief Check whether the depth pre-pass is in use */
+	bool isDepthPrePassEnabled() const { return mDepthPrePass; }
+
+	/** @brief Light the scene once per pixel from a G-buffer, instead of once per fragment drawn
+
+		The color pass becomes three subpasses:
+		- geometry: renderables with a G-buffer shader (see Renderable::setGBufferShader())
+			write albedo, normals and specular to the G-buffer, with their material's variant
+			applied (normal mapping, and the shininess stored for the lighting pass)
+		- lighting: a fullscreen triangle reads the G-buffer and depth as input attachments
+			and shades every pixel with the clustered lights and shadow maps
+		- forward: renderables without a G-buffer shader are drawn on top, as before
+
+		Since every pixel is lit once, shading cost no longer grows with overdraw, so the
+		depth pre-pass is not used. Rebuilds the swapchain resources.
+
+		@param enabled Use deferred shading
+	*/
+	void setDeferredShading(bool enabled);
+
+	/** @brief Check whether deferred shading is in use */
+	bool isDeferredShadingEnabled() const { return mDeferredShading; }
+
+	/** @brief Get the fragment shader of the deferred lighting pass
+
+		Its shadow filtering specialization constants match the forward shadow receivers'
+		(constant_id 0 to 2), and are applied the next time the lighting pipeline is created.
+	*/
+	std::shared_ptr<Shader> getDeferredLightingShader() const { return mDeferredLightingShaderSet.fragShader; }
+
+	/** @brief Get the pipeline statistics of the most recently completed frame
+
+		Useful to compare fragment shader invocations with and without the depth pre-pass.
+	*/
+	const PipelineStatistics& getPipelineStatistics() const { return mPipelineStatistics; }
+
 	std::vector<std::shared_ptr<Renderable>> mRenderables;	///<The renderables currently in use and being rendered
 private:
 	std::shared_ptr<VulkanContext> mContext;				///< The Vulkan Context object
 	std::shared_ptr<CommandPool> mCommandPool;				///< The Command Pool for allocating command buffers
 	std::shared_ptr<BufferManager> mBufferManager;			///< The Buffer Manager for allocating and performing buffer operations
 	std::shared_ptr<ImageManager> mImageManager;			///< The Image Manager for allocation and performing Image operations
+	std::shared_ptr<VulkanObjectCache> mObjectCache;		///< Shared samplers, set layouts and pipeline layouts
 
 	std::unique_ptr<Swapchain> mSwapchain;					///< The Primary Swapchain Object
 	std::vector<VkCommandBuffer> mCommandBuffers;			///< The Main command buffers in use (same size as the swapchain)
 
 	std::vector<std::shared_ptr<Mesh>> mMeshes;				///< All meshes that have been created
 	std::vector<std::shared_ptr<Shader>> mShaders;			///< All shader objects that have been created
+	std::map<std::tuple<std::string, VkShaderStageFlagBits, SpecializationConstants>, std::shared_ptr<Shader>> mShaderVariants;	///< Specialized shaders by file, stage and constants
+	PipelineRegistry mPipelineRegistry;						///< The renderable pipelines, shared between renderables with the same description
+	std::map<std::string, RenderableSetLayout> mDescriptorSetLayouts;	///< The renderable set layouts and their templates, shared between renderables with the same bindings (see PipelineRegistry::makeLayoutKey())
+	std::map<std::string, PipelineJob> mPipelineJobs;		///< Renderable pipelines compiling on mThreadPool, by registry key
+	std::vector<std::pair<std::shared_ptr<GraphicsPipeline>, uint64_t>> mRetiredPipelines;	///< Replaced pipelines kept alive for the frames in flight, with the frame they were replaced on
 	std::vector<std::shared_ptr<Texture>> mTextures;		///< All texture objects that have been created
 	std::vector<std::shared_ptr<UBO>> mUniformBuffers;		///< All UBOs that have been created
 
+	std::unique_ptr<Camera> mCamera;						///< Copy of the camera viewing the scene (null until setCamera() is called)
+	CullingBatch mCullingBatch;								///< World space bounds of all renderables, rebuilt every frame
+	std::vector<uint32_t> mVisibleRenderables;				///< Indices into mRenderables of the renderables that passed culling
+	std::vector<Bounds> mWorldBounds;						///< World space bounds of every renderable, gathered by cullRenderables()
+	std::unique_ptr<ThreadPool> mThreadPool;				///< Worker threads for CPU work done alongside rendering
+
+	OcclusionCullingMode mOcclusionCullingMode = OcclusionCullingMode::None;	///< How hidden renderables are culled
+	bool mDepthPrePass = false;								///< Is the color pass preceded by a depth only subpass
+	bool mDeferredShading = false;							///< Is the color pass split into geometry, lighting and forward subpasses
+	VkQueryPool mStatisticsQueryPool = VK_NULL_HANDLE;		///< One pipeline statistics query per swapchain image
+	std::vector<bool> mStatisticsPending;					///< Per swapchain image: was a query recorded that hasn't been read back
+	PipelineStatistics mPipelineStatistics;					///< Results of the last query read back
+	std::unique_ptr<OcclusionCuller> mOcclusionCuller;		///< Hi-Z depth pyramid and GPU culling pipelines
+	std::unique_ptr<MaterialLibrary> mMaterialLibrary;		///< Every material and its textures, bound at MATERIAL_DESCRIPTOR_SET
+	std::vector<OcclusionObject> mOcclusionObjects;			///< Per renderable data uploaded to the occlusion culler each frame
+	MaskedOcclusionBuffer mSoftwareOcclusion;				///< CPU depth buffer for software occlusion culling
+	std::vector<OccluderInstance> mOccluders;				///< The occluders rasterized this frame
+
+	std::vector<Light> mLights;								///< The lights set by setLights()
+	LightClusterGrid mLightClusters;						///< Bins mLights into clusters every frame
+	std::shared_ptr<UBO> mClusterUBO;						///< The cluster grid description (a ClusterUBO)
+	std::shared_ptr<UBO> mLightBuffer;						///< Storage buffer of every light
+	std::vector<std::vector<Light>> mUploadedLights;		///< Per swapchain image: the lights its light buffer currently holds
+	std::shared_ptr<UBO> mClusterLightBuffer;				///< Storage buffer of the cluster ranges and light indices
+
 
 	//more closely attached to a renderpass than swapchain
 	std::vector<VkFramebuffer> mSwapchainFramebuffers;		///< The framebuffers the pipelines write to
 	VkRenderPass mColorPass;								///< The Second, standard renderpass
+	VkRenderPass mColorLatePass = VK_NULL_HANDLE;			///< Continues the color pass after the late occlusion test (HiZ mode only)
 	VkRenderPass mShadowRenderPass;							///< The first renderpass, creating a shadow map
-	VkDescriptorPool mDescriptorPool;						///< The Descriptor Pool DescriptorSets allocate from
+	std::unique_ptr<DescriptorAllocator> mDescriptorAllocator;		///< Allocates the descriptor sets that live as long as the RenderSystem
+	std::vector<DescriptorAllocator> mFrameDescriptorAllocators;	///< Per frame in flight: allocates sets used by that frame only
 
 #pragma region DepthBuffer
 	VkImage mDepthImage;									///< The image the depth buffer writes to
@@ -226,18 +498,55 @@ private:
 	VkDeviceMemory mDepthImageMemory;						///< The memory the depth buffer is allocated from
 	VkImageView mDepthImageView;							///< A VkImageView to the Depth Buffer image
 #pragma endregion
+
+#pragma region DeferredShading
+	GBuffer mGBuffer;										///< The G-buffer attachments (only created in deferred mode)
+	ShaderSet mDeferredLightingShaderSet;					///< The fullscreen vertex shader and the lighting fragment shader
+	SharedDescriptorSetLayout mDeferredDescriptorSetLayout;		///< Input attachments, lighting UBOs, shadow maps and light buffers of the lighting pass
+	std::vector<VkDescriptorSet> mDeferredDescriptorSets;	///< One lighting pass descriptor set per swapchain image
+	std::shared_ptr<UBO> mDeferredUBO;						///< The camera data the lighting pass reconstructs positions with (a DeferredLightingUBO)
+	VkPipeline mDeferredLightingPipeline = VK_NULL_HANDLE;				///< Draws the lighting subpass' fullscreen triangle
+	SharedPipelineLayout mDeferredLightingPipelineLayout;				///< The layout of mDeferredLightingPipeline
+#pragma endregion
 	
 
 #pragma region ShadowMapping
+	ShadowSettings mShadowSettings;							///< Resolution, format and cascade layout of the shadow map
 	ShadowMap mShadowMap;									///< A ShadowMap object for the shadow pass
-	std::vector<VkFramebuffer> mShadowFramebuffers;			///< The framebuffers the shadow map's pipeline outputs to
+	std::vector<VkFramebuffer> mShadowFramebuffers;			///< The framebuffers the shadow map's pipeline outputs to (one per layer)
 	VkPipeline mShadowMapPipeline;							///< The pipeline the ShadowMap is processeed in
-	VkPipelineLayout mShadowMapPipelineLayout;				///< The layout of the ShadowMap's pipeline
+	SharedPipelineLayout mShadowMapPipelineLayout;			///< The layout of the ShadowMap's pipeline
 	ShaderSet mShadowMapShaderSet;							///< The Shaders used in the Shadow Pass (just one vertex shader)
-	VkDescriptorSetLayout mShadowMapDescriptorSetLayout;	///< The DescriptorSetLayout for the ShadowMap pipeline
+	SharedDescriptorSetLayout mShadowMapDescriptorSetLayout;	///< The DescriptorSetLayout for the ShadowMap pipeline
 	std::vector<VkDescriptorSet> mShadowMapDescriptorSets;	///< The DescriptorSets for all the resources sent to the Shaders processing the ShadowMap
-	std::shared_ptr<UBO> mShadowCasterUBO;					///< A UBO for holding the mvp matrices for the shadow-casting object
+	std::shared_ptr<UBO> mShadowUBO;						///< A UBO holding the shadow views, read by the shadow pass and receivers
+	ShadowUBO mShadowData;									///< The shadow views for the current frame, uploaded to mShadowUBO in drawFrame()
 	std::vector<VkCommandBuffer> mShadowCommandBuffers;		///< Command Buffers for processing the ShadowMap
+	std::vector<ShadowLight> mShadowLights;					///< The lights casting shadows, set by setShadowLights()
+	ShadowAtlas mShadowAtlas;								///< Packs the spot light views into the atlas layer
+	uint32_t mShadowViewCount = 0;							///< The number of views in mShadowData this frame
+	uint32_t mCascadeViewCount = 0;							///< The number of those views that are cascades (the rest are atlas tiles)
+	std::vector<ShadowAtlasTile> mAtlasTiles;				///< The atlas tile of each view after the cascades
+	std::vector<Frustum> mLightFrustums;					///< The frustum of each shadow view, used to cull shadow casters
+	std::vector<uint32_t> mLightVisibleRenderables;			///< Indices into mRenderables inside a light frustum (scratch space for cullShadowCasters())
+	std::vector<std::vector<uint32_t>> mShadowCasters;		///< Indices into mRenderables of the renderables drawn into each shadow view
+	std::vector<uint32_t> mShadowViewKeys;					///< Per shadow view: its slot in mShadowViewCache (light index * MAX_SHADOW_CASCADES + cascade)
+	std::vector<uint32_t> mShadowViewIntervals;				///< Per shadow view: how many frames a change may wait before it is re-rendered
+	std::vector<ShadowViewCache> mShadowViewCache;			///< What each light's region of the shadow map currently holds
+	std::vector<uint32_t> mRefreshedShadowViews;			///< The shadow views re-rendered this frame (none skips the shadow submission)
+	uint64_t mShadowFrame = 0;								///< Counts the frames drawn, for staggering shadow refreshes
+	bool mShadowReceiverVisible = false;					///< Whether anything on screen samples the shadow maps this frame
+
+	VkRenderPass mPointShadowRenderPass;					///< Renders every point light's cube in one pass
+	VkFramebuffer mPointShadowFramebuffer;					///< A layered framebuffer over every cube face
+	VkPipeline mPointShadowPipeline;						///< Vertex + geometry shader pipeline that picks each triangle's cube faces
+	SharedPipelineLayout mPointShadowPipelineLayout;		///< The layout of mPointShadowPipeline
+	ShaderSet mPointShadowShaderSet;						///< The shaders used for point light shadows (vertex and geometry)
+	uint32_t mPointShadowCount = 0;							///< The number of cubes in use this frame
+	std::vector<std::vector<PointShadowCaster>> mPointShadowCasters;	///< The casters of each cube, with the faces they reach
+	uint64_t mPointShadowSignature = 0;						///< Hash of the cubes and their casters when they were last rendered
+	bool mPointShadowsValid = false;						///< Whether the cube array holds what mPointShadowSignature describes
+	bool mRefreshPointShadows = false;						///< Whether the cubes are re-rendered this frame
 #pragma endregion
 
 #pragma region Synchronization
@@ -245,7 +554,11 @@ private:
 	std::vector<VkSemaphore> mShadowMapAvailableSemaphores;	///< Semaphores for indicating that a new ShadowMap has been created
 	std::vector<VkSemaphore> mRenderFinishedSemaphores;		///< Semaphores for indicating that a new frame has finished rendering
 	std::vector<VkFence> mFrameFences;						///< Fences that ensure a frame does not start being drawn until the last frame with the same index is done.
+	std::vector<VkFence> mImagesInFlight;					///< The frame fence last used with each swapchain image, so its command buffers can be safely re-recorded
 	size_t mCurrentFrame = 0;								///< The current frame that is being drawn (index into the framebuffer array
+	uint64_t mFrameNumber = 0;								///< Frames drawn so far, to tell when a retired pipeline is no longer in flight
+	std::chrono::steady_clock::time_point mInitializeTime;	///< When initialize() started, to report the time to the first frame
+	bool mFirstFramePresented = false;						///< Has the time to the first frame been reported
 #pragma endregion
 
 	VkClearValue mClearColor = { 0.0f, 0.0f, 0.0f, 1.0f };	///< The color that the screen will be cleared to
@@ -260,12 +573,22 @@ private:
 	/** @brief Recreate the Swapchain
 		
 		If large changes to the RenderSystem are made (such as changing the clear color),
-		the swapchain will need to be recreated with the new settings through this method
+		the swapchain will need to be recreated with the new settings through this method.
+		Only the size dependent resources are rebuilt, unless the image format changed or
+		rebuildColorPass is set.
+
+		@param rebuildColorPass	Also rebuild the color passes and their pipelines (i.e. their subpasses changed)
 	*/
-	void recreateSwapchain();
-	/** @brief Cleanup Swapchain-related resources
+	void recreateSwapchain(bool rebuildColorPass = false);
+	/** @brief Cleanup the Swapchain and the resources that depend on its size
 	*/
 	void cleanupSwapchain();
+	/** @brief Create the color render passes and every pipeline used in them
+	*/
+	void createColorPass();
+	/** @brief Cleanup the color render passes and their pipelines
+	*/
+	void cleanupColorPass();
 
 
 
@@ -277,17 +600,87 @@ private:
 	/** @brief Create a new pipeline
 		
 		@param pipeline				The pipeline to create
-		@param pipelineLayout		The layout for the pipeline, created in this method
-		@param descriptorSetLayout	Descripes Which types of resources the 
-										pipeline should expect as inputs for the shaders
+		@param pipelineLayout		The layout for the pipeline, from the object cache (shared with pipelines of the same layout)
+		@param setLayouts			Descripes Which types of resources the 
+										pipeline should expect as inputs for the shaders, one layout per set
 		@param shaderStages			The shaders that the pipline will use
 		@param renderPass			The renderPass the pipeline will use
+		@param pushConstantRanges	The push constants the shaders read (none by default)
+		@param dynamicStates		State set while recording besides the viewport and scissor, which always are (none by default)
+		@param outputState			Subpass, depth and color output state (the color pass defaults if not given)
+		@param flags				Creation flags (i.e. VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT for a quick compile)
 	*/
 	void createPipeline(VkPipeline&				pipeline, 
-						VkPipelineLayout&		pipelineLayout, 
-						VkDescriptorSetLayout&	descriptorSetLayout, 
+						SharedPipelineLayout&	pipelineLayout, 
+						const std::vector<SharedDescriptorSetLayout>& setLayouts, 
 						const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages, 
-						VkRenderPass&			renderPass);
+						VkRenderPass&			renderPass,
+						const std::vector<VkPushConstantRange>& pushConstantRanges = {},
+						const std::vector<VkDynamicState>& dynamicStates = {},
+						const PipelineOutputState& outputState = PipelineOutputState(),
+						VkPipelineCreateFlags	flags = 0);
+
+	/** @brief Get the descriptor set layout and update template for a set of Renderable bindings, creating them if no other Renderable uses the same
+		@param layoutBindings	The renderable's bindings, by binding number
+		@param layoutFlags		The layout's creation flags (VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR for a pushed set)
+	*/
+	const RenderableSetLayout& getDescriptorSetLayout(const std::map<uint32_t, VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags);
+
+	/** @brief Get the creation flags of a Renderable's set layout
+		@param renderable The renderable, with its descriptor mode chosen
+	*/
+	static VkDescriptorSetLayoutCreateFlags getLayoutFlags(const Renderable& renderable);
+
+	/** @brief Create a Renderable's color pipeline, and its depth only pipeline when the depth pre-pass is on
+		@param renderable	The renderable, with its descriptor set layout already created
+		@param quickStart	Compile unoptimized pipelines first, swapping in optimized ones when they are done
+	*/
+	void createRenderablePipelines(std::shared_ptr<Renderable>& renderable, bool quickStart);
+
+	/** @brief Get a pipeline for a Renderable from mPipelineRegistry, or queue its compile on mThreadPool
+
+		Renderables waiting for the same description share one compile. The pipeline is
+		handed to the Renderable by collectRenderablePipelines(), until then it isn't drawn.
+
+		@param renderable	The renderable, with its descriptor set layout already created
+		@param shaderStages	The shaders that the pipeline will use
+		@param outputState	Subpass, depth and color output state
+		@param depthOnly	Set the Renderable's depth pre-pass pipeline instead of its color pipeline
+		@param quickStart	Also queue an unoptimized compile, used until the optimized one is ready, if the pipeline has to be compiled
+	*/
+	void requestRenderablePipeline(std::shared_ptr<Renderable>& renderable,
+								   const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+								   const PipelineOutputState& outputState,
+								   bool depthOnly,
+								   bool quickStart);
+
+	/** @brief Compile a renderable pipeline, run on the worker threads
+		@param setLayout	The Renderable's descriptor set layout (set RENDERABLE_DESCRIPTOR_SET, after the material set)
+		@param renderPass	The color pass
+		@param shaderStages	The shaders that the pipeline will use (a ShaderStageCopy's, owned by the job)
+		@param outputState	Subpass, depth and color output state
+		@param flags		Pipeline creation flags
+	*/
+	std::shared_ptr<GraphicsPipeline> compileRenderablePipeline(SharedDescriptorSetLayout setLayout,
+																VkRenderPass renderPass,
+																const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+																PipelineOutputState outputState,
+																VkPipelineCreateFlags flags);
+
+	/** @brief Register the pipelines that finished compiling and hand them to the Renderables waiting for them
+		@param wait Block until every queued compile is done
+	*/
+	void collectRenderablePipelines(bool wait);
+
+	/** @brief Destroy the replaced pipelines that no frame in flight uses anymore
+		@param deviceIdle Release all of them, as the device is idle
+	*/
+	void releaseRetiredPipelines(bool deviceIdle);
+
+	/** @brief Check whether a Renderable has every pipeline the color pass needs
+		@param renderable The renderable
+	*/
+	bool isDrawable(const std::shared_ptr<Renderable>& renderable) const;
 
 	/** @brief Create a color renderPass object for the main pass
 	*/
@@ -306,15 +699,21 @@ private:
 	//Descriptors
 	//---------------
 
-	/** @brief Create the DescriptorPool
+	/** @brief Create the descriptor allocators
 		
-		The Descriptor Pool is memory pool for allocating DescriptorSets from.
+		Their pools are sized for DESCRIPTOR_POOL_SETS sets of the kind this renderer
+		makes (a few buffers and shadow maps each), more pools are added as they fill up.
+	*/
+	void createDescriptorAllocators();
+
+	/** @brief Allocate a descriptor set for the frame being recorded
 
-		@param maxSets				The maximum number of descriptor sets in the application
-		@param maxUniformBuffers	The maximum number of UBOs that will be used
-		@param maxImageSamplers		The maximum number of Image/Samplers(i.e. Textures) in the application.
+		The set is freed once the frame has finished (when its fence is waited on
+		again), for descriptors that are written anew every frame.
+
+		@param setLayout The layout of the set
 	*/
-	void createDescriptorPool(uint32_t maxSets, uint32_t maxUniformBuffers, uint32_t maxImageSamplers);
+	VkDescriptorSet allocateFrameDescriptorSet(VkDescriptorSetLayout setLayout);
 
 	/** @brief Create a DescriptorSetLayout for the Shadow pass */
 	void createShadowMapDescriptorSetLayout();
@@ -322,6 +721,18 @@ private:
 	/** @brief Create the necessary Descriptor Sets to create a shadow map. */
 	void createShadowMapDescriptorSets();
 
+	/** @brief Create the DescriptorSetLayout of the deferred lighting pass */
+	void createDeferredDescriptorSetLayout();
+
+	/** @brief Allocate the deferred lighting pass' descriptor sets (written by writeDeferredDescriptorSets()) */
+	void createDeferredDescriptorSets();
+
+	/** @brief Point the deferred lighting pass' descriptor sets at the current G-buffer, depth buffer and shadow maps
+
+		Called whenever one of them is recreated, so the device must be idle.
+	*/
+	void writeDeferredDescriptorSets();
+
 
 
 
@@ -332,22 +743,247 @@ private:
 	/** @brief Create the primary command buffers for the main pass */
 	void createCommandBuffers();
 
+	/** @brief Record the main pass for a single swapchain image
+
+		Only the renderables in mVisibleRenderables are drawn.
+
+		@param imageIndex	The index of the swapchain image (and command buffer) to record
+	*/
+	void recordCommandBuffer(uint32_t imageIndex);
+
+	/** @brief Record draws for every renderable that passed frustum culling
+
+		@param commandBuffer	The command buffer to record into (inside a render pass)
+		@param imageIndex		The swapchain image index, used to select descriptor sets
+		@param indirect			Use the occlusion culler's draw commands instead of direct draws
+		@param latePass			Use the late phase draw commands (only used when indirect is true)
+		@param pass				Which renderables to draw, and with which of their pipelines
+	*/
+	void drawVisibleRenderables(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool indirect, bool latePass, RenderablePass pass = RenderablePass::Color);
+
+	/** @brief Record one phase of the color pass (early or late), including the depth pre-pass if it is on
+
+		In deferred mode with HiZ culling, the early phase only fills the G-buffer. The late phase
+		adds the late geometry, then lights the pixels and draws the forward renderables of both phases.
+
+		@param commandBuffer	The command buffer to record into (inside the phase's render pass)
+		@param imageIndex		The swapchain image index, used to select descriptor sets
+		@param indirect			Use the occlusion culler's draw commands instead of direct draws
+		@param latePass			Use the late phase draw commands (only used when indirect is true)
+	*/
+	void drawColorPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool indirect, bool latePass);
+
+	/** @brief Create the pipeline statistics query pool (one query per swapchain image) */
+	void createStatisticsQueryPool();
+
+	/** @brief Read back the statistics of the last frame that used a swapchain image
+		@param imageIndex The swapchain image, whose last frame must have completed
+	*/
+	void readPipelineStatistics(uint32_t imageIndex);
+
 	/** @brief Create the primary command buffers for the shadow pass */
 	void createShadowCommandBuffers();
 
+	/** @brief Record the shadow pass for a single swapchain image
+
+		Only the views in mRefreshedShadowViews are drawn, each clearing just its own
+		region first. Each cascade gets its own pass, then every refreshed atlas tile
+		is drawn in a single pass over the atlas layer.
+
+		@param imageIndex	The index of the swapchain image (and shadow command buffer) to record
+	*/
+	void recordShadowCommandBuffer(uint32_t imageIndex);
+
+	/** @brief Bind the shadow pipeline and its descriptor set
+		@param commandBuffer	The command buffer being recorded
+		@param imageIndex		The index of the swapchain image (selects the descriptor set)
+	*/
+	void bindShadowPipeline(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	/** @brief Set the viewport and scissor of the pipelines drawn next
+		@param commandBuffer	The command buffer being recorded
+		@param region			The region of the framebuffer to draw to
+	*/
+	static void setViewport(VkCommandBuffer commandBuffer, const VkRect2D& region);
+
+	/** @brief Clear a shadow view's region and draw its shadow casters into it
+		@param commandBuffer	The command buffer being recorded, inside a shadow render pass
+		@param view				The index of the view in mShadowData
+		@param region			The texels of the layer the view renders to (viewport and scissor)
+	*/
+	void drawShadowCasters(VkCommandBuffer commandBuffer, uint32_t view, const VkRect2D& region);
+
 	/** @brief Draw a renderable object
 
 		Draw a renderable object. This method should be called during command buffer construction
 
 		@param commandBuffer	A commandBuffer that is in the middle of recording
 		@param model			A renderable object ready to be rendered
-		@param descriptorSet	A descriptor set for binding the required resources for the draw command
+		@param imageIndex		The swapchain image the command buffer is for
+	*/
+	void drawRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, uint32_t imageIndex);
+
+	/** @brief Bind a renderable's vertex buffer, index buffer and descriptors, and push its material, without drawing
+
+		The descriptors are bound, pushed or written to a set for this frame, depending on
+		the Renderable's DescriptorMode.
+
+		@param commandBuffer	The command buffer to record to
+		@param model			The renderable to bind
+		@param imageIndex		The swapchain image the command buffer is for
+	*/
+	void bindRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, uint32_t imageIndex);
+
+	/** @brief Find which renderables are visible from the camera
+
+		Gathers the world space bounds of every renderable and tests them against
+		the camera's view frustum, filling mVisibleRenderables. If no camera
+		has been set, every renderable is considered visible.
+	*/
+	void cullRenderables();
+
+	/** @brief Bin the lights into clusters and upload them for a swapchain image
+
+		Writes the image's buffers directly, so it must only be called once the
+		image's previous frame has finished. Without a camera every light is global.
+
+		@param imageIndex The swapchain image being drawn
+	*/
+	void updateLightClusters(uint32_t imageIndex);
+
+	/** @brief Copy the lights that changed into a swapchain image's light buffer
+
+		Each image's buffer is compared against what it was last given, and only
+		the runs of lights that differ are written.
+
+		@param imageIndex The swapchain image being drawn
+	*/
+	void uploadLights(uint32_t imageIndex);
+
+	/** @brief Recreate the light buffer so that lightCount lights fit
+
+		Rewrites every descriptor set the buffer is bound to, so it waits for the device to go idle.
+
+		@param lightCount The number of lights to make room for
 	*/
-	void drawRenderable(VkCommandBuffer commandBuffer, std::shared_ptr<Renderable> model, VkDescriptorSet& descriptorSet);
+	void growLightBuffer(size_t lightCount);
+
+	/** @brief Create and persistently map the buffers of a storage buffer
+
+		@param buffer	The storage buffer to fill in
+		@param size		The size of each buffer in bytes
+	*/
+	void allocateStorageBuffer(UBO& buffer, VkDeviceSize size);
+
+	/** @brief Find which renderables need to be drawn into the shadow map
+
+		Lays out this frame's shadow views, then fills mShadowCasters with the
+		shadow casters inside each view's light frustum.
+		If none of the renderables visible to the camera receive shadows, the
+		shadow map is never sampled and mShadowCasters is left empty.
+		Relies on the bounds and visibility gathered by cullRenderables().
+	*/
+	void cullShadowCasters();
+
+	/** @brief Decide which shadow views need to be re-rendered this frame
+
+		A view is refreshed when its matrix or any of its casters changed, unless it
+		was refreshed less than its interval ago. Cascades skip the wait once the camera
+		has turned more than ShadowSettings::maxCascadeTurn since they were rendered,
+		as the slice they cover no longer matches the view. Views that are not refreshed go back
+		to the matrix they were rendered with, so receivers still line up with the map.
+		Only called from drawFrame(), as it assumes the recorded pass will be submitted.
+	*/
+	void updateShadowCache();
+
+	/** @brief Hash everything that affects a shadow view's contents
+		@param view The index of the view in mShadowData
+	*/
+	uint64_t computeShadowSignature(uint32_t view) const;
+
+	/** @brief Continue an FNV-1a hash over a block of memory
+		@param hash	The hash so far
+		@param data	The bytes to add
+		@param size	The number of bytes
+	*/
+	static uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
+
+	/** @brief Build this frame's shadow views from mShadowLights
+
+		Cascades come first, then the spot lights in the order the atlas was packed.
+		Fills mShadowData, mLightFrustums, mAtlasTiles and the cache keys and
+		refresh intervals of each view.
+	*/
+	void updateShadowViews();
+
+	/** @brief Fit a directional light's cascades to the camera
+
+		Splits the camera frustum with the practical split scheme (a blend of
+		logarithmic and uniform splits) and fits an orthographic projection around
+		each slice's bounding sphere, snapped to whole texels so shadows don't
+		shimmer as the camera moves. Appends one shadow view per cascade.
+
+		@param light	The directional light
+	*/
+	void updateShadowCascades(const ShadowLight& light);
+
+	/** @brief Set up the six face matrices of a point light's cube
+		@param light	The point light
+		@param cube		The cube (of the cube array) the light renders into
+	*/
+	void updatePointShadowCube(const ShadowLight& light, uint32_t cube);
+
+	/** @brief Find the casters of every cube, and which faces each caster reaches
+
+		Each caster is tested against the six face frustums, so the geometry
+		shader only emits triangles to faces they can land on.
+	*/
+	void cullPointShadowCasters();
+
+	/** @brief Hash everything that affects the cube shadow maps */
+	uint64_t computePointShadowSignature() const;
+
+	/** @brief Whether a light's reach overlaps the camera's view frustum
+		@param light	The light, its position and range are tested
+	*/
+	bool isLightOnScreen(const ShadowLight& light) const;
+
+	/** @brief Estimate the atlas tile size a spot light deserves
+
+		Projects the light's range onto the screen, so a light filling the
+		screen gets the largest tile and distant lights get smaller ones.
+
+		@param light	The spot light
+		@return The requested tile size in texels, 0 if the light can't be seen
+	*/
+	uint32_t computeAtlasTileSize(const ShadowLight& light) const;
+
+	/** @brief Start rasterizing every renderable's occluder into the software occlusion buffer
+
+		Runs on the thread pool, the results are waited on in cullRenderables().
+	*/
+	void rasterizeOccluders();
+
+	/** @brief Whether the color pass starts with a depth only subpass (not in deferred mode) */
+	bool usesDepthPrePass() const { return mDepthPrePass && !mDeferredShading; }
 
 	/** @brief Create a depth buffer */
 	void createDepthBuffer();
 
+	/** @brief Create the G-buffer attachments, sized to the swapchain */
+	void createGBuffer();
+
+	/** @brief Destroy the G-buffer attachments, if there are any */
+	void cleanupGBuffer();
+
+	/** @brief Create the pipeline of the deferred lighting subpass */
+	void createDeferredLightingPipeline();
+
+	/** @brief Upload the camera data of the deferred lighting pass for a swapchain image
+		@param imageIndex The swapchain image being drawn, whose previous frame has finished
+	*/
+	void updateDeferredLightingUBO(uint32_t imageIndex);
+
 	/** @brief Create objects necessary to syncronize frame drawing 
 		Sync objects ensure that each stage of the drawFrame() method operates in
 		order, as calls to vkQueueSubmit and vkQueuePresentKHR are asynchronous.
@@ -363,6 +999,15 @@ private:
 	//ShadowMap	
 	//---------------
 
+	/** @brief Create everything that depends on the shadow settings
+
+		The shadow maps, their render passes, framebuffers and pipelines.
+	*/
+	void createShadowResources();
+
+	/** @brief Destroy the resources created by createShadowResources() */
+	void cleanupShadowResources();
+
 	/** @brief Create the ShadowMap, which is simply a depth map that can be used in the next render pass as ImageSampler input.
 		The resources created as part of the ShadowMap are as follows:
 			VkImage
@@ -372,18 +1017,29 @@ private:
 	void createShadowMap();
 
 	/** @brief Create a Pipeline for writing to the ShadowMap 
-		The pipeline created is simple, in that it contains only a single vertex shader
+		The pipeline created is simple, in that it contains only a single vertex shader.
+		The shader, descriptor set layout and UBO must already exist.
 	*/
 	void createShadowMapPipeline();
 
+	/** @brief Create a Pipeline for writing every point light's cube in one pass
+		A geometry shader emits each triangle once per cube face it reaches, selecting the face with gl_Layer.
+	*/
+	void createPointShadowPipeline();
+
 	/** @brief Create a RenderPass for writing to the ShadowMap 
-		@param shadowMap The ShadowMap the renderpass will write to when running
+		@param format		The depth format of the attachment
+		@param loadOp		LOAD to keep what is already in the image, CLEAR to start over
+		@param renderPass	The render pass created
 	*/
-	void createShadowRenderPass(const ShadowMap& shadowMap);
+	void createShadowRenderPass(VkFormat format, VkAttachmentLoadOp loadOp, VkRenderPass& renderPass);
 
-	/** @brief Create the FrameBuffers used as the output
+	/** @brief Create the FrameBuffers used as the output, one per layer of the shadow map
 		@param shadowRenderPass The VkRenderPass describing attachments
-		@param shadowImageView  The VkImageView object for the shadow map
+		@param shadowMap		The shadow map to render to
 	*/
-	void createShadowFramebuffers(VkRenderPass shadowRenderPass, VkImageView shadowImageView);
+	void createShadowFramebuffers(VkRenderPass shadowRenderPass, const ShadowMap& shadowMap);
+
+	/** @brief Create the layered framebuffer covering every face of the point light cube array */
+	void createPointShadowFramebuffer();
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "Renderable.h"
 
+#include <algorithm>
+#include <string>
+
 
 Renderable::Renderable(std::shared_ptr<VulkanContext> context) :
 	mContext(context)
@@ -7,7 +10,11 @@ Renderable::Renderable(std::shared_ptr<VulkanContext> context) :
 
 void Renderable::cleanup()
 {
-	vkDestroyDescriptorSetLayout(mContext->device, mDescriptorSetLayout, nullptr);
+	//the descriptor set layout, update template and pipelines are shared, the RenderSystem destroys them
+	mPipeline.reset();
+	mDepthPipeline.reset();
+	mDescriptorSetLayout.reset();
+	mUpdateTemplate = VK_NULL_HANDLE;
 }
 
 void Renderable::setMesh(std::shared_ptr<Mesh> mesh)
@@ -15,6 +22,41 @@ void Renderable::setMesh(std::shared_ptr<Mesh> mesh)
 	mMesh = mesh;
 }
 
+void Renderable::setModelMatrix(const glm::mat4& model)
+{
+	mModelMatrix = model;
+}
+
+void Renderable::setMaterial(uint32_t materialIndex)
+{
+	mMaterialIndex = materialIndex;
+}
+
+void Renderable::setOccluder(std::shared_ptr<OccluderMesh> occluder)
+{
+	mOccluder = occluder;
+}
+
+void Renderable::setCastsShadow(bool castsShadow)
+{
+	mCastsShadow = castsShadow;
+}
+
+void Renderable::setReceivesShadow(bool receivesShadow)
+{
+	mReceivesShadow = receivesShadow;
+}
+
+void Renderable::setDynamicBindings(bool dynamicBindings)
+{
+	mDynamicBindings = dynamicBindings;
+}
+
+Bounds Renderable::getWorldBounds() const
+{
+	return mMesh->getBounds().transformed(mModelMatrix);
+}
+
 void Renderable::bindTexture(std::shared_ptr<Texture> texture, uint32_t binding)
 {
 	std::cout << "Binding texture to " << binding << std::endl;
@@ -52,11 +94,25 @@ void Renderable::setShader(std::shared_ptr<Shader> shader, VkShaderStageFlagBits
 	default:
 		throw std::runtime_error("Cannot set shader in ShaderSet! Invalid ShaderStage parameter");
 	}
+
+	addReflectedBindings(shader->getInterface());
 }
 
 void Renderable::applyShaderSet(const ShaderSet& toApply)
 {
 	mShaderSet = toApply;
+	addReflectedBindings(toApply.getInterface());
+}
+
+void Renderable::setGBufferShader(std::shared_ptr<Shader> shader)
+{
+	if (shader && shader->getStage() != VK_SHADER_STAGE_FRAGMENT_BIT) {
+		throw std::runtime_error("G-buffer shader must be a fragment shader!");
+	}
+	mGBufferShader = shader;
+	if (shader) {
+		addReflectedBindings(shader->getInterface());
+	}
 }
 
 void Renderable::bindUniformBuffer(std::shared_ptr<UBO> bufferObject, uint32_t binding)
@@ -72,7 +128,20 @@ void Renderable::bindUniformBuffer(std::shared_ptr<UBO> bufferObject, uint32_t b
 	mBufferBindings[binding] = bufferObject;
 }
 
-void Renderable::bindShadowMap(const ShadowMap& shadowMap, uint32_t binding)
+void Renderable::bindStorageBuffer(std::shared_ptr<UBO> bufferObject, uint32_t binding)
+{
+	assert(bufferObject != nullptr);
+
+	std::cout << "Binding storage buffer to " << binding << std::endl;
+	if (mLayoutBindings.count(binding) == 0)
+		throw std::runtime_error("Cannot bind storage buffer, descriptor set layout binding does not exist!");
+	if (mLayoutBindings[binding].descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		throw std::runtime_error("Cannot bind storage buffer, binding.descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER");
+
+	mBufferBindings[binding] = bufferObject;
+}
+
+void Renderable::bindShadowMap(const ShadowMap& shadowMap, uint32_t binding, ShadowMapView view)
 {
 	std::cout << "Binding shadowMap to " << binding << std::endl;
 	if (mLayoutBindings.count(binding) == 0)
@@ -81,14 +150,53 @@ void Renderable::bindShadowMap(const ShadowMap& shadowMap, uint32_t binding)
 		throw std::runtime_error("Cannot bind texture, binding.descriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER!");
 
 	mShadowMapBindings[binding] = shadowMap;
+	mShadowMapViews[binding] = view;
+}
+
+void Renderable::updateShadowMap(const ShadowMap& shadowMap)
+{
+	if (mShadowMapBindings.empty())
+		return;
+
+	for (auto& shadowMapBinding : mShadowMapBindings) {
+		shadowMapBinding.second = shadowMap;
+	}
+
+	writeDescriptorData(mDescriptorData.size() / getDescriptorCount());
+	writeDescriptorSets();
+}
+
+void Renderable::updateBufferBinding(const std::shared_ptr<UBO>& bufferObject)
+{
+	bool bound = std::any_of(mBufferBindings.begin(), mBufferBindings.end(),
+		[&bufferObject](const std::pair<const uint32_t, std::shared_ptr<UBO>>& binding) { return binding.second == bufferObject; });
+	if (!bound)
+		return;
+
+	//the template writes every binding at once, the others are simply written again
+	writeDescriptorData(mDescriptorData.size() / getDescriptorCount());
+	writeDescriptorSets();
 }
 
 //Add a binding a particular shader is expecting to an std::map
 //This map will be referenced when binding resources to the renderable
 //	to check if the binding make sense
-//Ideally this would be done through a reflection process
 void Renderable::addShaderBinding(VkDescriptorType descriptorType, VkShaderStageFlagBits stage, uint32_t bindingNum, uint32_t count)
 {	
+	//bindings the shaders declare already exist, a declaration can only size a runtime array or add stages
+	auto reflected = mLayoutBindings.find(bindingNum);
+	if (reflected != mLayoutBindings.end()) {
+		VkDescriptorSetLayoutBinding& layoutBinding = reflected->second;
+		if (layoutBinding.descriptorType != descriptorType || (layoutBinding.descriptorCount != 0 && layoutBinding.descriptorCount != count)) {
+			throw std::runtime_error("Binding " + std::to_string(bindingNum) + " is declared as " + ShaderReflection::getTypeName(descriptorType) +
+				"[" + std::to_string(count) + "], but the shaders use " + ShaderReflection::getTypeName(layoutBinding.descriptorType) +
+				"[" + std::to_string(layoutBinding.descriptorCount) + "]");
+		}
+		layoutBinding.descriptorCount = count;
+		layoutBinding.stageFlags |= stage;
+		return;
+	}
+
 	VkDescriptorSetLayoutBinding layoutBinding = {};
 	layoutBinding.descriptorType = descriptorType;
 	layoutBinding.stageFlags = stage;
@@ -100,26 +208,70 @@ void Renderable::addShaderBinding(VkDescriptorType descriptorType, VkShaderStage
 	mLayoutBindings[bindingNum] = layoutBinding;
 }
 
-void Renderable::createDescriptorSetLayout()
+void Renderable::addReflectedBindings(const ShaderInterface& shaderInterface)
 {
-	//map is most convenient for adding & removing, but vkCreateDescriptorSetLayout
-	//wants a strict array
-	std::vector<VkDescriptorSetLayoutBinding> bindingsTmp;
-	bindingsTmp.reserve(mLayoutBindings.size());
-	for (auto const& bmap : mLayoutBindings) 
-		bindingsTmp.push_back(bmap.second);
+	for (const auto& set : shaderInterface.descriptorSets) {
+		if (set.first != MATERIAL_DESCRIPTOR_SET && set.first != RENDERABLE_DESCRIPTOR_SET) {
+			throw std::runtime_error("Renderable shaders can only use descriptor sets " + std::to_string(MATERIAL_DESCRIPTOR_SET) + " and " +
+				std::to_string(RENDERABLE_DESCRIPTOR_SET) + " (found set " + std::to_string(set.first) + ")!");
+		}
+	}
+
+	//the material set is the MaterialLibrary's, the shaders have to declare it as materials.glsl does
+	auto materialSet = shaderInterface.descriptorSets.find(MATERIAL_DESCRIPTOR_SET);
+	if (materialSet != shaderInterface.descriptorSets.end()) {
+		auto materialBindings = MaterialLibrary::getLayoutBindings();
+		for (const auto& binding : materialSet->second) {
+			if (binding.first >= materialBindings.size() ||
+				materialBindings[binding.first].descriptorType != binding.second.descriptorType ||
+				(binding.second.descriptorCount != 0 && binding.second.descriptorCount != materialBindings[binding.first].descriptorCount)) {
+				throw std::runtime_error("Material set binding " + std::to_string(binding.first) + " doesn't match materials.glsl!");
+			}
+		}
+	}
+
+	//every renderable pipeline has the same push constant range, holding the material index
+	VkPushConstantRange materialRange = MaterialLibrary::getPushConstantRange();
+	for (const auto& range : shaderInterface.pushConstantRanges) {
+		if (range.offset + range.size > materialRange.offset + materialRange.size || (range.stageFlags & ~materialRange.stageFlags) != 0) {
+			throw std::runtime_error("Renderable shaders can only push the material index (see materials.glsl)!");
+		}
+	}
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindingsTmp.size());
-	layoutInfo.pBindings = bindingsTmp.data();
+	auto set = shaderInterface.descriptorSets.find(RENDERABLE_DESCRIPTOR_SET);
+	if (set != shaderInterface.descriptorSets.end()) {
+		for (const auto& binding : set->second) {
+			auto existing = mLayoutBindings.find(binding.first);
+			if (existing == mLayoutBindings.end()) {
+				std::cout << "Adding reflected binding at " << binding.first << std::endl;
+				mLayoutBindings[binding.first] = binding.second;
+				continue;
+			}
 
-	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &mDescriptorSetLayout) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create descriptor set layout!");
+			//i.e. the G-buffer shader reading the same material as the forward shader
+			VkDescriptorSetLayoutBinding& layoutBinding = existing->second;
+			if (layoutBinding.descriptorType != binding.second.descriptorType ||
+				(binding.second.descriptorCount != 0 && layoutBinding.descriptorCount != binding.second.descriptorCount)) {
+				throw std::runtime_error("Shaders disagree on binding " + std::to_string(binding.first) + ": " +
+					ShaderReflection::getTypeName(layoutBinding.descriptorType) + "[" + std::to_string(layoutBinding.descriptorCount) + "] vs " +
+					ShaderReflection::getTypeName(binding.second.descriptorType) + "[" + std::to_string(binding.second.descriptorCount) + "]");
+			}
+			layoutBinding.stageFlags |= binding.second.stageFlags;
+		}
+	}
+
+	//every vertex shader input has to be fed by a Vertex attribute
+	auto attributes = Vertex::getAttributeDescriptions();
+	for (const auto& input : shaderInterface.vertexInputs) {
+		auto attribute = std::find_if(attributes.begin(), attributes.end(),
+			[&input](const VkVertexInputAttributeDescription& a) { return a.location == input.first; });
+		if (attribute == attributes.end() || !ShaderReflection::isInputCompatible(input.second, attribute->format)) {
+			throw std::runtime_error("Vertex shader input at location " + std::to_string(input.first) + " doesn't match the Vertex attributes!");
+		}
 	}
 }
 
-void Renderable::createDescriptorSets(const VkDescriptorPool& descriptorPool, uint32_t swapchainSize)
+void Renderable::createDescriptorSets(DescriptorAllocator& descriptorAllocator, uint32_t swapchainSize)
 {
 	if (mBufferBindings.size() + 
 		mTextureBindings.size() + 
@@ -127,124 +279,107 @@ void Renderable::createDescriptorSets(const VkDescriptorPool& descriptorPool, ui
 		throw std::runtime_error("Binding count mismatch!");
 	}
 
-	std::vector<VkDescriptorSetLayout> layouts(swapchainSize, mDescriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = swapchainSize;
-	allocInfo.pSetLayouts = layouts.data();
-
-	mDescriptorSets.resize(swapchainSize);
-	VkResult result = vkAllocateDescriptorSets(mContext->device, &allocInfo, &mDescriptorSets[0]);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate descriptor set!");
-	}
+	//buffers have one VkBuffer per swapchain image, textures and shadow maps are the same for every frame
+	size_t copies = mBufferBindings.empty() ? 1 : swapchainSize;
+	writeDescriptorData(copies);
 
+	//the other modes give the data to each draw instead
+	if (mDescriptorMode != DescriptorMode::Persistent)
+		return;
 
-	for (size_t i = 0; i < swapchainSize; i++)
-	{	
-		std::vector <VkWriteDescriptorSet> descriptorWrites = {};
-		using BufferInfoSet = std::pair<uint32_t, std::vector<VkDescriptorBufferInfo>>;		//each binding can have multiple infos associated (as in an array of buffers)
-		using ImageInfoSet = std::pair<uint32_t, std::vector<VkDescriptorImageInfo>>;
+	mDescriptorSets.resize(copies);
+	for (auto& descriptorSet : mDescriptorSets) {
+		descriptorSet = descriptorAllocator.allocate(*mDescriptorSetLayout);
+	}
+	writeDescriptorSets();
+}
 
-		std::vector <BufferInfoSet> bufferInfos = {};
-		std::vector <ImageInfoSet> textureInfos = {};
-		std::vector <ImageInfoSet> shadowMapInfos = {};
+const DescriptorInfo* Renderable::getDescriptorData(uint32_t imageIndex) const
+{
+	if (mDescriptorData.empty())
+		return nullptr;
 
-		for (const auto& bufBinding : mBufferBindings) {
-			BufferInfoSet infoSet;
-			infoSet.first = bufBinding.first;
+	size_t descriptorCount = getDescriptorCount();
+	size_t copies = mDescriptorData.size() / descriptorCount;
+	return &mDescriptorData[(imageIndex % copies) * descriptorCount];
+}
 
-			uint32_t descCount = mLayoutBindings[bufBinding.first].descriptorCount;
-			for (uint32_t bufIdx = 0; bufIdx < descCount; bufIdx++) {
-				VkDescriptorBufferInfo bufferInfo = {};
-				bufferInfo.buffer = bufBinding.second->buffers[descCount * i + bufIdx];
-				bufferInfo.offset = 0;
-				bufferInfo.range = bufBinding.second->bufferSize;
-				infoSet.second.push_back(bufferInfo);
-			}
-			bufferInfos.push_back(infoSet);
-		}
-		
-		for (const auto& texBinding : mTextureBindings) {
-			ImageInfoSet infoSet;
-			infoSet.first = texBinding.first;
-
-			uint32_t descCount = mLayoutBindings[texBinding.first].descriptorCount;
-			for (uint32_t texIdx = 0; texIdx < descCount; texIdx++) {
-				VkDescriptorImageInfo imageInfo = {};
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				imageInfo.imageView = texBinding.second->getImageView();
-				imageInfo.sampler = texBinding.second->getSampler();
-				infoSet.second.push_back(imageInfo);
-			}
+uint32_t Renderable::getDescriptorCount() const
+{
+	uint32_t descriptorCount = 0;
+	for (const auto& binding : mLayoutBindings) {
+		descriptorCount += binding.second.descriptorCount;
+	}
+	return descriptorCount;
+}
 
-			textureInfos.push_back(infoSet);
-		}
+std::vector<VkDescriptorUpdateTemplateEntryKHR> Renderable::getUpdateTemplateEntries(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings)
+{
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+	entries.reserve(layoutBindings.size());
+
+	size_t firstDescriptor = 0;
+	for (const auto& binding : layoutBindings) {
+		VkDescriptorUpdateTemplateEntryKHR entry = {};
+		entry.dstBinding = binding.binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = binding.descriptorCount;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = firstDescriptor * sizeof(DescriptorInfo);
+		entry.stride = sizeof(DescriptorInfo);
+		entries.push_back(entry);
+
+		firstDescriptor += binding.descriptorCount;
+	}
+	return entries;
+}
 
-		//shadowmap info
-		for (const auto& shadowMapBinding : mShadowMapBindings) {
-			ImageInfoSet infoSet;
-			infoSet.first = shadowMapBinding.first;
-
-			uint32_t descCount = mLayoutBindings[shadowMapBinding.first].descriptorCount;
-			for(uint32_t shadowIndex = 0; shadowIndex < descCount; shadowIndex++) {
-				VkDescriptorImageInfo shadowMapInfo;
-				shadowMapInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				shadowMapInfo.imageView = shadowMapBinding.second.imageView;
-				shadowMapInfo.sampler = shadowMapBinding.second.imageSampler;
-				infoSet.second.push_back(shadowMapInfo);
+void Renderable::writeDescriptorData(size_t copies)
+{
+	size_t descriptorCount = getDescriptorCount();
+	mDescriptorData.assign(descriptorCount * copies, DescriptorInfo());
+
+	//same order as getUpdateTemplateEntries(): bindings in order, each binding's descriptors in a row
+	for (size_t i = 0; i < copies; i++) {
+		DescriptorInfo* descriptor = mDescriptorData.data() + descriptorCount * i;
+
+		for (const auto& layoutBinding : mLayoutBindings) {
+			uint32_t binding = layoutBinding.first;
+			uint32_t descCount = layoutBinding.second.descriptorCount;
+
+			auto buffer = mBufferBindings.find(binding);
+			auto texture = mTextureBindings.find(binding);
+			auto shadowMap = mShadowMapBindings.find(binding);
+			for (uint32_t descIdx = 0; descIdx < descCount; descIdx++, descriptor++) {
+				if (buffer != mBufferBindings.end()) {
+					descriptor->buffer.buffer = buffer->second->buffers[descCount * i + descIdx];
+					descriptor->buffer.offset = 0;
+					descriptor->buffer.range = buffer->second->bufferSize;
+				}
+				else if (texture != mTextureBindings.end()) {
+					descriptor->image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					descriptor->image.imageView = texture->second->getImageView();
+					descriptor->image.sampler = texture->second->getSampler();
+				}
+				else if (shadowMap != mShadowMapBindings.end()) {
+					descriptor->image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					descriptor->image.imageView = shadowMap->second.getImageView(mShadowMapViews[binding]);
+					descriptor->image.sampler = shadowMap->second.imageSampler;
+				}
+				else {
+					throw std::runtime_error("Nothing is bound to binding " + std::to_string(binding) + "!");
+				}
 			}
-
-			shadowMapInfos.push_back(infoSet);
-		}
-
-
-		//make some descriptors for the buffers
-		for(const auto& info : bufferInfos){
-			VkWriteDescriptorSet bufferDescriptorWrite = {};
-			bufferDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			bufferDescriptorWrite.dstSet = mDescriptorSets[i];
-			bufferDescriptorWrite.dstBinding = info.first;
-			bufferDescriptorWrite.dstArrayElement = 0;
-			bufferDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			bufferDescriptorWrite.descriptorCount = mLayoutBindings[info.first].descriptorCount;
-			bufferDescriptorWrite.pBufferInfo = info.second.data();
-			bufferDescriptorWrite.pImageInfo = nullptr;
-			bufferDescriptorWrite.pTexelBufferView = nullptr;
-			descriptorWrites.push_back(bufferDescriptorWrite);
-		}
-		
-		//make descriptors for images
-		for(const auto& info : textureInfos){
-			VkWriteDescriptorSet textureDescriptorWrite = {};
-			textureDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			textureDescriptorWrite.dstSet = mDescriptorSets[i];
-			textureDescriptorWrite.dstBinding = info.first;
-			textureDescriptorWrite.dstArrayElement = 0;
-			textureDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			textureDescriptorWrite.descriptorCount = mLayoutBindings[info.first].descriptorCount;
-			textureDescriptorWrite.pBufferInfo = nullptr;
-			textureDescriptorWrite.pImageInfo = info.second.data();
-			textureDescriptorWrite.pTexelBufferView = nullptr;
-			descriptorWrites.push_back(textureDescriptorWrite);
 		}
+	}
+}
 
-		//make descriptor for shadowmap
-		for(const auto& info : shadowMapInfos) {
-			VkWriteDescriptorSet shadowDescriptorWrite = {};
-			shadowDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			shadowDescriptorWrite.dstSet = mDescriptorSets[i];
-			shadowDescriptorWrite.dstBinding = info.first;
-			shadowDescriptorWrite.dstArrayElement = 0;
-			shadowDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			shadowDescriptorWrite.descriptorCount = mLayoutBindings[info.first].descriptorCount;
-			shadowDescriptorWrite.pBufferInfo = nullptr;
-			shadowDescriptorWrite.pImageInfo = info.second.data();
-			shadowDescriptorWrite.pTexelBufferView = nullptr;
-			descriptorWrites.push_back(shadowDescriptorWrite);
-		}
+void Renderable::writeDescriptorSets()
+{
+	if (mUpdateTemplate == VK_NULL_HANDLE)
+		return;
 
-		vkUpdateDescriptorSets(mContext->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	for (uint32_t i = 0; i < mDescriptorSets.size(); i++) {
+		mContext->updateDescriptorSetWithTemplate(mContext->device, mDescriptorSets[i], mUpdateTemplate, getDescriptorData(i));
 	}
 }
@@ -16,9 +16,28 @@
 #include "VulkanContext.h"
 #include "Texture.h"
 #include "Shader.h"
+#include "PipelineRegistry.h"
 #include "Mesh.h"
 #include "UBO.h"
 #include "ShadowMap.h"
+#include "SoftwareOcclusion.h"
+#include "MaterialLibrary.h"
+#include "DescriptorAllocator.h"
+
+/** @brief One descriptor in the data an update template reads (see Renderable::getUpdateTemplateEntries()) */
+union DescriptorInfo
+{
+	VkDescriptorBufferInfo buffer;		///< Uniform and storage buffers
+	VkDescriptorImageInfo image;		///< Textures and shadow maps
+};
+
+/** @brief How a Renderable's bindings reach its draws */
+enum class DescriptorMode
+{
+	Persistent,		///< Written once to sets kept until cleanup (one per swapchain image, or one shared by all)
+	Pushed,			///< Pushed into the command buffer with each draw (VK_KHR_push_descriptor)
+	Transient		///< Written to a set from the frame's pool with each draw, for dynamic bindings without push descriptors
+};
 
 /**	@class Renderable
 	@brief A Class for representing objects that are rendered in the scene
@@ -61,6 +80,64 @@ public:
 	*/
 	void applyShaderSet(const ShaderSet& toApply);
 
+	/** @brief Set the fragment shader used instead of the ShaderSet's in deferred shading
+
+		The shader writes the G-buffer (see gBuffer.glsl) and uses the same bindings as the
+		Renderable's own fragment shader. It should be specialized like the fragment shader,
+		since the lighting pass takes the material's shininess from the G-buffer. Renderables
+		without one are shaded forward, after the lighting pass.
+
+		@param shader The G-buffer fragment shader, or null to always shade forward
+	*/
+	void setGBufferShader(std::shared_ptr<Shader> shader);
+
+	/** @brief Set the material the Renderable's shaders read (through materials.glsl)
+		@param materialIndex The index returned by RenderSystem::createMaterial()
+	*/
+	void setMaterial(uint32_t materialIndex);
+
+	/** @brief Set the model matrix used to place this Renderable in the world
+
+		This does not update any shader resources, it is used by the RenderSystem
+		to find the world space bounds of the Renderable (i.e. for culling)
+
+		@param model The model matrix of the Renderable
+	*/
+	void setModelMatrix(const glm::mat4& model);
+
+	/** @brief Get the world space bounds of this Renderable's mesh
+		@return The mesh bounds transformed by the model matrix
+	*/
+	Bounds getWorldBounds() const;
+
+	/** @brief Use simplified geometry to hide other Renderables during software occlusion culling
+		@param occluder The occluder mesh (object space, transformed by the model matrix). Null to stop occluding
+	*/
+	void setOccluder(std::shared_ptr<OccluderMesh> occluder);
+
+	/** @brief Set whether this Renderable is drawn into the shadow map
+		@param castsShadow False for objects that should not block light (i.e. emissive light indicators)
+	*/
+	void setCastsShadow(bool castsShadow);
+
+	/** @brief Set whether this Renderable's shaders sample the shadow map
+
+		The shadow pass is skipped when no visible Renderable receives shadows.
+
+		@param receivesShadow False if the Renderable is never shadowed
+	*/
+	void setReceivesShadow(bool receivesShadow);
+
+	/** @brief Set whether this Renderable's bindings are given with each draw instead of kept in descriptor sets
+
+		Suits many small objects (i.e. light indicators), which then don't take sets from the
+		descriptor pools. The bindings are pushed where the device supports push descriptors.
+		Must be set before the Renderable is instantiated.
+
+		@param dynamicBindings True to give the bindings with each draw
+	*/
+	void setDynamicBindings(bool dynamicBindings);
+
 
 
 
@@ -74,6 +151,10 @@ public:
 		what bindings to expect. When actually binding resources, this list
 		is checked to ensure that all the expected resources are filled and
 		there are no duplicates, etc.
+
+		The bindings the shaders declare are added when they are set, so this
+		is only needed to size runtime arrays, or to check the shaders match
+		what the application expects (throws if they don't).
 		
 		@param descriptorType	The type of descriptor to use (i.e image/sampler or uniform buffer)
 		@param stage			The stage the binding is at
@@ -96,12 +177,38 @@ public:
 	*/
 	void bindUniformBuffer(std::shared_ptr<UBO> bufferObject, uint32_t binding);
 
+	/** @brief Bind a Storage Buffer to be used by the renderable
+
+		Storage buffers use the same per swapchain image layout as UBOs
+
+		@param bufferObject		The buffer to be bound to the pipeline
+		@param binding			The value at which to bind the buffer
+	*/
+	void bindStorageBuffer(std::shared_ptr<UBO> bufferObject, uint32_t binding);
+
 	/** @brief Bind a ShadowMap to be used by the renderable
 		
 		@param shadowMap		The shadowMap to bind
 		@param binding			The value at which to bind the ShadowMap
+		@param view				Which of the ShadowMap's images the binding samples
+	*/
+	void bindShadowMap(const ShadowMap& shadowMap, uint32_t binding, ShadowMapView view = ShadowMapView::Layers);
+
+	/** @brief Point every shadow map binding at a recreated ShadowMap
+
+		Rewrites the existing descriptor sets in place, so the device must be idle.
+
+		@param shadowMap		The new shadowMap
 	*/
-	void bindShadowMap(const ShadowMap& shadowMap, uint32_t binding);
+	void updateShadowMap(const ShadowMap& shadowMap);
+
+	/** @brief Rewrite the bindings of a buffer whose VkBuffers were recreated
+
+		Rewrites the existing descriptor sets in place, so the device must be idle.
+
+		@param bufferObject		The recreated buffer (bindings of other buffers are left alone)
+	*/
+	void updateBufferBinding(const std::shared_ptr<UBO>& bufferObject);
 
 
 
@@ -109,36 +216,81 @@ public:
 	// Descriptor Set Setup
 	//---------------------------
 	
-	/** @brief Create the VkDescriptorSetLayout this Renderable uses
-	*/
-	void createDescriptorSetLayout();
-
 	/** @brief Create and write the VkDescriptorSets that will by used by this Renderable
 		
-		This method checks against the shader Bindings for missing resources. Then,
-		it creates a new Descriptor set for every swapchain image that contains all of the
-		bindings used by this Renderable
+		This method checks against the shader Bindings for missing resources. Then, it
+		lays out the descriptors of every binding for mUpdateTemplate, one copy per
+		swapchain image. Without buffer bindings nothing differs between swapchain images,
+		and a single copy is shared by all of them.
+
+		Persistent renderables get a set per copy, written with the template. Other
+		modes hand the data to the RenderSystem with each draw (see getDescriptorData()).
 
-		@param descriptorPool	The descriptorPool to draw from when making new descriptor sets
-		@param swapchainSize	The number of images in the swapchain
+		@param descriptorAllocator	The allocator to draw from when making new descriptor sets
+		@param swapchainSize		The number of images in the swapchain
 	*/
-	void createDescriptorSets(const VkDescriptorPool& descriptorPool, uint32_t swapchainSize);
+	void createDescriptorSets(DescriptorAllocator& descriptorAllocator, uint32_t swapchainSize);
+
+	/** @brief Get the descriptor set to draw with (DescriptorMode::Persistent only)
+		@param imageIndex The swapchain image being recorded
+	*/
+	VkDescriptorSet getDescriptorSet(uint32_t imageIndex) const { return mDescriptorSets[imageIndex % mDescriptorSets.size()]; }
+
+	/** @brief Get the descriptors mUpdateTemplate writes or pushes
+		@param imageIndex The swapchain image being recorded
+	*/
+	const DescriptorInfo* getDescriptorData(uint32_t imageIndex) const;
+
+	/** @brief Get the number of descriptors in this Renderable's set */
+	uint32_t getDescriptorCount() const;
+
+	/** @brief Get the entries of an update template for a set layout
+
+		Each binding's descriptors follow the previous binding's in the data, in binding order.
+
+		@param layoutBindings The bindings of the set layout, in binding order
+	*/
+	static std::vector<VkDescriptorUpdateTemplateEntryKHR> getUpdateTemplateEntries(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings);
 public:
 	std::shared_ptr<Mesh> mMesh;										///< The Mesh used by this Renderable
 	ShaderSet mShaderSet;												///< The set of Shaders used by this Renderable
+	std::shared_ptr<Shader> mGBufferShader;								///< Fragment shader writing the G-buffer in deferred shading (null if shaded forward)
+	glm::mat4 mModelMatrix = glm::mat4(1.0f);							///< The model matrix placing this Renderable in the world
+	uint32_t mMaterialIndex = 0;										///< The material pushed before this Renderable is drawn
+	std::shared_ptr<OccluderMesh> mOccluder;							///< Occluder geometry for software occlusion culling (null if this doesn't occlude)
+	bool mCastsShadow = true;											///< Whether this Renderable is drawn in the shadow pass
+	bool mReceivesShadow = true;										///< Whether this Renderable samples the shadow map
+	bool mDynamicBindings = false;										///< Whether the bindings are given with each draw instead of kept in sets
 
-	std::map<uint32_t, VkDescriptorSetLayoutBinding> mLayoutBindings;	///< All of the bindings used by this Renderable
-	std::map<uint32_t, std::shared_ptr<UBO>> mBufferBindings;			///< The UBOs that are bound to this Renderable
+	std::map<uint32_t, VkDescriptorSetLayoutBinding> mLayoutBindings;	///< All of the bindings used by this Renderable (set RENDERABLE_DESCRIPTOR_SET)
+	std::map<uint32_t, std::shared_ptr<UBO>> mBufferBindings;			///< The UBOs and storage buffers that are bound to this Renderable
 	std::map<uint32_t, std::shared_ptr<Texture>> mTextureBindings;		///< The Textures that are bound to this Renderable
 	std::map<uint32_t, ShadowMap> mShadowMapBindings;					///< The ShadowMaps that are bound to this Renderable
+	std::map<uint32_t, ShadowMapView> mShadowMapViews;					///< Which image of the bound ShadowMap each shadow map binding samples
 
 
-	VkDescriptorSetLayout mDescriptorSetLayout;							///< The descriptorSetLayout Used by this Renderable
-	std::vector<VkDescriptorSet> mDescriptorSets;						///< DescriptorSets used by this Renderable
+	DescriptorMode mDescriptorMode = DescriptorMode::Persistent;		///< How the bindings reach the draws, chosen by the RenderSystem on instantiation
+	SharedDescriptorSetLayout mDescriptorSetLayout;						///< The descriptorSetLayout Used by this Renderable (shared by renderables with the same bindings)
+	VkDescriptorUpdateTemplateKHR mUpdateTemplate = VK_NULL_HANDLE;		///< Writes or pushes the whole set from mDescriptorData (shared like the layout, null without bindings)
+	std::vector<VkDescriptorSet> mDescriptorSets;						///< DescriptorSets used by this Renderable (one per swapchain image, or one shared by all)
+	std::vector<DescriptorInfo> mDescriptorData;						///< The descriptors of every binding, one copy per descriptor set (or per set there would be)
 
 
-	VkPipelineLayout mPipelineLayout;									///< The layout of the pipeline used by this Renderable
-	VkPipeline mPipeline;												///< The pipeliner used by this Renderable
+	std::shared_ptr<GraphicsPipeline> mPipeline;						///< The pipeline used by this Renderable (shared with renderables of the same description)
+	std::shared_ptr<GraphicsPipeline> mDepthPipeline;					///< Vertex stages only, used by the depth pre-pass (null when it is off)
 private:
 	std::shared_ptr<VulkanContext> mContext;							///< The Render System's Vulkan Context
+
+	/** @brief Add the bindings a shader declares, and check its vertex inputs against Vertex
+		@param shaderInterface The interface of the shader (or ShaderSet) being applied
+	*/
+	void addReflectedBindings(const ShaderInterface& shaderInterface);
+
+	/** @brief Lay out the descriptors of the bound resources for mUpdateTemplate
+		@param copies The number of copies (buffers are indexed by copy, like swapchain images)
+	*/
+	void writeDescriptorData(size_t copies);
+
+	/** @brief Write mDescriptorData to the descriptor sets (one copy per set) */
+	void writeDescriptorSets();
 };
\ No newline at end of file
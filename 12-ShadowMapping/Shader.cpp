@@ -1,5 +1,6 @@
 #include "Shader.h"
 #include <assert.h>
+#include <algorithm>
 
 Shader::Shader(std::shared_ptr<VulkanContext> context) :
 	mContext(context),
@@ -17,6 +18,7 @@ void Shader::load(const std::vector<char>& code, VkShaderStageFlagBits stage)
 	mStage = stage;
 
 	createShaderModule(code);
+	mInterface = ShaderReflection::reflect(code, stage);
 }
 
 void Shader::free()
@@ -25,6 +27,31 @@ void Shader::free()
 	mStage = VK_SHADER_STAGE_ALL;
 }
 
+void Shader::setSpecializationConstant(uint32_t constantId, uint32_t value)
+{
+	auto entry = std::find_if(mSpecializationEntries.begin(), mSpecializationEntries.end(),
+		[constantId](const VkSpecializationMapEntry& e) { return e.constantID == constantId; });
+
+	if (entry != mSpecializationEntries.end()) {
+		mSpecializationData[entry->offset / sizeof(uint32_t)] = value;
+	}
+	else {
+		VkSpecializationMapEntry newEntry = {};
+		newEntry.constantID = constantId;
+		newEntry.offset = static_cast<uint32_t>(mSpecializationData.size() * sizeof(uint32_t));
+		newEntry.size = sizeof(uint32_t);
+		mSpecializationEntries.push_back(newEntry);
+		mSpecializationData.push_back(value);
+	}
+}
+
+void Shader::setSpecializationConstants(const SpecializationConstants& constants)
+{
+	for (const auto& constant : constants) {
+		setSpecializationConstant(constant.first, constant.second);
+	}
+}
+
 VkPipelineShaderStageCreateInfo Shader::getShaderStageInfo() const
 {
 	VkPipelineShaderStageCreateInfo createInfo = {};
@@ -33,6 +60,15 @@ VkPipelineShaderStageCreateInfo Shader::getShaderStageInfo() const
 	createInfo.module = mShaderModule;
 	createInfo.pName = "main";
 
+	//refreshed on every call, the vectors may have reallocated (or been copied) since the last one
+	if (!mSpecializationEntries.empty()) {
+		mSpecializationInfo.mapEntryCount = static_cast<uint32_t>(mSpecializationEntries.size());
+		mSpecializationInfo.pMapEntries = mSpecializationEntries.data();
+		mSpecializationInfo.dataSize = mSpecializationData.size() * sizeof(uint32_t);
+		mSpecializationInfo.pData = mSpecializationData.data();
+		createInfo.pSpecializationInfo = &mSpecializationInfo;
+	}
+
 	return createInfo;
 }
 
@@ -52,3 +88,27 @@ void Shader::createShaderModule(const std::vector<char>& code)
 		throw std::runtime_error("Failed to create shader module!");
 	}
 }
+
+ShaderStageCopy::ShaderStageCopy(const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages) :
+	mStages(shaderStages),
+	mSpecializationInfos(shaderStages.size()),
+	mSpecializationEntries(shaderStages.size()),
+	mSpecializationData(shaderStages.size())
+{
+	//sized up front, so the pointers into the vectors stay valid
+	for (size_t i = 0; i < mStages.size(); i++) {
+		const VkSpecializationInfo* source = mStages[i].pSpecializationInfo;
+		if (source == nullptr)
+			continue;
+
+		mSpecializationEntries[i].assign(source->pMapEntries, source->pMapEntries + source->mapEntryCount);
+		const char* data = static_cast<const char*>(source->pData);
+		mSpecializationData[i].assign(data, data + source->dataSize);
+
+		mSpecializationInfos[i].mapEntryCount = source->mapEntryCount;
+		mSpecializationInfos[i].pMapEntries = mSpecializationEntries[i].data();
+		mSpecializationInfos[i].dataSize = source->dataSize;
+		mSpecializationInfos[i].pData = mSpecializationData[i].data();
+		mStages[i].pSpecializationInfo = &mSpecializationInfos[i];
+	}
+}
@@ -4,9 +4,14 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
 
 #include "VulkanContext.h"
+#include "ShaderReflection.h"
+
+/** @brief Specialization constant values by constant_id (floats and bools are stored as their 32 bit pattern) */
+using SpecializationConstants = std::map<uint32_t, uint32_t>;
 
 /** @class Shader
 	
@@ -26,7 +31,8 @@ public:
 	~Shader();
 
 	/** @brief Create a shader object from SPIR-V code, and set a stage during which it will be used
-		This method immediately creates a VkShaderModule object, and discards the code given
+		This method immediately creates a VkShaderModule object and reads the shader's
+		interface (see getInterface()), then discards the code given
 		@param code A byte array of the loaded SPIR-V code
 		@param stage The stage during which this shader will be run in a pipeline
 	*/
@@ -35,6 +41,17 @@ public:
 	/** @brief Free the Vulkan resources created by the Shader Object */
 	void free();
 
+	/** @brief Set a specialization constant, applied when a pipeline is created with this shader
+		@param constantId The constant's constant_id in the shader
+		@param value The value to compile the pipeline with
+	*/
+	void setSpecializationConstant(uint32_t constantId, uint32_t value);
+
+	/** @brief Set several specialization constants at once
+		@param constants The values to compile the pipeline with, by constant_id
+	*/
+	void setSpecializationConstants(const SpecializationConstants& constants);
+
 	//---------
 	// Accessors
 	//---------
@@ -44,12 +61,20 @@ public:
 	
 	/** @brief Get the stage this shader is used in (Vertex, Fragment, etc.) */
 	VkShaderStageFlagBits getStage() const;
+
+	/** @brief Get the bindings, push constants and vertex inputs the shader's SPIR-V declares */
+	const ShaderInterface& getInterface() const { return mInterface; }
 protected:
 	std::shared_ptr<VulkanContext> mContext;				///< The Vulkan Context Object
 
 	VkShaderStageFlagBits mStage = VK_SHADER_STAGE_ALL;		///< The stage the shader operates during
 	VkShaderModule mShaderModule = VK_NULL_HANDLE;			///< The shader module (created in load())
 	VkPipelineShaderStageCreateInfo mShaderStageInfo;		///< Info for creating a shader stage in pipeline creation
+	ShaderInterface mInterface;								///< The interface reflected from the SPIR-V in load()
+
+	std::vector<VkSpecializationMapEntry> mSpecializationEntries;	///< Where each specialization constant sits in mSpecializationData
+	std::vector<uint32_t> mSpecializationData;						///< The specialization constant values
+	mutable VkSpecializationInfo mSpecializationInfo = {};			///< Points at the entries and data above (refilled by each getShaderStageInfo() call, see ShaderStageCopy)
 
 	/** @brief Create the VkShaderModule object
 		@param code A byte array containing the SPIR-V shader code
@@ -59,6 +84,34 @@ protected:
 
 
 
+/** @class ShaderStageCopy
+
+	@brief Shader stage infos with their own copy of the specialization data they point at
+
+	A Shader's stage info points into the Shader, which rewrites that data every time a
+	stage info is made from it, and can reallocate it when constants are set. Pipelines
+	compiled on the worker threads use a copy instead, which can't change under them.
+*/
+class ShaderStageCopy
+{
+public:
+	/** @brief Copy stage infos and the specialization data they point at
+		@param shaderStages The stage infos (i.e. from ShaderSet::createShaderInfoSet())
+	*/
+	ShaderStageCopy(const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages);
+
+	ShaderStageCopy(const ShaderStageCopy&) = delete;
+	ShaderStageCopy& operator=(const ShaderStageCopy&) = delete;
+
+	/** @brief Get the stage infos, pointing at this copy's specialization data */
+	const std::vector<VkPipelineShaderStageCreateInfo>& getStages() const { return mStages; }
+private:
+	std::vector<VkPipelineShaderStageCreateInfo> mStages;							///< The copied stage infos
+	std::vector<VkSpecializationInfo> mSpecializationInfos;							///< Each stage's specialization info (unused by stages without constants)
+	std::vector<std::vector<VkSpecializationMapEntry>> mSpecializationEntries;		///< Each stage's map entries
+	std::vector<std::vector<char>> mSpecializationData;								///< Each stage's constant values
+};
+
 /** @class ShaderSet
 
 	@brief A Set of shaders to be used in a pipeline
@@ -95,5 +148,18 @@ struct ShaderSet {
 
 		return shaderInfoSet;
 	}
+
+	/** @brief Merge the interfaces of the shaders used in this set (throws if two stages disagree on a binding) */
+	ShaderInterface getInterface() const
+	{
+		ShaderInterface merged;
+
+		for (const auto& shader : { vertShader, tessControlShader, tessEvalShader, geometryShader, fragShader }) {
+			if (shader)
+				merged.merge(shader->getInterface());
+		}
+
+		return merged;
+	}
 };
 
@@ -0,0 +1,343 @@
+#include "ShaderReflection.h"
+
+#include <vulkan/spirv.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+const VkFormat ShaderReflection::INPUT_FORMATS[3][4] = {
+	{ VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT },
+	{ VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT },
+	{ VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT }
+};
+
+void ShaderInterface::merge(const ShaderInterface& other)
+{
+	for (const auto& set : other.descriptorSets) {
+		for (const auto& binding : set.second) {
+			auto& bindings = descriptorSets[set.first];
+			auto existing = bindings.find(binding.first);
+			if (existing == bindings.end()) {
+				bindings[binding.first] = binding.second;
+				continue;
+			}
+
+			VkDescriptorSetLayoutBinding& merged = existing->second;
+			if (merged.descriptorType != binding.second.descriptorType || merged.descriptorCount != binding.second.descriptorCount) {
+				throw std::runtime_error("Shader stages disagree on set " + std::to_string(set.first) + " binding " + std::to_string(binding.first) + ": " +
+					ShaderReflection::getTypeName(merged.descriptorType) + "[" + std::to_string(merged.descriptorCount) + "] vs " +
+					ShaderReflection::getTypeName(binding.second.descriptorType) + "[" + std::to_string(binding.second.descriptorCount) + "]");
+			}
+			merged.stageFlags |= binding.second.stageFlags;
+		}
+	}
+
+	//stages declaring the same block share one range
+	for (const auto& range : other.pushConstantRanges) {
+		auto existing = std::find_if(pushConstantRanges.begin(), pushConstantRanges.end(),
+			[&range](const VkPushConstantRange& r) { return r.offset == range.offset && r.size == range.size; });
+		if (existing != pushConstantRanges.end())
+			existing->stageFlags |= range.stageFlags;
+		else
+			pushConstantRanges.push_back(range);
+	}
+
+	//only the vertex stage has vertex inputs
+	if (!other.vertexInputs.empty()) {
+		vertexInputs = other.vertexInputs;
+	}
+}
+
+ShaderInterface ShaderReflection::reflect(const std::vector<char>& code, VkShaderStageFlagBits stage)
+{
+	const uint32_t* words = reinterpret_cast<const uint32_t*>(code.data());
+	size_t wordCount = code.size() / sizeof(uint32_t);
+	if (wordCount < 5 || words[0] != SpvMagicNumber) {
+		throw std::runtime_error("Shader code is not SPIR-V!");
+	}
+
+	//first pass: every type, constant and decoration. Variables are kept for the second pass,
+	//as their decorations may be declared after them
+	Module module;
+	struct Variable { uint32_t id; uint32_t pointerType; uint32_t storageClass; };
+	std::vector<Variable> variables;
+
+	for (size_t offset = 5; offset < wordCount;) {
+		uint32_t instructionLength = words[offset] >> 16;
+		uint32_t opcode = words[offset] & 0xFFFF;
+		if (instructionLength == 0 || offset + instructionLength > wordCount) {
+			throw std::runtime_error("Malformed SPIR-V instruction!");
+		}
+		const uint32_t* operands = words + offset + 1;
+		uint32_t operandCount = instructionLength - 1;
+
+		switch (opcode)
+		{
+		case SpvOpDecorate:
+		case SpvOpMemberDecorate:
+		{
+			bool member = (opcode == SpvOpMemberDecorate);
+			if (operandCount < (member ? 3u : 2u))
+				break;
+			Decorations& target = member ? module.memberDecorations[operands[0]][operands[1]] : module.decorations[operands[0]];
+			uint32_t decoration = operands[member ? 2 : 1];
+			uint32_t value = (operandCount > (member ? 3u : 2u)) ? operands[member ? 3 : 2] : 0;
+
+			switch (decoration)
+			{
+			case SpvDecorationDescriptorSet: target.set = value; break;
+			case SpvDecorationBinding: target.binding = value; target.hasBinding = true; break;
+			case SpvDecorationLocation: target.location = value; target.hasLocation = true; break;
+			case SpvDecorationBuiltIn: target.builtIn = true; break;
+			case SpvDecorationBlock: target.block = true; break;
+			case SpvDecorationBufferBlock: target.bufferBlock = true; break;
+			case SpvDecorationOffset: target.offset = value; break;
+			case SpvDecorationArrayStride: target.arrayStride = value; break;
+			case SpvDecorationMatrixStride: target.matrixStride = value; break;
+			default: break;
+			}
+			break;
+		}
+		case SpvOpTypeVoid:
+		case SpvOpTypeBool:
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat:
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+		case SpvOpTypeImage:
+		case SpvOpTypeSampler:
+		case SpvOpTypeSampledImage:
+		case SpvOpTypeArray:
+		case SpvOpTypeRuntimeArray:
+		case SpvOpTypeStruct:
+		case SpvOpTypePointer:
+		{
+			Type& type = module.types[operands[0]];
+			type.opcode = opcode;
+			type.operands.assign(operands + 1, operands + operandCount);
+			break;
+		}
+		case SpvOpConstant:
+		case SpvOpSpecConstant:
+			if (operandCount >= 3)
+				module.constants[operands[1]] = operands[2];
+			break;
+		case SpvOpVariable:
+			if (operandCount >= 3)
+				variables.push_back({ operands[1], operands[0], operands[2] });
+			break;
+		default:
+			break;
+		}
+
+		offset += instructionLength;
+	}
+
+	//second pass: the interface variables
+	ShaderInterface shaderInterface;
+	for (const Variable& variable : variables) {
+		const Decorations& decorations = module.decorations[variable.id];
+		const Type& pointer = module.types.at(variable.pointerType);
+		uint32_t typeId = pointer.operands.at(1);
+
+		if (variable.storageClass == SpvStorageClassInput) {
+			if (stage == VK_SHADER_STAGE_VERTEX_BIT && decorations.hasLocation && !decorations.builtIn) {
+				shaderInterface.vertexInputs[decorations.location] = getInputFormat(module, typeId);
+			}
+			continue;
+		}
+
+		if (variable.storageClass == SpvStorageClassPushConstant) {
+			//the range covers the members' offsets, so a block starting at an offset shares the space with other stages
+			const Type& block = module.types.at(typeId);
+			uint32_t begin = UINT32_MAX;
+			uint32_t end = 0;
+			for (uint32_t member = 0; member < block.operands.size(); member++) {
+				const Decorations& memberDecorations = module.memberDecorations[typeId][member];
+				begin = std::min(begin, memberDecorations.offset);
+				end = std::max(end, memberDecorations.offset + getTypeSize(module, block.operands[member], memberDecorations.matrixStride));
+			}
+			if (end > begin) {
+				shaderInterface.pushConstantRanges.push_back({ static_cast<VkShaderStageFlags>(stage), begin, end - begin });
+			}
+			continue;
+		}
+
+		if (!decorations.hasBinding)
+			continue;
+
+		//arrays of resources become the binding's descriptor count
+		uint32_t descriptorCount = 1;
+		const Type* type = &module.types.at(typeId);
+		while (type->opcode == SpvOpTypeArray || type->opcode == SpvOpTypeRuntimeArray) {
+			if (type->opcode == SpvOpTypeArray) {
+				auto length = module.constants.find(type->operands.at(1));
+				descriptorCount *= (length != module.constants.end()) ? length->second : 1;
+			}
+			else {
+				descriptorCount = 0;
+			}
+			typeId = type->operands.at(0);
+			type = &module.types.at(typeId);
+		}
+
+		VkDescriptorType descriptorType = getDescriptorType(module, typeId, variable.storageClass);
+		if (descriptorType == VK_DESCRIPTOR_TYPE_MAX_ENUM)
+			continue;
+
+		VkDescriptorSetLayoutBinding layoutBinding = {};
+		layoutBinding.binding = decorations.binding;
+		layoutBinding.descriptorType = descriptorType;
+		layoutBinding.descriptorCount = descriptorCount;
+		layoutBinding.stageFlags = stage;
+		layoutBinding.pImmutableSamplers = nullptr;
+		shaderInterface.descriptorSets[decorations.set][decorations.binding] = layoutBinding;
+	}
+
+	return shaderInterface;
+}
+
+std::string ShaderReflection::getTypeName(VkDescriptorType descriptorType)
+{
+	switch (descriptorType)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER: return "sampler";
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return "combined image sampler";
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return "sampled image";
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return "storage image";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return "uniform texel buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return "storage texel buffer";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return "uniform buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return "storage buffer";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC: return "dynamic uniform buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: return "dynamic storage buffer";
+	case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: return "input attachment";
+	default: return "unknown descriptor";
+	}
+}
+
+VkDescriptorType ShaderReflection::getDescriptorType(const Module& module, uint32_t typeId, uint32_t storageClass)
+{
+	const Type& type = module.types.at(typeId);
+	auto decorations = module.decorations.find(typeId);
+	bool block = (decorations != module.decorations.end()) && decorations->second.block;
+	bool bufferBlock = (decorations != module.decorations.end()) && decorations->second.bufferBlock;
+
+	switch (storageClass)
+	{
+	case SpvStorageClassUniform:
+		if (bufferBlock)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return block ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	case SpvStorageClassStorageBuffer:
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	case SpvStorageClassUniformConstant:
+		break;
+	default:
+		return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	}
+
+	switch (type.opcode)
+	{
+	case SpvOpTypeSampler:
+		return VK_DESCRIPTOR_TYPE_SAMPLER;
+	case SpvOpTypeSampledImage:
+		return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	case SpvOpTypeImage:
+	{
+		//operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 = with a sampler, 2 = storage)
+		uint32_t dim = type.operands.at(1);
+		bool storage = (type.operands.at(5) == 2);
+		if (dim == SpvDimSubpassData)
+			return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		if (dim == SpvDimBuffer)
+			return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	}
+	default:
+		return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	}
+}
+
+uint32_t ShaderReflection::getTypeSize(const Module& module, uint32_t typeId, uint32_t matrixStride)
+{
+	const Type& type = module.types.at(typeId);
+	switch (type.opcode)
+	{
+	case SpvOpTypeBool:
+		return 4;
+	case SpvOpTypeInt:
+	case SpvOpTypeFloat:
+		return type.operands.at(0) / 8;
+	case SpvOpTypeVector:
+		return getTypeSize(module, type.operands.at(0), 0) * type.operands.at(1);
+	case SpvOpTypeMatrix:
+		//column major: each column is matrixStride apart, the last one only takes its own size
+		return matrixStride * (type.operands.at(1) - 1) + getTypeSize(module, type.operands.at(0), 0);
+	case SpvOpTypeArray:
+	{
+		auto length = module.constants.find(type.operands.at(1));
+		auto decorations = module.decorations.find(typeId);
+		uint32_t stride = (decorations != module.decorations.end()) ? decorations->second.arrayStride : 0;
+		return (length != module.constants.end()) ? stride * length->second : 0;
+	}
+	case SpvOpTypeStruct:
+	{
+		uint32_t size = 0;
+		auto members = module.memberDecorations.find(typeId);
+		for (uint32_t member = 0; member < type.operands.size(); member++) {
+			Decorations memberDecorations;
+			if (members != module.memberDecorations.end() && members->second.count(member))
+				memberDecorations = members->second.at(member);
+			size = std::max(size, memberDecorations.offset + getTypeSize(module, type.operands[member], memberDecorations.matrixStride));
+		}
+		return size;
+	}
+	default:
+		return 0;
+	}
+}
+
+VkFormat ShaderReflection::getInputFormat(const Module& module, uint32_t typeId)
+{
+	const Type* type = &module.types.at(typeId);
+	uint32_t componentCount = 1;
+	if (type->opcode == SpvOpTypeVector) {
+		componentCount = type->operands.at(1);
+		type = &module.types.at(type->operands.at(0));
+	}
+
+	//only 32 bit components, which is all a Vertex holds
+	if ((type->opcode != SpvOpTypeFloat && type->opcode != SpvOpTypeInt) || type->operands.at(0) != 32)
+		return VK_FORMAT_UNDEFINED;
+
+	if (componentCount < 1 || componentCount > 4)
+		return VK_FORMAT_UNDEFINED;
+	if (type->opcode == SpvOpTypeFloat)
+		return INPUT_FORMATS[0][componentCount - 1];
+	return INPUT_FORMATS[(type->operands.at(1) != 0) ? 1 : 2][componentCount - 1];
+}
+
+bool ShaderReflection::isInputCompatible(VkFormat input, VkFormat attribute)
+{
+	uint32_t inputComponents = 0;
+	uint32_t attributeComponents = 0;
+	int inputType = getInputFormatType(input, inputComponents);
+	int attributeType = getInputFormatType(attribute, attributeComponents);
+
+	//missing components are filled in, so the shader may read fewer than the attribute has
+	return inputType >= 0 && inputType == attributeType && inputComponents <= attributeComponents;
+}
+
+int ShaderReflection::getInputFormatType(VkFormat format, uint32_t& components)
+{
+	for (int type = 0; type < 3; type++) {
+		for (uint32_t count = 0; count < 4; count++) {
+			if (INPUT_FORMATS[type][count] == format) {
+				components = count + 1;
+				return type;
+			}
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+//STL
+#include <vector>
+#include <map>
+#include <string>
+
+/** @brief The resources and inputs a shader (or a set of shaders) uses, read from its SPIR-V */
+struct ShaderInterface
+{
+	std::map<uint32_t, std::map<uint32_t, VkDescriptorSetLayoutBinding>> descriptorSets;	///< Bindings by descriptor set, then binding number (stageFlags holds every stage using it)
+	std::vector<VkPushConstantRange> pushConstantRanges;									///< The push constant block of each stage
+	std::map<uint32_t, VkFormat> vertexInputs;												///< Vertex shader inputs by location (empty for other stages)
+
+	/** @brief Add the interface of another shader, i.e. the next stage of a pipeline
+
+		Bindings used by both are merged into one, visible to the stages of both.
+
+		@param other The interface to add
+	*/
+	void merge(const ShaderInterface& other);
+};
+
+/** @class ShaderReflection
+
+	@brief Reads the interface of a shader from its SPIR-V
+
+	Only the instructions describing the interface (decorations, types, constants
+	and global variables) are looked at. Descriptor arrays sized by a specialization
+	constant are counted with the constant's default value, and runtime sized arrays
+	get a descriptorCount of 0, to be sized by whoever declares the binding.
+*/
+class ShaderReflection
+{
+public:
+	/** @brief Read the interface of a shader
+		@param code		The SPIR-V code
+		@param stage	The stage the shader is used in
+		@return The shader's bindings, push constants and (for vertex shaders) inputs
+	*/
+	static ShaderInterface reflect(const std::vector<char>& code, VkShaderStageFlagBits stage);
+
+	/** @brief Get a readable name for a descriptor type, for error messages
+		@param descriptorType The descriptor type
+	*/
+	static std::string getTypeName(VkDescriptorType descriptorType);
+
+	/** @brief Check whether a vertex attribute can feed a vertex shader input
+		@param input		The input's format (from ShaderInterface::vertexInputs)
+		@param attribute	The attribute's format
+		@return True if both have the same component type, and the attribute has at least as many components
+	*/
+	static bool isInputCompatible(VkFormat input, VkFormat attribute);
+
+private:
+	static const VkFormat INPUT_FORMATS[3][4];		///< Float, signed and unsigned 32 bit formats, by component count
+
+	/** @brief Find a format in INPUT_FORMATS
+		@param format		The format
+		@param components	Set to the format's component count
+		@return The format's row of INPUT_FORMATS, or -1 if it isn't there
+	*/
+	static int getInputFormatType(VkFormat format, uint32_t& components);
+
+	/** @brief A type declared by the module, with the operands of its declaration */
+	struct Type
+	{
+		uint32_t opcode = 0;						///< The OpType* instruction that declared it
+		std::vector<uint32_t> operands;				///< The instruction's operands after the result id
+	};
+
+	/** @brief Decorations of an id (or of a struct member) that the reflection needs */
+	struct Decorations
+	{
+		uint32_t set = 0;							///< DescriptorSet
+		uint32_t binding = 0;						///< Binding
+		bool hasBinding = false;					///< Whether the Binding decoration is present
+		uint32_t location = 0;						///< Location
+		bool hasLocation = false;					///< Whether the Location decoration is present
+		bool builtIn = false;						///< BuiltIn variables aren't part of the interface
+		bool block = false;							///< Block (uniform or push constant block, storage buffer in SPIR-V 1.3+)
+		bool bufferBlock = false;					///< BufferBlock (storage buffer before SPIR-V 1.3)
+		uint32_t offset = 0;						///< Offset of a struct member
+		uint32_t arrayStride = 0;					///< ArrayStride of an array type
+		uint32_t matrixStride = 0;					///< MatrixStride of a struct member
+	};
+
+	/** @brief Everything read from the module, indexed by id */
+	struct Module
+	{
+		std::map<uint32_t, Type> types;											///< Types by result id
+		std::map<uint32_t, uint32_t> constants;									///< The low word of scalar (and spec) constants by result id
+		std::map<uint32_t, Decorations> decorations;							///< Decorations by target id
+		std::map<uint32_t, std::map<uint32_t, Decorations>> memberDecorations;	///< Decorations by struct id, then member
+	};
+
+	/** @brief Get the descriptor type of a resource variable
+		@param module		The module
+		@param typeId		The variable's type, with pointers and arrays removed
+		@param storageClass	The variable's storage class
+		@return The descriptor type, or VK_DESCRIPTOR_TYPE_MAX_ENUM if it isn't a descriptor
+	*/
+	static VkDescriptorType getDescriptorType(const Module& module, uint32_t typeId, uint32_t storageClass);
+
+	/** @brief Get the size in bytes of a type inside a block
+		@param module		The module
+		@param typeId		The type
+		@param matrixStride	The MatrixStride of the struct member holding the type (for matrices)
+	*/
+	static uint32_t getTypeSize(const Module& module, uint32_t typeId, uint32_t matrixStride);
+
+	/** @brief Get the vertex attribute format matching a vertex shader input type
+		@param module	The module
+		@param typeId	The input's type
+		@return The format, or VK_FORMAT_UNDEFINED for types spanning several locations
+	*/
+	static VkFormat getInputFormat(const Module& module, uint32_t typeId);
+};
@@ -0,0 +1,105 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <numeric>
+
+ShadowAtlas::ShadowAtlas(uint32_t resolution, uint32_t minTileSize)
+	: mResolution(floorPowerOfTwo(resolution)), mMinTileSize(std::max(floorPowerOfTwo(minTileSize), 1u))
+{
+}
+
+void ShadowAtlas::setResolution(uint32_t resolution, uint32_t minTileSize)
+{
+	mResolution = floorPowerOfTwo(resolution);
+	mMinTileSize = std::max(floorPowerOfTwo(minTileSize), 1u);
+}
+
+std::vector<ShadowAtlasTile> ShadowAtlas::allocate(const std::vector<uint32_t>& requestedSizes)
+{
+	std::vector<ShadowAtlasTile> tiles(requestedSizes.size());
+
+	mFreeTiles.clear();
+	ShadowAtlasTile whole;
+	whole.size = mResolution;
+	mFreeTiles.push_back(whole);
+
+	std::vector<uint32_t> sizes(requestedSizes.size());
+	uint64_t usedArea = 0;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		if (requestedSizes[i] == 0)
+			continue;
+		sizes[i] = std::max(std::min(floorPowerOfTwo(requestedSizes[i]), mResolution), mMinTileSize);
+		usedArea += uint64_t(sizes[i]) * sizes[i];
+	}
+
+	//when oversubscribed, halve the largest tiles first, so every light keeps a tile
+	//before any of them loses its shadow
+	uint64_t atlasArea = uint64_t(mResolution) * mResolution;
+	while (usedArea > atlasArea) {
+		auto largest = std::max_element(sizes.begin(), sizes.end());
+		if (*largest <= mMinTileSize)
+			break;
+		usedArea -= uint64_t(*largest) * *largest * 3 / 4;
+		*largest /= 2;
+	}
+
+	//serve the largest requests first, so the quadrants split cleanly
+	std::vector<size_t> order(sizes.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+		return sizes[a] > sizes[b];
+	});
+
+	for (size_t index : order) {
+		if (sizes[index] == 0)
+			continue;
+
+		//only fails once every tile is at the minimum size and the atlas is still full
+		takeTile(sizes[index], tiles[index]);
+	}
+
+	return tiles;
+}
+
+bool ShadowAtlas::takeTile(uint32_t size, ShadowAtlasTile& tile)
+{
+	//use the smallest free region that fits, to keep the large ones whole
+	auto best = mFreeTiles.end();
+	for (auto it = mFreeTiles.begin(); it != mFreeTiles.end(); ++it) {
+		if (it->size >= size && (best == mFreeTiles.end() || it->size < best->size))
+			best = it;
+	}
+	if (best == mFreeTiles.end())
+		return false;
+
+	ShadowAtlasTile region = *best;
+	mFreeTiles.erase(best);
+
+	//split into quadrants until the region is the right size, keeping the top left one
+	while (region.size > size) {
+		uint32_t half = region.size / 2;
+
+		ShadowAtlasTile quadrant;
+		quadrant.size = half;
+		quadrant.x = region.x + half;	quadrant.y = region.y;			mFreeTiles.push_back(quadrant);
+		quadrant.x = region.x;			quadrant.y = region.y + half;	mFreeTiles.push_back(quadrant);
+		quadrant.x = region.x + half;	quadrant.y = region.y + half;	mFreeTiles.push_back(quadrant);
+
+		region.size = half;
+	}
+
+	tile = region;
+	return true;
+}
+
+uint32_t ShadowAtlas::floorPowerOfTwo(uint32_t value)
+{
+	if (value == 0)
+		return 0;
+
+	uint32_t result = 1;
+	while (result <= value / 2) {
+		result *= 2;
+	}
+	return result;
+}
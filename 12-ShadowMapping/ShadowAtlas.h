@@ -0,0 +1,66 @@
+#pragma once
+
+//STL
+#include <vector>
+#include <cstdint>
+
+/** @brief A square region of the shadow atlas, in texels */
+struct ShadowAtlasTile
+{
+	uint32_t x = 0;			///< Left edge of the tile
+	uint32_t y = 0;			///< Top edge of the tile
+	uint32_t size = 0;		///< Width and height of the tile (0 if no space could be found)
+};
+
+/** @class ShadowAtlas
+
+	@brief Packs square, power of two shadow map tiles into one texture
+
+	Tiles are handed out by recursively splitting the atlas into quadrants.
+	Requests are served largest first, which packs power of two squares
+	without gaps. When the requests add up to more than the atlas, the largest
+	are halved until everything fits or every tile is at the minimum size.
+
+	The atlas is rebuilt every frame, so tile sizes can follow the lights
+	as they move on screen.
+*/
+class ShadowAtlas
+{
+public:
+	/** @brief Constructor
+		@param resolution	Width and height of the atlas in texels (a power of two)
+		@param minTileSize	The smallest tile that will be handed out
+	*/
+	ShadowAtlas(uint32_t resolution = 2048, uint32_t minTileSize = 64);
+
+	/** @brief Change the size of the atlas
+		@param resolution	Width and height of the atlas in texels (a power of two)
+		@param minTileSize	The smallest tile that will be handed out
+	*/
+	void setResolution(uint32_t resolution, uint32_t minTileSize);
+
+	/** @brief Get the width and height of the atlas in texels */
+	uint32_t getResolution() const { return mResolution; }
+
+	/** @brief Pack a set of tiles into an empty atlas
+
+		@param requestedSizes	The size each tile would like to be, rounded down to a power of two
+		@return The tiles, in the same order as the requests. A tile that didn't fit has a size of 0
+	*/
+	std::vector<ShadowAtlasTile> allocate(const std::vector<uint32_t>& requestedSizes);
+
+private:
+	uint32_t mResolution;							///< Width and height of the atlas
+	uint32_t mMinTileSize;							///< The smallest tile that will be handed out
+	std::vector<ShadowAtlasTile> mFreeTiles;		///< Unused regions left over from splitting
+
+	/** @brief Take a region of exactly the given size out of the free list
+		@param size	A power of two tile size
+		@param tile	The region found
+		@return False if no free region is large enough
+	*/
+	bool takeTile(uint32_t size, ShadowAtlasTile& tile);
+
+	/** @brief Round down to a power of two (0 stays 0) */
+	static uint32_t floorPowerOfTwo(uint32_t value);
+};
@@ -2,15 +2,142 @@
 
 #include <vulkan/vulkan.h>
 
+//glm
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <vector>
+
+//uwb-vk
+#include "Lighting.h"
+
+const uint32_t MAX_SHADOW_CASCADES = 4;								///< Maximum number of cascades (layers of the shadow map) a directional light can use
+const uint32_t MAX_SHADOW_VIEWS = MAX_SHADOW_CASCADES + MAX_LIGHTS;	///< Maximum number of views rendered into the shadow map each frame
+const uint32_t MAX_POINT_SHADOWS = 4;								///< Maximum number of point lights with cube shadow maps
+const float POINT_SHADOW_NEAR = 0.1f;								///< Near plane of every cube shadow map face
+const uint32_t MAX_PCF_TAPS = 16;									///< Size of the Poisson kernel receivers can filter shadows with
+
+/** @brief Settings controlling the size and layout of the shadow map
+
+	The shadow map's size is independent of the window, so resizing the window
+	does not reallocate it, and its fill cost does not grow with the screen resolution.
+*/
+struct ShadowSettings
+{
+	uint32_t resolution = 2048;						///< Width and height of each shadow map layer (and so of the atlas) in texels
+	VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;	///< Depth format of the shadow map (VK_FORMAT_D16_UNORM or VK_FORMAT_D32_SFLOAT)
+	uint32_t cascadeCount = MAX_SHADOW_CASCADES;	///< Number of cascades used for directional lights (1 to MAX_SHADOW_CASCADES)
+	float splitLambda = 0.75f;						///< Blend between uniform (0) and logarithmic (1) cascade splits
+	float maxDistance = 100.0f;						///< Distance from the camera that directional shadows reach
+	uint32_t minAtlasTileSize = 64;					///< The smallest atlas tile a spot light can be given
+	uint32_t pointResolution = 512;					///< Width and height of each cube shadow map face in texels
+	bool cacheShadows = true;						///< Only re-render the shadow views whose light or casters changed
+	uint32_t maxRefreshInterval = 4;				///< Most frames a changed far cascade or low importance light waits before it is re-rendered
+	float maxCascadeTurn = 5.0f;					///< Degrees the camera can turn before a waiting cascade is re-rendered right away
+};
+
+/** @brief A light that casts shadows this frame
+
+	Directional lights get cascades fit to the camera (only the first directional
+	light is shadowed). Spot lights share the shadow atlas, each getting a tile
+	sized by how much of the screen it can light and by its importance.
+*/
+struct ShadowLight
+{
+	uint32_t lightIndex = 0;								///< Index of the light in LightUBO::lights
+	LightType lightType = LightType::Spot;					///< Directional, Spot or Point
+	glm::vec3 position = glm::vec3(0.0f);					///< World space position (spot and point lights)
+	glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);		///< The direction the light travels in
+	glm::mat4 viewProj = glm::mat4(1.0f);					///< The light's projection * view matrix (spot lights)
+	float range = 20.0f;									///< How far the light reaches: its screen coverage (spot lights) or cube far plane (point lights)
+	float importance = 1.0f;								///< Scales the light's share of the atlas
+	float filterRadius = 1.5f;								///< Radius of the PCF kernel in shadow map texels (0 for a single bilinear compare)
+};
+
+/** @brief Which of a ShadowMap's images a shader binding samples */
+enum class ShadowMapView : uint32_t
+{
+	Layers = 0,		///< The cascades and spot light atlas (sampler2DArray)
+	PointCubes		///< The point light cubes (samplerCubeArray)
+};
+
 /** @brief A ShadowMap
 
 	A ShadowMap. Very similar to texture in data used, but its context of
 	use is very different, requiring its own struct.
+
+	The image is a 2D array with one layer per cascade, followed by one
+	layer holding the atlas that spot lights are packed into.
+	Point lights use a second image, a cube array with one cube per light.
 */
 struct ShadowMap {
 	VkImage image = VK_NULL_HANDLE;					///< The VkImage object written to
 	VkFormat imageFormat = VK_FORMAT_UNDEFINED;		///< The format of the VkImage
 	VkDeviceMemory imageMemory = VK_NULL_HANDLE;	///< Handle to the the deviceMemory the VkImage resides in
-	VkImageView imageView = VK_NULL_HANDLE;			///< A view to the VkImage object
-	VkSampler imageSampler = VK_NULL_HANDLE;		///< A sampler so the ShadowMap can be accessed in future passes
-};
\ No newline at end of file
+	VkImageView imageView = VK_NULL_HANDLE;			///< A 2D array view to every layer of the VkImage, for sampling
+	VkSampler imageSampler = VK_NULL_HANDLE;		///< A depth comparison sampler, so receivers get hardware filtered shadow tests
+	VkExtent2D extent = { 0, 0 };					///< The size of each layer
+	uint32_t layerCount = 0;						///< The number of layers in the image
+	std::vector<VkImageView> layerViews;			///< A view to each layer, used as framebuffer attachments
+	uint32_t atlasLayer = 0;						///< The layer holding the spot light atlas
+
+	VkImage pointImage = VK_NULL_HANDLE;			///< The cube array point lights render into (6 layers per cube)
+	VkDeviceMemory pointImageMemory = VK_NULL_HANDLE;	///< Handle to the deviceMemory pointImage resides in
+	VkImageView pointImageView = VK_NULL_HANDLE;	///< A cube array view of pointImage, for sampling
+	VkImageView pointLayersView = VK_NULL_HANDLE;	///< A 2D array view of every face, used as a layered framebuffer attachment
+	VkExtent2D pointExtent = { 0, 0 };				///< The size of each cube face
+	uint32_t pointLayerCount = 0;					///< The number of layers in pointImage
+
+	/** @brief Get the view receivers sample for a kind of shadow */
+	VkImageView getImageView(ShadowMapView view) const
+	{
+		return (view == ShadowMapView::PointCubes) ? pointImageView : imageView;
+	}
+};
+
+/** @brief A shadow caster drawn into the cube shadow map of one point light */
+struct PointShadowCaster
+{
+	uint32_t renderable = 0;		///< Index into the RenderSystem's renderables
+	uint32_t faceMask = 0;			///< The cube faces (bit per face, +X -X +Y -Y +Z -Z) the caster's bounds overlap
+};
+
+/** @brief One shadow map rendered from a light
+
+	Member order and padding follow std140.
+*/
+struct ShadowView
+{
+	glm::mat4 viewProj = glm::mat4(1.0f);		///< The light's view-projection matrix for this view
+	glm::vec4 atlasRect = glm::vec4(0.0f);		///< Where the view lives in the shadow map: UV offset (xy), UV scale (z) and layer (w)
+};
+
+/** @brief What was last rendered into one light's region of the shadow map
+
+	Lets views that haven't changed keep their contents between frames.
+*/
+struct ShadowViewCache
+{
+	bool valid = false;				///< Whether the region still holds this view
+	ShadowView view;				///< The view as it was rendered, which receivers keep using until it is refreshed
+	uint64_t signature = 0;			///< Hash of the view's matrix and its casters when it was rendered
+	uint64_t lastRefresh = 0;		///< The frame it was rendered on
+	glm::vec3 cameraForward = glm::vec3(0.0f);	///< The camera's forward vector when it was rendered (cascades are fit to the camera)
+};
+
+/** @brief The shadow views shared by the shadow pass and shadow receivers
+
+	Member order and padding follow std140, as the struct is copied
+	byte-by-byte into a uniform buffer.
+*/
+struct ShadowUBO
+{
+	ShadowView views[MAX_SHADOW_VIEWS];					///< Every view rendered this frame, cascades first
+	glm::uvec4 lightViews[MAX_LIGHTS] = {};				///< Per light: the first view (x), the number of views (y) and the cube index + 1 (z, 0 if none)
+	glm::vec4 splitDepths = glm::vec4(0.0f);			///< The far view space depth of each cascade
+	glm::mat4 pointFaceViewProj[MAX_POINT_SHADOWS * 6];	///< The view-projection of each cube face, cube by cube
+	glm::vec4 pointShadows[MAX_POINT_SHADOWS] = {};		///< Per cube: the light's position (xyz) and far plane (w)
+	glm::vec4 lightFilters[MAX_LIGHTS] = {};			///< Per light: the PCF kernel radius in texels (x)
+};
@@ -0,0 +1,329 @@
+#include "SoftwareOcclusion.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+	#include <xmmintrin.h>
+	#define UWB_RASTER_SSE
+#endif
+
+const int TILE_WIDTH = 8;					///< Tile width in pixels (one byte of the coverage mask per row)
+const int TILE_HEIGHT = 4;					///< Tile height in pixels
+const uint32_t FULL_TILE_MASK = 0xFFFFFFFF;	///< Coverage mask with every pixel of a tile set
+
+//Triangles closer than this (in clip space w) are dropped rather than clipped.
+//Dropping an occluder only means less gets culled, so this stays conservative
+const float MIN_CLIP_W = 1e-4f;
+
+std::shared_ptr<OccluderMesh> OccluderMesh::fromMesh(const Mesh& mesh)
+{
+	auto occluder = std::make_shared<OccluderMesh>();
+
+	occluder->positions.reserve(mesh.getVertices().size());
+	for (const auto& vertex : mesh.getVertices()) {
+		occluder->positions.push_back(glm::vec3(vertex.pos));
+	}
+	occluder->indices = mesh.getIndices();
+
+	return occluder;
+}
+
+std::shared_ptr<OccluderMesh> OccluderMesh::fromBox(const AABB& box)
+{
+	auto occluder = std::make_shared<OccluderMesh>();
+
+	//corner i has +x extent if bit 0 is set, +y if bit 1, +z if bit 2
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 sign((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		occluder->positions.push_back(box.center + box.extents * sign);
+	}
+
+	//two triangles per face, winding doesn't matter since occluders are two sided
+	occluder->indices = {
+		0, 2, 1,  1, 2, 3,		//-z
+		4, 5, 6,  5, 7, 6,		//+z
+		0, 1, 4,  1, 5, 4,		//-y
+		2, 6, 3,  3, 6, 7,		//+y
+		0, 4, 2,  2, 4, 6,		//-x
+		1, 3, 5,  3, 7, 5		//+x
+	};
+
+	return occluder;
+}
+
+MaskedOcclusionBuffer::MaskedOcclusionBuffer(uint32_t width, uint32_t height)
+{
+	mTilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	mTilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	mWidth = mTilesX * TILE_WIDTH;
+	mHeight = mTilesY * TILE_HEIGHT;
+	mTiles.resize(mTilesX * mTilesY);
+}
+
+void MaskedOcclusionBuffer::rasterize(const glm::mat4& viewProj, const std::vector<OccluderInstance>& occluders, ThreadPool* threadPool)
+{
+	//the tiles and triangles can't change while the last frame's bands are running
+	wait();
+
+	mViewProj = viewProj;
+	setupTriangles(occluders);
+
+	if (!threadPool) {
+		rasterizeBand(0, mTilesY);
+		return;
+	}
+
+	uint32_t bandCount = std::min(threadPool->size(), mTilesY);
+	uint32_t rowsPerBand = (mTilesY + bandCount - 1) / bandCount;
+	for (uint32_t firstRow = 0; firstRow < mTilesY; firstRow += rowsPerBand) {
+		int endRow = static_cast<int>(std::min(firstRow + rowsPerBand, mTilesY));
+		mPending.push_back(threadPool->submit([this, firstRow, endRow]() {
+			rasterizeBand(static_cast<int>(firstRow), endRow);
+		}));
+	}
+}
+
+bool MaskedOcclusionBuffer::wait()
+{
+	if (mPending.empty())
+		return false;
+
+	for (auto& band : mPending) {
+		band.get();
+	}
+	mPending.clear();
+	return true;
+}
+
+bool MaskedOcclusionBuffer::isVisible(const Bounds& bounds) const
+{
+	float minX = std::numeric_limits<float>::max();
+	float minY = std::numeric_limits<float>::max();
+	float maxX = -std::numeric_limits<float>::max();
+	float maxY = -std::numeric_limits<float>::max();
+	float minDepth = 1.0f;
+
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 sign((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		glm::vec4 clip = mViewProj * glm::vec4(bounds.box.center + bounds.box.extents * sign, 1.0f);
+
+		//the box reaches behind the camera, its screen extent can't be bounded
+		if (clip.w < MIN_CLIP_W)
+			return true;
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * mWidth;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * mHeight;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minDepth = std::min(minDepth, clip.z / clip.w);
+	}
+
+	if (minDepth <= 0.0f)
+		return true;
+
+	//every pixel the rectangle touches
+	int pixelX0 = std::max(static_cast<int>(std::floor(minX)), 0);
+	int pixelY0 = std::max(static_cast<int>(std::floor(minY)), 0);
+	int pixelX1 = std::min(static_cast<int>(std::floor(maxX)), static_cast<int>(mWidth) - 1);
+	int pixelY1 = std::min(static_cast<int>(std::floor(maxY)), static_cast<int>(mHeight) - 1);
+
+	//off screen, leave it to frustum culling
+	if (pixelX0 > pixelX1 || pixelY0 > pixelY1)
+		return true;
+
+	for (int tileY = pixelY0 / TILE_HEIGHT; tileY <= pixelY1 / TILE_HEIGHT; tileY++) {
+		int row0 = std::max(pixelY0 - tileY * TILE_HEIGHT, 0);
+		int row1 = std::min(pixelY1 - tileY * TILE_HEIGHT, TILE_HEIGHT - 1);
+
+		for (int tileX = pixelX0 / TILE_WIDTH; tileX <= pixelX1 / TILE_WIDTH; tileX++) {
+			int col0 = std::max(pixelX0 - tileX * TILE_WIDTH, 0);
+			int col1 = std::min(pixelX1 - tileX * TILE_WIDTH, TILE_WIDTH - 1);
+
+			uint32_t rowBits = ((1u << (col1 - col0 + 1)) - 1) << col0;
+			uint32_t rectMask = 0;
+			for (int row = row0; row <= row1; row++) {
+				rectMask |= rowBits << (row * TILE_WIDTH);
+			}
+
+			//masked pixels are bounded by both layers, the rest only by the reference layer
+			const Tile& tile = mTiles[tileY * mTilesX + tileX];
+			float tileDepth = ((rectMask & ~tile.mask) == 0) ? std::min(tile.zMax0, tile.zMax1) : tile.zMax0;
+
+			if (minDepth <= tileDepth)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void MaskedOcclusionBuffer::setupTriangles(const std::vector<OccluderInstance>& occluders)
+{
+	mTriangles.clear();
+
+	std::vector<glm::vec4> clipPositions;
+	for (const auto& occluder : occluders) {
+		glm::mat4 mvp = mViewProj * occluder.model;
+
+		clipPositions.resize(occluder.mesh->positions.size());
+		for (size_t i = 0; i < clipPositions.size(); i++) {
+			clipPositions[i] = mvp * glm::vec4(occluder.mesh->positions[i], 1.0f);
+		}
+
+		const auto& indices = occluder.mesh->indices;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			glm::vec4 clip[3] = { clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]] };
+
+			if (clip[0].w < MIN_CLIP_W || clip[1].w < MIN_CLIP_W || clip[2].w < MIN_CLIP_W)
+				continue;
+
+			float x[3], y[3], z[3];
+			for (int v = 0; v < 3; v++) {
+				x[v] = (clip[v].x / clip[v].w * 0.5f + 0.5f) * mWidth;
+				y[v] = (clip[v].y / clip[v].w * 0.5f + 0.5f) * mHeight;
+				z[v] = clip[v].z / clip[v].w;
+			}
+
+			//in front of the near plane
+			if (z[0] < 0.0f || z[1] < 0.0f || z[2] < 0.0f)
+				continue;
+
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (std::fabs(area) < 1e-6f)
+				continue;
+
+			float minX = std::min({ x[0], x[1], x[2] });
+			float maxX = std::max({ x[0], x[1], x[2] });
+			float minY = std::min({ y[0], y[1], y[2] });
+			float maxY = std::max({ y[0], y[1], y[2] });
+			if (maxX < 0.0f || maxY < 0.0f || minX >= mWidth || minY >= mHeight)
+				continue;
+
+			ScreenTriangle triangle;
+
+			//E(p) = A * p.x + B * p.y + C, positive inside for both windings
+			float orientation = (area > 0.0f) ? 1.0f : -1.0f;
+			for (int edge = 0; edge < 3; edge++) {
+				int v0 = edge;
+				int v1 = (edge + 1) % 3;
+				triangle.edgeA[edge] = orientation * (y[v0] - y[v1]);
+				triangle.edgeB[edge] = orientation * (x[v1] - x[v0]);
+				triangle.edgeC[edge] = orientation * (x[v0] * y[v1] - y[v0] * x[v1]);
+			}
+
+			//the farthest depth of the triangle bounds every pixel it covers
+			triangle.zMax = std::min(std::max({ z[0], z[1], z[2] }), 1.0f);
+
+			triangle.minTileX = std::max(static_cast<int>(minX), 0) / TILE_WIDTH;
+			triangle.maxTileX = std::min(static_cast<int>(maxX), static_cast<int>(mWidth) - 1) / TILE_WIDTH;
+			triangle.minTileY = std::max(static_cast<int>(minY), 0) / TILE_HEIGHT;
+			triangle.maxTileY = std::min(static_cast<int>(maxY), static_cast<int>(mHeight) - 1) / TILE_HEIGHT;
+
+			mTriangles.push_back(triangle);
+		}
+	}
+}
+
+void MaskedOcclusionBuffer::rasterizeBand(int firstRow, int endRow)
+{
+	std::fill(mTiles.begin() + firstRow * mTilesX, mTiles.begin() + endRow * mTilesX, Tile());
+
+	for (const auto& triangle : mTriangles) {
+		int tileY0 = std::max(triangle.minTileY, firstRow);
+		int tileY1 = std::min(triangle.maxTileY, endRow - 1);
+
+		for (int tileY = tileY0; tileY <= tileY1; tileY++) {
+			for (int tileX = triangle.minTileX; tileX <= triangle.maxTileX; tileX++) {
+				uint32_t coverage = computeCoverage(triangle, tileX, tileY);
+				if (coverage != 0) {
+					updateTile(mTiles[tileY * mTilesX + tileX], coverage, triangle.zMax);
+				}
+			}
+		}
+	}
+}
+
+uint32_t MaskedOcclusionBuffer::computeCoverage(const ScreenTriangle& triangle, int tileX, int tileY)
+{
+	//sample at pixel centers
+	float baseX = static_cast<float>(tileX * TILE_WIDTH) + 0.5f;
+	float baseY = static_cast<float>(tileY * TILE_HEIGHT) + 0.5f;
+	uint32_t coverage = 0;
+
+#if defined(UWB_RASTER_SSE)
+	//left and right halves of a tile row
+	__m128 xLeft = _mm_setr_ps(baseX, baseX + 1.0f, baseX + 2.0f, baseX + 3.0f);
+	__m128 xRight = _mm_add_ps(xLeft, _mm_set1_ps(4.0f));
+	__m128 zero = _mm_setzero_ps();
+
+	__m128 edgeXLeft[3], edgeXRight[3];
+	for (int edge = 0; edge < 3; edge++) {
+		__m128 a = _mm_set1_ps(triangle.edgeA[edge]);
+		edgeXLeft[edge] = _mm_mul_ps(a, xLeft);
+		edgeXRight[edge] = _mm_mul_ps(a, xRight);
+	}
+
+	for (int row = 0; row < TILE_HEIGHT; row++) {
+		float y = baseY + static_cast<float>(row);
+		__m128 insideLeft = _mm_cmpeq_ps(zero, zero);
+		__m128 insideRight = insideLeft;
+
+		for (int edge = 0; edge < 3; edge++) {
+			__m128 edgeY = _mm_set1_ps(triangle.edgeB[edge] * y + triangle.edgeC[edge]);
+			insideLeft = _mm_and_ps(insideLeft, _mm_cmpge_ps(_mm_add_ps(edgeXLeft[edge], edgeY), zero));
+			insideRight = _mm_and_ps(insideRight, _mm_cmpge_ps(_mm_add_ps(edgeXRight[edge], edgeY), zero));
+		}
+
+		uint32_t rowBits = static_cast<uint32_t>(_mm_movemask_ps(insideLeft)) |
+							(static_cast<uint32_t>(_mm_movemask_ps(insideRight)) << 4);
+		coverage |= rowBits << (row * TILE_WIDTH);
+	}
+#else
+	for (int row = 0; row < TILE_HEIGHT; row++) {
+		float y = baseY + static_cast<float>(row);
+		for (int col = 0; col < TILE_WIDTH; col++) {
+			float x = baseX + static_cast<float>(col);
+			bool inside = true;
+			for (int edge = 0; edge < 3; edge++) {
+				if (triangle.edgeA[edge] * x + triangle.edgeB[edge] * y + triangle.edgeC[edge] < 0.0f) {
+					inside = false;
+					break;
+				}
+			}
+			if (inside)
+				coverage |= 1u << (row * TILE_WIDTH + col);
+		}
+	}
+#endif
+
+	return coverage;
+}
+
+void MaskedOcclusionBuffer::updateTile(Tile& tile, uint32_t coverage, float zTri)
+{
+	//behind everything already in the tile, so it adds nothing
+	if (zTri >= tile.zMax0)
+		return;
+
+	//if the triangle is much closer than the working layer, start a new working layer from it
+	float distToWorking = tile.zMax1 - zTri;
+	float distToReference = tile.zMax0 - tile.zMax1;
+	if (distToWorking > distToReference) {
+		tile.zMax1 = 0.0f;
+		tile.mask = 0;
+	}
+
+	tile.zMax1 = std::max(tile.zMax1, zTri);
+	tile.mask |= coverage;
+
+	//a full working layer bounds the whole tile, so it replaces the reference layer
+	if (tile.mask == FULL_TILE_MASK) {
+		tile.zMax0 = std::min(tile.zMax0, tile.zMax1);
+		tile.zMax1 = 0.0f;
+		tile.mask = 0;
+	}
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+//glm
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//STL
+#include <vector>
+#include <future>
+#include <memory>
+
+//uwb-vk
+#include "Bounds.h"
+#include "ThreadPool.h"
+
+class Mesh;
+
+const uint32_t SOFTWARE_OCCLUSION_WIDTH = 256;		///< Width of the CPU depth buffer in pixels (multiple of the tile width)
+const uint32_t SOFTWARE_OCCLUSION_HEIGHT = 128;		///< Height of the CPU depth buffer in pixels (multiple of the tile height)
+
+/** @brief A simplified triangle mesh that is rasterized as an occluder
+
+	Occluders should be no larger than the object they stand in for,
+	otherwise they can hide objects that are actually visible.
+*/
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;	///< Object space vertex positions
+	std::vector<uint32_t> indices;		///< Triangle list indices into positions
+
+	/** @brief Use every triangle of a mesh as an occluder
+		@param mesh A loaded mesh (its CPU side vertices are used)
+	*/
+	static std::shared_ptr<OccluderMesh> fromMesh(const Mesh& mesh);
+
+	/** @brief Create a box occluder (12 triangles)
+
+		Only suitable for objects that fill their bounding box, such as crates or walls.
+
+		@param box The object space box
+	*/
+	static std::shared_ptr<OccluderMesh> fromBox(const AABB& box);
+};
+
+/** @brief An occluder mesh placed in the world */
+struct OccluderInstance
+{
+	std::shared_ptr<OccluderMesh> mesh;		///< The occluder geometry
+	glm::mat4 model;						///< Object to world transform
+};
+
+/** @class MaskedOcclusionBuffer
+
+	@brief A low resolution CPU depth buffer for occlusion culling
+
+	Follows the masked software occlusion culling approach: the screen is split
+	into 8x4 pixel tiles, and instead of a depth per pixel each tile stores a
+	32-bit coverage mask and two depths:
+	- zMax0, the farthest depth of the whole tile (the reference layer)
+	- zMax1, the farthest depth of the pixels in the coverage mask (the working layer)
+
+	When the mask fills up, the working layer becomes the new reference layer.
+	Coverage is computed with SSE, 4 pixels of a tile row at a time.
+	Rasterization is split into horizontal bands of tiles, one task per band,
+	so it can run on worker threads while the rest of the frame is prepared.
+
+	Depth follows Vulkan conventions: 0 at the near plane, 1 at the far plane.
+*/
+class MaskedOcclusionBuffer
+{
+public:
+	/** @brief Constructor
+		@param width	Width in pixels, rounded up to a multiple of 8
+		@param height	Height in pixels, rounded up to a multiple of 4
+	*/
+	MaskedOcclusionBuffer(uint32_t width = SOFTWARE_OCCLUSION_WIDTH, uint32_t height = SOFTWARE_OCCLUSION_HEIGHT);
+
+	/** @brief Start rasterizing occluders for a new frame
+
+		Occluders are transformed on the calling thread, then the tiles are
+		cleared and rasterized on the thread pool. Call wait() before testing.
+
+		@param viewProj		The camera's projection * view matrix
+		@param occluders	The occluders to rasterize
+		@param threadPool	The pool to rasterize on. If null, rasterization happens immediately on the calling thread
+	*/
+	void rasterize(const glm::mat4& viewProj, const std::vector<OccluderInstance>& occluders, ThreadPool* threadPool);
+
+	/** @brief Wait for rasterization started by rasterize() to finish
+		@return True if there was a rasterization to wait for
+	*/
+	bool wait();
+
+	/** @brief Test world space bounds against the occluders
+		@param bounds World space bounds
+		@return False if the bounds are entirely hidden behind occluders
+	*/
+	bool isVisible(const Bounds& bounds) const;
+
+	uint32_t getWidth() const { return mWidth; }		///< Get the width in pixels
+	uint32_t getHeight() const { return mHeight; }		///< Get the height in pixels
+
+private:
+	/** @brief The depth information of one 8x4 tile */
+	struct Tile
+	{
+		uint32_t mask = 0;			///< Pixels covered by the working layer (bit = row * 8 + column)
+		float zMax0 = 1.0f;			///< Reference layer, farthest depth of the whole tile
+		float zMax1 = 0.0f;			///< Working layer, farthest depth of the masked pixels
+	};
+
+	/** @brief A screen space triangle ready for rasterization */
+	struct ScreenTriangle
+	{
+		float edgeA[3];				///< Edge function x coefficients
+		float edgeB[3];				///< Edge function y coefficients
+		float edgeC[3];				///< Edge function constants
+		float zMax;					///< Farthest depth of the triangle
+		int minTileX, maxTileX;		///< Tile columns overlapped by the triangle's bounding box
+		int minTileY, maxTileY;		///< Tile rows overlapped by the triangle's bounding box
+	};
+
+	uint32_t mWidth;								///< Width in pixels
+	uint32_t mHeight;								///< Height in pixels
+	uint32_t mTilesX;								///< Number of tile columns
+	uint32_t mTilesY;								///< Number of tile rows
+	std::vector<Tile> mTiles;						///< Row major tiles
+	std::vector<ScreenTriangle> mTriangles;			///< Triangles set up by the last rasterize() call
+	glm::mat4 mViewProj = glm::mat4(1.0f);			///< The matrix the occluders were rasterized with
+	std::vector<std::future<void>> mPending;		///< Band tasks still in flight
+
+	/** @brief Transform occluders and set up their screen space triangles */
+	void setupTriangles(const std::vector<OccluderInstance>& occluders);
+
+	/** @brief Clear and rasterize every triangle into a range of tile rows
+		@param firstRow The first tile row of the band
+		@param endRow One past the last tile row of the band
+	*/
+	void rasterizeBand(int firstRow, int endRow);
+
+	/** @brief Compute which pixels of a tile are inside a triangle
+		@param triangle The triangle
+		@param tileX	Tile column
+		@param tileY	Tile row
+	*/
+	static uint32_t computeCoverage(const ScreenTriangle& triangle, int tileX, int tileY);
+
+	/** @brief Merge a triangle's coverage into a tile
+		@param tile		The tile to update
+		@param coverage	The pixels of the tile covered by the triangle
+		@param zTri		The farthest depth of the triangle
+	*/
+	static void updateTile(Tile& tile, uint32_t coverage, float zTri);
+};
@@ -2,7 +2,8 @@
 #include "RenderSystem.h"
 #include <assert.h>
 
-Texture::Texture(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<ImageManager> imageManager) :
+Texture::Texture(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<ImageManager> imageManager,
+	std::shared_ptr<VulkanObjectCache> objectCache) :
 	mWidth(0),
 	mHeight(0),
 	mChannels(0),
@@ -11,7 +12,8 @@ Texture::Texture(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferM
 	mImageMemory(VK_NULL_HANDLE),
 	mContext(context),
 	mBufferManager(bufferManager),
-	mImageManager(imageManager)
+	mImageManager(imageManager),
+	mObjectCache(objectCache)
 {
 }
 
@@ -32,8 +34,8 @@ Texture& Texture::load(unsigned char* pixelData, int width, int height, int chan
 
 void Texture::free()
 {
-	//free up resources
-	vkDestroySampler(mContext->device, mSampler, nullptr);
+	//free up resources (the sampler is destroyed along with the last texture using it)
+	mSampler.reset();
 	vkDestroyImageView(mContext->device, mImageView, nullptr);
 	vkDestroyImage(mContext->device, mImage, nullptr);
 	vkFreeMemory(mContext->device, mImageMemory, nullptr);
@@ -43,7 +45,6 @@ void Texture::free()
 	mHeight = 0;
 	mChannels = 0;
 	mImageSize = 0;
-	mSampler = VK_NULL_HANDLE;
 	mImageView = VK_NULL_HANDLE;
 	mImage = VK_NULL_HANDLE;
 	mImageMemory = VK_NULL_HANDLE;
@@ -121,7 +122,5 @@ void Texture::createTextureSampler()
 	samplerInfo.minLod = 0.0f;
 	samplerInfo.maxLod = 0.0f;
 
-	if (vkCreateSampler(mContext->device, &samplerInfo, nullptr, &mSampler) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create texture sampler!");
-	}
+	mSampler = mObjectCache->getSampler(samplerInfo);
 }
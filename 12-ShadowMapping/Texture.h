@@ -9,6 +9,7 @@
 
 #include "BufferManager.h"
 #include "ImageManager.h"
+#include "VulkanObjectCache.h"
 
 /** @class Texture
 
@@ -25,8 +26,10 @@ public:
 		@param context			A pointer to the RenderSystem's VulkanContext
 		@param bufferManager	A pointer to the RenderSystem's buffer manager
 		@param imageManager		A pointer to the RenderSystem's image manager
+		@param objectCache		A pointer to the RenderSystem's object cache, the sampler is shared through it
 	*/
-	Texture(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<ImageManager> imageManager);
+	Texture(std::shared_ptr<VulkanContext> context, std::shared_ptr<BufferManager> bufferManager, std::shared_ptr<ImageManager> imageManager,
+		std::shared_ptr<VulkanObjectCache> objectCache);
 
 	/** @brief load raw image data into this texture
 		@param data		A byte array of image data
@@ -46,13 +49,14 @@ public:
 	/** Get the VkImageView object for this texture */
 	VkImageView getImageView() const { return mImageView; };	
 	
-	/** Get the VkSampler object for this texture */
-	VkSampler getSampler() const { return mSampler; };			
+	/** Get the VkSampler object for this texture (shared with other textures) */
+	VkSampler getSampler() const { return mSampler ? *mSampler : VK_NULL_HANDLE; };			
 protected:
 	//Primary system pointers
 	std::shared_ptr<VulkanContext> mContext;			///< A shared pointer to the RenderSystem's VulkanContext
 	std::shared_ptr<BufferManager> mBufferManager;		///< A shared pointer to the RenderSystem's BufferManager
 	std::shared_ptr<ImageManager> mImageManager;		///< A shared pointer to the RenderSystem's ImageManager
+	std::shared_ptr<VulkanObjectCache> mObjectCache;	///< A shared pointer to the RenderSystem's VulkanObjectCache
 
 	int mWidth;											///< The resolution width of the texture
 	int mHeight;										///< The resolution height of the texture
@@ -63,7 +67,7 @@ protected:
 	VkImage mImage;										///< The VkImageHandle
 	VkDeviceMemory mImageMemory;						///< A handle to the device memory holding the image
 	VkImageView mImageView;								///< A Vulkan ImageView for the texture
-	VkSampler mSampler;									///< A sampler so the image can be used in a shader
+	SharedSampler mSampler;								///< A sampler so the image can be used in a shader, shared by textures sampled the same way
 
 protected:
 	/** @brief create a VkImage object from the pixel data
@@ -74,6 +78,6 @@ protected:
 	/** @brief Create a VkImageView object for accessing the VkImage */
 	void createTextureImageView();
 	
-	/** @brief Create a VkSampler object for access inside shaders */
+	/** @brief Get the VkSampler object for access inside shaders from the object cache */
 	void createTextureSampler();
 };
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+//STL
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/** @class ThreadPool
+
+	@brief A fixed set of worker threads that run queued tasks
+
+	Tasks are run in the order they are submitted, by whichever worker
+	is free first. Results (and exceptions) are returned through std::future.
+*/
+class ThreadPool
+{
+public:
+	/** @brief Constructor
+		@param threadCount The number of worker threads. 0 uses one less than the
+			number of hardware threads (leaving one for the render thread), with a minimum of 1
+	*/
+	explicit ThreadPool(uint32_t threadCount = 0);
+
+	/** @brief Destructor. Finishes all queued tasks, then joins the workers */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/** @brief Queue a task to be run on a worker thread
+		@param task A callable taking no arguments
+		@return A future for the task's result
+	*/
+	template<typename Task>
+	auto submit(Task&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTasks.push([packaged]() { (*packaged)(); });
+		}
+		mCondition.notify_one();
+		return result;
+	}
+
+	/** @brief Get the number of worker threads */
+	uint32_t size() const { return static_cast<uint32_t>(mWorkers.size()); }
+
+private:
+	std::vector<std::thread> mWorkers;					///< The worker threads
+	std::queue<std::function<void()>> mTasks;			///< Tasks waiting for a worker
+	std::mutex mMutex;									///< Guards mTasks and mStopping
+	std::condition_variable mCondition;					///< Signalled when a task is queued or the pool stops
+	bool mStopping = false;								///< Set by the destructor to end the worker loops
+
+	/** @brief Run tasks until the pool is stopped and the queue is empty */
+	void workerLoop();
+};
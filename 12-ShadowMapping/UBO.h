@@ -12,4 +12,5 @@ struct UBO
 	VkDeviceSize bufferSize = 0;					///< The Size of the objects in the buffer (in bytes)
 	std::vector<VkBuffer> buffers;					///< The VkBuffers that are used in the UBO
 	std::vector<VkDeviceMemory> buffersMemory;		///< The device memory used to make the UBO
+	std::vector<void*> mappedData;					///< Persistent host mappings of buffersMemory (empty if the buffers are mapped per update)
 };
\ No newline at end of file
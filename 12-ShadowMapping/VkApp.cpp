@@ -1,6 +1,8 @@
 #include "VkApp.h"
 #include "PrintUtil.h"
 
+#include <random>
+
 VkApp::VkApp() : mWindow(nullptr) {}
 
 void VkApp::run()
@@ -14,25 +16,34 @@ void VkApp::run()
 		glfwPollEvents();
 		handleInput();
 
-		updateShadowMVP(mLightUBO.lights[0]);
 		mCamera->updateViewMatrix();
+		updateShadowLights();
+		updateLights();
 		
-		//light buffers
+		//the lights themselves reach the shaders through the RenderSystem's light buffer
 		mLightUBO.viewPos = glm::vec4(mCamera->position, 1.0);
 		mRenderSystem.updateUniformBuffer<LightUBO>(*mLightUBOBuffer, mLightUBO, 0);
 		
 		//update transform buffers
 		updateMVPBuffer(*mCubeMVPBuffer, mCubeXForm, *mCamera);
 		updateMVPBuffer(*mGroundMVPBuffer, mGroundXForm, *mCamera);
+		mCube->setModelMatrix(mCubeXForm.getModelMatrix());
+		mGround->setModelMatrix(mGroundXForm.getModelMatrix());
+		for (size_t cubeIndex = 0; cubeIndex < mDroppedCubes.size(); cubeIndex++) {
+			updateMVPBuffer(*mDroppedCubeMVPBuffers[cubeIndex], mDroppedCubeXForms[cubeIndex], *mCamera);
+			mDroppedCubes[cubeIndex]->setModelMatrix(mDroppedCubeXForms[cubeIndex].getModelMatrix());
+		}
 		
 		//update light indicators
 		for (uint32_t lightIndex = 0; lightIndex < mTotalLights; lightIndex++) {
-			mLightIndicatorXForm[lightIndex].position = mLightUBO.lights[lightIndex].position;
+			mLightIndicatorXForm[lightIndex].position = mLights[lightIndex].position;
 
 			updateMVPBuffer(*mLightIndicatorMVPBuffer[lightIndex], mLightIndicatorXForm[lightIndex], *mCamera);
-			mRenderSystem.updateUniformBuffer<Light>(*mLightIndicatorLightBuffer[lightIndex], mLightUBO.lights[lightIndex], 0);
+			mLightIndicators[lightIndex]->setModelMatrix(mLightIndicatorXForm[lightIndex].getModelMatrix());
 		}
-		
+
+		//the camera is used to cull renderables that are out of view
+		mRenderSystem.setCamera(*mCamera);
 
 		mRenderSystem.drawFrame();
 
@@ -51,10 +62,15 @@ void VkApp::initialize(const std::string& appName)
 	glfwInit();
 	createWindow();
 	mRenderSystem.initialize(mWindow, appName);
+	mRenderSystem.setDepthPrePass(cDepthPrePass);
 	mInputSystem.initialize(mWindow);
 	
 	setupCamera();
 	setupLights();
+
+	//the lighting pass shades and filters shadows like the forward receivers, the materials' shininess comes from the G-buffer
+	mRenderSystem.getDeferredLightingShader()->setSpecializationConstants(getSceneLighting(true).getSpecializationConstants());
+	mRenderSystem.setDeferredShading(cDeferredShading);
 	
 	createCube();
 	mCubeXForm.scale = glm::vec3(4.0f);
@@ -100,13 +116,98 @@ void VkApp::handleInput()
 		if (clearColorIndex >= clearColors.size()) clearColorIndex = 0;
 	}
 
-	//print out FPS
-	if (mInputSystem.isKeyPressed(GLFW_KEY_F))
+	//print out FPS, and how much shading the color pass did
+	if (mInputSystem.isKeyPressed(GLFW_KEY_F)) {
 		std::cout << "frameTime: " << mFrameTime * 1000.0 << " ms ( " << (1.0 / mFrameTime) << " fps)" << std::endl;
 
+		const PipelineStatistics& statistics = mRenderSystem.getPipelineStatistics();
+		if (statistics.valid) {
+			std::cout << "vertex invocations: " << statistics.vertexShaderInvocations
+				<< ", fragment invocations: " << statistics.fragmentShaderInvocations << std::endl;
+		}
+
+		uint32_t droppedIndices = mRenderSystem.getLightClusters().getDroppedIndices();
+		if (droppedIndices > 0) {
+			std::cout << "light clusters overflowed, " << droppedIndices << " light indices dropped" << std::endl;
+		}
+	}
+
 	if (mInputSystem.isKeyPressed(GLFW_KEY_L))
 		mLightOrbit = !mLightOrbit;
 
+	//cycle the main light: spot (an atlas tile) -> directional (cascaded shadow maps) -> point (a shadow cube)
+	if (mInputSystem.isKeyPressed(GLFW_KEY_K)) {
+		switch (mLights[0].lightType) {
+		case LightType::Spot:
+			mLights[0].lightType = LightType::Directional;
+			std::cout << "Light 0: directional" << std::endl;
+			break;
+		case LightType::Directional:
+			mLights[0].lightType = LightType::Point;
+			std::cout << "Light 0: point" << std::endl;
+			break;
+		default:
+			mLights[0].lightType = LightType::Spot;
+			std::cout << "Light 0: spot" << std::endl;
+			break;
+		}
+	}
+
+	//cycle the shadow map resolution
+	if (mInputSystem.isKeyPressed(GLFW_KEY_M)) {
+		ShadowSettings settings = mRenderSystem.getShadowSettings();
+		settings.resolution = (settings.resolution >= 4096) ? 1024 : settings.resolution * 2;
+		mRenderSystem.setShadowSettings(settings);
+		std::cout << "Shadow resolution: " << settings.resolution << std::endl;
+	}
+
+	//toggle shadow caching, to compare against re-rendering every shadow view each frame
+	if (mInputSystem.isKeyPressed(GLFW_KEY_P)) {
+		ShadowSettings settings = mRenderSystem.getShadowSettings();
+		settings.cacheShadows = !settings.cacheShadows;
+		mRenderSystem.setShadowSettings(settings);
+		std::cout << "Shadow caching: " << (settings.cacheShadows ? "on" : "off") << std::endl;
+	}
+
+	if (mInputSystem.isKeyPressed(GLFW_KEY_N)) {
+		mClusteredLightsEnabled = !mClusteredLightsEnabled;
+		std::cout << "Clustered lights: " << (mClusteredLightsEnabled ? "on" : "off") << std::endl;
+	}
+
+	//toggle the depth pre-pass, compare fragment invocations with F
+	if (mInputSystem.isKeyPressed(GLFW_KEY_Z)) {
+		mRenderSystem.setDepthPrePass(!mRenderSystem.isDepthPrePassEnabled());
+		std::cout << "Depth pre-pass: " << (mRenderSystem.isDepthPrePassEnabled() ? "on" : "off") << std::endl;
+	}
+
+	//toggle deferred shading
+	if (mInputSystem.isKeyPressed(GLFW_KEY_X)) {
+		mRenderSystem.setDeferredShading(!mRenderSystem.isDeferredShadingEnabled());
+		std::cout << "Deferred shading: " << (mRenderSystem.isDeferredShadingEnabled() ? "on" : "off") << std::endl;
+	}
+
+	//cycle occlusion culling modes: none -> GPU (Hi-Z) -> CPU (software) -> none
+	if (mInputSystem.isKeyPressed(GLFW_KEY_H)) {
+		switch (mRenderSystem.getOcclusionCullingMode()) {
+		case OcclusionCullingMode::None:
+			mRenderSystem.setOcclusionCullingMode(OcclusionCullingMode::HiZ);
+			std::cout << "Occlusion culling: Hi-Z" << std::endl;
+			break;
+		case OcclusionCullingMode::HiZ:
+			mRenderSystem.setOcclusionCullingMode(OcclusionCullingMode::Software);
+			std::cout << "Occlusion culling: software" << std::endl;
+			break;
+		default:
+			mRenderSystem.setOcclusionCullingMode(OcclusionCullingMode::None);
+			std::cout << "Occlusion culling: off" << std::endl;
+			break;
+		}
+	}
+
+	//drop a cube into the running scene
+	if (mInputSystem.isKeyPressed(GLFW_KEY_J))
+		dropCube();
+
 	cameraControls();
 	lightControls();
 }
@@ -160,48 +261,48 @@ void VkApp::lightControls()
 	
 	//in orbit mode, all of the lights orbit around the origin
 	if (mLightOrbit) {
-		mLightUBO.lights[0].position = glm::vec4(orbitRadius * glm::sin(orbitSpeed * mElapsedTime),
+		mLights[0].position = glm::vec4(orbitRadius * glm::sin(orbitSpeed * mElapsedTime),
 												orbitWobble * glm::sin(orbitSpeed * mElapsedTime) + 8.0f,
 												orbitRadius * glm::cos(orbitSpeed * mElapsedTime), 1.0f);
 
 		//point at the center
-		mLightUBO.lights[0].direction = -glm::normalize(mLightUBO.lights[0].position);
+		mLights[0].direction = -glm::normalize(mLights[0].position);
 
 		for (uint32_t lightIndex = 1; lightIndex < mTotalLights; lightIndex++) {
 			glm::quat rot = glm::angleAxis(glm::radians(360.0f / mTotalLights * lightIndex), glm::vec3(0.0f, 1.0f, 0.0f));
-			mLightUBO.lights[lightIndex].position = rot * mLightUBO.lights[0].position;
+			mLights[lightIndex].position = rot * mLights[0].position;
 		}
 	}
 	else {	//if we're not in orbit mode, we can manipulate individual lights
 		//move the selected light
 		
 		if (mInputSystem.isKeyDown(GLFW_KEY_UP)) {	//negative z is away from pov
-			mLightUBO.lights[mSelectedLight].position += glm::vec4(0.0f, 0.0f, transDist, 1.0f);
+			mLights[mSelectedLight].position += glm::vec4(0.0f, 0.0f, transDist, 1.0f);
 		}
 		if (mInputSystem.isKeyDown(GLFW_KEY_DOWN)) {
-			mLightUBO.lights[mSelectedLight].position -= glm::vec4(0.0f, 0.0f, transDist, 1.0f);
+			mLights[mSelectedLight].position -= glm::vec4(0.0f, 0.0f, transDist, 1.0f);
 		}
 		if (mInputSystem.isKeyDown(GLFW_KEY_LEFT)) {	//negative z is away from pov
-			mLightUBO.lights[mSelectedLight].position -= glm::vec4(transDist, 0.0f, 0.0f, 1.0f);
+			mLights[mSelectedLight].position -= glm::vec4(transDist, 0.0f, 0.0f, 1.0f);
 		}
 		if (mInputSystem.isKeyDown(GLFW_KEY_RIGHT)) {
-			mLightUBO.lights[mSelectedLight].position += glm::vec4(transDist, 0.0f, 0.0f, 1.0f);
+			mLights[mSelectedLight].position += glm::vec4(transDist, 0.0f, 0.0f, 1.0f);
 		}
 		if (mInputSystem.isKeyDown(GLFW_KEY_LEFT_BRACKET)) {	//negative z is away from pov
-			mLightUBO.lights[mSelectedLight].position -= glm::vec4(0.0f, transDist, 0.0f, 1.0f);
+			mLights[mSelectedLight].position -= glm::vec4(0.0f, transDist, 0.0f, 1.0f);
 		}
 		if (mInputSystem.isKeyDown(GLFW_KEY_RIGHT_BRACKET)) {
-			mLightUBO.lights[mSelectedLight].position += glm::vec4(0.0f, transDist, 0.0f, 1.0f);
+			mLights[mSelectedLight].position += glm::vec4(0.0f, transDist, 0.0f, 1.0f);
 		}
 
 		//turn the selected light on/off
 		if (mInputSystem.isKeyPressed(GLFW_KEY_O)) {
-			mLightUBO.lights[mSelectedLight].isEnabled = !mLightUBO.lights[mSelectedLight].isEnabled;
-			std::cout << "Light " << mSelectedLight << ": " << ((mLightUBO.lights[mSelectedLight].isEnabled) ? "on" : "off") << std::endl;
+			mLights[mSelectedLight].isEnabled = !mLights[mSelectedLight].isEnabled;
+			std::cout << "Light " << mSelectedLight << ": " << ((mLights[mSelectedLight].isEnabled) ? "on" : "off") << std::endl;
 		}
 
 		if (mInputSystem.isKeyPressed(GLFW_KEY_U)) {
-			std::cout << "light position: " << mLightUBO.lights[mSelectedLight].position << std::endl;
+			std::cout << "light position: " << mLights[mSelectedLight].position << std::endl;
 		}
 	}
 
@@ -221,21 +322,62 @@ void VkApp::setupCamera()
 void VkApp::setupLights()
 {
 	mRenderSystem.createUniformBuffer<LightUBO>(mLightUBOBuffer, 1);
+	mLights.resize(MAX_LIGHTS);
 	mTotalLights = 1;
 
 	//setup spotlight
-	mLightUBO.lights[0].isEnabled	= true;
-	mLightUBO.lights[0].lightType   = LightType::Spot;
-	mLightUBO.lights[0].ambient     = glm::vec4(0.2, 0.2, 0.2, 1.0);
-	mLightUBO.lights[0].diffuse     = glm::vec4(4.0f, 4.0f, 4.0f, 1.0f);		//red light
-	mLightUBO.lights[0].specular    = glm::vec4(4.0f, 4.0f, 4.0f, 1.0f);		
-	mLightUBO.lights[0].cutOff		= glm::cos(glm::radians(45.0f));			//12.5f
-	mLightUBO.lights[0].outerCutOff = glm::cos(glm::radians(50.0f));			//15.0f
-	mLightUBO.lights[0].constant = 0.25f;// 1.0f
-	mLightUBO.lights[0].linear = 0.0f;// 0.09f;
-	mLightUBO.lights[0].quadratic = 0.0f;// 0.032f;
-
-	mRenderSystem.createUniformBuffer<glm::mat4>(mShadowVPBuffer, 1);
+	mLights[0].isEnabled	= true;
+	mLights[0].lightType   = LightType::Spot;
+	mLights[0].ambient     = glm::vec4(0.2, 0.2, 0.2, 1.0);
+	mLights[0].diffuse     = glm::vec4(4.0f, 4.0f, 4.0f, 1.0f);		//red light
+	mLights[0].specular    = glm::vec4(4.0f, 4.0f, 4.0f, 1.0f);		
+	mLights[0].cutOff		= glm::cos(glm::radians(45.0f));			//12.5f
+	mLights[0].outerCutOff = glm::cos(glm::radians(50.0f));			//15.0f
+	mLights[0].constant = 0.25f;// 1.0f
+	mLights[0].linear = 0.0f;// 0.09f;
+	mLights[0].quadratic = 0.0f;// 0.032f;
+
+	//scatter dim colored point lights just above the ground, fixed seed so every run looks the same
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-cClusteredLightArea, cClusteredLightArea);
+	std::uniform_real_distribution<float> height(0.25f, 1.5f);
+	std::uniform_real_distribution<float> color(0.1f, 1.0f);
+
+	mClusteredLights.resize(cClusteredLightCount);
+	for (auto& light : mClusteredLights) {
+		glm::vec3 lightColor(color(random), color(random), color(random));
+		light.isEnabled = true;
+		light.lightType = LightType::Point;
+		light.position = glm::vec4(position(random), height(random), position(random), 1.0f);
+		light.ambient = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		light.diffuse = glm::vec4(lightColor * 0.5f, 1.0f);
+		light.specular = glm::vec4(lightColor * 0.5f, 1.0f);
+		light.constant = 1.0f;
+		light.linear = 0.7f;
+		light.quadratic = 4.0f;
+	}
+}
+
+LightingVariant VkApp::getSceneLighting(bool receivesShadow) const
+{
+	//light 0 can be switched between every type, the clustered lights are point lights
+	LightingVariant lighting;
+	lighting.lightTypeMask = lightTypeBit(LightType::Directional) | lightTypeBit(LightType::Point) | lightTypeBit(LightType::Spot);
+	lighting.shadowedLightCount = receivesShadow ? mTotalLights : 0;
+	lighting.directionalPCFTaps = cDirectionalPCFTaps;
+	lighting.spotPCFTaps = cSpotPCFTaps;
+	lighting.pointPCFTaps = cPointPCFTaps;
+	return lighting;
+}
+
+void VkApp::updateLights()
+{
+	//the shadow casting lights keep their indices, so ShadowLight::lightIndex and the indicators still refer to them
+	mFrameLights.assign(mLights.begin(), mLights.end());
+	if (mClusteredLightsEnabled) {
+		mFrameLights.insert(mFrameLights.end(), mClusteredLights.begin(), mClusteredLights.end());
+	}
+	mRenderSystem.setLights(mFrameLights);
 }
 
 void VkApp::createLightIndicator(uint32_t lightIndex)
@@ -244,27 +386,34 @@ void VkApp::createLightIndicator(uint32_t lightIndex)
 	std::shared_ptr<Mesh> lightMesh;
 	mRenderSystem.createMesh(lightMesh, LIGHT_MODEL_PATH, false);
 	
+	//the indicators only differ in their resources, so they share their shaders and pipeline
 	ShaderSet lightIndicatorShaderSet;
-	mRenderSystem.createShader(lightIndicatorShaderSet.vertShader, LIGHT_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT);
-	mRenderSystem.createShader(lightIndicatorShaderSet.fragShader, LIGHT_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT);
+	mRenderSystem.createShaderVariant(lightIndicatorShaderSet.vertShader, LIGHT_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT, {});
+	mRenderSystem.createShaderVariant(lightIndicatorShaderSet.fragShader, LIGHT_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, {});
 
 	mRenderSystem.createUniformBuffer<MVPMatrices>(mLightIndicatorMVPBuffer[lightIndex], 1);
-	mRenderSystem.createUniformBuffer<Light>(mLightIndicatorLightBuffer[lightIndex], 1);
+	mRenderSystem.createUniformBuffer<glm::uvec4>(mLightIndicatorIndexBuffer[lightIndex], 1);
+	mRenderSystem.fillUniformBuffer(*mLightIndicatorIndexBuffer[lightIndex], glm::uvec4(lightIndex, 0, 0, 0));
 
 
 	mRenderSystem.createRenderable(mLightIndicators[lightIndex]);
 
 	mLightIndicators[lightIndex]->applyShaderSet(lightIndicatorShaderSet);
-	mLightIndicators[lightIndex]->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0, 1);
-	mLightIndicators[lightIndex]->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 1);
-
 
 	mLightIndicators[lightIndex]->setMesh(lightMesh);
 	mLightIndicators[lightIndex]->bindUniformBuffer(mLightIndicatorMVPBuffer[lightIndex], 0);
-	mLightIndicators[lightIndex]->bindUniformBuffer(mLightIndicatorLightBuffer[lightIndex], 1);
+	mLightIndicators[lightIndex]->bindStorageBuffer(mRenderSystem.getLightBuffer(), 1);
+	mLightIndicators[lightIndex]->bindUniformBuffer(mLightIndicatorIndexBuffer[lightIndex], 2);
 
 	mLightIndicatorXForm[lightIndex].scale = glm::vec3(0.1f);
 
+	//the indicators are emissive and sit inside the light, so they neither block nor receive it
+	mLightIndicators[lightIndex]->setCastsShadow(false);
+	mLightIndicators[lightIndex]->setReceivesShadow(false);
+
+	//there can be many of them, so they push their bindings rather than each keeping a set per swapchain image
+	mLightIndicators[lightIndex]->setDynamicBindings(true);
+
 	std::cout << "Instantiating light #" << lightIndex << std::endl;
 	mRenderSystem.instantiateRenderable(mLightIndicators[lightIndex]);
 }
@@ -272,8 +421,7 @@ void VkApp::createLightIndicator(uint32_t lightIndex)
 void VkApp::createCube()
 {
 	//start by creating the component resources
-	std::shared_ptr<Mesh> cubeMesh;
-	mRenderSystem.createMesh(cubeMesh, BOX_MODEL_PATH, true);
+	mRenderSystem.createMesh(mCubeMesh, BOX_MODEL_PATH, true);
 
 	std::shared_ptr<Texture> boxDiffuseMap;
 	mRenderSystem.createTexture(boxDiffuseMap, BOX_DIFFUSE_PATH);
@@ -284,37 +432,96 @@ void VkApp::createCube()
 	std::shared_ptr<Texture> boxSpecularMap;
 	mRenderSystem.createTexture(boxSpecularMap, BOX_SPECULAR_PATH);
 
+	//the box shaders don't sample the shadow map
+	SpecializationConstants boxLighting = getSceneLighting(false).getSpecializationConstants();
+
 	ShaderSet boxShaderSet;
 	mRenderSystem.createShader(boxShaderSet.vertShader, BOX_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT);
-	mRenderSystem.createShader(boxShaderSet.fragShader, BOX_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT);
+	mRenderSystem.createShaderVariant(boxShaderSet.fragShader, BOX_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, boxLighting);
+
+	std::shared_ptr<Shader> boxGBufferShader;
+	mRenderSystem.createShaderVariant(boxGBufferShader, BOX_GBUFFER_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, boxLighting);
 	
 	mRenderSystem.createUniformBuffer<MVPMatrices>(mCubeMVPBuffer, 1);
 
 	//create a renderable and make the appropriate attachments
 	mRenderSystem.createRenderable(mCube);
 
-	//setup the shaders and note the bindings they will use
+	//setup the shaders, the bindings they use are read from their SPIR-V
 	mCube->applyShaderSet(boxShaderSet);	
-	mCube->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0, 1);				//MVP
-	mCube->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 1);				//lights
-	mCube->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2, 1);		//diffuse map
-	mCube->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3, 1);		//normal map
-	mCube->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4, 1);		//specular map
+	mCube->setGBufferShader(boxGBufferShader);
 
 	//set the mesh we will use
-	mCube->setMesh(cubeMesh);
+	mCube->setMesh(mCubeMesh);
+
+	//the cube fills its bounds, so its box is an exact occluder
+	mCube->setOccluder(OccluderMesh::fromBox(mCubeMesh->getBounds().box));
+
+	//the box shaders don't sample the shadow map
+	mCube->setReceivesShadow(false);
+
+	//the textures are read through the material library
+	mCubeMaterial = mRenderSystem.createMaterial({ boxDiffuseMap, boxNormalMap, boxSpecularMap });
+	mCube->setMaterial(mCubeMaterial);
 
 	//bind resources
-	mCube->bindUniformBuffer(mCubeMVPBuffer, 0);
-	mCube->bindUniformBuffer(mLightUBOBuffer, 1);
-	mCube->bindTexture(boxDiffuseMap, 2);
-	mCube->bindTexture(boxNormalMap, 3);
-	mCube->bindTexture(boxSpecularMap, 4);
+	mCube->bindUniformBuffer(mCubeMVPBuffer, 0);						//MVP
+	mCube->bindUniformBuffer(mLightUBOBuffer, 1);						//lights
+	mCube->bindUniformBuffer(mRenderSystem.getClusterUBO(), 2);			//cluster grid
+	mCube->bindStorageBuffer(mRenderSystem.getLightBuffer(), 3);		//every light
+	mCube->bindStorageBuffer(mRenderSystem.getClusterLightBuffer(), 4);	//cluster light lists
 
 	//finally, instantiate
 	mRenderSystem.instantiateRenderable(mCube);
 }
 
+void VkApp::dropCube()
+{
+	uint32_t cubeIndex = static_cast<uint32_t>(mDroppedCubes.size());
+
+	//same box shaders as the first cube, with a different finish
+	LightingVariant lighting = getSceneLighting(false);
+	lighting.shininess = cDroppedCubeShininess[cubeIndex % cDroppedCubeShininess.size()];
+
+	//variants are cached, so a finish dropped before reuses its shaders and its pipeline
+	ShaderSet boxShaderSet;
+	mRenderSystem.createShaderVariant(boxShaderSet.vertShader, BOX_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT, {});
+	mRenderSystem.createShaderVariant(boxShaderSet.fragShader, BOX_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, lighting.getSpecializationConstants());
+
+	std::shared_ptr<UBO> mvpBuffer;
+	mRenderSystem.createUniformBuffer<MVPMatrices>(mvpBuffer, 1);
+
+	std::shared_ptr<Renderable> cube;
+	mRenderSystem.createRenderable(cube);
+	std::shared_ptr<Shader> boxGBufferShader;
+	mRenderSystem.createShaderVariant(boxGBufferShader, BOX_GBUFFER_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, lighting.getSpecializationConstants());
+
+	cube->applyShaderSet(boxShaderSet);
+	cube->setGBufferShader(boxGBufferShader);
+	cube->setMesh(mCubeMesh);
+	cube->setOccluder(OccluderMesh::fromBox(mCubeMesh->getBounds().box));
+	cube->setReceivesShadow(false);
+	cube->setMaterial(mCubeMaterial);
+
+	cube->bindUniformBuffer(mvpBuffer, 0);								//MVP
+	cube->bindUniformBuffer(mLightUBOBuffer, 1);						//lights
+	cube->bindUniformBuffer(mRenderSystem.getClusterUBO(), 2);			//cluster grid
+	cube->bindStorageBuffer(mRenderSystem.getLightBuffer(), 3);			//every light
+	cube->bindStorageBuffer(mRenderSystem.getClusterLightBuffer(), 4);	//cluster light lists
+
+	//rest it on the ground in front of the camera
+	Transform xform;
+	xform.position = mCamera->position + mCamera->forward * cDroppedCubeDistance;
+	xform.position.y = 0.5f;
+
+	std::cout << "Dropping cube #" << cubeIndex << " (shininess " << lighting.shininess << ")" << std::endl;
+	mRenderSystem.instantiateRenderable(cube);
+
+	mDroppedCubes.push_back(cube);
+	mDroppedCubeMVPBuffers.push_back(mvpBuffer);
+	mDroppedCubeXForms.push_back(xform);
+}
+
 void VkApp::createGround()
 {
 	//start by creating the component resources
@@ -332,40 +539,41 @@ void VkApp::createGround()
 
 	
 
+	SpecializationConstants groundLighting = getSceneLighting(true).getSpecializationConstants();
+
 	ShaderSet groundShaderSet;
 	mRenderSystem.createShader(groundShaderSet.vertShader, GROUND_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT);
-	mRenderSystem.createShader(groundShaderSet.fragShader, GROUND_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT);
+	mRenderSystem.createShaderVariant(groundShaderSet.fragShader, GROUND_FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, groundLighting);
+
+	std::shared_ptr<Shader> groundGBufferShader;
+	mRenderSystem.createShaderVariant(groundGBufferShader, GROUND_GBUFFER_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, groundLighting);
 
 	mRenderSystem.createUniformBuffer<MVPMatrices>(mGroundMVPBuffer, 1);
 
 	//create a renderable and make the appropriate attachments
 	mRenderSystem.createRenderable(mGround);
 
-	//setup the shaders and note the bindings they will use
-	//Current restriction: one resource per binding (no arrays right now) 
+	//setup the shaders, the bindings they use are read from their SPIR-V
 	mGround->applyShaderSet(groundShaderSet);
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0, 1);				//MVP
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1, 1);				//shadow VP matrix
+	mGround->setGBufferShader(groundGBufferShader);
 
+	mGround->setMesh(groundMesh);
+	mGround->setOccluder(OccluderMesh::fromMesh(*groundMesh));
 
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2, 1);				//lights
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3, 1);		//shadow map
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4, 1);		//diffuse map
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 5, 1);		//normal map
-	mGround->addShaderBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 6, 1);		//specular map
+	//nothing sits below the ground for it to shadow
+	mGround->setCastsShadow(false);
 
-	mGround->setMesh(groundMesh);
+	mGround->setMaterial(mRenderSystem.createMaterial({ groundDiffuseMap, groundNormalMap, groundSpecularMap }));
 
 	//bind resources
-	mGround->bindUniformBuffer(mGroundMVPBuffer, 0);
-	mGround->bindUniformBuffer(mShadowVPBuffer, 1);
-	
-
-	mGround->bindUniformBuffer(mLightUBOBuffer, 2);
-	mGround->bindShadowMap(mRenderSystem.getShadowMap(), 3);
-	mGround->bindTexture(groundDiffuseMap, 4);
-	mGround->bindTexture(groundNormalMap, 5);
-	mGround->bindTexture(groundSpecularMap, 6);
+	mGround->bindUniformBuffer(mGroundMVPBuffer, 0);									//MVP
+	mGround->bindUniformBuffer(mRenderSystem.getShadowUBO(), 1);						//shadow matrices (cascades)
+	mGround->bindUniformBuffer(mLightUBOBuffer, 2);										//lights
+	mGround->bindShadowMap(mRenderSystem.getShadowMap(), 3);							//shadow map
+	mGround->bindShadowMap(mRenderSystem.getShadowMap(), 4, ShadowMapView::PointCubes);	//point shadow cubes
+	mGround->bindUniformBuffer(mRenderSystem.getClusterUBO(), 5);						//cluster grid
+	mGround->bindStorageBuffer(mRenderSystem.getLightBuffer(), 6);						//every light
+	mGround->bindStorageBuffer(mRenderSystem.getClusterLightBuffer(), 7);				//cluster light lists
 
 	//instantiate (flush bindings, create pipeline)
 	std::cout << "Instantianting a wall" << std::endl;
@@ -385,23 +593,44 @@ void VkApp::updateMVPBuffer(const UBO& mvpBuffer,
 	mRenderSystem.updateUniformBuffer<MVPMatrices>(mvpBuffer, mvp, 0);
 }
 
-void VkApp::updateShadowMVP(const Light & light)
+void VkApp::updateShadowLights()
 {
-	glm::mat4 model = mCubeXForm.getModelMatrix();
-	glm::mat4 view = glm::lookAt(glm::vec3(light.position), glm::vec3(light.position + light.direction), glm::vec3(0.0, 1.0, 0.0));
-
 	//To correct clip space (vulkan has inverted y, 1/2 z)
 	const glm::mat4 clipFix(1.0f, 0.0f, 0.0f, 0.0f,
 						0.0f, -1.0f, 0.0f, 0.0f,
 						0.0f, 0.0f, 0.5f, 0.0f,
 						0.0f, 0.0f, 0.5f, 1.0f);
 
-	glm::mat4 projection = clipFix * glm::perspective(glm::radians(45.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-	glm::mat4 mvp = projection * view * model;
-
-	mRenderSystem.setLightMVPBuffer(mvp);
+	std::vector<ShadowLight> shadowLights;
+	for (uint32_t lightIndex = 0; lightIndex < mTotalLights; lightIndex++) {
+		const Light& light = mLights[lightIndex];
+		if (!light.isEnabled)
+			continue;
+
+		ShadowLight shadowLight;
+		shadowLight.lightIndex = lightIndex;
+		shadowLight.lightType = light.lightType;
+		shadowLight.position = glm::vec3(light.position);
+		shadowLight.direction = glm::vec3(light.direction);
+		shadowLight.range = cShadowLightRange;
+		shadowLight.filterRadius = cShadowFilterRadius;
+
+		//directional shadows are cascaded, which depends on the camera, so the RenderSystem fits them
+		if (light.lightType == LightType::Spot) {
+			glm::vec3 up = (std::abs(shadowLight.direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::mat4 view = glm::lookAt(shadowLight.position, shadowLight.position + shadowLight.direction, up);
+
+			//atlas tiles are square, and the projection only has to cover the spot's outer cone
+			float fov = 2.0f * glm::acos(light.outerCutOff);
+			glm::mat4 projection = clipFix * glm::perspective(fov, 1.0f, 0.1f, cShadowLightRange);
+			shadowLight.viewProj = projection * view;
+		}
+		else if (light.lightType == LightType::None) {
+			continue;
+		}
 
+		shadowLights.push_back(shadowLight);
+	}
 
-	mShadowVP = projection * view;
-	mRenderSystem.updateUniformBuffer(*mShadowVPBuffer, mShadowVP, 0);
+	mRenderSystem.setShadowLights(shadowLights);
 }
@@ -32,6 +32,7 @@ const std::string BOX_SPECULAR_PATH		= "Resources/Textures/UrbanTexturePack/Bric
 const std::string BOX_MODEL_PATH		= "Resources/Meshes/cube.mesh";
 const std::string BOX_VERT_SHADER_PATH  = "Resources/Shaders/multipleLights_vert.spv";
 const std::string BOX_FRAG_SHADER_PATH  = "Resources/Shaders/multipleLights_frag.spv";
+const std::string BOX_GBUFFER_SHADER_PATH = "Resources/Shaders/deferredGeometry_frag.spv";
 
 //ground
 const std::string GROUND_DIFFUSE_PATH		= "Resources/Textures/UrbanTexturePack/Ground_Dirt/Ground_Dirt_1k_d.tga";
@@ -40,6 +41,7 @@ const std::string GROUND_SPECULAR_PATH		= "Resources/Textures/UrbanTexturePack/G
 const std::string GROUND_MESH_PATH			= "Resources/Meshes/ground.mesh";
 const std::string GROUND_VERT_SHADER_PATH	= "Resources/Shaders/shadowReceive_vert.spv";
 const std::string GROUND_FRAG_SHADER_PATH	= "Resources/Shaders/shadowReceive_frag.spv";
+const std::string GROUND_GBUFFER_SHADER_PATH = "Resources/Shaders/deferredGeometryShadowReceive_frag.spv";
 
 //light indicator
 const std::string LIGHT_MODEL_PATH		 = "Resources/Meshes/cube.mesh";
@@ -50,6 +52,27 @@ const std::string LIGHT_FRAG_SHADER_PATH = "Resources/Shaders/lightObj_frag.spv"
 const float cCamTranslateSpeed = 20.0f;
 const float cCamRotateSpeed = 100.0f;
 const float cLightTranslateSpeed = 5.0f;
+const float cShadowLightRange = 30.0f;
+
+//shadow filtering
+const uint32_t cDirectionalPCFTaps = 16;		///< Poisson taps for cascaded shadows (see LightingVariant)
+const uint32_t cSpotPCFTaps = 8;				///< Poisson taps for atlas shadows
+const uint32_t cPointPCFTaps = 8;				///< Poisson taps for cube shadows
+const float cShadowFilterRadius = 1.5f;			///< PCF kernel radius in shadow map texels
+
+//the lit shaders are expensive and the boxes overlap, so depth is laid down first
+const bool cDepthPrePass = true;
+
+//light every pixel once from a G-buffer (the depth pre-pass is skipped while this is on)
+const bool cDeferredShading = false;
+
+//small unshadowed point lights scattered over the ground, shaded through the light clusters
+const uint32_t cClusteredLightCount = 1024;		///< Number of extra lights
+const float cClusteredLightArea = 25.0f;		///< Half the width of the square they are scattered over
+
+//cubes dropped in front of the camera with J, each finish gets its own shader variant
+const std::vector<float> cDroppedCubeShininess = { 64.0f, 128.0f, 4.0f };	///< Specular exponents the dropped cubes cycle through
+const float cDroppedCubeDistance = 8.0f;									///< How far in front of the camera they are dropped
 
 /** @class Transform
 	
@@ -139,32 +162,39 @@ private:
 	std::unique_ptr<Camera> mCamera;								///< A camera object used to view the scene
 	
 	//Lights UBO
-	std::shared_ptr<UBO> mLightUBOBuffer;							///< A UBO for sending light information to shaders
-	LightUBO mLightUBO;												///< Light source information
+	std::shared_ptr<UBO> mLightUBOBuffer;							///< A UBO for sending the view position to the lit shaders
+	LightUBO mLightUBO;												///< The view position the lights are shaded from
 
 	//Cube renderable
 	std::shared_ptr<Renderable> mCube;								///< A Cube Renderable in the center of the scene
 	std::shared_ptr<UBO> mCubeMVPBuffer;							///< A UBO for sending the Cube's MVP matrices to the shaders
 	Transform mCubeXForm;											///< The Cube's transform
+	std::shared_ptr<Mesh> mCubeMesh;								///< The cube mesh, shared with the dropped cubes
+	uint32_t mCubeMaterial = 0;										///< The cube's material, shared with the dropped cubes
+
+	//Cubes dropped in after the scene is up
+	std::vector<std::shared_ptr<Renderable>> mDroppedCubes;			///< Cubes added with the J key while the scene is running
+	std::vector<std::shared_ptr<UBO>> mDroppedCubeMVPBuffers;		///< MVP matrices for each dropped cube
+	std::vector<Transform> mDroppedCubeXForms;						///< Transforms for each dropped cube
 
 	//Ground Renderable
 	std::shared_ptr<Renderable> mGround;							///< A Ground Renderable to project shadows on
 	std::shared_ptr<UBO> mGroundMVPBuffer;							///< A UBO for sending the ground's MVP matrices to the shaders
 	Transform mGroundXForm;											///< The ground's transform
 
-	//Shadow Info
-	std::shared_ptr<UBO> mShadowVPBuffer;							///< A UBO for holding sending information about the shadow projection to make a shadow map
-	glm::mat4 mShadowVP;											///< A View+Projection matrix for projecting shadows
-
 	//Lights
 	std::shared_ptr<Renderable> mLightIndicators[MAX_LIGHTS];		///< A Set of renderables indicating where light sources are
 	std::shared_ptr<UBO> mLightIndicatorMVPBuffer[MAX_LIGHTS];		///< MVP matrices for each of the light indicator renderables
+	std::shared_ptr<UBO> mLightIndicatorIndexBuffer[MAX_LIGHTS];	///< The index of the light each indicator shows (x of a uvec4), written once
 	Transform mLightIndicatorXForm[MAX_LIGHTS];						///< Transforms for each light indicator
-	std::shared_ptr<UBO> mLightIndicatorLightBuffer[MAX_LIGHTS];	///< UBOs for each of the Light indicator MVP matrices
 
 	bool mLightOrbit = true;										///< If the light source is in orbit mode
 	uint32_t mSelectedLight = 0;									///< The index of the selected light
 	uint32_t mTotalLights = 0;										///< The total number of lights used in the scene
+	std::vector<Light> mLights;										///< The MAX_LIGHTS lights that can cast shadows and have indicators
+	std::vector<Light> mClusteredLights;							///< Extra lights after mLights (no indicators or shadows)
+	bool mClusteredLightsEnabled = true;							///< Are the extra lights shaded
+	std::vector<Light> mFrameLights;								///< Every light passed to the RenderSystem this frame
 public:
 	/** @brief Main Application Constructor	*/
 	VkApp();
@@ -233,6 +263,14 @@ private:
 	/** @brief Create a ground plane to cast shadows on */
 	void createGround();
 
+	/** @brief Drop a cube in front of the camera while the scene is running
+
+		Each finish is a new shader variant, so its pipeline is compiled while
+		the scene is on screen: the cube appears with an unoptimized pipeline,
+		and the optimized one is swapped in once ready.
+	*/
+	void dropCube();
+
 	//--------------------------
 	// Buffer Updating
 	//--------------------------
@@ -246,8 +284,19 @@ private:
 						const Transform& renderableXform, 
 						const Camera& cam);
 
-	/** @brief updates the MVP buffer for a light source and sets the VP buffer for the shadow it casts 
-		@param light The light casting a shadow
+	/** @brief Tell the RenderSystem which lights cast shadows this frame
+
+		Every enabled spot light gets a perspective view-projection covering its
+		outer cone, directional lights only pass their direction (the RenderSystem
+		fits cascades to the camera), point lights only pass their position and range.
 	*/
-	void updateShadowMVP(const Light& light);
+	void updateShadowLights();
+
+	/** @brief Describe the lights the scene's materials are shaded with, to specialize their shaders
+		@param receivesShadow Whether the material samples the shadow map
+	*/
+	LightingVariant getSceneLighting(bool receivesShadow) const;
+
+	/** @brief Pass the shadow casting lights, followed by the extra clustered lights, to the RenderSystem */
+	void updateLights();
 };
@@ -1,5 +1,8 @@
 #include "VulkanContext.h"
 
+#include <fstream>
+#include <cstring>
+
 VulkanContext::VulkanContext() : 
 	window(nullptr),
 	mCallback(nullptr),
@@ -7,7 +10,14 @@ VulkanContext::VulkanContext() :
 	device(VK_NULL_HANDLE),
 	graphicsQueue(VK_NULL_HANDLE),
 	presentQueue(VK_NULL_HANDLE),
-	surface(VK_NULL_HANDLE)
+	surface(VK_NULL_HANDLE),
+	pipelineCache(VK_NULL_HANDLE),
+	pushDescriptorsSupported(false),
+	maxPushDescriptors(0),
+	createDescriptorUpdateTemplate(nullptr),
+	destroyDescriptorUpdateTemplate(nullptr),
+	updateDescriptorSetWithTemplate(nullptr),
+	cmdPushDescriptorSetWithTemplate(nullptr)
 {}
 
 void VulkanContext::initialize(GLFWwindow *window, const std::string& appName)
@@ -22,12 +32,16 @@ void VulkanContext::initialize(GLFWwindow *window, const std::string& appName)
 	this->window = window;
 	createSurface(mInstance, window);
 	createDevice(mInstance);
+	createPipelineCache();
 }
 
 void VulkanContext::cleanup()
 {
 	std::cout << "Destroying Vulkan Context" << std::endl;
 
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
 	vkDestroyDevice(device, nullptr);
 	vkDestroySurfaceKHR(mInstance, surface, nullptr);
 
@@ -138,17 +152,49 @@ void VulkanContext::createDevice(VkInstance instance)
 	deviceFeatures.tessellationShader = VK_TRUE;	//Project 9 - Tesselation
 	deviceFeatures.fillModeNonSolid = VK_TRUE;
 	deviceFeatures.geometryShader = VK_TRUE;		//Project 10 - Geometry Shader
+	deviceFeatures.imageCubeArray = VK_TRUE;		//Project 12 - point light shadows
+	deviceFeatures.pipelineStatisticsQuery = VK_TRUE;	//Project 12 - depth pre-pass statistics
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;	//Project 12 - bindless materials
+
+	//the material textures are one partially filled array, written while frames using it are in flight
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedIndexing = getDescriptorIndexingFeatures(instance);
+	if (!supportedIndexing.runtimeDescriptorArray || 
+		!supportedIndexing.descriptorBindingPartiallyBound || 
+		!supportedIndexing.descriptorBindingSampledImageUpdateAfterBind) {
+		throw std::runtime_error("The device doesn't support the descriptor indexing features bindless materials need!");
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
 
 	//main createInfo struct
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext = &indexingFeatures;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
 	//extensions we want this device to use
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	std::vector<const char*> extensions = deviceExtensions;
+	for (const char* extension : optionalDeviceExtensions) {
+		if (isDeviceExtensionSupported(extension)) {
+			extensions.push_back(extension);
+		}
+		else {
+			std::cout << extension << " is not supported" << std::endl;
+		}
+	}
+	pushDescriptorsSupported = isDeviceExtensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	if (pushDescriptorsSupported) {
+		maxPushDescriptors = getMaxPushDescriptors(instance);
+	}
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
 	//create the device
 	if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device) != VK_SUCCESS) {
@@ -158,6 +204,78 @@ void VulkanContext::createDevice(VkInstance instance)
 	//get the queue handles
 	vkGetDeviceQueue(device, selectedIndices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, selectedIndices.presentFamily, 0, &presentQueue);
+
+	loadDeviceFunctions();
+}
+
+VkPhysicalDeviceDescriptorIndexingFeaturesEXT VulkanContext::getDescriptorIndexingFeatures(VkInstance instance)
+{
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	//Vulkan 1.0 only has the extension's version of vkGetPhysicalDeviceFeatures2
+	auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	if (getFeatures2 == nullptr) {
+		throw std::runtime_error("Failed to get vkGetPhysicalDeviceFeatures2KHR!");
+	}
+
+	VkPhysicalDeviceFeatures2KHR features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &indexingFeatures;
+	getFeatures2(physicalDevice, &features);
+
+	indexingFeatures.pNext = nullptr;
+	return indexingFeatures;
+}
+
+bool VulkanContext::isDeviceExtensionSupported(const char* extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0)
+			return true;
+	}
+	return false;
+}
+
+uint32_t VulkanContext::getMaxPushDescriptors(VkInstance instance)
+{
+	auto getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+	if (getProperties2 == nullptr) {
+		throw std::runtime_error("Failed to get vkGetPhysicalDeviceProperties2KHR!");
+	}
+
+	VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties = {};
+	pushDescriptorProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+
+	VkPhysicalDeviceProperties2KHR properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+	properties.pNext = &pushDescriptorProperties;
+	getProperties2(physicalDevice, &properties);
+
+	return pushDescriptorProperties.maxPushDescriptors;
+}
+
+void VulkanContext::loadDeviceFunctions()
+{
+	createDescriptorUpdateTemplate = (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR");
+	destroyDescriptorUpdateTemplate = (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR");
+	updateDescriptorSetWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR");
+	if (createDescriptorUpdateTemplate == nullptr || destroyDescriptorUpdateTemplate == nullptr || updateDescriptorSetWithTemplate == nullptr) {
+		throw std::runtime_error("Failed to get the descriptor update template functions!");
+	}
+
+	if (pushDescriptorsSupported) {
+		cmdPushDescriptorSetWithTemplate = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+		if (cmdPushDescriptorSetWithTemplate == nullptr) {
+			throw std::runtime_error("Failed to get vkCmdPushDescriptorSetWithTemplateKHR!");
+		}
+	}
 }
 
 void VulkanContext::createSurface(VkInstance instance, GLFWwindow* window)
@@ -186,6 +304,9 @@ std::vector<const char*> VulkanContext::getRequiredExtensions()
 
 	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
+	//needed to query the descriptor indexing features
+	extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 	}
@@ -208,3 +329,72 @@ void VulkanContext::setupDebugCallback()
 		throw std::runtime_error("failed to set up debug callback!");
 	}
 }
+
+void VulkanContext::createPipelineCache()
+{
+	std::vector<char> data;
+	std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		file.close();
+
+		if (!isPipelineCacheCompatible(data)) {
+			std::cout << "Ignoring pipeline cache \"" << PIPELINE_CACHE_PATH << "\", it was made by another device or driver" << std::endl;
+			data.clear();
+		}
+		else {
+			std::cout << "Loaded " << data.size() << " bytes of pipeline cache" << std::endl;
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline cache!");
+	}
+}
+
+void VulkanContext::savePipelineCache()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+		return;
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+		return;
+
+	//losing the cache only costs startup time, so a failed write isn't an error
+	std::ofstream file(PIPELINE_CACHE_PATH, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "Failed to save pipeline cache \"" << PIPELINE_CACHE_PATH << "\"" << std::endl;
+		return;
+	}
+	file.write(data.data(), dataSize);
+	std::cout << "Saved " << dataSize << " bytes of pipeline cache" << std::endl;
+}
+
+bool VulkanContext::isPipelineCacheCompatible(const std::vector<char>& data)
+{
+	//headerSize, headerVersion, vendorID, deviceID, then the pipelineCacheUUID
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (data.size() < headerSize)
+		return false;
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	return header[0] >= headerSize &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == properties.vendorID &&
+		header[3] == properties.deviceID &&
+		memcmp(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
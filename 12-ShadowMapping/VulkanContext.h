@@ -5,11 +5,14 @@
 #include <stdexcept>
 #include <iostream>
 #include <vector>
+#include <string>
 
 #include "Validation.h"
 #include "Extensions.h"
 #include "QueueFamilies.h"
 
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";	///< Where the pipeline cache is kept between runs
+
 /**
 	@class VulkanContext
 
@@ -35,6 +38,15 @@ public:
 	VkQueue graphicsQueue;				///< Queue used for drawing
 	VkQueue presentQueue;				///< Queue used for presentation
 	VkSurfaceKHR surface;				///< Surface to be drawn to
+	VkPipelineCache pipelineCache;		///< Shared by every pipeline creation, loaded from and saved to PIPELINE_CACHE_PATH
+
+	bool pushDescriptorsSupported;		///< Whether VK_KHR_push_descriptor is enabled
+	uint32_t maxPushDescriptors;		///< The most descriptors a push descriptor set layout may hold (0 without push descriptors)
+
+	PFN_vkCreateDescriptorUpdateTemplateKHR createDescriptorUpdateTemplate;		///< VK_KHR_descriptor_update_template, Vulkan 1.0 has no core entry point
+	PFN_vkDestroyDescriptorUpdateTemplateKHR destroyDescriptorUpdateTemplate;	///< VK_KHR_descriptor_update_template
+	PFN_vkUpdateDescriptorSetWithTemplateKHR updateDescriptorSetWithTemplate;	///< VK_KHR_descriptor_update_template
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate;	///< VK_KHR_push_descriptor (null if it isn't supported)
 
 	VulkanContext();
 
@@ -44,7 +56,7 @@ public:
 	*/
 	void initialize(GLFWwindow *window, const std::string& appName);
 
-	/** @brief Cleans up all allocated resources 
+	/** @brief Cleans up all allocated resources, saving the pipeline cache first
 	*/
 	void cleanup();
 
@@ -69,6 +81,24 @@ private:
 	*/
 	void createDevice(VkInstance instance);
 	
+	/** @brief Query which descriptor indexing features the selected physical device supports
+		@param instance The Vulkan Instance
+	*/
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT getDescriptorIndexingFeatures(VkInstance instance);
+
+	/** @brief Check whether the selected physical device supports a device extension
+		@param extensionName The name of the extension
+	*/
+	bool isDeviceExtensionSupported(const char* extensionName);
+
+	/** @brief Query the most descriptors the selected physical device can push into one set
+		@param instance The Vulkan Instance
+	*/
+	uint32_t getMaxPushDescriptors(VkInstance instance);
+
+	/** @brief Get the entry points of the device extensions that aren't exported by the loader */
+	void loadDeviceFunctions();
+	
 	/** @brief Creates the VkSurfaceKHR Object
 		@param instance The Vulkan Instance
 
@@ -87,4 +117,21 @@ private:
 	
 	/** @brief Sets up a callback for Validation Layers */
 	void setupDebugCallback();
+
+	/** @brief Creates the VkPipelineCache, seeded from PIPELINE_CACHE_PATH if the file was saved by this device and driver
+	*/
+	void createPipelineCache();
+
+	/** @brief Writes the pipeline cache's data to PIPELINE_CACHE_PATH
+	*/
+	void savePipelineCache();
+
+	/** @brief Checks that saved pipeline cache data was made by the selected device and driver
+
+		Drivers are required to reject foreign data themselves, but some don't, so the
+		header (VkPipelineCacheHeaderVersionOne) is checked before handing it over.
+
+		@param data The saved cache data
+	*/
+	bool isPipelineCacheCompatible(const std::vector<char>& data);
 };
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "VulkanObjectCache.h"
+#include "PipelineRegistry.h"
+
+VulkanObjectCache::VulkanObjectCache(std::shared_ptr<VulkanContext> context) :
+	mContext(context)
+{}
+
+SharedSampler VulkanObjectCache::getSampler(const VkSamplerCreateInfo& samplerInfo)
+{
+	//every field is written out one by one, so struct padding never ends up in the key
+	std::string key;
+	appendBytes(key, samplerInfo.flags);
+	appendBytes(key, samplerInfo.magFilter);
+	appendBytes(key, samplerInfo.minFilter);
+	appendBytes(key, samplerInfo.mipmapMode);
+	appendBytes(key, samplerInfo.addressModeU);
+	appendBytes(key, samplerInfo.addressModeV);
+	appendBytes(key, samplerInfo.addressModeW);
+	appendBytes(key, samplerInfo.mipLodBias);
+	appendBytes(key, samplerInfo.anisotropyEnable);
+	appendBytes(key, samplerInfo.maxAnisotropy);
+	appendBytes(key, samplerInfo.compareEnable);
+	appendBytes(key, samplerInfo.compareOp);
+	appendBytes(key, samplerInfo.minLod);
+	appendBytes(key, samplerInfo.maxLod);
+	appendBytes(key, samplerInfo.borderColor);
+	appendBytes(key, samplerInfo.unnormalizedCoordinates);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	SharedSampler sampler = find(mSamplers, key);
+	if (sampler)
+		return sampler;
+
+	VkSampler handle;
+	if (vkCreateSampler(mContext->device, &samplerInfo, nullptr, &handle) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create sampler!");
+	}
+
+	sampler = share(handle, vkDestroySampler);
+	add(mSamplers, key, sampler);
+	return sampler;
+}
+
+SharedDescriptorSetLayout VulkanObjectCache::getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags)
+{
+	std::string key = PipelineRegistry::makeLayoutKey(layoutBindings, layoutFlags);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	SharedDescriptorSetLayout setLayout = find(mSetLayouts, key);
+	if (setLayout)
+		return setLayout;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.flags = layoutFlags;
+	layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutInfo.pBindings = layoutBindings.data();
+
+	VkDescriptorSetLayout handle;
+	if (vkCreateDescriptorSetLayout(mContext->device, &layoutInfo, nullptr, &handle) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor set layout!");
+	}
+
+	setLayout = share(handle, vkDestroyDescriptorSetLayout);
+	add(mSetLayouts, key, setLayout);
+	return setLayout;
+}
+
+SharedDescriptorSetLayout VulkanObjectCache::adoptDescriptorSetLayout(VkDescriptorSetLayout setLayout)
+{
+	return share(setLayout, vkDestroyDescriptorSetLayout);
+}
+
+SharedPipelineLayout VulkanObjectCache::getPipelineLayout(const std::vector<SharedDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+	//the handles are only unique while they are alive, which the layout made with them sees to
+	std::vector<VkDescriptorSetLayout> setLayoutHandles;
+	std::string key;
+	appendBytes(key, setLayouts.size());
+	for (const auto& setLayout : setLayouts) {
+		setLayoutHandles.push_back(*setLayout);
+		appendBytes(key, *setLayout);
+	}
+	appendBytes(key, pushConstantRanges.size());
+	for (const auto& range : pushConstantRanges) {
+		appendBytes(key, range.stageFlags);
+		appendBytes(key, range.offset);
+		appendBytes(key, range.size);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	SharedPipelineLayout pipelineLayout = find(mPipelineLayouts, key);
+	if (pipelineLayout)
+		return pipelineLayout;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayoutHandles.size());
+	pipelineLayoutInfo.pSetLayouts = setLayoutHandles.data();
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.empty() ? nullptr : pushConstantRanges.data();
+
+	VkPipelineLayout handle;
+	if (vkCreatePipelineLayout(mContext->device, &pipelineLayoutInfo, nullptr, &handle) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline layout!");
+	}
+
+	pipelineLayout = share(handle, vkDestroyPipelineLayout, setLayouts);
+	add(mPipelineLayouts, key, pipelineLayout);
+	return pipelineLayout;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+//vulkan
+#include <vulkan/vulkan.h>
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+//uwb-vk
+#include "VulkanContext.h"
+
+using SharedSampler = std::shared_ptr<const VkSampler>;							///< A sampler from the VulkanObjectCache, destroyed with the last reference
+using SharedDescriptorSetLayout = std::shared_ptr<const VkDescriptorSetLayout>;	///< A set layout from the VulkanObjectCache, destroyed with the last reference
+using SharedPipelineLayout = std::shared_ptr<const VkPipelineLayout>;			///< A pipeline layout from the VulkanObjectCache, destroyed with the last reference
+
+/** @class VulkanObjectCache
+
+	@brief Hands out one shared handle per distinct sampler, descriptor set layout and pipeline layout
+
+	Like the PipelineRegistry, each object's description is flattened into a key,
+	and an object already created with the same key is handed out again. Handles
+	are reference counted: the cache only keeps weak references, so an object is
+	destroyed once its last user lets go of it.
+
+	Set layouts are handed out before the pipeline layouts made from them, so equal
+	pipeline layouts are recognized by their set layout handles. Pipelines made with
+	a shared layout also match more pipeline cache entries.
+
+	Pipeline layouts are requested by the pipeline compiles on the worker threads,
+	so every lookup is locked.
+*/
+class VulkanObjectCache
+{
+public:
+	/** @brief Constructor
+		@param context The RenderSystem's Vulkan Context
+	*/
+	VulkanObjectCache(std::shared_ptr<VulkanContext> context);
+
+	/** @brief Get a sampler, creating it if there is none with the same description
+		@param samplerInfo The sampler's description (pNext must be null)
+	*/
+	SharedSampler getSampler(const VkSamplerCreateInfo& samplerInfo);
+
+	/** @brief Get a descriptor set layout, creating it if there is none with the same bindings
+		@param layoutBindings	The bindings, in binding order (without immutable samplers)
+		@param layoutFlags		The layout's creation flags
+	*/
+	SharedDescriptorSetLayout getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings, VkDescriptorSetLayoutCreateFlags layoutFlags = 0);
+
+	/** @brief Get a pipeline layout, creating it if there is none with the same set layouts and push constants
+
+		The layout keeps its set layouts alive, so their handles can't be reused
+		by another set layout while a key made from them is still in use.
+
+		@param setLayouts			The descriptor set layouts, by set number
+		@param pushConstantRanges	The push constant ranges
+	*/
+	SharedPipelineLayout getPipelineLayout(const std::vector<SharedDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+	/** @brief Wrap a descriptor set layout made outside the cache, so pipeline layouts can be requested with it
+		@param setLayout The set layout, destroyed with the last reference
+	*/
+	SharedDescriptorSetLayout adoptDescriptorSetLayout(VkDescriptorSetLayout setLayout);
+
+	/** @brief Get how many requests were answered with an existing object (logged when the RenderSystem shuts down) */
+	uint32_t getReuseCount() const { return mReuseCount; }
+
+private:
+	std::shared_ptr<VulkanContext> mContext;			///< The RenderSystem's Vulkan Context
+
+	std::mutex mMutex;																	///< Guards the maps, objects are requested from the worker threads
+	std::unordered_map<std::string, std::weak_ptr<const VkSampler>> mSamplers;				///< Every live sampler by key
+	std::unordered_map<std::string, std::weak_ptr<const VkDescriptorSetLayout>> mSetLayouts;	///< Every live set layout by key
+	std::unordered_map<std::string, std::weak_ptr<const VkPipelineLayout>> mPipelineLayouts;	///< Every live pipeline layout by key
+	uint32_t mReuseCount = 0;															///< Requests answered with an existing object
+
+	/** @brief Find a live object by key
+		@param objects	The objects of one type
+		@param key		The object's key
+		@return The object, or null if there is none (or it was destroyed)
+	*/
+	template<typename Handle>
+	std::shared_ptr<const Handle> find(std::unordered_map<std::string, std::weak_ptr<const Handle>>& objects, const std::string& key)
+	{
+		auto entry = objects.find(key);
+		if (entry == objects.end())
+			return nullptr;
+
+		std::shared_ptr<const Handle> object = entry->second.lock();
+		if (object) {
+			mReuseCount++;
+		}
+		return object;
+	}
+
+	/** @brief Add a new object, dropping the entries of destroyed objects first
+		@param objects	The objects of one type
+		@param key		The object's key
+		@param object	The new object
+	*/
+	template<typename Handle>
+	void add(std::unordered_map<std::string, std::weak_ptr<const Handle>>& objects, const std::string& key, const std::shared_ptr<const Handle>& object)
+	{
+		//only done when something is created, so lookups stay a single find
+		for (auto it = objects.begin(); it != objects.end();) {
+			if (it->second.expired())
+				it = objects.erase(it);
+			else
+				++it;
+		}
+		objects[key] = object;
+	}
+
+	/** @brief Wrap a new handle, destroying it with the last reference
+		@param handle		The handle
+		@param destroy		The function destroying it (i.e. vkDestroySampler)
+		@param keepAlive	Objects the handle was made from, released after it is destroyed
+	*/
+	template<typename Handle, typename Destroy, typename KeepAlive = std::nullptr_t>
+	std::shared_ptr<const Handle> share(Handle handle, Destroy destroy, KeepAlive keepAlive = nullptr)
+	{
+		std::shared_ptr<VulkanContext> context = mContext;
+		return std::shared_ptr<const Handle>(new Handle(handle), [context, destroy, keepAlive](const Handle* object) {
+			destroy(context->device, *object, nullptr);
+			delete object;
+		});
+	}
+
+	/** @brief Append the bytes of a value to a key
+		@param key		The key being built
+		@param value	The value to append
+	*/
+	template<typename T>
+	static void appendBytes(std::string& key, const T& value)
+	{
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+};
@@ -12,6 +12,7 @@ fShaders = glob.glob(sys.argv[1] + "\\*.frag")
 tcShaders = glob.glob(sys.argv[1] + "\\*.tesc")
 teShaders = glob.glob(sys.argv[1] + "\\*.tese")
 gShaders = glob.glob(sys.argv[1] + "\\*.geom")
+cShaders = glob.glob(sys.argv[1] + "\\*.comp")
 
 def process(shaderList, ext):
     print("processing " + ext + " shaders:")
@@ -26,3 +27,4 @@ process(fShaders, "frag")
 process(tcShaders, "tesc")
 process(teShaders, "tese")
 process(gShaders, "geom")
+process(cShaders, "comp")
@@ -0,0 +1,56 @@
+//Clustered light lists (see LightClustering.h), include after lighting.glsl.
+//The including shader picks the bindings by defining
+//CLUSTER_UBO_BINDING, LIGHT_BUFFER_BINDING and CLUSTER_LIGHT_BUFFER_BINDING, and their
+//set with RESOURCE_SET (0 if not defined)
+
+#ifndef RESOURCE_SET
+#define RESOURCE_SET 0
+#endif
+
+layout(set = RESOURCE_SET, binding = CLUSTER_UBO_BINDING) uniform ClusterUBO
+{
+	uvec4 gridSize;			//clusters along x, y, z
+	vec4 depthSlicing;		//near, far, slice scale, slice bias
+	vec4 tileSize;			//cluster size in pixels
+	uvec4 globalLights;		//offset and count of the lights reaching every cluster
+} clusters;
+
+//the first MAX_LIGHTS lights are the ones that can cast shadows
+layout(std430, set = RESOURCE_SET, binding = LIGHT_BUFFER_BINDING) readonly buffer LightBuffer
+{
+	uint lightCount;		//followed by 12 bytes of padding, Light is 16 byte aligned
+	Light lights[];
+} lightBuffer;
+
+//(offset, count) per cluster, followed by the light indices
+layout(std430, set = RESOURCE_SET, binding = CLUSTER_LIGHT_BUFFER_BINDING) readonly buffer ClusterLightBuffer
+{
+	uint clusterLights[];
+};
+
+//find the cluster holding a pixel, from its position and 0..1 depth
+uint findCluster(vec2 fragCoord, float depth)
+{
+	float nearPlane = clusters.depthSlicing.x;
+	float farPlane = clusters.depthSlicing.y;
+	float viewDepth = nearPlane * farPlane / (farPlane - depth * (farPlane - nearPlane));
+
+	uvec3 cell;
+	cell.xy = min(uvec2(fragCoord / clusters.tileSize.xy), clusters.gridSize.xy - 1);
+	cell.z = uint(clamp(log(viewDepth) * clusters.depthSlicing.z - clusters.depthSlicing.w, 0.0, float(clusters.gridSize.z - 1)));
+	return cell.x + clusters.gridSize.x * (cell.y + clusters.gridSize.y * cell.z);
+}
+
+//the lights reaching every cluster come first, then the cluster's own lights
+uint clusterLightCount(uint cluster)
+{
+	return clusters.globalLights.y + clusterLights[cluster * 2 + 1];
+}
+
+uint clusterLightIndex(uint cluster, uint i)
+{
+	uint globalCount = clusters.globalLights.y;
+	return (i < globalCount) ? 
+		clusterLights[clusters.globalLights.x + i] : 
+		clusterLights[clusterLights[cluster * 2] + i - globalCount];
+}
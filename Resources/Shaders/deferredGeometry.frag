@@ -0,0 +1,36 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "gBuffer.glsl"
+#include "materials.glsl"
+
+//same constant_ids as in lighting.glsl, the material's variant is applied here
+layout(constant_id = 6) const float SHININESS = 16.0;
+layout(constant_id = 7) const bool NORMAL_MAPPING = true;
+
+layout(location = 0) in vec3 inWorldPos;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in mat3 inWorldTBN;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormals;
+layout(location = 2) out vec4 outSpecular;
+
+void main() 
+{
+	Material material = getMaterial();
+
+	vec3 normal = normalize(inWorldTBN[2]);
+	if (NORMAL_MAPPING) {
+		normal = sampleMaterial(material.normalMap, inUV);
+		normal = normalize(normal * 2.0 - 1.0);
+		normal = normalize(inWorldTBN * normal);
+	}
+
+	outAlbedo = vec4(sampleMaterial(material.diffuseMap, inUV), 0.0);
+	outNormals = vec4(encodeOctahedral(normal), encodeOctahedral(normalize(inWorldTBN[2])));
+	outSpecular = vec4(sampleMaterial(material.specularMap, inUV), encodeShininess(SHININESS));
+}
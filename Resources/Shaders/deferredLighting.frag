@@ -0,0 +1,74 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#define SHADOW_UBO_BINDING 5
+#define SHADOW_MAP_BINDING 6
+#define POINT_SHADOW_MAP_BINDING 7
+#define CLUSTER_UBO_BINDING 8
+#define LIGHT_BUFFER_BINDING 9
+#define CLUSTER_LIGHT_BUFFER_BINDING 10
+
+//every material is lit here, so the geometry pass leaves its shininess in the G-buffer
+//(normal mapping was already applied there)
+float gShininess;
+#define MATERIAL_SHININESS gShininess
+
+#include "lighting.glsl"
+#include "shadowSampling.glsl"
+#include "clusteredLights.glsl"
+#include "gBuffer.glsl"
+
+//written by the geometry subpass, read back at the same pixel
+layout(input_attachment_index = 0, binding = 0) uniform subpassInput gAlbedo;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInput gNormals;
+layout(input_attachment_index = 2, binding = 2) uniform subpassInput gSpecular;
+layout(input_attachment_index = 3, binding = 3) uniform subpassInput gDepth;
+
+layout(binding = 4) uniform DeferredLightingUBO
+{
+	mat4 inverseViewProj;	//from 0..1 depth back to world space
+	mat4 view;
+	vec4 viewPos;
+	vec4 screenSize;		//framebuffer width and height (xy)
+} ubo;
+
+layout(location = 0) out vec4 outFragColor;
+
+//lights every pixel once, however many surfaces were drawn over it
+void main() 
+{
+	//nothing was drawn here, keep the clear color
+	float depth = subpassLoad(gDepth).r;
+	if(depth >= 1.0)
+		discard;
+
+	vec2 ndc = gl_FragCoord.xy / ubo.screenSize.xy * 2.0 - 1.0;
+	vec4 worldPos4 = ubo.inverseViewProj * vec4(ndc, depth, 1.0);
+	vec3 worldPos = worldPos4.xyz / worldPos4.w;
+	float viewDepth = -(ubo.view * vec4(worldPos, 1.0)).z;
+
+	vec4 albedo = subpassLoad(gAlbedo);
+	vec4 normals = subpassLoad(gNormals);
+	vec3 normal = decodeOctahedral(normals.xy);
+	vec3 surfaceNormal = decodeOctahedral(normals.zw);
+	vec4 specular = subpassLoad(gSpecular);
+	vec3 specularColor = specular.rgb;
+	gShininess = decodeShininess(specular.a);
+	bool receivesShadow = albedo.a > 0.5;
+
+	vec3 viewDir = normalize(ubo.viewPos.xyz - worldPos);
+	vec3 result = vec3(0.0);
+
+	uint cluster = findCluster(gl_FragCoord.xy, depth);
+	uint lightCount = min(clusterLightCount(cluster), MAX_FRAGMENT_LIGHTS);
+	for(uint i = 0; i < lightCount; i++)
+	{
+		uint lightIndex = clusterLightIndex(cluster, i);
+		Light light = lightBuffer.lights[lightIndex];
+
+		float shadow = (receivesShadow && isLightShadowed(lightIndex)) ? computeShadow(lightIndex, light.lightType, worldPos, viewDepth) : 1.0;
+		result += processLight(light, normal, surfaceNormal, worldPos, viewDir, albedo.rgb, specularColor, shadow);
+	}
+	outFragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,37 @@
+//G-buffer layout of the deferred path (see GBuffer.h):
+//	0: albedo (rgb), 1 if the surface receives shadows (a)			R8G8B8A8_UNORM
+//	1: normal mapped normal (xy) and surface normal (zw), octahedral	R16G16B16A16_SFLOAT
+//	2: specular color (rgb), the material's shininess (a)				R8G8B8A8_UNORM
+
+vec2 octahedralWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+//fold a unit vector onto an octahedron, then flatten it into the -1..1 square
+vec2 encodeOctahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return (n.z >= 0.0) ? n.xy : octahedralWrap(n.xy);
+}
+
+vec3 decodeOctahedral(vec2 f)
+{
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return normalize(n);
+}
+
+//the lighting pass is one shader for every material, so the specular exponent is stored
+//per pixel. Kept as log2 over 1..1024, so low exponents don't lose all their precision
+float encodeShininess(float shininess)
+{
+	return clamp(log2(shininess) / 10.0, 0.0, 1.0);
+}
+
+float decodeShininess(float encoded)
+{
+	return exp2(encoded * 10.0);
+}
@@ -1,38 +1,35 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : enable
 
-//Light type "enum"
-const uint eLightType_None = 0;
-const uint eLightType_Directional = 1;
-const uint eLightType_Point = 2;
-const uint eLightType_Spot = 3;
+#include "lighting.glsl"
 
-layout(binding = 1) uniform AttachedLight
+//the light storage buffer shared with the lit shaders (see clusteredLights.glsl)
+layout(std430, set = 1, binding = 1) readonly buffer LightBuffer
 {
-	vec4 position;
-	vec4 direction;
+	uint lightCount;
+	Light lights[];
+} lightBuffer;
 
-	vec4 ambient;
-	vec4 diffuse;
-	vec4 specular;
-
-	bool isEnabled;
-
-	float constant;
-	float linear;
-	float quadratic;
-	
-	float cutOff;
-    float outerCutOff;
-	uint  lightType;
-} light;
+//the light this indicator shows (x)
+layout(set = 1, binding = 2) uniform LightIndex
+{
+	uvec4 index;
+} indicator;
 
 layout(location = 0) out vec4 outFragColor;
 
 void main() 
 {
+	uint lightIndex = indicator.index.x;
+	if (lightIndex >= lightBuffer.lightCount) {
+		outFragColor = vec4(0.0);
+		return;
+	}
+
+	Light light = lightBuffer.lights[lightIndex];
 	float modif = (light.isEnabled) ? 1.0 : 0.1;
 
 	outFragColor = modif * light.diffuse;
-}
\ No newline at end of file
+}
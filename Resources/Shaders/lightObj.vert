@@ -3,7 +3,8 @@
 #extension GL_ARB_shading_language_420pack : enable
 
 
-layout(binding = 0) uniform MVP {
+//like every renderable the bindings are in set 1, the indicators just leave the material set unused
+layout(set = 1, binding = 0) uniform MVP {
     mat4 model;
     mat4 view;
     mat4 projection;
@@ -13,7 +14,7 @@ layout(binding = 0) uniform MVP {
 layout(location = 0) in vec4 inPos;
 
 out gl_PerVertex {
-    vec4 gl_Position;
+    invariant vec4 gl_Position;     //the depth pre-pass and the shading pass must agree exactly
 };
 
 void main() 
@@ -0,0 +1,155 @@
+//Light shading shared by the forward shaders and the deferred lighting pass
+//(include with GL_GOOGLE_include_directive)
+
+const uint MAX_LIGHTS = 8;
+
+//Light type "enum"
+const uint eLightType_None = 0;
+const uint eLightType_Directional = 1;
+const uint eLightType_Point = 2;
+const uint eLightType_Spot = 3;
+
+//Specialization constants, so a material only pays for the lights it is lit by
+//(constant_id 0-2 are the PCF taps in shadowSampling.glsl, see LightingVariant in Lighting.h)
+layout(constant_id = 3) const uint LIGHT_TYPE_MASK = 0xE;			//bit (1 << lightType) set for every light type that is shaded
+layout(constant_id = 4) const uint SHADOWED_LIGHT_COUNT = 8;		//the first lights whose shadows are sampled (0 compiles shadows out)
+layout(constant_id = 5) const uint MAX_FRAGMENT_LIGHTS = 65535;		//most lights shaded per fragment
+layout(constant_id = 6) const float SHININESS = 16.0;
+layout(constant_id = 7) const bool NORMAL_MAPPING = true;			//sample the normal map, rather than use the surface normal
+
+//the specular exponent the lights are shaded with. A shader lighting several materials
+//(i.e. deferredLighting.frag) defines it to a per pixel value before the include
+#ifndef MATERIAL_SHININESS
+#define MATERIAL_SHININESS SHININESS
+#endif
+
+//does a light sample its shadow, for the lights that have a shadow map slot
+bool isLightShadowed(uint lightIndex)
+{
+	return lightIndex < min(SHADOWED_LIGHT_COUNT, MAX_LIGHTS);
+}
+
+struct Light
+{
+	vec4  position;
+	vec4  direction;
+
+	vec4  ambient;
+	vec4  diffuse;
+	vec4  specular;
+
+	bool  isEnabled;
+
+	float constant;
+	float linear;
+	float quadratic;
+
+	float cutOff;
+    float outerCutOff;
+	uint  lightType;
+};
+
+//worldNormal is the normal mapped normal, surfaceNormal the raw one (so that we don't get reflections on unlit surfaces).
+//shadow scales the diffuse and specular terms, 1.0 when unshadowed
+vec3 processDirLight(Light dirLight, vec3 worldNormal, vec3 surfaceNormal, vec3 worldFragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shadow)
+{
+	vec3 lightDir = normalize(-dirLight.direction.xyz);
+
+	float diff = max(dot(lightDir, surfaceNormal), 0.0);
+	float spec = 0.0;
+	if(diff > 0.0)
+	{
+		vec3 reflectDir = reflect(-lightDir, worldNormal);
+		spec = pow(max(dot(viewDir, reflectDir), 0.0), MATERIAL_SHININESS);
+	}
+
+	vec3 ambient  =  dirLight.ambient.rgb * diffuseColor;
+	vec3 diffuse  =  dirLight.diffuse.rgb * diff * diffuseColor * shadow;
+	vec3 specular =  dirLight.specular.rgb * spec * specularColor * shadow;
+
+	return (ambient + diffuse + specular);
+}
+
+vec3 processPointLight(Light pointLight, vec3 worldNormal, vec3 surfaceNormal, vec3 worldFragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shadow)
+{
+		vec3 lightDir = normalize(pointLight.position.xyz - worldFragPos);
+
+		float diff = max(dot(lightDir, surfaceNormal), 0.0);
+
+		float spec = 0.0;
+		if(diff > 0.0)
+		{
+			vec3 reflectDir = reflect(-lightDir, worldNormal);
+			spec = pow(max(dot(viewDir, reflectDir), 0.0), MATERIAL_SHININESS);
+		}
+
+		float dist = length(pointLight.position.xyz - worldFragPos);
+		float attenuation = 1.0 / 
+			(pointLight.constant + 
+			 pointLight.linear * dist + 
+			 pointLight.quadratic * (dist * dist));    
+   
+		vec3 ambient  =  pointLight.ambient.rgb * diffuseColor;
+		vec3 diffuse  =  pointLight.diffuse.rgb * diff * diffuseColor;
+		vec3 specular =  pointLight.specular.rgb * spec * specularColor;
+
+		ambient *= attenuation;
+		diffuse *= attenuation * shadow;
+		specular *= attenuation * shadow;
+		return (ambient + diffuse + specular);
+}
+
+vec3 processSpotLight(Light spotLight, vec3 worldNormal, vec3 surfaceNormal, vec3 worldFragPos, vec3 viewDir,  vec3 diffuseColor, vec3 specularColor, float shadow)
+{
+		vec3 lightDir = normalize(spotLight.position.xyz - worldFragPos);
+
+		float diff = max(dot(lightDir, surfaceNormal), 0.0); 
+
+		float spec = 0.0;
+		if(diff > 0.0)
+		{
+			vec3 reflectDir = reflect(-lightDir, worldNormal);
+			spec = pow(max(dot(viewDir, reflectDir), 0.0), MATERIAL_SHININESS);
+		}
+
+		float dist = length(spotLight.position.xyz - worldFragPos);
+		float attenuation = 1.0 / 
+			(spotLight.constant + 
+			 spotLight.linear * dist + 
+			 spotLight.quadratic * (dist * dist));  
+
+		float theta = dot(lightDir, normalize(-spotLight.direction.xyz)); 
+    	float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    	float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);  
+   
+		vec3 ambient  =  spotLight.ambient.rgb * diffuseColor;
+		vec3 diffuse  =  spotLight.diffuse.rgb * diff * diffuseColor * shadow;
+		vec3 specular =  spotLight.specular.rgb * spec * specularColor * shadow;
+
+		//ambient *= attenuation;
+		diffuse *= attenuation * intensity;
+		specular *= attenuation * intensity;
+		return (ambient + diffuse + specular);
+}
+
+//shade with any type of light in LIGHT_TYPE_MASK (the others are compiled out and add nothing), magenta for an invalid type
+vec3 processLight(Light light, vec3 worldNormal, vec3 surfaceNormal, vec3 worldFragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shadow)
+{
+	switch(light.lightType)
+	{
+		case eLightType_Directional:
+			if ((LIGHT_TYPE_MASK & (1u << eLightType_Directional)) == 0u)
+				return vec3(0.0);
+			return processDirLight(light, worldNormal, surfaceNormal, worldFragPos, viewDir, diffuseColor, specularColor, shadow);
+		case eLightType_Point:
+			if ((LIGHT_TYPE_MASK & (1u << eLightType_Point)) == 0u)
+				return vec3(0.0);
+			return processPointLight(light, worldNormal, surfaceNormal, worldFragPos, viewDir, diffuseColor, specularColor, shadow);
+		case eLightType_Spot:
+			if ((LIGHT_TYPE_MASK & (1u << eLightType_Spot)) == 0u)
+				return vec3(0.0);
+			return processSpotLight(light, worldNormal, surfaceNormal, worldFragPos, viewDir, diffuseColor, specularColor, shadow);
+		default:
+			return vec3(1.0, 0.0, 1.0);
+	}
+}
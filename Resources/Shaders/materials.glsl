@@ -0,0 +1,35 @@
+//Bindless materials (see MaterialLibrary.h), in set 0 of every renderable pipeline.
+//The Renderable's own bindings are in set 1. The including shader enables
+//GL_EXT_nonuniform_qualifier, which the unsized texture array needs
+
+struct Material
+{
+	uint diffuseMap;		//indices into materialTextures
+	uint normalMap;
+	uint specularMap;
+	uint padding;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer MaterialBuffer
+{
+	Material materials[];
+} materialBuffer;
+
+layout(set = 0, binding = 1) uniform sampler2D materialTextures[];
+
+//pushed before each draw
+layout(push_constant) uniform DrawConstants
+{
+	uint materialIndex;
+} draw;
+
+//the same material is used by the whole draw, so the indices are dynamically uniform
+Material getMaterial()
+{
+	return materialBuffer.materials[draw.materialIndex];
+}
+
+vec3 sampleMaterial(uint textureIndex, vec2 uv)
+{
+	return texture(materialTextures[textureIndex], uv).rgb;
+}
@@ -2,7 +2,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout(binding = 0) uniform Matrices 
+layout(set = 1, binding = 0) uniform Matrices 
 {
     mat4 model;
     mat4 view;
@@ -22,7 +22,7 @@ layout(location = 2) out vec2 outUV;
 layout(location = 3) out mat3 outWorldTBN;
 
 out gl_PerVertex {
-    vec4 gl_Position;
+    invariant vec4 gl_Position;     //the depth pre-pass and the shading pass must agree exactly
 };
 
 void main() 
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform PushConstants
+{
+    mat4 model;         //the model matrix of the object being drawn
+    uint cube;          //the point light's cube (read by the geometry shader)
+    uint faceMask;      //the cube faces the object touches (read by the geometry shader)
+} object;
+
+layout(location = 0) in vec4 inPosition;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+void main()
+{
+    //stays in world space, the geometry shader projects it once per face
+    gl_Position = object.model * inPosition;
+}
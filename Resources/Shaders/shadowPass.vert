@@ -1,10 +1,31 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UBO
+const uint MAX_LIGHTS = 8;
+const uint MAX_SHADOW_CASCADES = 4;
+const uint MAX_SHADOW_VIEWS = MAX_SHADOW_CASCADES + MAX_LIGHTS;
+const uint MAX_POINT_SHADOWS = 4;
+
+struct ShadowView
+{
+    mat4 viewProj;      //the light's view-projection matrix
+    vec4 atlasRect;     //where the view lives in the shadow map (read by receivers)
+};
+
+layout(set = 0, binding = 0) uniform ShadowUBO
+{
+    ShadowView views[MAX_SHADOW_VIEWS];     //every cascade and atlas tile rendered this frame
+    uvec4 lightViews[MAX_LIGHTS];
+    vec4 splitDepths;
+    mat4 pointFaceViewProj[MAX_POINT_SHADOWS * 6];     //point light faces (drawn by pointShadowPass)
+    vec4 pointShadows[MAX_POINT_SHADOWS];
+} shadow;
+
+layout(push_constant) uniform PushConstants
 {
-    mat4 MVPMatrix;     //the MVP matrix for the light source
-} ubo;
+    mat4 model;         //the model matrix of the object being drawn
+    uint view;          //the shadow view being rendered (the viewport selects its layer or atlas tile)
+} object;
 
 layout(location = 0) in vec4 inPosition;
 
@@ -15,5 +36,5 @@ out gl_PerVertex
 
 void main()
 {
-    gl_Position = ubo.MVPMatrix * inPosition;
-}
\ No newline at end of file
+    gl_Position = shadow.views[object.view].viewProj * object.model * inPosition;
+}
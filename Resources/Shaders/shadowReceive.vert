@@ -2,7 +2,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout(binding = 0) uniform Matrices 
+layout(set = 1, binding = 0) uniform Matrices 
 {
     mat4 model;
     mat4 view;
@@ -10,11 +10,6 @@ layout(binding = 0) uniform Matrices
     mat4 normalMat;
 } mvp;
 
-layout(binding = 1) uniform UBO
-{
-    mat4 VP;
-} shadowUBO;
-
 layout(location = 0) in vec4 inPos;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec3 inNormal;
@@ -25,17 +20,17 @@ layout(location = 0) out vec3 outWorldPos;
 layout(location = 1) out vec4 outColor;
 layout(location = 2) out vec2 outUV;
 layout(location = 3) out mat3 outWorldTBN;
-layout(location = 12) out vec4 outShadowCoord;
+layout(location = 12) out float outViewDepth;
 
 out gl_PerVertex {
-    vec4 gl_Position;
+    invariant vec4 gl_Position;     //the depth pre-pass and the shading pass must agree exactly
 };
 
 void main() 
 {
     vec4 worldPos4 = mvp.model * inPos;
     outWorldPos = worldPos4.xyz;
-    outShadowCoord = shadowUBO.VP * worldPos4;
+    outViewDepth = -(mvp.view * worldPos4).z;
 
     vec3 T = mat3(transpose(inverse(mvp.model))) * inTangent;
     vec3 N = mat3(transpose(inverse(mvp.model))) * inNormal;
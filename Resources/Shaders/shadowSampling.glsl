@@ -0,0 +1,165 @@
+//Shadow map sampling shared by the forward shadow receivers and the deferred lighting pass.
+//Include after lighting.glsl. The including shader picks the bindings by defining
+//SHADOW_UBO_BINDING, SHADOW_MAP_BINDING and POINT_SHADOW_MAP_BINDING, and their set
+//with RESOURCE_SET (0 if not defined)
+
+#ifndef RESOURCE_SET
+#define RESOURCE_SET 0
+#endif
+
+const uint MAX_SHADOW_CASCADES = 4;
+const uint MAX_SHADOW_VIEWS = MAX_SHADOW_CASCADES + MAX_LIGHTS;
+const uint MAX_POINT_SHADOWS = 4;
+const float POINT_SHADOW_NEAR = 0.1;
+const uint MAX_PCF_TAPS = 16;
+
+//Poisson taps per light type (0 for a single hardware bilinear compare), set when the pipeline is created
+layout(constant_id = 0) const uint DIRECTIONAL_PCF_TAPS = 16;
+layout(constant_id = 1) const uint SPOT_PCF_TAPS = 8;
+layout(constant_id = 2) const uint POINT_PCF_TAPS = 8;
+
+struct ShadowView
+{
+    mat4 viewProj;      //the light's view-projection matrix
+    vec4 atlasRect;     //UV offset (xy), UV scale (z) and layer (w) of the view in the shadow map
+};
+
+layout(set = RESOURCE_SET, binding = SHADOW_UBO_BINDING) uniform ShadowUBO
+{
+    ShadowView views[MAX_SHADOW_VIEWS];
+    uvec4 lightViews[MAX_LIGHTS];           //per light: first view (x), view count (y, 0 if unshadowed) and cube + 1 (z, 0 if none)
+    vec4 splitDepths;                       //the far view depth of each cascade
+    mat4 pointFaceViewProj[MAX_POINT_SHADOWS * 6];
+    vec4 pointShadows[MAX_POINT_SHADOWS];   //per cube: the light's position (xyz) and far plane (w)
+    vec4 lightFilters[MAX_LIGHTS];          //per light: PCF kernel radius in texels (x)
+} shadowUBO;
+
+layout(set = RESOURCE_SET, binding = SHADOW_MAP_BINDING) uniform sampler2DArrayShadow shadowMap;
+layout(set = RESOURCE_SET, binding = POINT_SHADOW_MAP_BINDING) uniform samplerCubeArrayShadow pointShadowMap;
+
+//a rotated Poisson disk, one rotation per pixel so the banding of a fixed kernel turns into noise
+const vec2 poissonDisk[MAX_PCF_TAPS] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2( 0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2( 0.34495938,  0.29387760),
+    vec2(-0.91588581,  0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543,  0.27676845), vec2( 0.97484398,  0.75648379),
+    vec2( 0.44323325, -0.97511554), vec2( 0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2( 0.79197514,  0.19090188),
+    vec2(-0.24188840,  0.99706507), vec2(-0.81409955,  0.91437590),
+    vec2( 0.19984126,  0.78641367), vec2( 0.14383161, -0.14100790)
+);
+
+mat2 kernelRotation()
+{
+    //interleaved gradient noise
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    float s = sin(angle);
+    float c = cos(angle);
+    return mat2(c, s, -s, c);
+}
+
+//each texture() call is a hardware compare of a 2x2 footprint, already returning a filtered 0..1
+float filterAtlasShadow(vec2 uv, vec4 atlasRect, float depth, float radius, uint tapCount)
+{
+    //keep filtering from reading across the tile's edge
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    vec2 minUV = atlasRect.xy + 0.5 * texelSize;
+    vec2 maxUV = atlasRect.xy + atlasRect.z - 0.5 * texelSize;
+
+    tapCount = min(tapCount, MAX_PCF_TAPS);
+    if(tapCount == 0 || radius <= 0.0)
+        return texture(shadowMap, vec4(clamp(uv, minUV, maxUV), atlasRect.w, depth));
+
+    mat2 rotation = kernelRotation();
+    float lit = 0.0;
+    for(uint i = 0; i < tapCount; i++)
+    {
+        vec2 offset = rotation * poissonDisk[i] * radius * texelSize;
+        lit += texture(shadowMap, vec4(clamp(uv + offset, minUV, maxUV), atlasRect.w, depth));
+    }
+    return lit / float(tapCount);
+}
+
+float computePointShadow(uint cube, vec3 worldPos, float radius)
+{
+    vec3 lightToFrag = worldPos - shadowUBO.pointShadows[cube].xyz;
+    float far = shadowUBO.pointShadows[cube].w;
+
+    //the face the direction picks is the one with the largest axis, so that axis is the view depth
+    float faceDepth = max(abs(lightToFrag.x), max(abs(lightToFrag.y), abs(lightToFrag.z)));
+    if(faceDepth > far)
+        return 1.0;
+
+    //same 0..1 depth the perspective projection of the faces wrote
+    float depth = far / (far - POINT_SHADOW_NEAR) * (1.0 - POINT_SHADOW_NEAR / faceDepth);
+
+    uint tapCount = min(POINT_PCF_TAPS, MAX_PCF_TAPS);
+    if(tapCount == 0 || radius <= 0.0)
+        return texture(pointShadowMap, vec4(lightToFrag, float(cube)), depth);
+
+    //the kernel is laid out across the direction, scaled to the size of a texel at this distance
+    vec3 direction = normalize(lightToFrag);
+    vec3 tangent = normalize(cross(direction, abs(direction.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 bitangent = cross(direction, tangent);
+    float texelSize = 2.0 * faceDepth / float(textureSize(pointShadowMap, 0).x);
+
+    mat2 rotation = kernelRotation();
+    float lit = 0.0;
+    for(uint i = 0; i < tapCount; i++)
+    {
+        vec2 offset = rotation * poissonDisk[i] * radius * texelSize;
+        vec3 tapDirection = lightToFrag + tangent * offset.x + bitangent * offset.y;
+        lit += texture(pointShadowMap, vec4(tapDirection, float(cube)), depth);
+    }
+    return lit / float(tapCount);
+}
+
+float computeShadow(uint lightIndex, uint lightType, vec3 worldPos, float viewDepth)
+{
+    float radius = shadowUBO.lightFilters[lightIndex].x;
+
+    //point lights are shadowed by a cube instead of views
+    uint cube = shadowUBO.lightViews[lightIndex].z;
+    if(cube > 0)
+        return computePointShadow(cube - 1, worldPos, radius);
+
+    uint firstView = shadowUBO.lightViews[lightIndex].x;
+    uint viewCount = shadowUBO.lightViews[lightIndex].y;
+
+    //the light doesn't cast shadows this frame
+    if(viewCount == 0)
+        return 1.0;
+
+    //cascaded lights: pick the first cascade that reaches this far from the camera
+    uint view = firstView;
+    if(viewCount > 1)
+    {
+        for(uint i = 0; i < viewCount - 1; i++)
+        {
+            if(viewDepth > shadowUBO.splitDepths[i])
+                view = firstView + i + 1;
+        }
+
+        //beyond the last cascade
+        if(viewDepth > shadowUBO.splitDepths[viewCount - 1])
+            return 1.0;
+    }
+
+    vec4 shadowCoord = shadowUBO.views[view].viewProj * vec4(worldPos, 1.0);
+    if(shadowCoord.w <= 0.0)
+        return 1.0;     //behind the light
+    vec3 lightSpaceNDC = shadowCoord.xyz / shadowCoord.w;
+
+    //outside of the projection, the neighbouring atlas tiles belong to other lights
+    if(abs(lightSpaceNDC.x) > 1.0 ||
+       abs(lightSpaceNDC.y) > 1.0 ||
+       lightSpaceNDC.z > 1.0)
+       return 1.0;
+
+    //move into the view's tile
+    vec4 atlasRect = shadowUBO.views[view].atlasRect;
+    vec2 shadowMapUV = atlasRect.xy + (lightSpaceNDC.xy * 0.5 + 0.5) * atlasRect.z;
+
+    uint tapCount = (lightType == eLightType_Directional) ? DIRECTIONAL_PCF_TAPS : SPOT_PCF_TAPS;
+    return filterAtlasShadow(shadowMapUV, atlasRect, lightSpaceNDC.z, radius, tapCount);
+}